@@ -0,0 +1,948 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+// micro-benchmarks for the hot paths of the collab core: serialization of the broadcast
+// structures, database reads, chunk reads, ip selection and file transfer over loopback
+// results are written in the layout of google benchmark's json output, so that runs can be
+// compared with its tools (e.g. compare.py) to catch regressions between releases
+
+#include "../collab/collab.h"
+#include "../collab/impl.h"
+#include "../version_info.h"
+
+// leccore
+#include <liblec/leccore/hash.h>
+#include <liblec/leccore/database.h>
+
+// STL
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <functional>
+#include <future>
+#include <ctime>
+#include <cstdlib>
+
+#include <Windows.h>
+
+namespace {
+	struct options {
+		std::string filter;		// only run benchmarks whose name contains this
+		std::vector<long long> rows = { 1000, 10000, 100000 };
+		double min_time = 0.5;	// in seconds, how long to run each benchmark for at least
+		long long transfer_size = 64LL * 1024 * 1024;
+		int transfer_iterations = 3;
+
+		// away from the ports of the app and of the harness
+		unsigned short broadcast_port = 41030;
+		unsigned short transfer_port = 46554;
+
+		std::string folder = "benchmark";
+		std::string cert_folder = ".";
+		std::string json_file;
+	};
+
+	// the work done in one iteration
+	struct work {
+		long long bytes = 0;
+		long long items = 0;
+	};
+
+	struct result {
+		std::string name;
+		long long iterations = 0;
+		double real_time = 0;	// per iteration, in time_unit
+		double cpu_time = 0;	// per iteration, in time_unit
+		std::string time_unit;
+		double bytes_per_second = 0;
+		double items_per_second = 0;
+		std::string error;
+	};
+
+	long long filetime_to_ns(const FILETIME& ft) {
+		ULARGE_INTEGER value;
+		value.LowPart = ft.dwLowDateTime;
+		value.HighPart = ft.dwHighDateTime;
+		return static_cast<long long>(value.QuadPart) * 100;	// 100-nanosecond units
+	}
+
+	// the cpu time used by this thread so far, in nanoseconds
+	long long thread_cpu_time() {
+		FILETIME creation_time, exit_time, kernel_time, user_time;
+		if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+			return 0;
+
+		return filetime_to_ns(kernel_time) + filetime_to_ns(user_time);
+	}
+
+	// the cpu time used by this process so far, in nanoseconds
+	long long process_cpu_time() {
+		FILETIME creation_time, exit_time, kernel_time, user_time;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+			return 0;
+
+		return filetime_to_ns(kernel_time) + filetime_to_ns(user_time);
+	}
+
+	long long now_ns() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	class runner {
+	public:
+		runner(const options& opt) :
+			_opt(opt) {}
+
+		bool selected(const std::string& name) {
+			return _opt.filter.empty() || name.find(_opt.filter) != std::string::npos;
+		}
+
+		// run the iteration repeatedly, with the number of iterations growing until the run
+		// takes at least the minimum time; the cpu time is that of the calling thread
+		void run(const std::string& name, std::function<bool(work&, std::string&)> iteration) {
+			if (!selected(name))
+				return;
+
+			result res;
+			res.name = name;
+			res.time_unit = "ns";
+
+			long long iterations = 1;
+
+			while (true) {
+				work total;
+				std::string error;
+
+				const auto cpu_start = thread_cpu_time();
+				const auto start = now_ns();
+
+				for (long long i = 0; i < iterations; i++) {
+					if (!iteration(total, error)) {
+						res.error = error;
+						break;
+					}
+				}
+
+				const auto elapsed = now_ns() - start;
+				const auto cpu_elapsed = thread_cpu_time() - cpu_start;
+
+				if (!res.error.empty())
+					break;
+
+				const double seconds = elapsed / 1e9;
+
+				if (seconds >= _opt.min_time || iterations >= 1000000000) {
+					set(res, iterations, static_cast<double>(elapsed), static_cast<double>(cpu_elapsed), total);
+					break;
+				}
+
+				// aim a little past the minimum time, growing by at most ten times
+				const double multiplier = seconds > 0 ? _opt.min_time * 1.4 / seconds : 10.0;
+				iterations = static_cast<long long>(iterations * (std::min)((std::max)(multiplier, 2.0), 10.0));
+			}
+
+			report(res);
+		}
+
+		// run the iteration a fixed number of times, for benchmarks that are too expensive to
+		// calibrate; the iteration measures its own time, and the cpu time is that of the process
+		// since the work is done by the collab threads
+		void run_fixed(const std::string& name, int iterations,
+			std::function<bool(work&, long long& elapsed_ns, std::string&)> iteration) {
+			if (!selected(name))
+				return;
+
+			result res;
+			res.name = name;
+			res.time_unit = "ms";
+
+			work total;
+			long long elapsed = 0, cpu_elapsed = 0;
+
+			for (int i = 0; i < iterations; i++) {
+				std::string error;
+				long long iteration_elapsed = 0;
+
+				const auto cpu_start = process_cpu_time();
+				const bool success = iteration(total, iteration_elapsed, error);
+				cpu_elapsed += process_cpu_time() - cpu_start;
+
+				if (!success) {
+					res.error = error;
+					break;
+				}
+
+				elapsed += iteration_elapsed;
+			}
+
+			if (res.error.empty())
+				set(res, iterations, elapsed / 1e6, cpu_elapsed / 1e6, total);
+
+			report(res);
+		}
+
+		const std::vector<result>& results() {
+			return _results;
+		}
+
+	private:
+		const options& _opt;
+		std::vector<result> _results;
+
+		// times are totals, in the result's time unit
+		void set(result& res, long long iterations, double real_time, double cpu_time, const work& total) {
+			const double seconds = res.time_unit == "ms" ? real_time / 1e3 : real_time / 1e9;
+
+			res.iterations = iterations;
+			res.real_time = real_time / iterations;
+			res.cpu_time = cpu_time / iterations;
+			res.bytes_per_second = seconds > 0 ? total.bytes / seconds : 0;
+			res.items_per_second = seconds > 0 ? total.items / seconds : 0;
+		}
+
+		void report(const result& res) {
+			std::cout << std::left << std::setw(56) << res.name;
+
+			if (!res.error.empty())
+				std::cout << "ERROR: " << res.error << "\n";
+			else {
+				std::cout << std::right << std::fixed << std::setprecision(0) <<
+					std::setw(14) << res.real_time << " " << res.time_unit <<
+					std::setw(14) << res.cpu_time << " " << res.time_unit <<
+					std::setw(12) << res.iterations;
+
+				if (res.bytes_per_second > 0)
+					std::cout << std::setprecision(1) << "  " << res.bytes_per_second / (1024 * 1024) << " MiB/s";
+
+				if (res.items_per_second > 0)
+					std::cout << std::setprecision(0) << "  " << res.items_per_second << " items/s";
+
+				std::cout << "\n";
+			}
+
+			_results.push_back(res);
+		}
+	};
+
+	std::string json_string(const std::string& value) {
+		std::string escaped;
+
+		for (const auto& c : value) {
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+
+			escaped += c;
+		}
+
+		return "\"" + escaped + "\"";
+	}
+
+	bool write_json(const std::string& path, const std::vector<result>& results) {
+		std::ofstream json(path, std::ios::out | std::ios::trunc);
+
+		char date[32] = {};
+		const std::time_t now = std::time(nullptr);
+		std::tm tm = {};
+		if (localtime_s(&tm, &now) == 0)
+			std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+
+		const char* host = std::getenv("COMPUTERNAME");
+
+		json << "{\n" <<
+			"  \"context\": {\n" <<
+			"    \"date\": " << json_string(date) << ",\n" <<
+			"    \"host_name\": " << json_string(host ? host : "") << ",\n" <<
+			"    \"executable\": \"benchmark\",\n" <<
+			"    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n" <<
+			"    \"collab_version\": " << json_string(appversion) << ",\n" <<
+#ifdef _DEBUG
+			"    \"library_build_type\": \"debug\"\n" <<
+#else
+			"    \"library_build_type\": \"release\"\n" <<
+#endif
+			"  },\n" <<
+			"  \"benchmarks\": [";
+
+		bool first = true;
+
+		for (const auto& res : results) {
+			json << (first ? "\n" : ",\n") <<
+				"    {\n" <<
+				"      \"name\": " << json_string(res.name) << ",\n" <<
+				"      \"run_name\": " << json_string(res.name) << ",\n" <<
+				"      \"run_type\": \"iteration\",\n" <<
+				"      \"repetitions\": 1,\n" <<
+				"      \"repetition_index\": 0,\n" <<
+				"      \"threads\": 1,\n" <<
+				"      \"iterations\": " << res.iterations << ",\n";
+
+			if (!res.error.empty())
+				json <<
+				"      \"error_occurred\": true,\n" <<
+				"      \"error_message\": " << json_string(res.error) << ",\n";
+
+			json << std::setprecision(17) <<
+				"      \"real_time\": " << res.real_time << ",\n" <<
+				"      \"cpu_time\": " << res.cpu_time << ",\n" <<
+				"      \"time_unit\": " << json_string(res.time_unit);
+
+			if (res.bytes_per_second > 0)
+				json << ",\n      \"bytes_per_second\": " << res.bytes_per_second;
+
+			if (res.items_per_second > 0)
+				json << ",\n      \"items_per_second\": " << res.items_per_second;
+
+			json << "\n    }";
+			first = false;
+		}
+
+		json << "\n  ]\n}\n";
+		return static_cast<bool>(json);
+	}
+
+	// realistic items, with the field sizes the app produces
+	const std::string sample_session_id = liblec::leccore::hash_string::sha256("benchmark#session");
+	const std::string sample_sender_id = liblec::leccore::hash_string::sha256("benchmark#sender");
+
+	std::string sample_hash(long long i) {
+		return liblec::leccore::hash_string::sha256("benchmark#" + std::to_string(i));
+	}
+
+	collab::message sample_message(long long i) {
+		collab::message message;
+		message.unique_id = sample_hash(i).substr(0, 32);
+		message.time = 1700000000 + i;
+		message.session_id = sample_session_id;
+		message.sender_unique_id = sample_sender_id;
+		message.text = "This is message number " + std::to_string(i) + ", about as long as a typical chat message is.";
+		message.hlc = static_cast<unsigned long long>(message.time) * 1000 << 16;
+		return message;
+	}
+
+	collab::file sample_file(long long i) {
+		collab::file file;
+		file.hash = sample_hash(i);
+		file.time = 1700000000 + i;
+		file.session_id = sample_session_id;
+		file.sender_unique_id = sample_sender_id;
+		file.name = "Document " + std::to_string(i);
+		file.extension = ".pdf";
+		file.description = "A document shared in the session";
+		file.size = 1024 * 1024;
+		return file;
+	}
+
+	review_header_structure sample_review_header(long long i) {
+		review_header_structure review;
+		review.unique_id = sample_hash(-i).substr(0, 32);
+		review.time = 1700000000 + i;
+		review.session_id = sample_session_id;
+		review.file_hash = sample_hash(i);
+		review.sender_unique_id = sample_sender_id;
+		return review;
+	}
+
+	template <typename T>
+	void benchmark_serialization(runner& r, const std::string& structure, size_t items, const T& cls,
+		bool (*serialize)(const T&, std::string&, std::string&),
+		bool (*deserialize)(const std::string&, T&, std::string&)) {
+		const std::string suffix = "/" + std::to_string(items);
+
+		r.run("serialize_" + structure + suffix, [&](work& w, std::string& error) {
+			std::string serialized;
+			if (!serialize(cls, serialized, error))
+				return false;
+
+			w.bytes += serialized.length();
+			w.items += items;
+			return true;
+			});
+
+		std::string serialized, error;
+		if (!serialize(cls, serialized, error))
+			return;
+
+		r.run("deserialize_" + structure + suffix, [&](work& w, std::string& error) {
+			T deserialized;
+			if (!deserialize(serialized, deserialized, error))
+				return false;
+
+			w.bytes += serialized.length();
+			w.items += items;
+			return true;
+			});
+	}
+
+	void benchmark_serialization(runner& r) {
+		for (size_t count : { 10, 100 }) {
+			session_broadcast_structure cls;
+			cls.source_node_unique_id = sample_sender_id;
+
+			for (size_t i = 0; i < count; i++) {
+				collab::session session;
+				session.unique_id = sample_hash(i);
+				session.name = "Session " + std::to_string(i);
+				session.description = "A collaboration session";
+				session.passphrase_hash = sample_hash(i + 1);
+				cls.session_list.push_back(session);
+			}
+
+			benchmark_serialization(r, "session_broadcast_structure", count, cls,
+				serialize_session_broadcast_structure, deserialize_session_broadcast_structure);
+		}
+
+		// message broadcasts are capped at message_broadcast_limit, the larger size is for headroom
+		for (size_t count : { static_cast<size_t>(message_broadcast_limit), static_cast<size_t>(100) }) {
+			message_broadcast_structure cls;
+			cls.source_node_unique_id = sample_sender_id;
+
+			for (size_t i = 0; i < count; i++)
+				cls.message_list.push_back(sample_message(i));
+
+			benchmark_serialization(r, "message_broadcast_structure", count, cls,
+				serialize_message_broadcast_structure, deserialize_message_broadcast_structure);
+		}
+
+		for (size_t count : { 10, 100, 1000 }) {
+			file_broadcast_structure cls;
+			cls.source_node_unique_id = sample_sender_id;
+			cls.ips = { "192.168.1.10", "10.0.0.5" };
+
+			for (size_t i = 0; i < count; i++)
+				cls.file_list.push_back(sample_file(i));
+
+			benchmark_serialization(r, "file_broadcast_structure", count, cls,
+				serialize_file_broadcast_structure, deserialize_file_broadcast_structure);
+		}
+
+		for (size_t count : { 10, 100, 1000 }) {
+			review_broadcast_structure cls;
+			cls.source_node_unique_id = sample_sender_id;
+			cls.ips = { "192.168.1.10", "10.0.0.5" };
+
+			for (size_t i = 0; i < count; i++)
+				cls.review_list.push_back(sample_review_header(i));
+
+			benchmark_serialization(r, "review_broadcast_structure", count, cls,
+				serialize_review_broadcast_structure, deserialize_review_broadcast_structure);
+		}
+
+		// a summary is the same size whatever the number of items it covers
+		{
+			std::vector<std::string> keys;
+			for (long long i = 0; i < 1000; i++)
+				keys.push_back(sample_hash(i));
+
+			auto cls = make_merkle_summary(merkle_tree(keys));
+			cls.source_node_unique_id = sample_sender_id;
+			cls.ips = { "192.168.1.10", "10.0.0.5" };
+			cls.session_id = sample_session_id;
+
+			benchmark_serialization(r, "merkle_summary_structure", keys.size(), cls,
+				serialize_merkle_summary_structure, deserialize_merkle_summary_structure);
+		}
+	}
+
+	// fill the database with rows messages, files and reviews in one session
+	// rows are generated by sqlite itself so that even a million rows load in seconds
+	bool load_rows(liblec::leccore::database::connection& con, long long rows, std::string& error) {
+		if (!intern_identifier(con, sample_session_id, error) ||
+			!intern_identifier(con, sample_sender_id, error))
+			return false;
+
+		const std::string series = "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < ?) ";
+		const std::string keys = "(SELECT ID FROM Identifiers WHERE Value = ?), (SELECT ID FROM Identifiers WHERE Value = ?)";
+		const double base_time = 1700000000.0;
+
+		if (!con.execute("BEGIN TRANSACTION;", {}, error))
+			return false;
+
+		const bool success =
+			con.execute(series +
+				"INSERT INTO SessionMessages (UniqueID, Time, SessionKey, SenderKey, Message, HLC) "
+				"SELECT printf('%032x', i), CAST(? AS INTEGER) + i, " + keys + ", "
+				"'This is message number ' || i || ', about as long as a typical chat message is.', "
+				"printf('%016x', (CAST(? AS INTEGER) + i) * 1000 * 65536) FROM n;",
+				{ static_cast<double>(rows), base_time, sample_session_id, sample_sender_id, base_time }, error) &&
+			con.execute(series +
+				"INSERT INTO SessionFiles (Hash, Time, SessionKey, SenderKey, Name, Extension, Description, Size) "
+				"SELECT printf('%064x', i), CAST(? AS INTEGER) + i, " + keys + ", "
+				"'Document ' || i, '.pdf', 'A document shared in the session', 1048576 FROM n;",
+				{ static_cast<double>(rows), base_time, sample_session_id, sample_sender_id }, error) &&
+			con.execute(series +
+				"INSERT INTO FileReviews (UniqueID, Time, SessionKey, FileHash, SenderKey, Text) "
+				"SELECT printf('r%031x', i), CAST(? AS INTEGER) + i, (SELECT ID FROM Identifiers WHERE Value = ?), "
+				"printf('%064x', i), (SELECT ID FROM Identifiers WHERE Value = ?), 'Looks good, see the comments on page ' || i FROM n;",
+				{ static_cast<double>(rows), base_time, sample_session_id, sample_sender_id }, error);
+
+		if (!success) {
+			std::string rollback_error;
+			if (!con.execute("ROLLBACK;", {}, rollback_error)) {}
+
+			return false;
+		}
+
+		return con.execute("COMMIT;", {}, error);
+	}
+
+	void benchmark_database(runner& r, const options& opt) {
+		for (const auto& rows : opt.rows) {
+			const std::string suffix = "/" + std::to_string(rows);
+
+			if (!r.selected("get_messages" + suffix) && !r.selected("get_latest_messages" + suffix) &&
+				!r.selected("get_files" + suffix) && !r.selected("get_reviews" + suffix))
+				continue;
+
+			const std::string unique_id = liblec::leccore::hash_string::sha256("benchmark#database#" + std::to_string(rows));
+			const std::string folder = opt.folder + "\\database-" + std::to_string(rows);
+			const std::string database_file = folder + "\\collab.db";
+			std::string error;
+
+			try {
+				std::filesystem::create_directories(folder + "\\files");
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Preparing '" << folder << "' failed: " << e.what() << "\n";
+				continue;
+			}
+
+			collab instance;
+			instance.set_unique_id(unique_id);
+			instance.set_ports(opt.broadcast_port, opt.transfer_port);
+
+			// initializing brings the schema up to date
+			if (!instance.initialize(database_file, opt.cert_folder, folder + "\\files", [](const std::string&) {}, error)) {
+				std::cerr << "Initializing database failed: " << error << "\n";
+				continue;
+			}
+
+			{
+				// same key as the one collab uses
+				liblec::leccore::database::connection con("sqlcipher", database_file,
+					liblec::leccore::hash_string::sha256("{key#" + unique_id + "}"));
+
+				if (!con.connect(error) || !load_rows(con, rows, error)) {
+					std::cerr << "Loading " << rows << " rows failed: " << error << "\n";
+					continue;
+				}
+			}
+
+			r.run("get_messages" + suffix, [&](work& w, std::string& error) {
+				std::vector<collab::message> messages;
+				if (!instance.get_messages(sample_session_id, messages, error))
+					return false;
+
+				w.items += messages.size();
+				return true;
+				});
+
+			// what the chat pane asks for
+			r.run("get_latest_messages" + suffix, [&](work& w, std::string& error) {
+				std::vector<collab::message> messages;
+				if (!instance.get_latest_messages(sample_session_id, messages, message_broadcast_limit, error))
+					return false;
+
+				w.items += messages.size();
+				return true;
+				});
+
+			r.run("get_files" + suffix, [&](work& w, std::string& error) {
+				std::vector<collab::file> files;
+				if (!instance.get_files(sample_session_id, files, error))
+					return false;
+
+				w.items += files.size();
+				return true;
+				});
+
+			r.run("get_reviews" + suffix, [&](work& w, std::string& error) {
+				std::vector<collab::review> reviews;
+				if (!instance.get_reviews(sample_session_id, reviews, error))
+					return false;
+
+				w.items += reviews.size();
+				return true;
+				});
+		}
+	}
+
+	bool make_random_file(const std::string& path, long long size, std::mt19937_64& rng, std::string& error) {
+		std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+		if (!file) {
+			error = "Creating '" + path + "' failed";
+			return false;
+		}
+
+		std::vector<unsigned long long> block(8192);
+
+		while (size > 0) {
+			for (auto& value : block)
+				value = rng();
+
+			const auto length = (std::min)(size, static_cast<long long>(block.size() * sizeof(block[0])));
+			file.write(reinterpret_cast<const char*>(block.data()), length);
+			size -= length;
+		}
+
+		if (!file) {
+			error = "Writing '" + path + "' failed";
+			return false;
+		}
+
+		return true;
+	}
+
+	void benchmark_read_chunk(runner& r, const options& opt) {
+		const std::string name = "read_chunk/" + std::to_string(file_chunk_size);
+
+		if (!r.selected(name))
+			return;
+
+		// the file is read from the file system cache, as it mostly is when a source serves a
+		// file that several sinks are downloading
+		const long long size = 64LL * file_chunk_size;
+		const int total_chunks = static_cast<int>(size / file_chunk_size);
+		const std::string path = opt.folder + "\\read_chunk.bin";
+
+		std::mt19937_64 rng(42);
+		std::string error;
+
+		if (!make_random_file(path, size, rng, error)) {
+			std::cerr << error << "\n";
+			return;
+		}
+
+		int chunk_number = 0;
+
+		r.run(name, [&](work& w, std::string& error) {
+			const auto chunk = read_chunk(path, chunk_number, total_chunks);
+
+			if (chunk.length() != file_chunk_size) {
+				error = "Chunk " + std::to_string(chunk_number) + " is " + std::to_string(chunk.length()) + " bytes";
+				return false;
+			}
+
+			chunk_number = (chunk_number + 1) % total_chunks;
+			w.bytes += chunk.length();
+			w.items++;
+			return true;
+			});
+	}
+
+	void benchmark_select_ip(runner& r) {
+		const std::vector<std::string> host_ips = { "192.168.1.10", "10.0.0.5", "172.16.0.2" };
+		const std::vector<std::string> peer_ips = { "192.168.1.20", "10.1.0.7" };
+
+		r.run("select_ip/same_host", [&](work& w, std::string& error) {
+			if (select_ip(host_ips, host_ips).empty()) {
+				error = "No ip selected";
+				return false;
+			}
+
+			w.items++;
+			return true;
+			});
+
+		r.run("select_ip/lan", [&](work& w, std::string& error) {
+			if (select_ip(host_ips, peer_ips).empty()) {
+				error = "No ip selected";
+				return false;
+			}
+
+			w.items++;
+			return true;
+			});
+	}
+
+	// posting small pieces of work to the background executor and waiting for all of them, against
+	// a thread per piece of work
+	void benchmark_executor(runner& r) {
+		constexpr int pieces = 256;
+
+		auto piece = []() {
+			unsigned long long value = 0;
+
+			for (int i = 0; i < 1000; i++)
+				value = value * 31 + i;
+
+			return value != 1;
+		};
+
+		executor pool;
+
+		r.run("executor/fan_out/" + std::to_string(pieces), [&](work& w, std::string& error) {
+			std::vector<std::future<bool>> results;
+			results.reserve(pieces);
+
+			for (int i = 0; i < pieces; i++)
+				results.push_back(pool.submit(collab::work_priority::normal, piece));
+
+			for (auto& result : results)
+				result.wait();
+
+			w.items += pieces;
+			return true;
+			});
+
+		r.run("std_async/fan_out/" + std::to_string(pieces), [&](work& w, std::string& error) {
+			std::vector<std::future<bool>> results;
+			results.reserve(pieces);
+
+			for (int i = 0; i < pieces; i++)
+				results.push_back(std::async(std::launch::async, piece));
+
+			for (auto& result : results)
+				result.wait();
+
+			w.items += pieces;
+			return true;
+			});
+	}
+
+	// time from sharing a file on one node until another node on the same pc has downloaded and
+	// verified it, discovery included
+	void benchmark_transfer(runner& r, const options& opt) {
+		const std::string name = "share_file_loopback/" + std::to_string(opt.transfer_size);
+
+		if (!r.selected(name))
+			return;
+
+		std::string error;
+
+		struct node {
+			std::unique_ptr<collab> instance;
+			std::string folder;
+		};
+
+		node nodes[2];
+
+		for (int i = 0; i < 2; i++) {
+			auto& n = nodes[i];
+			n.folder = opt.folder + "\\transfer-" + std::to_string(i);
+
+			try {
+				std::filesystem::create_directories(n.folder + "\\files");
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Preparing '" << n.folder << "' failed: " << e.what() << "\n";
+				return;
+			}
+
+			n.instance = std::make_unique<collab>();
+			n.instance->set_unique_id(liblec::leccore::hash_string::sha256("benchmark#transfer#" + std::to_string(i)));
+			n.instance->set_ports(opt.broadcast_port, static_cast<unsigned short>(opt.transfer_port + 2 * (i + 1)));
+
+			collab::session session;
+			session.unique_id = sample_session_id;
+			session.name = "Benchmark";
+			session.description = "Benchmark session";
+			session.passphrase_hash = sample_hash(0);
+
+			if (!n.instance->initialize(n.folder + "\\collab.db", opt.cert_folder, n.folder + "\\files",
+				[](const std::string&) {}, error) ||
+				!n.instance->create_session(session, error)) {
+				std::cerr << "Starting transfer node failed: " << error << "\n";
+				return;
+			}
+
+			n.instance->set_current_session_unique_id(session.unique_id);
+		}
+
+		auto& source = *nodes[0].instance;
+		auto& sink = *nodes[1].instance;
+
+		// prepare the files beforehand so that only the transfer is timed
+		std::mt19937_64 rng(42);
+		std::vector<collab::file> files;
+
+		for (int i = 0; i < opt.transfer_iterations; i++) {
+			const std::string path = opt.folder + "\\transfer-" + std::to_string(i) + ".bin";
+
+			collab::file file;
+			if (!make_random_file(path, opt.transfer_size, rng, error) ||
+				!source.import_file(path, file.hash, error)) {
+				std::cerr << "Preparing transfer file failed: " << error << "\n";
+				return;
+			}
+
+			file.time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+			file.session_id = sample_session_id;
+			file.sender_unique_id = source.unique_id();
+			file.name = "transfer-" + std::to_string(i);
+			file.extension = ".bin";
+			file.description = "Benchmark file";
+			file.size = opt.transfer_size;
+			files.push_back(file);
+		}
+
+		// let the sources start
+		for (int i = 0; i < 100 && !(source.file_source_running() && sink.file_source_running()); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		size_t next = 0;
+
+		r.run_fixed(name, opt.transfer_iterations, [&](work& w, long long& elapsed, std::string& error) {
+			const auto& file = files[next++];
+			const auto start = now_ns();
+
+			if (!source.create_file(file, error))
+				return false;
+
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(120);
+
+			while (!sink.file_exists(file.hash, file.session_id)) {
+				if (std::chrono::steady_clock::now() > deadline) {
+					error = "Timed out waiting for the download";
+					return false;
+				}
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+
+			elapsed = now_ns() - start;
+			w.bytes += file.size;
+			w.items++;
+			return true;
+			});
+	}
+
+	void print_usage() {
+		std::cout <<
+			"usage: benchmark [options]\n"
+			"  --filter <text>            only run benchmarks whose name contains the text\n"
+			"  --rows <n,n,...>           database sizes (default 1000,10000,100000)\n"
+			"  --min-time <seconds>       minimum run time per benchmark (default 0.5)\n"
+			"  --transfer-size <bytes>    size of the files transferred (default 67108864)\n"
+			"  --transfer-iterations <n>  number of files transferred (default 3)\n"
+			"  --folder <path>            scratch folder, emptied first (default .\\benchmark)\n"
+			"  --certs <path>             folder with collab.source and collab.sink (default .)\n"
+			"  --json <path>              write the results to this file as json\n";
+	}
+
+	bool parse_options(int argc, char* argv[], options& opt, std::string& error) {
+		for (int i = 1; i < argc; i++) {
+			const std::string arg = argv[i];
+
+			if (i + 1 >= argc) {
+				error = "Missing value for " + arg;
+				return false;
+			}
+
+			const std::string value = argv[++i];
+
+			try {
+				if (arg == "--filter")
+					opt.filter = value;
+				else if (arg == "--rows") {
+					opt.rows.clear();
+
+					std::stringstream ss(value);
+					std::string item;
+					while (std::getline(ss, item, ','))
+						opt.rows.push_back(std::stoll(item));
+				}
+				else if (arg == "--min-time")
+					opt.min_time = std::stod(value);
+				else if (arg == "--transfer-size")
+					opt.transfer_size = std::stoll(value);
+				else if (arg == "--transfer-iterations")
+					opt.transfer_iterations = (std::max)(std::stoi(value), 1);
+				else if (arg == "--folder")
+					opt.folder = value;
+				else if (arg == "--certs")
+					opt.cert_folder = value;
+				else if (arg == "--json")
+					opt.json_file = value;
+				else {
+					error = "Unknown option: " + arg;
+					return false;
+				}
+			}
+			catch (const std::exception&) {
+				error = "Invalid value for " + arg + ": " + value;
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	options opt;
+	std::string error;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--help") {
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (!parse_options(argc, argv, opt, error)) {
+		std::cerr << error << "\n\n";
+		print_usage();
+		return 1;
+	}
+
+	try {
+		std::filesystem::remove_all(opt.folder);
+		std::filesystem::create_directories(opt.folder);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Preparing '" << opt.folder << "' failed: " << e.what() << "\n";
+		return 1;
+	}
+
+	runner r(opt);
+
+	benchmark_serialization(r);
+	benchmark_database(r, opt);
+	benchmark_read_chunk(r, opt);
+	benchmark_select_ip(r);
+	benchmark_executor(r);
+	benchmark_transfer(r, opt);
+
+	if (!opt.json_file.empty() && !write_json(opt.json_file, r.results())) {
+		std::cerr << "Writing '" << opt.json_file << "' failed\n";
+		return 1;
+	}
+
+	for (const auto& res : r.results()) {
+		if (!res.error.empty())
+			return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../impl.h"
+
+// the database calls queue up behind the database mutex anyway, so they go at normal priority to leave
+// the high priority threads free for work that other work is waiting on
+
+std::future<collab::async_result<std::vector<collab::session>>> collab::get_sessions_async() {
+	return _d._executor.submit(work_priority::normal, [this]() {
+		async_result<std::vector<session>> result;
+		result.success = get_sessions(result.value, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_result<collab::user>> collab::get_user_async(const std::string& unique_id) {
+	return _d._executor.submit(work_priority::normal, [this, unique_id]() {
+		async_result<user> result;
+		result.success = get_user(unique_id, result.value, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_status> collab::create_message_async(const message& message) {
+	return _d._executor.submit(work_priority::normal, [this, message]() {
+		async_status result;
+		result.success = create_message(message, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_result<std::vector<collab::message>>> collab::get_messages_async(const std::string& session_unique_id) {
+	return _d._executor.submit(work_priority::normal, [this, session_unique_id]() {
+		async_result<std::vector<message>> result;
+		result.success = get_messages(session_unique_id, result.value, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_result<std::vector<collab::message>>> collab::get_messages_after_async(const std::string& session_unique_id,
+	unsigned long long hlc) {
+	return _d._executor.submit(work_priority::normal, [this, session_unique_id, hlc]() {
+		async_result<std::vector<message>> result;
+		result.success = get_messages_after(session_unique_id, hlc, result.value, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_status> collab::create_file_async(const file& file) {
+	return _d._executor.submit(work_priority::normal, [this, file]() {
+		async_status result;
+		result.success = create_file(file, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_result<bool>> collab::file_exists_async(const std::string& hash,
+	const std::string& session_unique_id) {
+	return _d._executor.submit(work_priority::normal, [this, hash, session_unique_id]() {
+		async_result<bool> result;
+		result.value = file_exists(hash, session_unique_id);
+		result.success = true;
+		return result;
+		});
+}
+
+std::future<collab::async_result<std::vector<collab::file>>> collab::get_files_async(const std::string& session_unique_id) {
+	return _d._executor.submit(work_priority::normal, [this, session_unique_id]() {
+		async_result<std::vector<file>> result;
+		result.success = get_files(session_unique_id, result.value, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_result<std::string>> collab::import_file_async(const std::string& full_path) {
+	return _d._executor.submit(work_priority::normal, [this, full_path]() {
+		async_result<std::string> result;
+		result.success = import_file(full_path, result.value, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_status> collab::export_file_async(const std::string& hash, const std::string& destination) {
+	return _d._executor.submit(work_priority::normal, [this, hash, destination]() {
+		async_status result;
+		result.success = export_file(hash, destination, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_status> collab::create_review_async(const review& review) {
+	return _d._executor.submit(work_priority::normal, [this, review]() {
+		async_status result;
+		result.success = create_review(review, result.error);
+		return result;
+		});
+}
+
+std::future<collab::async_result<std::vector<collab::review>>> collab::get_reviews_async(const std::string& session_unique_id,
+	const std::string& file_hash) {
+	return _d._executor.submit(work_priority::normal, [this, session_unique_id, file_hash]() {
+		async_result<std::vector<review>> result;
+		result.success = get_reviews(session_unique_id, file_hash, result.value, result.error);
+		return result;
+		});
+}
@@ -0,0 +1,244 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+// winsock has to come before anything that pulls in Windows.h
+#include <WinSock2.h>
+#include <iphlpapi.h>
+
+#include "../impl.h"
+
+// STL
+#include <algorithm>
+
+#pragma comment(lib, "iphlpapi.lib")
+
+// serialize template to make collab::node_capacity serializable
+template<class Archive>
+void serialize(Archive& ar, collab::node_capacity& cls, const unsigned int version) {
+	ar& cls.unique_id;
+	ar& cls.cores;
+	ar& cls.free_memory;
+	ar& cls.free_disk;
+	ar& cls.load;
+	ar& cls.link_speed;
+}
+
+bool serialize_capacity_structure(const collab::node_capacity& cls, std::string& serialized, std::string& error) {
+	error.clear();
+
+	std::stringstream ss;
+
+	try {
+		boost::archive::text_oarchive oa(ss);
+		oa& cls;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	// encode to base64
+	serialized = liblec::leccore::base64::encode(ss.str());
+	return true;
+}
+
+bool deserialize_capacity_structure(const std::string& serialized, collab::node_capacity& cls, std::string& error) {
+	std::stringstream ss;
+
+	// decode from base64
+	ss << liblec::leccore::base64::decode(serialized);
+
+	try {
+		boost::archive::text_iarchive ia(ss);
+		ia& cls;
+		return true;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+}
+
+collab::node_capacity quantize_capacity(const collab::node_capacity& capacity) {
+	constexpr long long memory_step = 64LL * 1024 * 1024;
+	constexpr long long disk_step = 1024LL * 1024 * 1024;
+	constexpr int load_step = 10;
+
+	collab::node_capacity cls = capacity;
+	cls.free_memory -= cls.free_memory % memory_step;
+	cls.free_disk -= cls.free_disk % disk_step;
+	cls.load = ((cls.load + load_step / 2) / load_step) * load_step;
+	return cls;
+}
+
+double capacity_score(const collab::node_capacity& capacity) {
+	return static_cast<double>(capacity.link_speed) * (100 - (std::min)(capacity.load, 100)) / 100.0;
+}
+
+static unsigned long long filetime_value(const FILETIME& time) {
+	ULARGE_INTEGER value;
+	value.LowPart = time.dwLowDateTime;
+	value.HighPart = time.dwHighDateTime;
+	return value.QuadPart;
+}
+
+// the speed of the fastest network link that is up, in bits per second
+static long long fastest_link_speed() {
+	ULONG size = 16 * 1024;
+	std::vector<unsigned char> buffer;
+	ULONG result = ERROR_BUFFER_OVERFLOW;
+
+	// the adapter list can grow between calls, so try a few times
+	for (int attempt = 0; attempt < 3 && result == ERROR_BUFFER_OVERFLOW; attempt++) {
+		buffer.resize(size);
+		result = GetAdaptersAddresses(AF_UNSPEC, GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER,
+			NULL, reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()), &size);
+	}
+
+	if (result != ERROR_SUCCESS)
+		return 0;
+
+	unsigned long long fastest = 0;
+
+	for (auto p_adapter = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()); p_adapter; p_adapter = p_adapter->Next) {
+		if (p_adapter->OperStatus != IfOperStatusUp || p_adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK)
+			continue;
+
+		// unknown speeds are reported as all bits set
+		if (p_adapter->TransmitLinkSpeed != static_cast<unsigned long long>(-1))
+			fastest = (std::max)(fastest, static_cast<unsigned long long>(p_adapter->TransmitLinkSpeed));
+	}
+
+	return static_cast<long long>(fastest);
+}
+
+collab::node_capacity capacity_sampler::sample(const std::string& unique_id, const std::string& folder) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	const auto now = std::chrono::steady_clock::now();
+
+	if (_has_sample && now - _sampled < std::chrono::milliseconds{ capacity_sample_interval }) {
+		_last.unique_id = unique_id;
+		return _last;
+	}
+
+	collab::node_capacity cls;
+	cls.unique_id = unique_id;
+	cls.cores = static_cast<int>(std::thread::hardware_concurrency());
+
+	MEMORYSTATUSEX memory_status = {};
+	memory_status.dwLength = sizeof(memory_status);
+
+	if (GlobalMemoryStatusEx(&memory_status))
+		cls.free_memory = static_cast<long long>(memory_status.ullAvailPhys);
+
+	ULARGE_INTEGER free_bytes = {};
+
+	if (GetDiskFreeSpaceExA(folder.c_str(), &free_bytes, NULL, NULL))
+		cls.free_disk = static_cast<long long>(free_bytes.QuadPart);
+
+	// the load over the time since the last sample, kernel time includes idle time
+	FILETIME idle_time, kernel_time, user_time;
+
+	if (GetSystemTimes(&idle_time, &kernel_time, &user_time)) {
+		const unsigned long long idle = filetime_value(idle_time);
+		const unsigned long long busy = filetime_value(kernel_time) + filetime_value(user_time) - idle;
+
+		if (_has_sample) {
+			const unsigned long long idle_delta = idle - _idle_time;
+			const unsigned long long busy_delta = busy - _busy_time;
+
+			if (idle_delta + busy_delta > 0)
+				cls.load = static_cast<int>((100 * busy_delta) / (idle_delta + busy_delta));
+		}
+
+		_idle_time = idle;
+		_busy_time = busy;
+	}
+
+	cls.link_speed = fastest_link_speed();
+
+	_last = cls;
+	_sampled = now;
+	_has_sample = true;
+
+	return _last;
+}
+
+void collab::impl::receive_capacity(const collab::node_capacity& capacity) {
+	if (capacity.unique_id.empty() || capacity.unique_id == _collab.unique_id())
+		return;	// ignore this data
+
+	const auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(_capacity_mutex);
+
+	auto& peer = _peer_capacities[capacity.unique_id];
+	peer.capacity = capacity;
+	peer.last_seen = now;
+
+	// forget peers that have gone away
+	for (auto it = _peer_capacities.begin(); it != _peer_capacities.end();) {
+		if (now - it->second.last_seen > std::chrono::milliseconds{ capacity_peer_timeout })
+			it = _peer_capacities.erase(it);
+		else
+			it++;
+	}
+}
+
+bool collab::impl::get_peer_capacity(const std::string& unique_id, collab::node_capacity& capacity) {
+	std::lock_guard<std::mutex> lock(_capacity_mutex);
+
+	auto it = _peer_capacities.find(unique_id);
+
+	if (it == _peer_capacities.end() ||
+		std::chrono::steady_clock::now() - it->second.last_seen > std::chrono::milliseconds{ capacity_peer_timeout })
+		return false;
+
+	capacity = it->second.capacity;
+	return true;
+}
+
+bool collab::impl::busy() {
+	const collab::node_capacity capacity = _capacity_sampler.sample(_collab.unique_id(), _collab.files_folder());
+	return capacity.load >= task_steal_load_limit ||
+		(capacity.free_disk > 0 && capacity.free_disk < task_min_free_disk);
+}
+
+void collab::get_capacity(node_capacity& capacity) {
+	capacity = _d._capacity_sampler.sample(_d._unique_id, files_folder());
+}
+
+void collab::get_peer_capacities(std::vector<node_capacity>& peers) {
+	peers.clear();
+
+	const auto now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(_d._capacity_mutex);
+
+	for (const auto& [unique_id, peer] : _d._peer_capacities) {
+		if (now - peer.last_seen <= std::chrono::milliseconds{ capacity_peer_timeout })
+			peers.push_back(peer.capacity);
+	}
+}
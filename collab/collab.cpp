@@ -26,136 +26,61 @@
 #include "impl.h"
 #include "../helper_functions.h"
 
+// STL
+#include <algorithm>
+
 collab::impl::impl(collab& collab) :
 	_p_con(nullptr),
 	_collab(collab) {}
 
 collab::impl::~impl() {
-	// stop session broadcast thread
-	{
-		liblec::auto_mutex lock(_session_broadcast_mutex);
-		_stop_session_broadcast = true;
-	}
-
-	if (_session_broadcast_sender.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _session_broadcast_sender.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
-	}
-
-	if (_session_broadcast_receiver.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _session_broadcast_receiver.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
-	}
-
-	if (_message_broadcast_sender.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _message_broadcast_sender.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
+	// stop the broadcast threads, waking up any that are taking a breath
+	_stop.request_stop();
 
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
-	}
-
-	if (_message_broadcast_receiver.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _message_broadcast_receiver.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
-	}
-
-	if (_user_broadcast_sender.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _user_broadcast_sender.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
+	// release any transfers waiting for their turn
+	_transfer_scheduler.stop();
 
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
+	// stop the file download workers
+	{
+		std::lock_guard<std::mutex> lock(_download_mutex);
+		_stop_downloads = true;
 	}
 
-	if (_user_broadcast_receiver.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _user_broadcast_receiver.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
+	_download_cv.notify_all();
 
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
+	for (auto& worker : _file_download_workers) {
+		if (worker.valid())
+			worker.wait();	// wait for the thread to exit
 	}
 
-	if (_file_broadcast_sender.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _file_broadcast_sender.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
+	// stop the review fetch worker
+	{
+		std::lock_guard<std::mutex> lock(_review_fetch_mutex);
+		_stop_review_fetches = true;
 	}
 
-	if (_file_broadcast_receiver.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _file_broadcast_receiver.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
+	_review_fetch_cv.notify_all();
 
-			if (!thread_running)
-				break;
+	if (_review_fetch_worker.valid())
+		_review_fetch_worker.wait();	// wait for the thread to exit
 
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
+	// stop the task workers, the stop request ends any commands they are running
+	for (auto& worker : _task_workers) {
+		if (worker.valid())
+			worker.wait();	// wait for the thread to exit
 	}
 
-	if (_review_broadcast_sender.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _review_broadcast_sender.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
+	for (auto* p_thread : { &_session_broadcast_sender, &_session_broadcast_receiver,
+		&_message_broadcast_sender, &_message_broadcast_receiver,
+		&_user_broadcast_sender, &_user_broadcast_receiver,
+		&_file_broadcast_sender, &_file_broadcast_receiver,
+		&_review_broadcast_sender, &_review_broadcast_receiver }) {
+		if (p_thread->valid())
+			p_thread->wait();	// wait for the thread to exit
 	}
 
-	if (_review_broadcast_receiver.valid()) {
-		// wait for the thread to exit
-		while (true) {
-			bool thread_running = _review_broadcast_receiver.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready;
-
-			if (!thread_running)
-				break;
-
-			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-		}
-	}
+	// run the background work that is still queued, it may need the database
+	_executor.stop();
 
 	if (_p_con) {
 		delete _p_con;
@@ -170,7 +95,7 @@ bool collab::impl::initialize(const std::string& database_file, const std::strin
 
 	_cert_folder = cert_folder;
 	_files_folder = files_folder;
-	_log = log;
+	_log.set_log(log);
 
 	// make database connection object
 	_p_con = new liblec::leccore::database::connection("sqlcipher",
@@ -180,6 +105,10 @@ bool collab::impl::initialize(const std::string& database_file, const std::strin
 	if (!_p_con->connect(error))
 		return false;
 
+	// bring the database up to date
+	if (!upgrade_database(error))
+		return false;
+
 	// remove all temporary sessions from the local database
 	std::vector<session> sessions;
 
@@ -213,9 +142,20 @@ bool collab::impl::initialize(const std::string& database_file, const std::strin
 		_file_broadcast_sender = std::async(std::launch::async, file_broadcast_sender_func, this);
 		_file_broadcast_receiver = std::async(std::launch::async, file_broadcast_receiver_func, this);
 
+		// file download workers
+		for (int i = 0; i < _download_worker_count; i++)
+			_file_download_workers.push_back(std::async(std::launch::async, file_download_worker_func, this));
+
 		// review threads
 		_review_broadcast_sender = std::async(std::launch::async, review_broadcast_sender_func, this);
 		_review_broadcast_receiver = std::async(std::launch::async, review_broadcast_receiver_func, this);
+		_review_fetch_worker = std::async(std::launch::async, review_fetch_worker_func, this);
+
+		// task workers
+		_idle_task_workers = _task_worker_count;
+
+		for (int i = 0; i < _task_worker_count; i++)
+			_task_workers.push_back(std::async(std::launch::async, task_worker_func, this));
 	}
 	catch (const std::exception& e) {
 		error = e.what();
@@ -225,6 +165,158 @@ bool collab::impl::initialize(const std::string& database_file, const std::strin
 	return true;
 }
 
+void stop_signal::request_stop() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_cv.notify_all();
+	notify_listeners();
+}
+
+bool stop_signal::stop_requested() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stop;
+}
+
+void stop_signal::wake() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_wake_count++;
+	}
+
+	_cv.notify_all();
+	notify_listeners();
+}
+
+bool stop_signal::sleep_for(const std::chrono::milliseconds& duration) {
+	return sleep_for(duration, wake_count());
+}
+
+bool stop_signal::sleep_for(const std::chrono::milliseconds& duration, unsigned long long wake_count) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_cv.wait_for(lock, duration, [&]() { return _stop || _wake_count != wake_count; });
+	return !_stop;
+}
+
+unsigned long long stop_signal::wake_count() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _wake_count;
+}
+
+int stop_signal::add_listener(std::function<void()> listener) {
+	std::lock_guard<std::mutex> lock(_listener_mutex);
+	_listeners[_next_listener_id] = listener;
+	return _next_listener_id++;
+}
+
+void stop_signal::remove_listener(int id) {
+	std::lock_guard<std::mutex> lock(_listener_mutex);
+	_listeners.erase(id);
+}
+
+void stop_signal::notify_listeners() {
+	// listeners are called under the lock so that none is called after it has been removed
+	std::lock_guard<std::mutex> lock(_listener_mutex);
+
+	for (auto& [id, listener] : _listeners)
+		listener();
+}
+
+broadcast_cadence::broadcast_cadence(stop_signal& stop) :
+	_stop(stop) {}
+
+bool broadcast_cadence::due(const std::string& state) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	const auto digest = std::hash<std::string>{}(state);
+	const auto now = std::chrono::steady_clock::now();
+
+	if (_announced && !_kicked) {
+		// the change has been announced, so this state counts as broadcast
+		_announced = false;
+		_digest = digest;
+	}
+
+	if (_kicked || digest != _digest) {
+		// something changed, start over with short intervals
+		_interval = std::chrono::milliseconds{ broadcast_cycle_min };
+	}
+	else {
+		if (now < _next_broadcast)
+			return false;
+
+		// nothing has changed, back off
+		_interval = (std::min)(_interval * 2, std::chrono::milliseconds{ broadcast_cycle_max });
+	}
+
+	_kicked = false;
+	_digest = digest;
+
+	// jitter the interval
+	thread_local std::mt19937 generator{ std::random_device{}() };
+	std::uniform_real_distribution<double> distribution(1.0 - broadcast_cycle_jitter, 1.0 + broadcast_cycle_jitter);
+
+	_next_broadcast = now + std::chrono::milliseconds{
+		static_cast<long long>(static_cast<double>(_interval.count()) * distribution(generator)) };
+
+	return true;
+}
+
+std::chrono::milliseconds broadcast_cadence::time_to_next() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	const auto now = std::chrono::steady_clock::now();
+
+	if (_kicked || now >= _next_broadcast)
+		return std::chrono::milliseconds{ 0 };
+
+	return std::chrono::duration_cast<std::chrono::milliseconds>(_next_broadcast - now) + std::chrono::milliseconds{ 1 };
+}
+
+void broadcast_cadence::kick() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_kicked = true;
+	}
+
+	// wake the sender up
+	_stop.wake();
+}
+
+void broadcast_cadence::hurry() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		const auto soon = std::chrono::steady_clock::now() + std::chrono::milliseconds{ broadcast_cycle_min };
+
+		_interval = std::chrono::milliseconds{ broadcast_cycle_min };
+
+		if (_next_broadcast <= soon)
+			return;	// already due soon enough
+
+		_next_broadcast = soon;
+	}
+
+	// wake the sender up so that it sleeps for the shorter time
+	_stop.wake();
+}
+
+void broadcast_cadence::announced() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_announced = true;
+	_interval = std::chrono::milliseconds{ broadcast_cycle_min };
+	_next_broadcast = std::chrono::steady_clock::now() + _interval;
+}
+
+void collab::impl::kick_broadcasts() {
+	for (auto* p_cadence : { &_session_cadence, &_message_cadence,
+		&_user_cadence, &_file_cadence, &_review_cadence, &_task_cadence, &_capacity_cadence })
+		p_cadence->kick();
+}
+
 const std::string& collab::impl::cert_folder() {
 	return _cert_folder;
 }
@@ -277,3 +369,22 @@ bool collab::file_source_running() {
 bool collab::review_source_running() {
 	return _d.review_source_running();
 }
+
+void collab::set_download_worker_count(int count) {
+	_d._download_worker_count = (std::max)(count, 1);
+}
+
+void collab::set_task_workers(int count, const std::vector<std::string>& programs) {
+	_d._task_worker_count = (std::max)(count, 0);
+	_d._task_programs = programs;
+}
+
+void collab::set_unique_id(const std::string& unique_id) {
+	if (!unique_id.empty())
+		_d._unique_id = unique_id;
+}
+
+void collab::set_ports(unsigned short broadcast_port, unsigned short transfer_port) {
+	_d._broadcast_port = broadcast_port;
+	_d._transfer_port = transfer_port;
+}
@@ -27,6 +27,8 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <map>
+#include <future>
 
 /// <summary>Collaboration class.</summary>
 class collab {
@@ -74,13 +76,20 @@ public:
 		/// <summary>The message text (basic HTML supported).</summary>
 		std::string text;
 
+		/// <summary>The message's hybrid logical clock timestamp, which orders messages consistently
+		/// across nodes even if their clocks are skewed. The upper 48 bits are the physical time in
+		/// milliseconds and the lower 16 bits a logical counter. Leave it at 0 when creating a message
+		/// and it will be assigned by <see cref="create_message"></see>.</summary>
+		unsigned long long hlc = 0;
+
 		bool operator==(const message& param) const {
 			return
 				unique_id == param.unique_id &&
 				time == param.time &&
 				session_id == param.session_id &&
 				sender_unique_id == param.sender_unique_id &&
-				text == param.text;
+				text == param.text &&
+				hlc == param.hlc;
 		}
 
 		bool operator!=(const message& param) const {
@@ -181,6 +190,183 @@ public:
 		}
 	};
 
+	/// <summary>Search hit structure.</summary>
+	struct search_hit {
+		/// <summary>The kind of item that was found.</summary>
+		enum class item_type {
+			/// <summary>A session message.</summary>
+			message,
+
+			/// <summary>A file review.</summary>
+			review,
+		};
+
+		/// <summary>The kind of item that was found.</summary>
+		item_type type = item_type::message;
+
+		/// <summary>The unique ID of the message or review.</summary>
+		std::string unique_id;
+
+		/// <summary>The time the message or review was posted (time_t value).</summary>
+		long long time = 0;
+
+		/// <summary>An extract of the text around the match, with the matching terms in
+		/// &lt;strong&gt; tags. The text itself is escaped (&amp;amp;, &amp;lt;, &amp;gt;,
+		/// &amp;quot;), so the tags are the only markup in it.</summary>
+		std::string snippet;
+	};
+
+	/// <summary>Task structure. A task is a command that any node in the session that has
+	/// room for it can run, on files shared in the session.</summary>
+	struct task {
+		/// <summary>The unique ID of the task.</summary>
+		std::string unique_id;
+
+		/// <summary>The time the task was submitted (time_t value).</summary>
+		long long time = 0;
+
+		/// <summary>The unique ID of the session the task was submitted to.</summary>
+		std::string session_id;
+
+		/// <summary>The unique ID of the user that submitted the task.</summary>
+		std::string submitter_unique_id;
+
+		/// <summary>The name of the task, also used as the name of the result file.</summary>
+		std::string name;
+
+		/// <summary>The command line, e.g. 'ffmpeg.exe -i "{input0}" "{output}"'. {input0},
+		/// {input1} and so on are replaced with the full paths to the inputs, and {output} with
+		/// the full path to the file the command is to write its result to.</summary>
+		std::string command;
+
+		/// <summary>The hashes of the input files, which have to be shared in the session.</summary>
+		std::vector<std::string> inputs;
+
+		/// <summary>The extension of the result file, including the dot, e.g. '.mp4'.</summary>
+		std::string output_extension;
+	};
+
+	/// <summary>The state of a task.</summary>
+	enum class task_state {
+		/// <summary>Waiting for a node to run it.</summary>
+		queued,
+
+		/// <summary>Being run.</summary>
+		running,
+
+		/// <summary>Run successfully, the result is shared in the session.</summary>
+		completed,
+
+		/// <summary>The command couldn't be run, or it failed.</summary>
+		failed,
+	};
+
+	/// <summary>Task status structure.</summary>
+	struct task_status {
+		/// <summary>The task.</summary>
+		collab::task task;
+
+		/// <summary>The state of the task.</summary>
+		task_state state = task_state::queued;
+
+		/// <summary>The unique ID of the node running or that ran the task.</summary>
+		std::string worker_unique_id;
+
+		/// <summary>The hash of the result file, once the task is completed.</summary>
+		std::string result_hash;
+
+		/// <summary>The command's exit code, once the task has been run.</summary>
+		int exit_code = 0;
+
+		/// <summary>Why the task failed.</summary>
+		std::string error;
+	};
+
+	/// <summary>Node capacity structure. Every node advertises its capacity periodically.</summary>
+	struct node_capacity {
+		/// <summary>The node's unique ID.</summary>
+		std::string unique_id;
+
+		/// <summary>The number of logical processors.</summary>
+		int cores = 0;
+
+		/// <summary>The physical memory available, in bytes.</summary>
+		long long free_memory = 0;
+
+		/// <summary>The space available on the drive the files folder is on, in bytes.</summary>
+		long long free_disk = 0;
+
+		/// <summary>The CPU load, as a percentage.</summary>
+		int load = 0;
+
+		/// <summary>The speed of the fastest network link that is up, in bits per second.</summary>
+		long long link_speed = 0;
+	};
+
+	/// <summary>The outcome of an asynchronous call.</summary>
+	struct async_status {
+		/// <summary>Whether the call was successful.</summary>
+		bool success = false;
+
+		/// <summary>Error information.</summary>
+		std::string error;
+	};
+
+	/// <summary>The outcome of an asynchronous call that produces a value.</summary>
+	template<class T>
+	struct async_result : async_status {
+		/// <summary>The value produced by the call.</summary>
+		T value{};
+	};
+
+	/// <summary>Background work priority classes, in order of precedence.</summary>
+	enum class work_priority {
+		/// <summary>Short work that other work is waiting on, e.g. reading ahead.</summary>
+		high,
+
+		/// <summary>Work the user is waiting on, e.g. adding a file.</summary>
+		normal,
+
+		/// <summary>Work nobody is waiting on.</summary>
+		low,
+	};
+
+	/// <summary>Transfer priority classes, in order of precedence.</summary>
+	enum class transfer_priority {
+		/// <summary>Interactive content, e.g. review text.</summary>
+		interactive,
+
+		/// <summary>Files of up to 8MB.</summary>
+		small_file,
+
+		/// <summary>Files larger than 8MB.</summary>
+		bulk_file,
+	};
+
+	/// <summary>Transfer structure.</summary>
+	struct transfer {
+		/// <summary>The unique ID of the item being transferred, e.g. the file's hash.</summary>
+		std::string id;
+
+		/// <summary>The name of the item being transferred, e.g. 'SRS Document.pdf'.</summary>
+		std::string name;
+
+		/// <summary>The IP address of the peer the item is being transferred from.</summary>
+		std::string peer;
+
+		/// <summary>The transfer's priority class.</summary>
+		transfer_priority priority = transfer_priority::bulk_file;
+
+		/// <summary>The size of the item, in bytes (0 if not known in advance).</summary>
+		long long size = 0;
+
+		/// <summary>The number of bytes received so far.</summary>
+		long long transferred = 0;
+
+		/// <summary>Whether the transfer has started moving data (false if it is still queued).</summary>
+		bool active = false;
+	};
+
 	collab ();
 	~collab ();
 
@@ -192,7 +378,8 @@ public:
 	/// <param name="database_file">The full path to the database file.</param>
 	/// <param name="cert_folder">The full path to the certificate folder.</param>
 	/// <param name="files_folder">The full path to the files folder.</param>
-	/// <param name="log">The function to call for logging.</param>
+	/// <param name="log">The function to call for logging. It is called from a background
+	/// thread, one event at a time.</param>
 	/// <param name="error">Error information.</param>
 	/// <returns>Returns true if successful, else false.</returns>
 	/// <remarks>This method creates the database connection. Calling any methods that need a
@@ -216,6 +403,254 @@ public:
 	/// <summary>Check if the review source is running.</summary>
 	/// <returns>Returns true if the review source is running, else false.</returns>
 	bool review_source_running();
+
+	/// <summary>Set the number of files that can be downloaded at once.</summary>
+	/// <param name="count">The number of download workers (at least 1, the default is 3).</param>
+	/// <remarks>The workers are started by <see cref="initialize"></see>, so this method has to
+	/// be called before it to have any effect.</remarks>
+	void set_download_worker_count(int count);
+
+	/// <summary>Let this node run tasks, both its own and those of its peers.</summary>
+	/// <param name="count">The number of tasks that can run at once (the default is 0, i.e.
+	/// this node doesn't run tasks).</param>
+	/// <param name="programs">The programs tasks are allowed to run, e.g. 'ffmpeg.exe' or a
+	/// full path. A task whose command starts with any other program fails.</param>
+	/// <remarks>Tasks come from any node in the session, so only list programs that are safe
+	/// to run with any arguments. The workers are started by <see cref="initialize"></see>, so
+	/// this method has to be called before it to have any effect.</remarks>
+	void set_task_workers(int count, const std::vector<std::string>& programs);
+
+	/// <summary>Set the unique id of this node.</summary>
+	/// <param name="unique_id">The unique id, to be used in place of the one made from this PC's
+	/// BIOS serial number.</param>
+	/// <remarks>Meant for running several nodes on one PC, e.g. in the simulation harness. The
+	/// unique id also keys the database, so this method has to be called before
+	/// <see cref="initialize"></see>.</remarks>
+	void set_unique_id(const std::string& unique_id);
+
+	/// <summary>Set the ports used by this node.</summary>
+	/// <param name="broadcast_port">The first of the five consecutive udp ports used for discovery
+	/// and sync (the default is 30030). Nodes only see each other if they use the same ports.</param>
+	/// <param name="transfer_port">The first of the two consecutive tcp ports the file and review
+	/// sources listen on (the default is 55554). Nodes on the same PC need to use different ones,
+	/// peers learn them from the node's broadcasts.</param>
+	/// <remarks>Has to be called before <see cref="initialize"></see> to have any effect.</remarks>
+	void set_ports(unsigned short broadcast_port, unsigned short transfer_port);
+
+	/// <summary>Traffic totals, counted from when the collab object is created.</summary>
+	struct traffic {
+		/// <summary>The number of discovery and sync datagrams sent.</summary>
+		unsigned long long datagrams_sent = 0;
+
+		/// <summary>The bytes sent in datagrams, headers included.</summary>
+		unsigned long long datagram_bytes_sent = 0;
+
+		/// <summary>The number of datagrams received, including those meant for other sessions.</summary>
+		unsigned long long datagrams_received = 0;
+
+		/// <summary>The bytes received in datagrams.</summary>
+		unsigned long long datagram_bytes_received = 0;
+
+		/// <summary>The bytes received over tcp: file chunks, reviews and file and review
+		/// list reconciliation.</summary>
+		unsigned long long transfer_bytes_received = 0;
+	};
+
+	/// <summary>Get the traffic totals.</summary>
+	/// <returns>Returns the totals.</returns>
+	traffic get_traffic();
+
+	/// <summary>A snapshot of the metrics collected by the collab object.</summary>
+	/// <remarks>Metric names are dot separated, e.g. 'datagrams.received.messages',
+	/// 'transfer_bytes.received.192.168.1.5' or 'db.get_messages'.</remarks>
+	struct metrics {
+		/// <summary>A latency histogram.</summary>
+		struct histogram {
+			/// <summary>The number of durations recorded.</summary>
+			unsigned long long count = 0;
+
+			/// <summary>The sum of the durations, in milliseconds.</summary>
+			double total_ms = 0.0;
+
+			/// <summary>The longest duration, in milliseconds.</summary>
+			double max_ms = 0.0;
+
+			/// <summary>The median, estimated from the buckets, in milliseconds.</summary>
+			double p50_ms = 0.0;
+
+			/// <summary>The 90th percentile, estimated from the buckets, in milliseconds.</summary>
+			double p90_ms = 0.0;
+
+			/// <summary>The 99th percentile, estimated from the buckets, in milliseconds.</summary>
+			double p99_ms = 0.0;
+
+			/// <summary>The upper bound of each bucket in milliseconds, and the number of
+			/// durations in the bucket. Buckets double in size.</summary>
+			std::vector<std::pair<double, unsigned long long>> buckets;
+		};
+
+		/// <summary>Counters, e.g. the number of datagrams sent on each channel.</summary>
+		std::map<std::string, unsigned long long> counters;
+
+		/// <summary>Gauges, e.g. the number of files waiting to be downloaded.</summary>
+		std::map<std::string, long long> gauges;
+
+		/// <summary>Latency histograms, e.g. of each database operation.</summary>
+		std::map<std::string, histogram> histograms;
+	};
+
+	/// <summary>Get a snapshot of the metrics.</summary>
+	/// <param name="snapshot">The snapshot.</param>
+	/// <remarks>Metrics are updated without taking locks, so the values in a snapshot may be a
+	/// few updates apart from each other.</remarks>
+	void get_metrics(metrics& snapshot);
+
+	/// <summary>Save a snapshot of the metrics to a file, as json.</summary>
+	/// <param name="full_path">The full path to the file, including the file name.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	bool save_metrics(const std::string& full_path, std::string& error);
+
+	/// <summary>The transport used for discovery and sync datagrams.</summary>
+	enum class transport {
+		/// <summary>Broadcast to the whole local network (the default).</summary>
+		broadcast,
+
+		/// <summary>Multicast to a group per session, so that only nodes in the same session
+		/// receive the session's traffic. Datagrams are broadcast too until peers on other
+		/// machines are heard on a multicast group, since multicast isn't routed on every network.</summary>
+		multicast,
+	};
+
+	/// <summary>Select the transport used for discovery and sync datagrams.</summary>
+	/// <param name="transport">The transport.</param>
+	/// <remarks>Can be changed at any time. Datagrams are received over both transports regardless
+	/// of the selection, so a multicast node hears broadcast nodes. Nodes that don't join multicast
+	/// groups, i.e. older versions, only hear a multicast node while it's also broadcasting.</remarks>
+	void set_transport(transport transport);
+
+	/// <summary>Get the transport used for discovery and sync datagrams.</summary>
+	/// <returns>Returns the transport.</returns>
+	transport get_transport();
+
+	//------------------------------------------------------------------------------------------------
+	// logging
+
+	/// <summary>The severity of a log event.</summary>
+	enum class log_level {
+		/// <summary>Step by step detail, e.g. download progress.</summary>
+		debug,
+
+		/// <summary>Things the user would want to know about, e.g. a new file being found.</summary>
+		info,
+
+		/// <summary>Something didn't go as planned but will be retried or worked around.</summary>
+		warning,
+
+		/// <summary>Something failed.</summary>
+		error,
+	};
+
+	/// <summary>Set the lowest level of log events that are logged.</summary>
+	/// <param name="level">The level (the default is debug, i.e. everything is logged).</param>
+	/// <remarks>Events below the level are discarded where they are raised, before any text
+	/// is made for them.</remarks>
+	void set_log_level(log_level level);
+
+	/// <summary>Also write log events to a binary log file.</summary>
+	/// <param name="full_path">The full path to the log file, including the file name. Pass an
+	/// empty string to stop writing to the log file.</param>
+	/// <param name="max_size">The size, in bytes, at which the log file is rotated.</param>
+	/// <param name="max_files">The number of rotated log files to keep, named full_path.1 (the
+	/// most recent) to full_path.max_files.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>Events are written as raw records, which are a fraction of the size of the text.
+	/// Use <see cref="read_log_file"></see> to turn them back into text.</remarks>
+	bool set_log_file(const std::string& full_path, unsigned long long max_size, int max_files,
+		std::string& error);
+
+	/// <summary>Read a binary log file written by the collab object.</summary>
+	/// <param name="full_path">The full path to the log file.</param>
+	/// <param name="events">The events, each as a line of text with its time and level.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	static bool read_log_file(const std::string& full_path, std::vector<std::string>& events,
+		std::string& error);
+
+	/// <summary>Get the number of log events that were dropped.</summary>
+	/// <returns>Returns the number of events dropped because they were raised faster than they
+	/// could be written out. The oldest waiting events are the ones dropped.</returns>
+	unsigned long long dropped_log_events();
+
+	//------------------------------------------------------------------------------------------------
+	// tracing
+
+	/// <summary>A stage in the handling of a message, file or review on one node.</summary>
+	struct trace_span {
+		/// <summary>The unique id of the message or review, or the hash of the file.</summary>
+		std::string item_id;
+
+		/// <summary>The stage, e.g. 'message.store'. It starts with the item type.</summary>
+		std::string name;
+
+		/// <summary>The unique id of the node that recorded the span.</summary>
+		std::string node_id;
+
+		/// <summary>When the stage started, in microseconds since the epoch (wall clock).</summary>
+		long long start_us = 0;
+
+		/// <summary>How long the stage took, in microseconds, 0 for a point in time.</summary>
+		long long duration_us = 0;
+
+		/// <summary>Additional information, e.g. the node the item came from.</summary>
+		std::string detail;
+	};
+
+	/// <summary>Record a point in time in the handling of an item.</summary>
+	/// <param name="item_id">The unique id of the message or review, or the hash of the file.</param>
+	/// <param name="name">The stage, e.g. 'message.render' when a message is first shown.</param>
+	void add_trace_event(const std::string& item_id, const std::string& name);
+
+	/// <summary>Get the trace spans recorded by this node.</summary>
+	/// <param name="spans">The spans, oldest first.</param>
+	/// <remarks>The spans of an item, e.g. a message, go from it being written on the node it
+	/// was written on to it being stored and shown on every other node. Only the most recent
+	/// spans are kept.</remarks>
+	void get_trace(std::vector<trace_span>& spans);
+
+	/// <summary>Save the trace spans recorded by this node as a Chrome trace, which can be
+	/// opened in chrome://tracing or https://ui.perfetto.dev.</summary>
+	/// <param name="full_path">The full path to the file, including the file name.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	bool save_trace(const std::string& full_path, std::string& error);
+
+	/// <summary>Save trace spans as a Chrome trace, e.g. those of several nodes put together.</summary>
+	/// <param name="full_path">The full path to the file, including the file name.</param>
+	/// <param name="spans">The spans. Each node gets its own process in the trace.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	static bool save_trace(const std::string& full_path, const std::vector<trace_span>& spans,
+		std::string& error);
+
+	//------------------------------------------------------------------------------------------------
+	// transfers
+
+	/// <summary>Get the transfer queue.</summary>
+	/// <param name="transfers">The transfers, active ones first, then queued ones in the order
+	/// in which they will be scheduled.</param>
+	/// <remarks>Interactive transfers take precedence over small files, which take precedence
+	/// over bulk files. A lower class transfer waits between chunks while a higher class one
+	/// is waiting to move data.</remarks>
+	void get_transfers(std::vector<transfer>& transfers);
+
+	/// <summary>Limit the bandwidth used for receiving files and reviews.</summary>
+	/// <param name="global_limit">The limit across all transfers, in bytes per second (0 means unlimited).</param>
+	/// <param name="peer_limit">The limit for transfers from any one peer, in bytes per second (0 means unlimited).</param>
+	/// <remarks>Leaving headroom on the link keeps chat messages, which aren't scheduled,
+	/// flowing while large files are being received.</remarks>
+	void set_transfer_rate_limits(long long global_limit, long long peer_limit);
 	
 	//------------------------------------------------------------------------------------------------
 	// users
@@ -346,6 +781,8 @@ public:
 	/// <param name="message">The session message as defined in <see cref="collab::message"></see>.</param>
 	/// <param name="error">Error information.</param>
 	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>A message whose sender is this node is announced to peers straight away, and is
+	/// given a hybrid logical clock timestamp if it doesn't have one.</remarks>
 	bool create_message(const message& message,
 		std::string& error);
 
@@ -354,7 +791,8 @@ public:
 	/// <param name="messages">The list of messages.</param>
 	/// <param name="error">Error information.</param>
 	/// <returns>Returns true if successful, else false.</returns>
-	/// <remarks>Messages are ordered chronologically, starting with the oldest.</remarks>
+	/// <remarks>Messages are ordered by their hybrid logical clock timestamp, starting with the oldest,
+	/// and messages with the same timestamp by the sender's unique id.</remarks>
 	bool get_messages(const std::string& session_unique_id,
 		std::vector<message>& messages,
 		std::string& error);
@@ -365,11 +803,29 @@ public:
 	/// <param name="number">The number of latest messages (0 means unlimited).</param>
 	/// <param name="error">Error information.</param>
 	/// <returns>Returns true if successful, else false.</returns>
-	/// <remarks>Messages are ordered chronologically, starting with the latest.</remarks>
+	/// <remarks>Messages are ordered by their hybrid logical clock timestamp, starting with the latest.</remarks>
 	bool get_latest_messages(const std::string& session_unique_id,
 		std::vector<message>& messages,
 		int number, std::string& error);
 
+	/// <summary>Get the session messages that come after a given point.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <param name="hlc">The hybrid logical clock timestamp to start after, e.g. that of the last
+	/// message already known.</param>
+	/// <param name="messages">The list of messages.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>Messages are ordered as in <see cref="get_messages"></see>.</remarks>
+	bool get_messages_after(const std::string& session_unique_id,
+		unsigned long long hlc, std::vector<message>& messages,
+		std::string& error);
+
+	/// <summary>Get the revision of the local message store.</summary>
+	/// <returns>A number that changes whenever a message is added.</returns>
+	/// <remarks>This is a cheap way to tell whether <see cref="get_messages"></see> needs to be
+	/// called again, e.g. when refreshing a chat view frequently.</remarks>
+	unsigned long long messages_revision();
+
 	/// <summary>Check if a user has any messages in a given session.</summary>
 	/// <param name="user_unique_id">The user's unique id.</param>
 	/// <param name="session_unique_id">The session's unique id.</param>
@@ -419,6 +875,26 @@ public:
 	/// <returns>Returns true if the file exists, else false.</returns>
 	bool file_exists(const std::string& hash);
 
+	/// <summary>Import a file into the files folder.</summary>
+	/// <param name="full_path">The full path to the file.</param>
+	/// <param name="hash">The file's sha256 hash, which is also its name in the files folder.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>Where the volume supports block cloning (ReFS, Dev Drive) the file is cloned
+	/// copy-on-write and then hashed, otherwise it is hashed while it is being copied. Either way
+	/// the data is only read once. If the files folder already has a file with the same hash, the
+	/// new copy is discarded.</remarks>
+	bool import_file(const std::string& full_path, std::string& hash, std::string& error);
+
+	/// <summary>Export a file from the files folder.</summary>
+	/// <param name="hash">The file's hash.</param>
+	/// <param name="destination">The full path to the destination file.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>Where the volume supports block cloning the destination is a copy-on-write clone,
+	/// otherwise the file is copied using large sequential reads and writes.</remarks>
+	bool export_file(const std::string& hash, const std::string& destination, std::string& error);
+
 	/// <summary>Check if a user has any files in a given session.</summary>
 	/// <param name="user_unique_id">The user's unique id.</param>
 	/// <param name="session_unique_id">The session's unique id.</param>
@@ -473,6 +949,148 @@ public:
 	/// <remarks>Checks the local database.</remarks>
 	bool review_exists(const std::string& unique_id);
 
+	//------------------------------------------------------------------------------------------------
+	// search
+
+	/// <summary>Search the messages and reviews in a session.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <param name="query">The words to search for. Every word has to be found, and a word also
+	/// matches longer words that start with it.</param>
+	/// <param name="limit">The maximum number of hits to return.</param>
+	/// <param name="cursor">Where to continue from: 0 for the first page of hits, and the value
+	/// returned in next_cursor for the pages that follow.</param>
+	/// <param name="hits">The list of hits, best match first.</param>
+	/// <param name="next_cursor">The cursor of the next page of hits, or -1 if there are no more.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>Uses a full-text index that is kept up to date as messages and reviews are created.
+	/// If the database doesn't support full-text indexes, the text is scanned instead and the
+	/// hits are ordered chronologically, starting with the latest.</remarks>
+	bool search(const std::string& session_unique_id,
+		const std::string& query,
+		int limit, int cursor,
+		std::vector<search_hit>& hits,
+		int& next_cursor,
+		std::string& error);
+
+	//------------------------------------------------------------------------------------------------
+	// tasks
+
+	/// <summary>Submit a task to a session.</summary>
+	/// <param name="task">The task. The unique id, time and submitter are filled in if left empty.</param>
+	/// <param name="unique_id">The unique id of the task.</param>
+	/// <param name="error">Error information.</param>
+	/// <returns>Returns true if successful, else false.</returns>
+	/// <remarks>The task waits on this node until a worker takes it. This node's own workers
+	/// take the oldest task, idle peers in the session take the newest (work stealing). The
+	/// worker fetches the inputs like any other shared file, runs the command and shares the
+	/// result as a new file in the session. Tasks are kept in memory, so tasks that are still
+	/// queued when the collab object is destroyed are lost. Results aren't, they are files.</remarks>
+	bool submit_task(const task& task, std::string& unique_id, std::string& error);
+
+	/// <summary>Get the tasks submitted from this node to a session.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <param name="tasks">The tasks, in the order they were submitted.</param>
+	void get_tasks(const std::string& session_unique_id, std::vector<task_status>& tasks);
+
+	//------------------------------------------------------------------------------------------------
+	// capacity
+
+	/// <summary>Get this node's capacity, as it is advertised to peers.</summary>
+	/// <param name="capacity">The capacity.</param>
+	/// <remarks>Sampled at most once a second.</remarks>
+	void get_capacity(node_capacity& capacity);
+
+	/// <summary>Get the capacity of peers.</summary>
+	/// <param name="peers">The capacities last advertised by the peers that are still around.</param>
+	/// <remarks>Peers are listened to while this node is in a session. The advertised figures are
+	/// rounded so that small changes don't cause broadcasts, e.g. the load to 10%.</remarks>
+	void get_peer_capacities(std::vector<node_capacity>& peers);
+
+	//------------------------------------------------------------------------------------------------
+	// background work
+
+	/// <summary>Run work in the background.</summary>
+	/// <param name="work">The work, returning true if successful.</param>
+	/// <param name="priority">The work's priority.</param>
+	/// <returns>The future result of the work.</returns>
+	/// <remarks>The work is run on a pool of threads, one per core, that is shared with the collab
+	/// object's own background work. Idle threads take work from busy ones, so a burst of work
+	/// spreads across all the cores. Work still queued when the collab object is destroyed is run
+	/// before the destructor returns.</remarks>
+	std::future<bool> run_async(std::function<bool()> work, work_priority priority = work_priority::normal);
+
+	//------------------------------------------------------------------------------------------------
+	// asynchronous calls
+	// the methods below do what the methods of the same name without the _async suffix do, in the
+	// background, so that a UI thread never has to wait on the database. Poll the future, e.g. with
+	// wait_for(std::chrono::seconds(0)) in a timer, rather than waiting on it.
+
+	/// <summary>Get all available sessions in the background.</summary>
+	/// <returns>The sessions, see <see cref="get_sessions"></see>.</returns>
+	std::future<async_result<std::vector<session>>> get_sessions_async();
+
+	/// <summary>Get user info in the background.</summary>
+	/// <param name="unique_id">The unique id of the user.</param>
+	/// <returns>The user, see <see cref="get_user"></see>.</returns>
+	std::future<async_result<user>> get_user_async(const std::string& unique_id);
+
+	/// <summary>Create a session message in the background.</summary>
+	/// <param name="message">The session message.</param>
+	/// <returns>The outcome, see <see cref="create_message"></see>.</returns>
+	std::future<async_status> create_message_async(const message& message);
+
+	/// <summary>Get session messages in the background.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <returns>The messages, see <see cref="get_messages"></see>.</returns>
+	std::future<async_result<std::vector<message>>> get_messages_async(const std::string& session_unique_id);
+
+	/// <summary>Get the session messages that come after a given point in the background.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <param name="hlc">The hybrid logical clock timestamp to start after.</param>
+	/// <returns>The messages, see <see cref="get_messages_after"></see>.</returns>
+	std::future<async_result<std::vector<message>>> get_messages_after_async(const std::string& session_unique_id,
+		unsigned long long hlc);
+
+	/// <summary>Create a file in the background.</summary>
+	/// <param name="file">The file.</param>
+	/// <returns>The outcome, see <see cref="create_file"></see>.</returns>
+	std::future<async_status> create_file_async(const file& file);
+
+	/// <summary>Check if a file exists in a given session in the background.</summary>
+	/// <param name="hash">The hash of the file.</param>
+	/// <param name="session_unique_id">The session's unique ID.</param>
+	/// <returns>Whether the file exists, see <see cref="file_exists"></see>.</returns>
+	std::future<async_result<bool>> file_exists_async(const std::string& hash, const std::string& session_unique_id);
+
+	/// <summary>Get session files in the background.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <returns>The files, see <see cref="get_files"></see>.</returns>
+	std::future<async_result<std::vector<file>>> get_files_async(const std::string& session_unique_id);
+
+	/// <summary>Import a file into the files folder in the background.</summary>
+	/// <param name="full_path">The full path to the file.</param>
+	/// <returns>The file's hash, see <see cref="import_file"></see>.</returns>
+	std::future<async_result<std::string>> import_file_async(const std::string& full_path);
+
+	/// <summary>Export a file from the files folder in the background.</summary>
+	/// <param name="hash">The file's hash.</param>
+	/// <param name="destination">The full path to export the file to.</param>
+	/// <returns>The outcome, see <see cref="export_file"></see>.</returns>
+	std::future<async_status> export_file_async(const std::string& hash, const std::string& destination);
+
+	/// <summary>Create a review in the background.</summary>
+	/// <param name="review">The review.</param>
+	/// <returns>The outcome, see <see cref="create_review"></see>.</returns>
+	std::future<async_status> create_review_async(const review& review);
+
+	/// <summary>Get session file reviews for a specific file in the background.</summary>
+	/// <param name="session_unique_id">The session's unique id.</param>
+	/// <param name="file_hash">The file's hash.</param>
+	/// <returns>The reviews, see <see cref="get_reviews"></see>.</returns>
+	std::future<async_result<std::vector<review>>> get_reviews_async(const std::string& session_unique_id,
+		const std::string& file_hash);
+
 private:
 	class impl;
 	impl& _d;
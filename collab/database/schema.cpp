@@ -0,0 +1,193 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../collab.h"
+#include "../impl.h"
+
+namespace {
+	// session and user ids are interned, rows refer to them by the integer key in Identifiers
+	// times and sizes are integers
+	const char session_messages_schema[] =
+		"(UniqueID TEXT NOT NULL, "
+		"Time INTEGER NOT NULL, "
+		"SessionKey INTEGER NOT NULL, "
+		"SenderKey INTEGER NOT NULL, "
+		"Message TEXT NOT NULL, "
+		"HLC TEXT NOT NULL DEFAULT '', PRIMARY KEY(UniqueID))";
+
+	const char session_files_schema[] =
+		"(Hash TEXT NOT NULL, "
+		"Time INTEGER NOT NULL, "
+		"SessionKey INTEGER NOT NULL, "
+		"SenderKey INTEGER NOT NULL, "
+		"Name TEXT NOT NULL, "
+		"Extension TEXT NOT NULL, "
+		"Description TEXT NOT NULL, "
+		"Size INTEGER NOT NULL, PRIMARY KEY(Hash, SessionKey))";
+
+	const char file_reviews_schema[] =
+		"(UniqueID TEXT NOT NULL, "
+		"Time INTEGER NOT NULL, "
+		"SessionKey INTEGER NOT NULL, "
+		"FileHash TEXT NOT NULL, "
+		"SenderKey INTEGER NOT NULL, "
+		"Text TEXT NOT NULL, PRIMARY KEY(UniqueID))";
+
+	bool table_exists(liblec::leccore::database::connection& con, const std::string& table) {
+		liblec::leccore::database::table results;
+
+		std::string error;
+		if (!con.execute_query("SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?;",
+			{ table }, results, error))
+			return false;
+
+		return !results.data.empty();
+	}
+
+	bool column_exists(liblec::leccore::database::connection& con, const std::string& table, const std::string& column) {
+		liblec::leccore::database::table results;
+
+		// the query fails if the column doesn't exist
+		std::string error;
+		return con.execute_query("SELECT " + column + " FROM " + table + " LIMIT 1;", {}, results, error);
+	}
+
+	// execute the statements in a single transaction
+	bool execute_transaction(liblec::leccore::database::connection& con,
+		const std::vector<std::string>& statements, std::string& error) {
+		if (!con.execute("BEGIN TRANSACTION;", {}, error))
+			return false;
+
+		for (const auto& statement : statements) {
+			if (!con.execute(statement, {}, error)) {
+				std::string rollback_error;
+				if (!con.execute("ROLLBACK;", {}, rollback_error)) {}
+
+				return false;
+			}
+		}
+
+		return con.execute("COMMIT;", {}, error);
+	}
+
+	// move the rows of a table from before interning into a table in the current format
+	// old_columns and new_columns are matched up in order
+	bool migrate_table(liblec::leccore::database::connection& con, const std::string& table, const std::string& schema,
+		const std::string& old_columns, const std::string& new_columns, std::string& error) {
+		return execute_transaction(con, {
+			"CREATE TABLE " + table + "New " + schema + ";",
+
+			// intern the ids the table refers to
+			"INSERT OR IGNORE INTO Identifiers (Value) SELECT SessionID FROM " + table + ";",
+			"INSERT OR IGNORE INTO Identifiers (Value) SELECT SenderUniqueID FROM " + table + ";",
+
+			"INSERT INTO " + table + "New (" + new_columns + ") "
+			"SELECT " + old_columns + " FROM " + table + " t "
+			"JOIN Identifiers s ON s.Value = t.SessionID "
+			"JOIN Identifiers u ON u.Value = t.SenderUniqueID;",
+
+			"DROP TABLE " + table + ";",
+			"ALTER TABLE " + table + "New RENAME TO " + table + ";"
+			}, error);
+	}
+}
+
+bool intern_identifier(liblec::leccore::database::connection& con, const std::string& value, std::string& error) {
+	return con.execute("INSERT OR IGNORE INTO Identifiers (Value) VALUES(?);", { value }, error);
+}
+
+bool collab::impl::upgrade_database(std::string& error) {
+	liblec::auto_mutex lock(_database_mutex);
+
+	// get optional object
+	auto con_opt = get_connection();
+
+	if (!con_opt.has_value()) {
+		error = "No database connection";
+		return false;
+	}
+
+	// get database connection object reference
+	auto& con = con_opt.value().get();
+
+	if (!con.execute("CREATE TABLE IF NOT EXISTS Identifiers "
+		"(ID INTEGER PRIMARY KEY, "
+		"Value TEXT NOT NULL UNIQUE);",
+		{}, error))
+		return false;
+
+	// migrate tables from before interning
+	if (table_exists(con, "SessionMessages") && !column_exists(con, "SessionMessages", "SessionKey")) {
+		_log(log_event::upgrading_table, "message");
+
+		// tables from before hybrid logical clocks don't have the HLC column
+		if (!column_exists(con, "SessionMessages", "HLC")) {
+			if (!con.execute("ALTER TABLE SessionMessages ADD COLUMN HLC TEXT NOT NULL DEFAULT '';", {}, error))
+				return false;
+		}
+
+		// derive the timestamps of messages that don't have one from their time, like hybrid_logical_clock::from_time
+		if (!con.execute("UPDATE SessionMessages SET HLC = printf('%016x', CAST(Time AS INTEGER) * 65536000) WHERE HLC = '';",
+			{}, error))
+			return false;
+
+		if (!migrate_table(con, "SessionMessages", session_messages_schema,
+			"t.UniqueID, CAST(t.Time AS INTEGER), s.ID, u.ID, t.Message, t.HLC",
+			"UniqueID, Time, SessionKey, SenderKey, Message, HLC", error))
+			return false;
+	}
+
+	if (table_exists(con, "SessionFiles") && !column_exists(con, "SessionFiles", "SessionKey")) {
+		_log(log_event::upgrading_table, "file");
+
+		if (!migrate_table(con, "SessionFiles", session_files_schema,
+			"t.Hash, CAST(t.Time AS INTEGER), s.ID, u.ID, t.Name, t.Extension, t.Description, CAST(t.Size AS INTEGER)",
+			"Hash, Time, SessionKey, SenderKey, Name, Extension, Description, Size", error))
+			return false;
+	}
+
+	if (table_exists(con, "FileReviews") && !column_exists(con, "FileReviews", "SessionKey")) {
+		_log(log_event::upgrading_table, "review");
+
+		if (!migrate_table(con, "FileReviews", file_reviews_schema,
+			"t.UniqueID, CAST(t.Time AS INTEGER), s.ID, t.FileHash, u.ID, t.Text",
+			"UniqueID, Time, SessionKey, FileHash, SenderKey, Text", error))
+			return false;
+	}
+
+	// create tables if they don't exist
+	if (!con.execute(std::string("CREATE TABLE IF NOT EXISTS SessionMessages ") + session_messages_schema + ";", {}, error) ||
+		!con.execute(std::string("CREATE TABLE IF NOT EXISTS SessionFiles ") + session_files_schema + ";", {}, error) ||
+		!con.execute(std::string("CREATE TABLE IF NOT EXISTS FileReviews ") + file_reviews_schema + ";", {}, error))
+		return false;
+
+	// indexes for the hot queries
+	if (!con.execute("CREATE INDEX IF NOT EXISTS SessionMessagesByHLC ON SessionMessages (SessionKey, HLC);", {}, error) ||
+		!con.execute("CREATE INDEX IF NOT EXISTS SessionFilesByTime ON SessionFiles (SessionKey, Time);", {}, error) ||
+		!con.execute("CREATE INDEX IF NOT EXISTS FileReviewsByFile ON FileReviews (SessionKey, FileHash);", {}, error))
+		return false;
+
+	return create_search_index(con, error);
+}
@@ -0,0 +1,155 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../impl.h"
+
+// STL
+#include <algorithm>
+
+// the executor the current thread belongs to, if any, and the thread's queue
+static thread_local executor* t_p_executor = nullptr;
+static thread_local size_t t_queue = 0;
+
+executor::executor() {
+	const size_t count = (std::max)(std::thread::hardware_concurrency(), 2u);
+
+	for (size_t i = 0; i < count; i++)
+		_queues.push_back(std::make_unique<worker_queues>());
+
+	for (size_t i = 0; i < count; i++)
+		_threads.emplace_back(&executor::worker_func, this, i);
+}
+
+executor::~executor() {
+	stop();
+}
+
+void executor::post(collab::work_priority priority, std::function<void()> work) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_stopping) {
+			// the threads are gone
+			work();
+			return;
+		}
+
+		_pending++;
+	}
+
+	// work posted from one of our threads stays with that thread, where its data is likely still in the cache
+	const size_t index = t_p_executor == this ? t_queue : _next_queue++ % _queues.size();
+
+	{
+		std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+		_queues[index]->queues[static_cast<size_t>(priority)].push_back(std::move(work));
+	}
+
+	_cv.notify_one();
+}
+
+bool executor::take(collab::work_priority lowest, std::function<void()>& work) {
+	const size_t home = t_p_executor == this ? t_queue : 0;
+	const size_t count = _queues.size();
+
+	for (size_t priority = 0; priority <= static_cast<size_t>(lowest); priority++) {
+		for (size_t i = 0; i < count; i++) {
+			const size_t index = (home + i) % count;
+			auto& queue = _queues[index]->queues[priority];
+
+			std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+
+			if (queue.empty())
+				continue;
+
+			// the newest work from our own queue, the oldest from the others
+			if (i == 0) {
+				work = std::move(queue.back());
+				queue.pop_back();
+			}
+			else {
+				work = std::move(queue.front());
+				queue.pop_front();
+			}
+
+			std::lock_guard<std::mutex> pending_lock(_mutex);
+			_pending--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void executor::worker_func(size_t index) {
+	t_p_executor = this;
+	t_queue = index;
+
+	while (true) {
+		std::function<void()> work;
+
+		if (take(collab::work_priority::low, work)) {
+			work();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		// work may be counted a moment before it is queued, in which case we go round again
+		_cv.wait(lock, [this]() { return _stopping || _pending > 0; });
+
+		if (_stopping && _pending == 0)
+			break;
+	}
+}
+
+void executor::stop() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+
+	_cv.notify_all();
+
+	for (auto& thread : _threads) {
+		if (!thread.joinable())
+			continue;
+
+		// a thread can't wait for itself, e.g. when the last reference to the owner is let go of in a piece of work
+		if (thread.get_id() == std::this_thread::get_id())
+			thread.detach();
+		else
+			thread.join();
+	}
+
+	_threads.clear();
+}
+
+size_t executor::thread_count() {
+	return _queues.size();
+}
+
+std::future<bool> collab::run_async(std::function<bool()> work, work_priority priority) {
+	return _d._executor.submit(priority, std::move(work));
+}
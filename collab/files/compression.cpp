@@ -0,0 +1,238 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../impl.h"
+
+// Windows
+#include <Windows.h>
+#include <compressapi.h>
+
+#pragma comment(lib, "cabinet.lib")
+
+// STL
+#include <array>
+#include <cmath>
+
+bool is_compressed_file_type(const std::string& extension) {
+	std::string ext = extension;
+
+	for (auto& it : ext)
+		it = tolower(it);
+
+	return
+		// archives
+		ext == ".zip" || ext == ".rar" || ext == ".gz" || ext == ".7z" || ext == ".xz" || ext == ".bz2" ||
+		// video
+		ext == ".mp4" || ext == ".avi" || ext == ".3gp" || ext == ".wmv" || ext == ".mkv" || ext == ".webm" ||
+		// audio
+		ext == ".mp3" || ext == ".m4a" || ext == ".ogg" || ext == ".aac" || ext == ".wma" ||
+		// images
+		ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".gif" ||
+		// office documents (zip containers)
+		ext == ".docx" || ext == ".xlsx" || ext == ".pptx";
+}
+
+double estimate_entropy(const std::string& data) {
+	if (data.empty())
+		return 0.;
+
+	// sample up to four 16KB windows spread across the data
+	const size_t window = 16 * 1024;
+	const size_t windows = 4;
+
+	std::array<size_t, 256> histogram = {};
+	size_t total = 0;
+
+	if (data.length() <= window * windows) {
+		for (const auto& c : data)
+			histogram[static_cast<unsigned char>(c)]++;
+
+		total = data.length();
+	}
+	else {
+		const size_t step = (data.length() - window) / (windows - 1);
+
+		for (size_t w = 0; w < windows; w++) {
+			const size_t start = w * step;
+
+			for (size_t i = start; i < start + window; i++)
+				histogram[static_cast<unsigned char>(data[i])]++;
+
+			total += window;
+		}
+	}
+
+	double entropy = 0.;
+
+	for (const auto& count : histogram) {
+		if (count == 0)
+			continue;
+
+		const double p = static_cast<double>(count) / total;
+		entropy -= p * std::log2(p);
+	}
+
+	return entropy;
+}
+
+std::string chunk_codec_name(chunk_codec codec) {
+	switch (codec) {
+	case chunk_codec::xpress_huff: return "xpress_huff";
+	case chunk_codec::xpress: return "xpress";
+	case chunk_codec::none:
+	default: return "none";
+	}
+}
+
+bool parse_chunk_codec(const std::string& name, chunk_codec& codec) {
+	for (const auto& it : { chunk_codec::none, chunk_codec::xpress_huff, chunk_codec::xpress }) {
+		if (name == chunk_codec_name(it)) {
+			codec = it;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::string supported_chunk_codecs() {
+	return chunk_codec_name(chunk_codec::xpress_huff) + "," + chunk_codec_name(chunk_codec::xpress);
+}
+
+chunk_codec select_chunk_codec(const std::string& capabilities) {
+	std::vector<std::string> offered;
+	std::stringstream ss(capabilities);
+	std::string name;
+
+	while (std::getline(ss, name, ','))
+		offered.push_back(name);
+
+	for (const auto& it : { chunk_codec::xpress_huff, chunk_codec::xpress }) {
+		for (const auto& m_it : offered) {
+			if (m_it == chunk_codec_name(it))
+				return it;
+		}
+	}
+
+	return chunk_codec::none;
+}
+
+static DWORD compress_algorithm(chunk_codec codec) {
+	return codec == chunk_codec::xpress ? COMPRESS_ALGORITHM_XPRESS : COMPRESS_ALGORITHM_XPRESS_HUFF;
+}
+
+std::string encode_chunk(const std::string& chunk, chunk_codec codec) {
+	std::string frame;
+
+	auto store = [&]() {
+		frame.reserve(chunk.length() + 1);
+		frame += static_cast<char>(chunk_codec::none);
+		frame += chunk;
+		return frame;
+	};
+
+	if (codec == chunk_codec::none || chunk.empty() || estimate_entropy(chunk) > chunk_entropy_threshold)
+		return store();
+
+	COMPRESSOR_HANDLE compressor = NULL;
+	if (!CreateCompressor(compress_algorithm(codec), NULL, &compressor))
+		return store();
+
+	bool compressed = false;
+	SIZE_T compressed_size = 0;
+
+	// compressed data is only worth sending if it is smaller than the data itself
+	std::string buffer(chunk.length(), '\0');
+
+	if (Compress(compressor, chunk.data(), chunk.length(), &buffer[0], buffer.length(), &compressed_size)) {
+		if (compressed_size < chunk.length()) {
+			frame.reserve(compressed_size + 1);
+			frame += static_cast<char>(codec);
+			frame.append(buffer.data(), compressed_size);
+			compressed = true;
+		}
+	}
+
+	CloseCompressor(compressor);
+
+	return compressed ? frame : store();
+}
+
+bool decode_chunk(const std::string& frame, std::string& chunk, std::string& error) {
+	chunk.clear();
+
+	if (frame.empty()) {
+		error = "Empty chunk frame";
+		return false;
+	}
+
+	const chunk_codec codec = static_cast<chunk_codec>(frame[0]);
+
+	if (codec == chunk_codec::none) {
+		chunk = frame.substr(1);
+		return true;
+	}
+
+	if (codec != chunk_codec::xpress_huff && codec != chunk_codec::xpress) {
+		error = "Unknown chunk codec";
+		return false;
+	}
+
+	DECOMPRESSOR_HANDLE decompressor = NULL;
+	if (!CreateDecompressor(compress_algorithm(codec), NULL, &decompressor)) {
+		error = "Creating decompressor failed";
+		return false;
+	}
+
+	bool decompressed = false;
+
+	do {
+		// query the size of the original data (recorded by the compressor in buffer mode)
+		SIZE_T size = 0;
+		Decompress(decompressor, frame.data() + 1, frame.length() - 1, NULL, 0, &size);
+
+		if (size == 0 || size > static_cast<SIZE_T>(file_chunk_size)) {
+			error = "Invalid compressed chunk";
+			break;
+		}
+
+		chunk.resize(size);
+
+		if (!Decompress(decompressor, frame.data() + 1, frame.length() - 1, &chunk[0], chunk.length(), &size)) {
+			error = "Decompressing chunk failed";
+			break;
+		}
+
+		chunk.resize(size);
+		decompressed = true;
+	} while (false);
+
+	CloseDecompressor(decompressor);
+
+	if (!decompressed)
+		chunk.clear();
+
+	return decompressed;
+}
@@ -0,0 +1,385 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../collab.h"
+#include "../impl.h"
+
+// lecnet
+#include <liblec/lecnet/tcp.h>
+
+// leccore
+#include <liblec/leccore/file.h>
+
+// STL
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+bool collab::impl::queue_file_download(const file& file, const std::vector<std::string>& ips, unsigned short transfer_port,
+	const std::string& source_unique_id) {
+	// look up the source before taking the download mutex, the ip lookup can block and the capacities have a lock of their own
+	std::vector<std::string> ips_client;
+	liblec::lecnet::tcp::get_host_ips(ips_client);
+	const std::string address = select_ip(ips, ips_client);
+
+	collab::node_capacity candidate;
+	const bool candidate_known = !source_unique_id.empty() && get_peer_capacity(source_unique_id, candidate);
+
+	// the source a queued download of the file is waiting on, if any
+	std::string current_source_unique_id;
+
+	{
+		std::lock_guard<std::mutex> lock(_download_mutex);
+
+		auto it = std::find_if(_download_queue.begin(), _download_queue.end(), [&](const file_download& download) {
+			return download.file.hash == file.hash;
+			});
+
+		if (it != _download_queue.end())
+			current_source_unique_id = it->source_unique_id;
+	}
+
+	collab::node_capacity current;
+	const bool current_known = candidate_known && !current_source_unique_id.empty() &&
+		current_source_unique_id != source_unique_id && get_peer_capacity(current_source_unique_id, current);
+
+	std::lock_guard<std::mutex> lock(_download_mutex);
+
+	if (_pending_downloads.count(file.hash) > 0) {
+		// already queued or being downloaded, a download that hasn't started yet moves to a source with a lot more capacity
+		auto it = std::find_if(_download_queue.begin(), _download_queue.end(), [&](const file_download& download) {
+			return download.file.hash == file.hash;
+			});
+
+		// the download may have started or moved while the capacities were looked up
+		if (it != _download_queue.end() && current_known && it->source_unique_id == current_source_unique_id &&
+			capacity_score(candidate) > capacity_switch_margin * capacity_score(current)) {
+			_transfer_scheduler.complete(it->ticket);
+
+			it->address = address;
+			it->port = node_port(transfer_port, FILE_TRANSFER_PORT);
+			it->source_unique_id = source_unique_id;
+			it->ticket = _transfer_scheduler.enqueue(file.hash, file.name + file.extension, it->address,
+				file.size <= small_file_threshold ? transfer_priority::small_file : transfer_priority::bulk_file, file.size);
+		}
+
+		return false;
+	}
+
+	file_download download;
+	download.file = file;
+
+	// select the ip to connect to
+	download.address = address;
+	download.port = node_port(transfer_port, FILE_TRANSFER_PORT);
+	download.source_unique_id = source_unique_id;
+	download.queued_us = trace_clock_now();
+
+	// add the download to the transfer queue
+	download.ticket = _transfer_scheduler.enqueue(file.hash, file.name + file.extension, download.address,
+		file.size <= small_file_threshold ? transfer_priority::small_file : transfer_priority::bulk_file, file.size);
+
+	_download_queue.push_back(download);
+	_pending_downloads.insert(file.hash);
+	_metrics.gauge("queue.downloads").set(static_cast<long long>(_download_queue.size()));
+
+	// wake up a download worker
+	_download_cv.notify_one();
+	return true;
+}
+
+void collab::impl::queue_merkle_descent(payload_type channel, const merkle_summary_structure& summary) {
+	std::lock_guard<std::mutex> lock(_download_mutex);
+
+	auto it = std::find_if(_descent_queue.begin(), _descent_queue.end(), [&](const merkle_descent& descent) {
+		return descent.channel == channel && descent.summary.source_node_unique_id == summary.source_node_unique_id;
+		});
+
+	if (it != _descent_queue.end()) {
+		// the peer's tree has moved on since, look into the latest one instead
+		it->summary = summary;
+		return;
+	}
+
+	merkle_descent descent;
+	descent.channel = channel;
+	descent.summary = summary;
+	_descent_queue.push_back(descent);
+	_metrics.gauge("queue.descents").set(static_cast<long long>(_descent_queue.size()));
+
+	// wake up a download worker
+	_download_cv.notify_one();
+}
+
+void collab::impl::file_download_worker_func(impl* p_impl) {
+	while (true) {
+		file_download download;
+
+		{
+			std::unique_lock<std::mutex> lock(p_impl->_download_mutex);
+
+			// wait for a download, or a look into a peer's tree
+			p_impl->_download_cv.wait(lock, [p_impl]() {
+				return p_impl->_stop_downloads || !p_impl->_download_queue.empty() || !p_impl->_descent_queue.empty();
+				});
+
+			if (p_impl->_stop_downloads)
+				break;
+
+			if (!p_impl->_descent_queue.empty()) {
+				// looks into trees come first, they're quick and are what finds the downloads in the first place
+				merkle_descent descent = p_impl->_descent_queue.front();
+				p_impl->_descent_queue.erase(p_impl->_descent_queue.begin());
+				p_impl->_metrics.gauge("queue.descents").set(static_cast<long long>(p_impl->_descent_queue.size()));
+
+				lock.unlock();
+				run_merkle_descent(p_impl, descent);
+				continue;
+			}
+
+			// take the smallest file first, so small files aren't stuck behind bulk files
+			auto it = std::min_element(p_impl->_download_queue.begin(), p_impl->_download_queue.end(),
+				[](const file_download& a, const file_download& b) { return a.file.size < b.file.size; });
+
+			download = *it;
+			p_impl->_download_queue.erase(it);
+			p_impl->_metrics.gauge("queue.downloads").set(static_cast<long long>(p_impl->_download_queue.size()));
+		}
+
+		const auto& it = download.file;
+		const auto download_start = std::chrono::steady_clock::now();
+		const auto download_start_us = trace_clock_now();
+		p_impl->_trace.record(it.hash, "file.queue", download.queued_us, download_start_us - download.queued_us);
+
+		const bool downloaded = download_file(p_impl, download);
+
+		const auto download_time = std::chrono::steady_clock::now() - download_start;
+		p_impl->_trace.record(it.hash, "file.download", download_start_us,
+			std::chrono::duration_cast<std::chrono::microseconds>(download_time).count(),
+			(downloaded ? "from " : "failed, from ") + download.address);
+
+		if (downloaded)
+			p_impl->_metrics.histogram("download.file").record(download_time);
+		else
+			p_impl->_metrics.counter("download_failures.file").add();
+
+		// remove the download from the transfer queue
+		p_impl->_transfer_scheduler.complete(download.ticket);
+
+		if (downloaded) {
+			std::string error;
+
+			// add this file to the local database
+			if (p_impl->_collab.create_file(it, error)) {
+				// file added successfully to the local database
+				p_impl->_log(log_event::file_saved, it.name, it.extension);
+			}
+			else
+				p_impl->_log(log_event::file_save_failed, it.name, it.extension, error);
+		}
+
+		{
+			// the file can now be queued again if need be, e.g. if the download failed
+			std::lock_guard<std::mutex> lock(p_impl->_download_mutex);
+			p_impl->_pending_downloads.erase(it.hash);
+		}
+	}
+}
+
+bool collab::impl::download_file(impl* p_impl, const file_download& download) {
+	const auto& it = download.file;
+	const auto& selected_ip = download.address;
+	const auto ticket = download.ticket;
+
+	bool downloaded = false;	// flag to determine if physical file has been downloaded
+	std::string error;
+
+	// configure tcp/ip sink parameters
+	liblec::lecnet::tcp::client::client_params params;
+	params.address = selected_ip;
+	params.port = download.port;
+	params.magic_number = file_transfer_magic_number;
+	params.use_ssl = true;
+	params.ca_cert_path = p_impl->cert_folder() + "\\collab.sink";
+
+	// create tcp/ip sink object
+	liblec::lecnet::tcp::client sink;
+
+	if (sink.connect(params, error)) {
+		while (sink.connecting())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		if (sink.connected(error)) {
+			// "filename#chunk_number/total_chunks"
+
+			const std::string filename = it.hash;
+
+			const auto file_size = it.size;
+
+			auto total_chunks = file_size / file_chunk_size;
+
+			if (file_size % file_chunk_size <= file_size)
+				total_chunks++;
+
+			// download to a temporary file, the file only takes its final name once its hash has been checked
+			// so that a failed download is never taken for the file
+			const std::string final_path = p_impl->files_folder() + "\\" + it.hash;
+			const std::string output_path = final_path + ".part";
+
+			auto remove_temporary_file = [&]() {
+				std::error_code ec;
+				std::filesystem::remove(output_path, ec);
+			};
+
+			p_impl->_log(log_event::file_download_connected, selected_ip, it.name, it.extension, log_size{ static_cast<unsigned long long>(file_size) });
+
+			// negotiate chunk compression, unless the file's content is already compressed
+			chunk_codec codec = chunk_codec::none;
+
+			if (!is_compressed_file_type(it.extension)) {
+				std::string capabilities;
+				if (sink.send_data(file_transfer_capabilities_request, capabilities, 10, nullptr, error))
+					codec = select_chunk_codec(capabilities);
+			}
+
+			const std::string codec_suffix = codec == chunk_codec::none ?
+				std::string() : "#" + chunk_codec_name(codec);
+
+			try {
+				// create destination file object
+				std::ofstream file(output_path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+				bool write_error = false;
+
+				// hash the chunks as they are written so the downloaded file doesn't have to be read again
+				liblec::hash_stream hasher;
+
+				long long total_downloaded = 0;
+				long long total_received = 0;	// bytes on the wire
+				float previous_percentage = 0.f;
+
+				// get chunks and write them out
+				for (int chunk_number = 0; chunk_number < total_chunks; chunk_number++) {
+					// make file request string in the form "filename#chunk_number/total_chunks[#codec]"
+					const std::string file_request_string =
+						it.hash + "#" + std::to_string(chunk_number) + "/" + std::to_string(total_chunks) + codec_suffix;
+
+					// wait for this download's turn
+					if (!p_impl->_transfer_scheduler.acquire(ticket)) {
+						p_impl->_log(log_event::file_download_cancelled, it.name, it.extension);
+						write_error = true;
+						break;
+					}
+
+					// send the file request string, and receive the file chunk data
+					std::string received, chunk_data;
+
+					if (sink.send_data(file_request_string, received, 20, nullptr, error)) {
+						total_received += received.length();
+						count_transfer(p_impl->_metrics, "received", selected_ip, received.length());
+						p_impl->_transfer_scheduler.consume(ticket, received.length());
+
+						if (codec == chunk_codec::none)
+							chunk_data.swap(received);
+						else
+							if (!received.empty() && !decode_chunk(received, chunk_data, error)) {
+								p_impl->_log(log_event::file_download_failed, it.name, it.extension, error);
+								write_error = true;
+								break;
+							}
+
+						// write chunk data
+						file.write(chunk_data.c_str(), chunk_data.length());
+
+						if (!hasher.update(chunk_data.data(), chunk_data.length())) {
+							p_impl->_log(log_event::file_hash_failed, it.name, it.extension);
+							write_error = true;
+							break;
+						}
+
+						total_downloaded += chunk_data.length();
+
+						float percentage = 100.f * (file_size ? (static_cast<float>(total_downloaded) / static_cast<float>(file_size)) : 100.f);
+						percentage = smallest(percentage, 100.f);
+
+						if (percentage - previous_percentage >= 20.f || percentage == 100.f) {
+							previous_percentage = percentage;
+							p_impl->_log(log_event::file_download_progress, it.name, it.extension, static_cast<int>(percentage + .5f));
+						}
+					}
+					else {
+						p_impl->_log(log_event::file_download_failed, it.name, it.extension, error);
+						write_error = true;
+						break;
+					}
+				}
+
+				file.close();
+
+				if (!write_error && codec != chunk_codec::none && total_downloaded > 0)
+					p_impl->_log(log_event::file_download_compressed, it.name, it.extension,
+						log_size{ static_cast<unsigned long long>(total_received) }, chunk_codec_name(codec));
+
+				if (!write_error) {
+					// file downloaded successfully ... let's check it's hash
+					std::string hash;
+					if (hasher.finish(hash)) {
+						if (hash == it.hash) {
+							p_impl->_log(log_event::file_hash_matched, it.name, it.extension);
+
+							// move the file into place, unless the same data got there meanwhile
+							if (file_available(final_path))
+								remove_temporary_file();
+							else
+								std::filesystem::rename(output_path, final_path);
+
+							downloaded = true;	// hash match confirmed
+						}
+						else
+							p_impl->_log(log_event::file_hash_mismatch, it.name, it.extension, log_id{ hash }, log_id{ it.hash });
+					}
+					else
+						p_impl->_log(log_event::file_hash_failed, it.name, it.extension);
+				}
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+				p_impl->_log(log_event::file_download_failed, it.name, it.extension, error);
+			}
+
+			if (!downloaded)
+				remove_temporary_file();
+
+			// disconnect tcp sink
+			sink.disconnect();
+		}
+		else
+			p_impl->_log(log_event::file_connection_failed, it.name, it.extension, selected_ip, error);
+	}
+	else
+		p_impl->_log(log_event::file_connection_failed, it.name, it.extension, selected_ip, error);
+
+	return downloaded;
+}
@@ -33,19 +33,10 @@
 // STL
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
 
-// serialize template to make collab::file serializable
-template<class Archive>
-void serialize(Archive& ar, collab::file& cls, const unsigned int version) {
-	ar& cls.hash;
-	ar& cls.time;
-	ar& cls.session_id;
-	ar& cls.sender_unique_id;
-	ar& cls.name;
-	ar& cls.extension;
-	ar& cls.description;
-	ar& cls.size;
-}
+// boost
+#include <boost\serialization\version.hpp>
 
 // serialize template to make file_broadcast_structure serializable
 template<class Archive>
@@ -53,8 +44,14 @@ void serialize(Archive& ar, file_broadcast_structure& cls, const unsigned int ve
 	ar& cls.source_node_unique_id;
 	ar& cls.ips;
 	ar& cls.file_list;
+
+	// version 1 adds the source node's transfer port
+	if (version > 0)
+		ar& cls.transfer_port;
 }
 
+BOOST_CLASS_VERSION(file_broadcast_structure, 1)
+
 bool serialize_file_broadcast_structure(const file_broadcast_structure& cls, std::string& serialized, std::string& error) {
 	error.clear();
 
@@ -91,6 +88,15 @@ bool deserialize_file_broadcast_structure(const std::string& serialized, file_br
 	}
 }
 
+// selects files with the interned ids resolved, to be followed by a WHERE clause on f
+// times and sizes are read back as real numbers because leccore's integer getter is only 32 bits wide
+const char file_query[] =
+	"SELECT f.Hash AS Hash, CAST(f.Time AS REAL) AS Time, s.Value AS SessionID, u.Value AS SenderUniqueID, "
+	"f.Name AS Name, f.Extension AS Extension, f.Description AS Description, CAST(f.Size AS REAL) AS Size "
+	"FROM SessionFiles f "
+	"JOIN Identifiers s ON s.ID = f.SessionKey "
+	"JOIN Identifiers u ON u.ID = f.SenderKey ";
+
 std::string read_chunk(const std::string& fullpath, int chunk_number, int total_chunks) {
 	std::string chunk_data;
 
@@ -158,27 +164,51 @@ std::string read_chunk(const std::string& fullpath, int chunk_number, int total_
 	return chunk_data;
 }
 
+std::shared_ptr<const file_tree> get_file_tree(collab& collab, merkle_cache<collab::file>& trees,
+	const std::string& session_unique_id) {
+	return trees.get(session_unique_id, [&](std::vector<collab::file>& files) {
+		std::string error;
+		return collab.get_files(session_unique_id, files, error);
+		}, [](const collab::file& file) { return file.hash; });
+}
+
 class file_source : public liblec::lecnet::tcp::server_async_ssl {
 	collab& _collab;
+	metrics_registry& _metrics;
+	task_board& _tasks;
+	merkle_cache<collab::file>& _trees;
 
 public:
-	file_source(collab& collab) :
-		_collab(collab) {}
+	file_source(collab& collab, metrics_registry& metrics, task_board& tasks, merkle_cache<collab::file>& trees) :
+		_collab(collab), _metrics(metrics), _tasks(tasks), _trees(trees) {}
 
 private:
 	// overrides
 	void log(const std::string& time_stamp, const std::string& event) override {}
 	std::string on_receive(const client_address& address, const std::string& data_received) override {
-		return on_receive(data_received);
+		// idle workers come here for tasks submitted from this node
+		std::string reply = is_task_request(data_received) ?
+			_tasks.answer(data_received, address.address) : on_receive(data_received);
+		count_transfer(_metrics, "sent", address.address, reply.length());
+		return reply;
 	}
 
 	// overload
-	// datareceived is in the form "filename#chunk_number/total_chunks"
+	// datareceived is in the form "filename#chunk_number/total_chunks" or "filename#chunk_number/total_chunks#codec"
 	std::string on_receive(const std::string& data_received) {
-		// figure out filename, chunk number and total chunks
+		if (data_received == file_transfer_capabilities_request)
+			return supported_chunk_codecs();
+
+		std::string session_unique_id, prefix;
+		if (parse_merkle_request(data_received, session_unique_id, prefix))
+			return on_merkle_request(session_unique_id, prefix);
+
+		// figure out filename, chunk number, total chunks and codec
 		std::string filename;
 		int chunk_number = 0;
 		int total_chunks = 0;
+		bool framed = false;
+		chunk_codec codec = chunk_codec::none;
 
 		auto idx = data_received.find('#');
 
@@ -186,6 +216,18 @@ private:
 			filename = data_received.substr(0, idx);
 			auto s = data_received.substr(idx + 1, data_received.length() - idx - 1);
 
+			idx = s.find('#');
+
+			if (idx != std::string::npos) {
+				// the sink expects a chunk frame
+				framed = true;
+
+				if (!parse_chunk_codec(s.substr(idx + 1), codec))
+					codec = chunk_codec::none;
+
+				s.erase(idx);
+			}
+
 			idx = s.find('/');
 
 			if (idx != std::string::npos) {
@@ -195,21 +237,51 @@ private:
 		}
 
 		const std::string fullpath = _collab.files_folder() + "\\" + filename;
-		return read_chunk(fullpath, chunk_number, total_chunks);
+		const std::string chunk = read_chunk(fullpath, chunk_number, total_chunks);
+
+		if (!framed || chunk.empty())
+			return chunk;
+
+		return encode_chunk(chunk, codec);
+	}
+
+	// list the session's files beneath the requested node of the file tree
+	std::string on_merkle_request(const std::string& session_unique_id, const std::string& prefix) {
+		const auto p_tree = get_file_tree(_collab, _trees, session_unique_id);
+
+		if (!p_tree)
+			return std::string();
+
+		return answer_merkle_request(p_tree->tree, prefix, [&](const std::set<std::string>& keys) {
+			file_broadcast_structure cls;
+			cls.source_node_unique_id = _collab.unique_id();
+
+			for (const auto& key : keys) {
+				auto it = p_tree->items.find(key);
+				if (it != p_tree->items.end())
+					cls.file_list.push_back(it->second);
+			}
+
+			std::string serialized, error;
+			if (!serialize_file_broadcast_structure(cls, serialized, error))
+				serialized.clear();
+
+			return serialized;
+		});
 	}
 };
 
 void collab::impl::file_broadcast_sender_func(impl* p_impl) {
 	// create a file source object
 	liblec::lecnet::tcp::server::server_params params;
-	params.port = FILE_TRANSFER_PORT;
+	params.port = node_port(p_impl->_transfer_port, FILE_TRANSFER_PORT);
 	params.magic_number = file_transfer_magic_number;
-	params.max_clients = 1;
+	params.max_clients = max_file_source_clients;
 	params.server_cert = p_impl->cert_folder() + "\\collab.source";
 	params.server_cert_key = p_impl->cert_folder() + "\\collab.source";
 	params.server_cert_key_password = "com.github.alecmus.collab.source";
 	
-	file_source source(p_impl->_collab);
+	file_source source(p_impl->_collab, p_impl->_metrics, p_impl->_task_board, p_impl->_file_trees);
 
 	// start the source
 	if (!source.start(params)) {
@@ -220,25 +292,27 @@ void collab::impl::file_broadcast_sender_func(impl* p_impl) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 
 	if (source.running()) {
-		p_impl->_log("File source started");
+		p_impl->_log(log_event::source_started, "File");
 
 		{
 			liblec::auto_mutex lock(p_impl->_file_source_mutex);
 			p_impl->_file_source_running = true;
 		}
 
-		// create a broadcast sender object
-		liblec::lecnet::udp::broadcast::sender sender(FILE_BROADCAST_PORT);
+		// create a datagram sender object
+		datagram_sender sender(node_port(p_impl->_broadcast_port, FILE_BROADCAST_PORT));
 
-		// loop until _stop_session_broadcast is false
+		// loop until a stop is requested
 		while (source.running()) {
-			{
-				liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+			// check if a stop has been requested
+			if (p_impl->_stop.stop_requested())
+				break;
 
-				// check flag
-				if (p_impl->_stop_session_broadcast)
-					break;
-			}
+			// wake ups from here on cut the next breath short
+			const auto wake_count = p_impl->_stop.wake_count();
+
+			// the broadcast, left empty if there is nothing to broadcast
+			std::string serialized_file_list;
 
 			std::string current_session_unique_id;
 
@@ -249,52 +323,62 @@ void collab::impl::file_broadcast_sender_func(impl* p_impl) {
 
 			if (!current_session_unique_id.empty()) {
 				std::string error;
-				std::vector<file> local_file_list;
 
-				// get file list from local database
-				if (p_impl->_collab.get_files(current_session_unique_id, local_file_list, error)) {
+				// get the file tree, the database is only read if the files have changed
+				const auto p_tree = get_file_tree(p_impl->_collab, p_impl->_file_trees, current_session_unique_id);
 
-					// make a file broadcast object
-					std::string serialized_file_list;
-					file_broadcast_structure cls;
+				if (p_tree) {
+					// summarize the file list, peers that find that the summary differs look into it over tcp
+					merkle_summary_structure cls = make_merkle_summary(p_tree->tree);
 
 					// capture source node unique id
 					cls.source_node_unique_id = p_impl->_collab.unique_id();
 
-					// capture host ip addresses
+					// capture host ip addresses and the port peers can reach the file source on
 					liblec::lecnet::tcp::get_host_ips(cls.ips);
+					cls.transfer_port = p_impl->_transfer_port;
 
-					// capture local file list
-					cls.file_list = local_file_list;
+					cls.session_id = current_session_unique_id;
 
-					// serialize the file broadcast object
-					if (serialize_file_broadcast_structure(cls, serialized_file_list, error)) {
+					// serialize the file summary object
+					if (!serialize_merkle_summary_structure(cls, serialized_file_list, error))
+						serialized_file_list.clear();
+				}
+			}
 
-						// broadcast the serialized object
-						unsigned long actual_count = 0;
-						if (sender.send(serialized_file_list, 1, 0, actual_count, error)) {
-							// broadcast successful
-						}
-					}
+			// broadcast the serialized object if it's due
+			if (p_impl->_file_cadence.due(serialized_file_list) && !serialized_file_list.empty()) {
+				std::string error;
+				if (p_impl->send_datagram(sender, payload_type::file_summary, serialized_file_list, current_session_unique_id, error)) {
+					// broadcast successful
 				}
 			}
 
-			// take a breath
-			std::this_thread::sleep_for(std::chrono::milliseconds{ file_broadcast_cycle });
-		}
+			// the task summary shares the file channel, it has a cadence of its own
+			const std::string serialized_task_summary = current_session_unique_id.empty() ?
+				std::string() : p_impl->make_task_summary(current_session_unique_id);
 
-		bool stopped_by_request = false;
+			if (p_impl->_task_cadence.due(serialized_task_summary) && !serialized_task_summary.empty()) {
+				std::string error;
+				if (p_impl->send_datagram(sender, payload_type::task_summary, serialized_task_summary, current_session_unique_id, error)) {
+					// broadcast successful
+				}
+			}
 
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
-			stopped_by_request = p_impl->_stop_session_broadcast == true;
+			// put tasks whose workers have gone away back in the queue
+			p_impl->requeue_lost_tasks();
+
+			// take a breath until the next broadcast is due, a change wakes us up sooner
+			p_impl->_stop.sleep_for((std::min)(p_impl->_file_cadence.time_to_next(), p_impl->_task_cadence.time_to_next()), wake_count);
 		}
 
+		const bool stopped_by_request = p_impl->_stop.stop_requested();
+
 		if (!stopped_by_request)
-			p_impl->_log("Error: file source stopped");
+			p_impl->_log(log_event::source_stopped, "file");
 	}
 	else {
-		p_impl->_log("Error: file source failed to start");
+		p_impl->_log(log_event::source_start_failed, "file");
 
 		liblec::auto_mutex lock(p_impl->_file_source_mutex);
 		p_impl->_file_source_running = false;
@@ -316,18 +400,22 @@ void collab::impl::file_broadcast_sender_func(impl* p_impl) {
 }
 
 void collab::impl::file_broadcast_receiver_func(impl* p_impl) {
-	// create broadcast receiver object
-	liblec::lecnet::udp::broadcast::receiver receiver(FILE_BROADCAST_PORT, "0.0.0.0");
-
-	// loop until _stop_session_broadcast is false
-	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+	// create datagram receiver object
+	datagram_receiver receiver(node_port(p_impl->_broadcast_port, FILE_BROADCAST_PORT), p_impl->_stop);
 
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
+	{
+		std::string error;
+		if (!receiver.start(error)) {
+			p_impl->_log(log_event::receiver_start_failed, "file", error);
+			return;
 		}
+	}
+
+	// loop until a stop is requested
+	while (true) {
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
 		std::string current_session_unique_id;
 
@@ -336,190 +424,121 @@ void collab::impl::file_broadcast_receiver_func(impl* p_impl) {
 			current_session_unique_id = p_impl->_current_session_unique_id;
 		}
 
+		{
+			// listen on the session's multicast group, broadcasts are received regardless
+			std::string error;
+			if (!receiver.set_group(session_multicast_group(current_session_unique_id), error))
+				p_impl->_log(log_event::receiver_join_failed, "file", error);
+		}
+
 		if (!current_session_unique_id.empty()) {
 			std::string error;
 
 			// check if collab.sink file exists
 			if (!file_available(p_impl->cert_folder() + "\\collab.sink")) {
-				p_impl->_log("Error: sink file not available. No files will be received.");
+				p_impl->_log(log_event::sink_unavailable, "files");
 				break;
 			}
 
-			// run the receiver
-			if (receiver.run(file_receiver_cycle, error)) {
-				// loop while running
-				while (receiver.running())
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			// wait for datagrams, a stop request or session change cuts the wait short
+			std::vector<std::string> datagrams;
+			if (receiver.wait(datagrams, std::chrono::milliseconds{ file_receiver_cycle })) {
+				p_impl->count_received_datagrams(payload_type::file_list, receiver, datagrams);
+
+				// the local file tree, only looked up if a summary comes in
+				std::shared_ptr<const file_tree> p_local_tree;
+
+				// process every datagram received
+				for (auto& serialized_file_list : datagrams) {
+					payload_type type;
+
+					// discard datagrams for other channels and sessions before going to the trouble of decoding them
+					if (!peek_datagram_type(serialized_file_list, type) ||
+						(type != payload_type::file_summary && type != payload_type::task_summary) ||
+						!strip_datagram_header(serialized_file_list, type, current_session_unique_id))
+						continue;
 
-				// no longer running ... check if a datagram was received
-				std::string serialized_file_list;
-				if (receiver.get(serialized_file_list, error)) {
 					// datagram received ... deserialize
 
-					file_broadcast_structure cls;
-					if (deserialize_file_broadcast_structure(serialized_file_list, cls, error)) {
-						// deserialized successfully
+					if (type == payload_type::task_summary) {
+						task_summary_structure summary;
+						if (!deserialize_task_summary_structure(serialized_file_list, summary, error)) {
+							p_impl->count_deserialize_failure(payload_type::task_summary);
+							continue;
+						}
 
-						// check if data is coming from a different node
-						if (cls.source_node_unique_id == p_impl->_collab.unique_id())
-							continue;	// ignore this data
+						if (summary.session_id == current_session_unique_id)
+							p_impl->receive_task_summary(summary);
 
-						// check if any file is missing in the local database
-						for (const auto& it : cls.file_list) {
-							if (it.session_id != current_session_unique_id)
-								continue;	// ignore this data, it's for another session
+						continue;
+					}
 
-							// check if file exists in the session (local database)
-							if (!p_impl->_collab.file_exists(it.hash, it.session_id)) {
-								p_impl->_log("New file found (UDP): '" + it.name + it.extension + "' (source node: " + shorten_unique_id(cls.source_node_unique_id) + ")");
+					if (type == payload_type::file_summary) {
+						merkle_summary_structure summary;
+						if (!deserialize_merkle_summary_structure(serialized_file_list, summary, error)) {
+							p_impl->count_deserialize_failure(payload_type::file_summary);
+							continue;
+						}
 
-								bool downloaded = false;	// flag to determine if physical file has been downloaded
+						// check if data is coming from a different node
+						if (summary.source_node_unique_id == p_impl->_collab.unique_id() ||
+							summary.session_id != current_session_unique_id)
+							continue;	// ignore this data
 
-								// check if a file with the same data exists in another session
-								if (p_impl->_collab.file_exists(it.hash)) {
-									// the file was already downloaded in another session
-									p_impl->_log("File '" + it.name + it.extension + "' already downloaded as " + shorten_unique_id(it.hash) + "' in another session");
-									downloaded = true;
-								}
-								else {
-									// get sink IP list
-									std::vector<std::string> ips_client;
-									liblec::lecnet::tcp::get_host_ips(ips_client);
+						if (!p_local_tree)
+							p_local_tree = get_file_tree(p_impl->_collab, p_impl->_file_trees, current_session_unique_id);
 
-									// select the ip to connect to
-									const std::string selected_ip = select_ip(cls.ips, ips_client);
+						if (p_local_tree && summary.root == p_local_tree->tree.hash(""))
+							continue;	// same files
 
-									// configure tcp/ip sink parameters
-									liblec::lecnet::tcp::client::client_params params;
-									params.address = selected_ip;
-									params.port = FILE_TRANSFER_PORT;
-									params.magic_number = file_transfer_magic_number;
-									params.use_ssl = true;
-									params.ca_cert_path = p_impl->cert_folder() + "\\collab.sink";
-
-									// create tcp/ip sink object
-									liblec::lecnet::tcp::client sink;
-
-									if (sink.connect(params, error)) {
-										while (sink.connecting())
-											std::this_thread::sleep_for(std::chrono::milliseconds(1));
-
-										if (sink.connected(error)) {
-											// "filename#chunk_number/total_chunks"
-
-											const std::string filename = it.hash;
-
-											const auto file_size = it.size;
-
-											auto total_chunks = file_size / file_chunk_size;
-
-											if (file_size % file_chunk_size <= file_size)
-												total_chunks++;
-
-											const std::string output_path = p_impl->files_folder() + "\\" + it.hash;
-
-											p_impl->_log("Connected via TCP to " + selected_ip + " to download '" + it.name + it.extension + "' (" + liblec::leccore::format_size(file_size) + ")");
-
-											try {
-												// create destination file object
-												std::ofstream file(output_path, std::ios::out | std::ios::trunc | std::ios::binary);
-
-												bool write_error = false;
-
-												long long total_downloaded = 0;
-												float previous_percentage = 0.f;
-
-												// get chunks and write them out
-												for (int chunk_number = 0; chunk_number < total_chunks; chunk_number++) {
-													// make file request string in the form "filename#chunk_number/total_chunks"
-													const std::string file_request_string =
-														it.hash + "#" + std::to_string(chunk_number) + "/" + std::to_string(total_chunks);
-
-													// send the file request string, and receive the file chunk data
-													std::string chunk_data;
-
-													if (sink.send_data(file_request_string, chunk_data, 20, nullptr, error)) {
-														// write chunk data
-														file.write(chunk_data.c_str(), chunk_data.length());
-
-														total_downloaded += chunk_data.length();
-
-														float percentage = 100.f * (file_size ? (static_cast<float>(total_downloaded) / static_cast<float>(file_size)) : 100.f);
-														percentage = smallest(percentage, 100.f);
-
-														if (percentage - previous_percentage >= 20.f || percentage == 100.f) {
-															previous_percentage = percentage;
-															p_impl->_log("File '" + it.name + it.extension + "' download: " + liblec::leccore::round_off::to_string(percentage, 0) + "%");
-														}
-													}
-													else {
-														p_impl->_log("Error downloading '" + it.name + it.extension + "': " + error);
-														write_error = true;
-														break;
-													}
-												}
-
-												file.close();
-
-												if (!write_error) {
-													// file downloaded successfully ... let's check it's hash
-
-													liblec::leccore::hash_file hash_file;
-													hash_file.start(output_path, { liblec::leccore::hash_file::algorithm::sha256 });
-
-													p_impl->_log("Hashing downloaded file '" + it.name + it.extension + "'");
-
-													while (hash_file.hashing())
-														std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
-
-													liblec::leccore::hash_file::hash_results results;
-													if (hash_file.result(results, error)) {
-														auto hash = results.at(liblec::leccore::hash_file::algorithm::sha256);
-
-														if (hash == it.hash) {
-															p_impl->_log("Hash match for file '" + it.name + it.extension + "'");
-															downloaded = true;	// hash match confirmed
-														}
-														else
-															p_impl->_log("Hash mis-match for file '" + it.name + it.extension + "': obtained " + shorten_unique_id(hash) + " instead of " + shorten_unique_id(it.hash));
-													}
-												}
-											}
-											catch (const std::exception& e) {
-												error = e.what();
-												p_impl->_log("Error downloading '" + it.name + it.extension + "': " + error);
-											}
-
-											// disconnect tcp sink
-											sink.disconnect();
-										}
-										else
-											p_impl->_log("TCP connection for downloading '" + it.name + it.extension + "' from " + selected_ip + " failed: " + error);
-									}
-									else
-										p_impl->_log("TCP connection for downloading '" + it.name + it.extension + "' from " + selected_ip + " failed: " + error);
-								}
-
-								if (downloaded) {
-									// add this file to the local database
-									if (p_impl->_collab.create_file(it, error)) {
-										// file added successfully to the local database
-										p_impl->_log("File '" + it.name + it.extension + "' entry saved successfully");
-									}
-									else
-										p_impl->_log("Entry failed for '" + it.name + it.extension + "': " + error);
-								}
-							}
-						}
+						// the peer may be missing some of our files too, let it see our summary soon
+						p_impl->_file_cadence.hurry();
+
+						// look into the parts of the source's file tree that differ on a download worker,
+						// the round trips would otherwise keep this thread from listening
+						p_impl->queue_merkle_descent(payload_type::file_summary, summary);
 					}
 				}
 			}
-
-			receiver.stop();
 		}
 		else {
 			// take a breath
-			std::this_thread::sleep_for(std::chrono::milliseconds{ file_receiver_cycle });
+			p_impl->_stop.sleep_for(std::chrono::milliseconds{ file_receiver_cycle });
+		}
+	}
+}
+
+void collab::impl::receive_file_list(impl* p_impl, const file_broadcast_structure& cls,
+	const std::string& current_session_unique_id) {
+	std::string error;
+
+	// check if any file is missing in the local database
+	for (const auto& it : cls.file_list) {
+		if (it.session_id != current_session_unique_id)
+			continue;	// ignore this data, it's for another session
+
+		// check if file exists in the session (local database)
+		if (!p_impl->_collab.file_exists(it.hash, it.session_id)) {
+			// check if a file with the same data exists in another session
+			if (p_impl->_collab.file_exists(it.hash)) {
+				// the file was already downloaded in another session
+				p_impl->_log(log_event::file_already_downloaded, it.name, it.extension, log_id{ it.hash });
+
+				// add this file to the local database
+				if (p_impl->_collab.create_file(it, error)) {
+					// file added successfully to the local database
+					p_impl->_log(log_event::file_saved, it.name, it.extension);
+				}
+				else
+					p_impl->_log(log_event::file_save_failed, it.name, it.extension, error);
+			}
+			else {
+				// leave the download to the download workers so this thread can get back to listening
+				if (p_impl->queue_file_download(it, cls.ips, cls.transfer_port, cls.source_node_unique_id)) {
+					p_impl->_log(log_event::file_found, it.name, it.extension, log_id{ cls.source_node_unique_id });
+					p_impl->_trace.mark(it.hash, "file.found", "from " + shorten_unique_id(cls.source_node_unique_id));
+				}
+			}
 		}
 	}
 }
@@ -530,7 +549,9 @@ bool collab::impl::file_source_running() {
 }
 
 bool collab::create_file(const file& file, std::string& error) {
+	scoped_trace trace(_d._trace, file.hash, "file.store");
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.create_file);
 
 	// get optional object
 	auto con_opt = _d.get_connection();
@@ -543,30 +564,29 @@ bool collab::create_file(const file& file, std::string& error) {
 	// get database connection object reference
 	auto& con = con_opt.value().get();
 
-	// create table if it doesn't exist
-	if (!con.execute("CREATE TABLE IF NOT EXISTS SessionFiles "
-		"(Hash TEXT NOT NULL, "
-		"Time REAL NOT NULL, "
-		"SessionID TEXT NOT NULL, "
-		"SenderUniqueID TEXT NOT NULL, "
-		"Name TEXT NOT NULL, "
-		"Extension TEXT NOT NULL, "
-		"Description TEXT NOT NULL, "
-		"Size REAL NOT NULL, PRIMARY KEY(Hash, SessionID));",
-		{}, error))
+	if (!intern_identifier(con, file.session_id, error) ||
+		!intern_identifier(con, file.sender_unique_id, error))
 		return false;
 
 	// insert data into table
-	if (!con.execute("INSERT INTO SessionFiles VALUES(?, ?, ?, ?, ?, ?, ?, ?);",
+	if (!con.execute("INSERT INTO SessionFiles (Hash, Time, SessionKey, SenderKey, Name, Extension, Description, Size) "
+		"VALUES(?, ?, (SELECT ID FROM Identifiers WHERE Value = ?), (SELECT ID FROM Identifiers WHERE Value = ?), ?, ?, ?, ?);",
 		{ file.hash, static_cast<double>(file.time), file.session_id, file.sender_unique_id,
 		file.name, file.extension, file.description, static_cast<double>(file.size) }, error))
 		return false;
 
+	// the session's file tree has changed
+	_d._file_trees.invalidate(file.session_id);
+
+	// broadcast the change straight away
+	_d._file_cadence.kick();
+
 	return true;
 }
 
 bool collab::get_files(const std::string& session_unique_id, std::vector<file>& files, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_files);
 
 	files.clear();
 
@@ -589,9 +609,8 @@ bool collab::get_files(const std::string& session_unique_id, std::vector<file>&
 	liblec::leccore::database::table results;
 
 	if (!con.execute_query(
-		"SELECT Hash, Time, SessionID, SenderUniqueID, Name, Extension, Description, Size "
-		"FROM SessionFiles "
-		"WHERE SessionID = ? ORDER BY Time DESC;",
+		std::string(file_query) +
+		"WHERE f.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) ORDER BY f.Time DESC;",
 		{ session_unique_id }, results, error))
 		return false;
 
@@ -637,6 +656,7 @@ bool collab::get_files(const std::string& session_unique_id, std::vector<file>&
 bool collab::get_file(const std::string& hash,
 	const std::string& session_unique_id, file& file, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_file);
 
 	file = {};
 
@@ -659,9 +679,8 @@ bool collab::get_file(const std::string& hash,
 	liblec::leccore::database::table results;
 
 	if (!con.execute_query(
-		"SELECT Hash, Time, SessionID, SenderUniqueID, Name, Extension, Description, Size "
-		"FROM SessionFiles "
-		"WHERE Hash = ? AND SessionID = ?;",
+		std::string(file_query) +
+		"WHERE f.Hash = ? AND f.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?);",
 		{ hash, session_unique_id }, results, error))
 		return false;
 
@@ -724,7 +743,7 @@ bool collab::file_exists(const std::string& hash,
 	if (!con.execute_query(
 		"SELECT Time "
 		"FROM SessionFiles "
-		"WHERE Hash = ? AND SessionID = ?;",
+		"WHERE Hash = ? AND SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?);",
 		{ hash, session_unique_id }, results, error))
 		return false;
 
@@ -780,7 +799,8 @@ bool collab::user_has_files_in_session(const std::string& user_unique_id, const
 	if (!con.execute_query(
 		"SELECT Time "
 		"FROM SessionFiles "
-		"WHERE SenderUniqueID = ? AND SessionID = ?;",
+		"WHERE SenderKey = (SELECT ID FROM Identifiers WHERE Value = ?) "
+		"AND SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?);",
 		{ user_unique_id, session_unique_id }, results, error))
 		return false;
 
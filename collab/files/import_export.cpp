@@ -0,0 +1,465 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../impl.h"
+
+// Windows
+#include <Windows.h>
+#include <winioctl.h>	// for FSCTL_DUPLICATE_EXTENTS_TO_FILE
+
+// STL
+#include <filesystem>
+
+static std::string last_error_string() {
+	const DWORD code = GetLastError();
+	char* buffer = nullptr;
+
+	FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+		NULL, code, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), reinterpret_cast<LPSTR>(&buffer), 0, NULL);
+
+	std::string message = buffer ? buffer : "Error " + std::to_string(code);
+
+	if (buffer)
+		LocalFree(buffer);
+
+	// remove trailing line break
+	while (!message.empty() && (message.back() == '\r' || message.back() == '\n'))
+		message.pop_back();
+
+	return message;
+}
+
+// closes the file handle when it goes out of scope
+class file_handle {
+	HANDLE _handle;
+
+public:
+	file_handle(HANDLE handle) :
+		_handle(handle) {}
+
+	~file_handle() {
+		if (valid())
+			CloseHandle(_handle);
+	}
+
+	bool valid() const {
+		return _handle != INVALID_HANDLE_VALUE && _handle != NULL;
+	}
+
+	HANDLE get() const {
+		return _handle;
+	}
+
+	file_handle(const file_handle&) = delete;
+	file_handle& operator=(const file_handle&) = delete;
+};
+
+// page aligned buffer for large sequential reads and writes
+class aligned_buffer {
+	char* _data;
+	DWORD _size;
+
+public:
+	aligned_buffer(DWORD size) :
+		_data(static_cast<char*>(VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE))),
+		_size(size) {}
+
+	~aligned_buffer() {
+		if (_data)
+			VirtualFree(_data, 0, MEM_RELEASE);
+	}
+
+	bool valid() const {
+		return _data != nullptr;
+	}
+
+	char* data() {
+		return _data;
+	}
+
+	DWORD size() const {
+		return _size;
+	}
+
+	aligned_buffer(const aligned_buffer&) = delete;
+	aligned_buffer& operator=(const aligned_buffer&) = delete;
+};
+
+// make a copy-on-write clone of a file (block cloning, supported on ReFS and Dev Drive volumes)
+// no data is read or written, and the clone shares the source's disk space until either is modified
+static bool clone_file(const std::string& source, const std::string& destination, std::string& error) {
+	file_handle source_file(CreateFileA(source.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+
+	if (!source_file.valid()) {
+		error = last_error_string();
+		return false;
+	}
+
+	// check if the volume supports block cloning
+	DWORD file_system_flags = 0;
+	if (!GetVolumeInformationByHandleW(source_file.get(), NULL, 0, NULL, NULL, &file_system_flags, NULL, 0)) {
+		error = last_error_string();
+		return false;
+	}
+
+	if ((file_system_flags & FILE_SUPPORTS_BLOCK_REFCOUNTING) == 0) {
+		error = "Block cloning not supported";
+		return false;
+	}
+
+	LARGE_INTEGER file_size = {};
+	if (!GetFileSizeEx(source_file.get(), &file_size)) {
+		error = last_error_string();
+		return false;
+	}
+
+	// get the cluster size, cloned regions have to be cluster aligned
+	char volume_path[MAX_PATH + 1] = {};
+	DWORD sectors_per_cluster = 0, bytes_per_sector = 0, free_clusters = 0, total_clusters = 0;
+
+	if (!GetVolumePathNameA(source.c_str(), volume_path, MAX_PATH) ||
+		!GetDiskFreeSpaceA(volume_path, &sectors_per_cluster, &bytes_per_sector, &free_clusters, &total_clusters)) {
+		error = last_error_string();
+		return false;
+	}
+
+	const long long cluster_size = static_cast<long long>(sectors_per_cluster) * bytes_per_sector;
+
+	bool cloned = false;
+
+	{
+		file_handle destination_file(CreateFileA(destination.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+
+		if (!destination_file.valid()) {
+			error = last_error_string();
+			return false;
+		}
+
+		do {
+			// the destination has to be sparse if the source is
+			BY_HANDLE_FILE_INFORMATION source_info = {};
+			if (!GetFileInformationByHandle(source_file.get(), &source_info)) {
+				error = last_error_string();
+				break;
+			}
+
+			DWORD bytes_returned = 0;
+
+			if (source_info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) {
+				if (!DeviceIoControl(destination_file.get(), FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytes_returned, NULL)) {
+					error = last_error_string();
+					break;
+				}
+			}
+
+			// the destination has to be at least as large as the regions being cloned into it
+			FILE_END_OF_FILE_INFO end_of_file = {};
+			end_of_file.EndOfFile = file_size;
+
+			if (!SetFileInformationByHandle(destination_file.get(), FileEndOfFileInfo, &end_of_file, sizeof(end_of_file))) {
+				error = last_error_string();
+				break;
+			}
+
+			// clone in regions of at most 1GB (each request is limited to less than 4GB)
+			const long long region_size = 1024LL * 1024LL * 1024LL;
+			bool region_error = false;
+
+			for (long long offset = 0; offset < file_size.QuadPart; offset += region_size) {
+				long long byte_count = smallest(region_size, file_size.QuadPart - offset);
+
+				// round the last region up to a cluster boundary
+				byte_count = ((byte_count + cluster_size - 1) / cluster_size) * cluster_size;
+
+				DUPLICATE_EXTENTS_DATA extents = {};
+				extents.FileHandle = source_file.get();
+				extents.SourceFileOffset.QuadPart = offset;
+				extents.TargetFileOffset.QuadPart = offset;
+				extents.ByteCount.QuadPart = byte_count;
+
+				if (!DeviceIoControl(destination_file.get(), FSCTL_DUPLICATE_EXTENTS_TO_FILE,
+					&extents, sizeof(extents), NULL, 0, &bytes_returned, NULL)) {
+					error = last_error_string();
+					region_error = true;
+					break;
+				}
+			}
+
+			cloned = !region_error;
+		} while (false);
+	}
+
+	if (!cloned) {
+		try { std::filesystem::remove(destination); }
+		catch (const std::exception&) {}
+	}
+
+	return cloned;
+}
+
+// copy a file using large page aligned buffers, reading the next block on the executor while the
+// current one is being written. If a hasher is supplied the data is added to it as it passes through.
+static bool stream_copy(const std::string& source, const std::string& destination,
+	liblec::hash_stream* p_hasher, executor& pool, std::string& error) {
+	file_handle source_file(CreateFileA(source.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+
+	if (!source_file.valid()) {
+		error = "Opening '" + source + "' failed: " + last_error_string();
+		return false;
+	}
+
+	LARGE_INTEGER file_size = {};
+	if (!GetFileSizeEx(source_file.get(), &file_size)) {
+		error = last_error_string();
+		return false;
+	}
+
+	bool copied = false;
+
+	{
+		file_handle destination_file(CreateFileA(destination.c_str(), GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+
+		if (!destination_file.valid()) {
+			error = "Creating '" + destination + "' failed: " + last_error_string();
+			return false;
+		}
+
+		do {
+			// allocate the full size upfront to keep the destination contiguous
+			FILE_END_OF_FILE_INFO end_of_file = {};
+			end_of_file.EndOfFile = file_size;
+			if (!SetFileInformationByHandle(destination_file.get(), FileEndOfFileInfo, &end_of_file, sizeof(end_of_file))) {}
+
+			aligned_buffer current(file_import_block_size), next(file_import_block_size);
+
+			if (!current.valid() || !next.valid()) {
+				error = "Insufficient memory";
+				break;
+			}
+
+			auto read_block = [&source_file](aligned_buffer& buffer) -> long long {
+				DWORD bytes_read = 0;
+				if (!ReadFile(source_file.get(), buffer.data(), buffer.size(), &bytes_read, NULL))
+					return -1;
+
+				return bytes_read;
+			};
+
+			aligned_buffer* p_current = &current;
+			aligned_buffer* p_next = &next;
+
+			long long current_length = read_block(*p_current);
+			bool block_error = false;
+
+			while (current_length > 0) {
+				// read ahead
+				auto next_read = pool.submit(collab::work_priority::high, [&read_block, p_next]() { return read_block(*p_next); });
+
+				if (p_hasher && !p_hasher->update(p_current->data(), static_cast<size_t>(current_length))) {
+					pool.wait(next_read);
+					error = "Hashing failed";
+					block_error = true;
+					break;
+				}
+
+				DWORD bytes_written = 0;
+				if (!WriteFile(destination_file.get(), p_current->data(), static_cast<DWORD>(current_length), &bytes_written, NULL) ||
+					bytes_written != static_cast<DWORD>(current_length)) {
+					error = "Writing '" + destination + "' failed: " + last_error_string();
+					pool.wait(next_read);
+					block_error = true;
+					break;
+				}
+
+				current_length = pool.wait(next_read);
+				std::swap(p_current, p_next);
+			}
+
+			if (block_error)
+				break;
+
+			if (current_length < 0) {
+				error = "Reading '" + source + "' failed: " + last_error_string();
+				break;
+			}
+
+			copied = true;
+		} while (false);
+	}
+
+	if (!copied) {
+		try { std::filesystem::remove(destination); }
+		catch (const std::exception&) {}
+	}
+
+	return copied;
+}
+
+// hash a file using large page aligned buffers, reading the next block on the executor while the
+// current one is being hashed
+static bool stream_hash(const std::string& full_path, std::string& hash, executor& pool, std::string& error) {
+	file_handle file(CreateFileA(full_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+
+	if (!file.valid()) {
+		error = "Opening '" + full_path + "' failed: " + last_error_string();
+		return false;
+	}
+
+	aligned_buffer current(file_import_block_size), next(file_import_block_size);
+
+	if (!current.valid() || !next.valid()) {
+		error = "Insufficient memory";
+		return false;
+	}
+
+	auto read_block = [&file](aligned_buffer& buffer) -> long long {
+		DWORD bytes_read = 0;
+		if (!ReadFile(file.get(), buffer.data(), buffer.size(), &bytes_read, NULL))
+			return -1;
+
+		return bytes_read;
+	};
+
+	liblec::hash_stream hasher;
+
+	aligned_buffer* p_current = &current;
+	aligned_buffer* p_next = &next;
+
+	long long current_length = read_block(*p_current);
+
+	while (current_length > 0) {
+		// read ahead
+		auto next_read = pool.submit(collab::work_priority::high, [&read_block, p_next]() { return read_block(*p_next); });
+
+		const bool hashed = hasher.update(p_current->data(), static_cast<size_t>(current_length));
+		current_length = pool.wait(next_read);
+
+		if (!hashed) {
+			error = "Hashing failed";
+			return false;
+		}
+
+		std::swap(p_current, p_next);
+	}
+
+	if (current_length < 0) {
+		error = "Reading '" + full_path + "' failed: " + last_error_string();
+		return false;
+	}
+
+	if (!hasher.finish(hash)) {
+		error = "Hashing failed";
+		return false;
+	}
+
+	return true;
+}
+
+bool collab::import_file(const std::string& full_path, std::string& hash, std::string& error) {
+	hash.clear();
+	error.clear();
+
+	if (full_path.empty()) {
+		error = "File path not supplied";
+		return false;
+	}
+
+	// the final name (the hash) is only known after all the data has passed through, so put the
+	// data in a temporary file in the files folder first
+	const std::string temporary_path = files_folder() + "\\" + liblec::leccore::hash_string::uuid() + ".import";
+
+	auto remove_temporary_file = [&]() {
+		try { std::filesystem::remove(temporary_path); }
+		catch (const std::exception&) {}
+	};
+
+	std::string clone_error;
+	if (clone_file(full_path, temporary_path, clone_error)) {
+		// cloned without copying any data, hash the clone (one read pass)
+		if (!stream_hash(temporary_path, hash, _d._executor, error)) {
+			remove_temporary_file();
+			return false;
+		}
+	}
+	else {
+		// copy, hashing the data in the same pass
+		liblec::hash_stream hasher;
+
+		if (!stream_copy(full_path, temporary_path, &hasher, _d._executor, error))
+			return false;
+
+		if (!hasher.finish(hash)) {
+			error = "Hashing failed";
+			remove_temporary_file();
+			return false;
+		}
+	}
+
+	try {
+		const std::string final_path = files_folder() + "\\" + hash;
+
+		if (file_available(final_path)) {
+			// the same data is already in the files folder
+			remove_temporary_file();
+		}
+		else
+			std::filesystem::rename(temporary_path, final_path);
+	}
+	catch (const std::exception& e) {
+		hash.clear();
+		error = e.what();
+		remove_temporary_file();
+		return false;
+	}
+
+	return true;
+}
+
+bool collab::export_file(const std::string& hash, const std::string& destination, std::string& error) {
+	error.clear();
+
+	if (hash.empty() || destination.empty()) {
+		error = "File hash or destination not supplied";
+		return false;
+	}
+
+	const std::string full_path = files_folder() + "\\" + hash;
+
+	if (!file_available(full_path)) {
+		error = "File not found in the files folder";
+		return false;
+	}
+
+	std::string clone_error;
+	if (clone_file(full_path, destination, clone_error))
+		return true;
+
+	return stream_copy(full_path, destination, nullptr, _d._executor, error);
+}
@@ -41,6 +41,21 @@
 #include <thread>
 #include <future>
 #include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <map>
+#include <set>
+#include <random>
+#include <atomic>
+#include <functional>
+#include <array>
+#include <memory>
+#include <shared_mutex>
+#include <fstream>
+#include <cstring>
+#include <type_traits>
+#include <deque>
 
 // boost
 
@@ -64,26 +79,141 @@ enum tcp_ports {
 	REVIEW_TRANSFER_PORT,
 };
 
+// the port a node uses for the given purpose, given the first of its ports (see collab::set_ports)
+inline unsigned short node_port(unsigned short first_port, ports port) {
+	return static_cast<unsigned short>(first_port + (port - SESSION_BROADCAST_PORT));
+}
+
+inline unsigned short node_port(unsigned short first_port, tcp_ports port) {
+	return static_cast<unsigned short>(first_port + (port - FILE_TRANSFER_PORT));
+}
+
 constexpr int file_transfer_magic_number = 173;
 constexpr int file_chunk_size = 1024 * 1024;	// the size of each file chunk used in file transfer
+constexpr int file_import_block_size = 4 * 1024 * 1024;	// the size of each block read when importing a file
 
 constexpr int review_transfer_magic_number = 181;
 
-constexpr int session_broadcast_cycle = 1200;	// in milliseconds
-constexpr int session_receiver_cycle = 1500;	// in milliseconds
+// file transfer requests are in the form "filename#chunk_number/total_chunks", optionally followed by
+// "#codec" if the source has listed the codec in its reply to the capabilities request
+// sources that predate chunk compression reply to the capabilities request with an empty string
+constexpr char file_transfer_capabilities_request[] = "?capabilities";
 
-constexpr int message_broadcast_cycle = 1200;	// in milliseconds
-constexpr int message_receiver_cycle = 1500;	// in milliseconds
+// read a chunk of the file for a sink, the last chunk holds whatever remains of the file
+std::string read_chunk(const std::string& fullpath, int chunk_number, int total_chunks);
 
-constexpr int user_broadcast_cycle = 1200;		// in milliseconds
-constexpr int user_receiver_cycle = 1500;		// in milliseconds
+// chunk codecs, in order of preference
+// a compressed chunk is sent as a frame whose first byte is the codec used for that chunk
+enum class chunk_codec : char {
+	none = '0',			// stored, e.g. when the data doesn't compress
+	xpress_huff = '2',	// LZ77 + Huffman, good ratio at close to wire speed
+	xpress = '1',		// LZ77 only, fastest
+};
 
-constexpr int file_broadcast_cycle = 1200;		// in milliseconds
-constexpr int file_receiver_cycle = 1500;		// in milliseconds
+constexpr double chunk_entropy_threshold = 7.5;	// bits per byte, chunks above this are stored as is
+
+// file types whose content is already compressed and isn't worth compressing again
+bool is_compressed_file_type(const std::string& extension);
+
+// estimate the Shannon entropy of data, in bits per byte, from a sample of the data
+double estimate_entropy(const std::string& data);
+
+std::string chunk_codec_name(chunk_codec codec);
+bool parse_chunk_codec(const std::string& name, chunk_codec& codec);
+
+// list of supported codecs as sent in reply to the capabilities request, e.g. "xpress_huff,xpress"
+std::string supported_chunk_codecs();
+
+// choose the most preferred codec in a source's capability list, chunk_codec::none if there is no match
+chunk_codec select_chunk_codec(const std::string& capabilities);
+
+// make a chunk frame, falling back to storing the chunk as is if it doesn't compress
+std::string encode_chunk(const std::string& chunk, chunk_codec codec);
+bool decode_chunk(const std::string& frame,
+	std::string& chunk, std::string& error);
+
+constexpr int max_file_source_clients = 8;		// the number of sinks that can download from the file source at once
+constexpr int max_review_source_clients = 4;	// the number of sinks that can fetch reviews or look into the review tree at once
+constexpr int default_download_worker_count = 3;	// the number of files downloaded at once
+
+constexpr long long small_file_threshold = 8LL * 1024 * 1024;	// files up to this size are scheduled ahead of bulk files
+
+// coordinates transfers so that interactive content isn't stuck behind bulk files
+// each transfer waits for its turn before moving a chunk of data: a transfer can't go ahead
+// while a transfer of a higher priority class is waiting, and the data moved is charged to
+// a global and a per-peer token bucket which must be out of debt before the next chunk
+class transfer_scheduler {
+public:
+	transfer_scheduler() = default;
+	~transfer_scheduler() = default;
+
+	// add a transfer to the queue, returns the ticket used to refer to the transfer
+	long long enqueue(const std::string& id, const std::string& name,
+		const std::string& peer, collab::transfer_priority priority, long long size);
+
+	// wait until the transfer may move its next chunk, returns false if the scheduler has been stopped
+	bool acquire(long long ticket);
+
+	// account for data moved by the transfer
+	void consume(long long ticket, long long bytes);
+
+	// remove the transfer from the queue
+	void complete(long long ticket);
+
+	void set_limits(long long global_limit, long long peer_limit);
+	void get_transfers(std::vector<collab::transfer>& transfers);
 
-constexpr int review_broadcast_cycle = 1200;	// in milliseconds
+	// release all waiting transfers, causing acquire to fail
+	void stop();
+
+private:
+	struct token_bucket {
+		double tokens = 0.0;
+		std::chrono::steady_clock::time_point last_refill;
+	};
+
+	struct entry {
+		collab::transfer transfer;
+		bool waiting = false;
+	};
+
+	// refill the bucket and return the time until it is out of debt, in seconds
+	static double refill(token_bucket& bucket, long long limit,
+		const std::chrono::steady_clock::time_point& now);
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::map<long long, entry> _transfers;	// K = ticket
+	std::map<std::string, token_bucket> _peer_buckets;	// K = peer
+	token_bucket _global_bucket;
+	long long _next_ticket = 0;
+	long long _global_limit = 0;	// bytes per second, 0 means unlimited
+	long long _peer_limit = 0;		// bytes per second, 0 means unlimited
+	bool _stopped = false;
+};
+
+constexpr int broadcast_cycle_min = 500;		// in milliseconds, the interval between broadcasts right after a change
+constexpr int broadcast_cycle_max = 30000;		// in milliseconds, the interval between broadcasts once nothing has changed for a while
+constexpr double broadcast_cycle_jitter = 0.2;	// intervals are randomly varied by up to this fraction
+
+constexpr int session_receiver_cycle = 1500;	// in milliseconds
+constexpr int message_receiver_cycle = 1500;	// in milliseconds
+constexpr int user_receiver_cycle = 1500;		// in milliseconds
+constexpr int file_receiver_cycle = 1500;		// in milliseconds
 constexpr int review_receiver_cycle = 1500;	// in milliseconds
 
+constexpr int task_worker_cycle = 2000;			// in milliseconds, how often an idle task worker looks for work
+constexpr int task_input_timeout = 600;			// in seconds, how long a task worker waits for a task's inputs to arrive
+constexpr int task_peer_timeout = 3 * broadcast_cycle_max;	// in milliseconds, a peer not heard from in this long is taken to be gone
+constexpr int task_summary_grace = 5000;		// in milliseconds, how long a worker has to list a task it took in its summary
+constexpr int task_report_attempts = 3;			// how many times a worker tries to report a task's outcome to the submitter
+constexpr int task_steal_load_limit = 85;		// in percent, a node with a higher cpu load leaves peers' tasks alone
+constexpr long long task_min_free_disk = 1024LL * 1024 * 1024;	// in bytes, a node with less free space leaves peers' tasks alone
+
+constexpr int capacity_sample_interval = 1000;	// in milliseconds, how often this node's capacity is sampled at most
+constexpr int capacity_peer_timeout = 3 * broadcast_cycle_max;	// in milliseconds, a peer not heard from in this long is dropped from the peer table
+constexpr double capacity_switch_margin = 1.25;	// a queued download moves to a source that is this much better
+
 constexpr int message_broadcast_limit = 10;		// only broadcast the latest 10 messages
 
 struct session_broadcast_structure {
@@ -106,14 +236,67 @@ bool serialize_message_broadcast_structure(const message_broadcast_structure& cl
 bool deserialize_message_broadcast_structure(const std::string& serialized,
 	message_broadcast_structure& cls, std::string& error);
 
+constexpr int search_snippet_tokens = 16;		// the number of words in a search hit's snippet
+constexpr int search_snippet_length = 160;		// the number of characters in a snippet when the text is scanned
+
+constexpr long long hlc_max_drift = 60LL * 60 * 1000;	// in milliseconds, peer clocks further ahead than this aren't followed
+
+// hybrid logical clock, for ordering messages consistently across nodes whose clocks may be skewed
+// a timestamp packs the physical time in milliseconds into the upper 48 bits and a logical counter into the
+// lower 16 bits, so timestamps compare as plain integers; the clock never goes backwards, and after a
+// timestamp from a peer has been seen every local timestamp comes after it
+class hybrid_logical_clock {
+public:
+	hybrid_logical_clock() = default;
+	~hybrid_logical_clock() = default;
+
+	// a timestamp for a local event
+	unsigned long long now();
+
+	// take a timestamp received from a peer into account
+	void update(unsigned long long timestamp);
+
+	// the timestamp of a message from a node that predates hybrid logical clocks, from its time_t
+	static unsigned long long from_time(long long time);
+
+private:
+	static unsigned long long physical_now();
+
+	std::mutex _mutex;
+	unsigned long long _last = 0;
+};
+
+// session and user ids are interned in the Identifiers table, and rows in the message, file and
+// review tables refer to them by their integer key, e.g. "(SELECT ID FROM Identifiers WHERE Value = ?)"
+// an id has to be interned before a row that refers to it is inserted
+bool intern_identifier(liblec::leccore::database::connection& con, const std::string& value, std::string& error);
+
+// hybrid logical clock timestamps are stored as 16 hex digits, which sort like the numbers themselves
+std::string hlc_to_string(unsigned long long hlc);
+unsigned long long hlc_from_string(const std::string& hlc);
+
 bool serialize_user_structure(const collab::user& cls,
 	std::string& serialized, std::string& error);
 bool deserialize_user_structure(const std::string& serialized,
 	collab::user& cls, std::string& error);
 
+// serialize template to make collab::file serializable
+template<class Archive>
+void serialize(Archive& ar, collab::file& cls, const unsigned int version) {
+	ar& cls.hash;
+	ar& cls.time;
+	ar& cls.session_id;
+	ar& cls.sender_unique_id;
+	ar& cls.name;
+	ar& cls.extension;
+	ar& cls.description;
+	ar& cls.size;
+}
+
 struct file_broadcast_structure {
 	std::string source_node_unique_id;
 	std::vector<std::string> ips;
+	unsigned short transfer_port = FILE_TRANSFER_PORT;	// the first of the source node's tcp ports
 	std::vector<collab::file> file_list;
 };
 
@@ -135,6 +318,7 @@ struct review_header_structure {
 struct review_broadcast_structure {
 	std::string source_node_unique_id;
 	std::vector<std::string> ips;
+	unsigned short transfer_port = FILE_TRANSFER_PORT;	// the first of the source node's tcp ports
 	std::vector<review_header_structure> review_list;
 };
 
@@ -143,6 +327,919 @@ bool serialize_review_broadcast_structure(const review_broadcast_structure& cls,
 bool deserialize_review_broadcast_structure(const std::string& serialized,
 	review_broadcast_structure& cls, std::string& error);
 
+constexpr int merkle_fanout = 16;			// each node has a child per hex digit
+constexpr int merkle_leaf_size = 16;		// nodes with up to this many items are listed instead of descended into
+constexpr int max_merkle_requests = 256;	// the most nodes looked into in one reconciliation
+
+// a merkle tree over the keys of a session's items, e.g. file hashes or review unique ids
+// keys are placed by the hex digits of their hash, so a node is identified by a prefix of hex digits
+// (the root by an empty prefix) and its hash covers every key beneath it; nodes with the same hash
+// hold the same keys, so reconciliation only has to look into the nodes that differ
+// the nodes down to the leaves are hashed once, when the tree is made
+class merkle_tree {
+public:
+	merkle_tree() = default;
+	merkle_tree(const std::vector<std::string>& keys);
+	~merkle_tree() = default;
+
+	// the hash of the node, 0 if there is nothing beneath it
+	unsigned long long hash(const std::string& prefix) const;
+
+	// the hashes of the node's children, in hex digit order
+	std::vector<unsigned long long> children(const std::string& prefix) const;
+
+	// the keys beneath the node
+	std::set<std::string> keys(const std::string& prefix) const;
+	size_t count(const std::string& prefix) const;
+
+private:
+	// K = hex digest of the key, V = key; keys whose digests collide are all kept
+	using key_map = std::multimap<std::string, std::string>;
+
+	struct node {
+		unsigned long long hash = 0;
+		size_t count = 0;
+	};
+
+	// hash the node and, unless it's a leaf, its children
+	void build(const std::string& prefix, key_map::const_iterator first, key_map::const_iterator last);
+
+	// the keys beneath the node
+	std::pair<key_map::const_iterator, key_map::const_iterator> range(const std::string& prefix) const;
+
+	key_map _keys;
+	std::map<std::string, node> _nodes;	// K = prefix, the nodes that have keys beneath them down to the leaves
+};
+
+// the merkle trees of sessions' items, along with the items themselves, so that broadcasting summaries,
+// answering node requests and reconciling don't each read the session's whole list from the database
+// trees are made when first asked for, and a session's tree is dropped whenever an item is added to it
+template<class T>
+class merkle_cache {
+public:
+	struct entry {
+		merkle_tree tree;
+		std::map<std::string, T> items;	// K = key
+	};
+
+	// get the session's tree, read_items is only called if the tree isn't cached
+	// returns nullptr if the items can't be read
+	std::shared_ptr<const entry> get(const std::string& session_unique_id,
+		std::function<bool(std::vector<T>& items)> read_items,
+		std::function<std::string(const T& item)> key) {
+		unsigned long long generation = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			auto it = _trees.find(session_unique_id);
+			if (it != _trees.end())
+				return it->second;
+
+			generation = _generations[session_unique_id];
+		}
+
+		std::vector<T> items;
+		if (!read_items(items))
+			return nullptr;
+
+		auto p_entry = std::make_shared<entry>();
+		std::vector<std::string> keys;
+		keys.reserve(items.size());
+
+		for (auto& item : items) {
+			keys.push_back(key(item));
+			p_entry->items.emplace(keys.back(), std::move(item));
+		}
+
+		p_entry->tree = merkle_tree(keys);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// don't keep a tree that an item was added behind the back of
+		if (generation == _generations[session_unique_id])
+			_trees[session_unique_id] = p_entry;
+
+		return p_entry;
+	}
+
+	// drop the session's cached tree, e.g. after an item has been added to it
+	void invalidate(const std::string& session_unique_id) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_trees.erase(session_unique_id);
+		_generations[session_unique_id]++;
+	}
+
+private:
+	std::mutex _mutex;
+	std::map<std::string, unsigned long long> _generations;	// K = session unique id
+	std::map<std::string, std::shared_ptr<const entry>> _trees;	// K = session unique id
+};
+
+using file_tree = merkle_cache<collab::file>::entry;
+using review_tree = merkle_cache<collab::review>::entry;
+
+// the session's file and review trees, from the cache if they're there; nullptr if they can't be read
+std::shared_ptr<const file_tree> get_file_tree(collab& collab, merkle_cache<collab::file>& trees,
+	const std::string& session_unique_id);
+std::shared_ptr<const review_tree> get_review_tree(collab& collab, merkle_cache<collab::review>& trees,
+	const std::string& session_unique_id);
+
+// broadcast in place of the full list of a session's items
+struct merkle_summary_structure {
+	std::string source_node_unique_id;
+	std::vector<std::string> ips;
+	unsigned short transfer_port = FILE_TRANSFER_PORT;	// the first of the source node's tcp ports
+	std::string session_id;
+	unsigned long long root = 0;
+	std::vector<unsigned long long> buckets;	// the hashes of the root's children
+};
+
+bool serialize_merkle_summary_structure(const merkle_summary_structure& cls,
+	std::string& serialized, std::string& error);
+bool deserialize_merkle_summary_structure(const std::string& serialized,
+	merkle_summary_structure& cls, std::string& error);
+
+// make a summary of the tree
+merkle_summary_structure make_merkle_summary(const merkle_tree& tree);
+
+// a source's reply when asked about a node of its tree
+struct merkle_node_structure {
+	std::vector<unsigned long long> children;	// the hashes of the node's children, if the node is too big to be listed
+	std::string items;	// the items beneath the node, serialized by the channel, if the node is small enough to be listed
+};
+
+bool serialize_merkle_node_structure(const merkle_node_structure& cls,
+	std::string& serialized, std::string& error);
+bool deserialize_merkle_node_structure(const std::string& serialized,
+	merkle_node_structure& cls, std::string& error);
+
+// requests for nodes are in the form "?tree#session_unique_id#prefix", and are sent to the file and review sources
+// sources that predate merkle trees reply with an empty string
+std::string make_merkle_request(const std::string& session_unique_id, const std::string& prefix);
+bool parse_merkle_request(const std::string& request, std::string& session_unique_id, std::string& prefix);
+
+// answer a request for a node of the tree, serialize_items is called with the keys of the items to list
+std::string answer_merkle_request(const merkle_tree& tree, const std::string& prefix,
+	std::function<std::string(const std::set<std::string>& keys)> serialize_items);
+
+// a stop flag that threads can sleep on, so that they notice a stop request immediately
+// instead of after their current cycle
+class stop_signal {
+public:
+	stop_signal() = default;
+	~stop_signal() = default;
+
+	void request_stop();
+	bool stop_requested();
+
+	// wake up sleeping threads without stopping them, e.g. so they pick up a session change
+	void wake();
+
+	// sleep for the given duration, or until a stop is requested or wake is called
+	// returns false if a stop has been requested
+	bool sleep_for(const std::chrono::milliseconds& duration);
+
+	// same as above, but doesn't sleep at all if wake has been called since wake_count was taken
+	// so that a thread doesn't miss a wake up that comes in while it's busy
+	bool sleep_for(const std::chrono::milliseconds& duration, unsigned long long wake_count);
+	unsigned long long wake_count();
+
+	// for objects that have their own way of waiting, e.g. a datagram receiver
+	// the listener is called whenever a stop is requested or wake is called
+	int add_listener(std::function<void()> listener);
+	void remove_listener(int id);
+
+private:
+	void notify_listeners();
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	bool _stop = false;
+	unsigned long long _wake_count = 0;
+
+	std::mutex _listener_mutex;
+	std::map<int, std::function<void()>> _listeners;	// K = id
+	int _next_listener_id = 0;
+};
+
+// get the description of a winsock error code
+std::string winsock_error_string(int error_code);
+
+constexpr int max_datagram_size = 65507;		// the largest payload a udp datagram can carry
+constexpr int max_queued_datagrams = 1024;		// the oldest datagrams are dropped beyond this
+constexpr int datagram_receive_buffer = 4 * 1024 * 1024;	// the socket receive buffer, to absorb bursts
+
+// receives udp datagrams on a dedicated thread that blocks on the socket
+// every datagram that arrives is drained from the socket and queued for processing, so a burst
+// of datagrams isn't lost while the previous one is being processed
+class datagram_receiver {
+public:
+	datagram_receiver(unsigned short port, stop_signal& stop);
+	~datagram_receiver();
+
+	bool start(std::string& error);
+	void stop();
+
+	// join the given multicast group, leaving the one previously joined (if any)
+	// broadcasts continue to be received regardless of the group joined, and a failed join isn't
+	// retried until the group changes
+	bool set_group(const std::string& group, std::string& error);
+
+	// wait for datagrams and take everything that has been queued
+	// returns false if nothing arrived within the timeout, or if the wait was cut short by the stop signal
+	bool wait(std::vector<std::string>& datagrams, const std::chrono::milliseconds& timeout);
+
+	// the number of datagrams dropped because the queue was full, since the last call
+	unsigned long long take_dropped();
+
+	// whether a datagram from another machine has arrived on a multicast group since the last call
+	bool take_heard_on_group();
+
+private:
+	class datagram_receiver_impl;
+	datagram_receiver_impl& _d;
+
+	datagram_receiver(const datagram_receiver&) = delete;
+	datagram_receiver& operator=(const datagram_receiver&) = delete;
+};
+
+constexpr const char* broadcast_address = "255.255.255.255";
+constexpr const char* discovery_multicast_group = "239.255.67.1";	// for traffic that isn't tied to a session
+constexpr int multicast_ttl = 4;		// how many routers multicast datagrams are allowed to cross
+constexpr int multicast_peer_timeout = 3 * broadcast_cycle_max;	// in milliseconds, multicast senders broadcast too unless a peer was heard on a group this recently
+
+// the kind of payload a datagram carries
+enum class payload_type : unsigned char {
+	session_list = 1,
+	message_list,
+	user,
+	file_list,
+	review_list,
+	file_summary,
+	review_summary,
+	task_summary,
+	capacity,
+};
+
+// every datagram starts with a compact header so that receivers can discard datagrams meant for
+// other channels or sessions without decoding them:
+// [magic 'C' 'L' 'B'] [version] [payload type] [session hash, 8 bytes little endian, 0 if not tied to a session]
+// the header can't be mistaken for the start of a headerless (base64) datagram from an earlier release
+// the version is that of the whole datagram protocol, bumped whenever the payloads change in a way that
+// earlier nodes can't read; datagrams without a header or with a different version are discarded (see the readme)
+// version 2: files and reviews are announced as merkle summaries and messages carry a hybrid logical clock
+constexpr unsigned char datagram_header_version = 2;
+constexpr size_t datagram_header_size = 13;
+
+// 64-bit fnv-1a hash, for when every node has to compute the same hash (std::hash won't do)
+unsigned long long fnv1a_hash(const std::string& data);
+
+// fnv-1a hash of a session's unique id, 0 for an empty id
+unsigned long long session_hash(const std::string& session_unique_id);
+
+// put the header in front of the payload
+std::string add_datagram_header(payload_type type, const std::string& session_unique_id, const std::string& payload);
+
+// get the payload type from the datagram's header, returns false if it has no header or a different version
+bool peek_datagram_type(const std::string& datagram, payload_type& type);
+
+// check the datagram's header and strip it, leaving just the payload
+// returns false if the datagram has no header, a different version, or is for a different channel or session
+bool strip_datagram_header(std::string& datagram, payload_type type, const std::string& session_unique_id);
+
+// get the multicast group for the given session, or the discovery group if the session is empty
+// sessions are spread across 239.255.68.0 - 239.255.127.255 (administratively scoped)
+std::string session_multicast_group(const std::string& session_unique_id);
+
+// sends udp datagrams to a broadcast address or to a multicast group
+class datagram_sender {
+public:
+	datagram_sender(unsigned short port);
+	~datagram_sender();
+
+	bool send(const std::string& datagram, const std::string& address, std::string& error);
+
+private:
+	class datagram_sender_impl;
+	datagram_sender_impl& _d;
+
+	datagram_sender(const datagram_sender&) = delete;
+	datagram_sender& operator=(const datagram_sender&) = delete;
+};
+
+// the channel a payload type is sent on, e.g. "files" for both file lists and file summaries
+std::string channel_name(payload_type type);
+
+constexpr int metric_histogram_buckets = 32;	// bucket i holds durations under 2^i microseconds, the last one the rest
+
+// metrics are updated with relaxed atomics only, so that any thread can update them without waiting
+class metric_counter {
+public:
+	void add(unsigned long long count = 1) { _value.fetch_add(count, std::memory_order_relaxed); }
+	unsigned long long value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<unsigned long long> _value{ 0 };
+};
+
+class metric_gauge {
+public:
+	void set(long long value) { _value.store(value, std::memory_order_relaxed); }
+	long long value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<long long> _value{ 0 };
+};
+
+class metric_histogram {
+public:
+	void record(const std::chrono::steady_clock::duration& duration);
+	void snapshot(collab::metrics::histogram& histogram) const;
+
+private:
+	std::array<std::atomic<unsigned long long>, metric_histogram_buckets> _buckets{};
+	std::atomic<unsigned long long> _count{ 0 };
+	std::atomic<unsigned long long> _total{ 0 };	// in microseconds
+	std::atomic<unsigned long long> _max{ 0 };		// in microseconds
+};
+
+// metrics are made the first time they are asked for and live as long as the registry, so
+// references to them can be kept; looking up a metric that already exists only takes a shared lock
+class metrics_registry {
+public:
+	metrics_registry();
+
+	// tells registries apart, unlike their address, which a later registry may reuse
+	unsigned long long serial() const { return _serial; }
+
+	metric_counter& counter(const std::string& name);
+	metric_gauge& gauge(const std::string& name);
+	metric_histogram& histogram(const std::string& name);
+
+	void snapshot(collab::metrics& snapshot);
+
+private:
+	const unsigned long long _serial;
+	std::shared_mutex _mutex;
+	std::map<std::string, std::unique_ptr<metric_counter>> _counters;
+	std::map<std::string, std::unique_ptr<metric_gauge>> _gauges;
+	std::map<std::string, std::unique_ptr<metric_histogram>> _histograms;
+};
+
+// records the time from its construction to its destruction in the histogram
+class scoped_timer {
+public:
+	scoped_timer(metric_histogram& histogram) :
+		_histogram(histogram),
+		_start(std::chrono::steady_clock::now()) {}
+	~scoped_timer() { _histogram.record(std::chrono::steady_clock::now() - _start); }
+
+private:
+	metric_histogram& _histogram;
+	const std::chrono::steady_clock::time_point _start;
+
+	scoped_timer(const scoped_timer&) = delete;
+	scoped_timer& operator=(const scoped_timer&) = delete;
+};
+
+// the metrics of a datagram channel, looked up once so that sending and receiving only update atomics
+struct channel_metrics {
+	channel_metrics(metrics_registry& metrics, const std::string& channel);
+
+	metric_counter& datagrams_sent;
+	metric_counter& datagram_bytes_sent;
+	metric_counter& datagrams_received;
+	metric_counter& datagram_bytes_received;
+	metric_counter& datagrams_dropped;
+	metric_counter& deserialize_failures;
+	metric_gauge& datagram_batch;
+};
+
+// the latency histograms of the database calls, looked up once
+struct database_metrics {
+	database_metrics(metrics_registry& metrics);
+
+	metric_histogram& create_session;
+	metric_histogram& get_sessions;
+	metric_histogram& get_user;
+	metric_histogram& create_message;
+	metric_histogram& get_messages;
+	metric_histogram& get_latest_messages;
+	metric_histogram& get_messages_after;
+	metric_histogram& create_file;
+	metric_histogram& get_files;
+	metric_histogram& get_file;
+	metric_histogram& create_review;
+	metric_histogram& get_reviews;
+	metric_histogram& get_review;
+	metric_histogram& search;
+};
+
+// make a json string, quotes included
+std::string json_string(const std::string& value);
+
+// count bytes transferred over tcp, both in total and for the peer, direction is "sent" or "received"
+// each thread keeps the counters of the peer it last counted, so a run of transfers with the same
+// peer, e.g. the chunks of a file, only updates atomics
+void count_transfer(metrics_registry& metrics, const std::string& direction, const std::string& peer,
+	unsigned long long bytes);
+
+// every event collab logs, see log_event_formats for their levels and text
+// the binary log file stores these ids, so new events are only ever added at the end
+enum class log_event : unsigned short {
+	upgrading_table,
+	receiver_start_failed,
+	receiver_join_failed,
+	source_started,
+	source_stopped,
+	source_start_failed,
+	sink_unavailable,
+	tree_lookup_failed,
+	user_found,
+	user_edited,
+	user_edit_failed,
+	user_saved,
+	user_save_failed,
+	session_received,
+	temporary_session_saved,
+	temporary_session_failed,
+	session_save_failed,
+	message_received,
+	message_saved,
+	message_save_failed,
+	file_found,
+	file_already_downloaded,
+	file_saved,
+	file_save_failed,
+	file_download_connected,
+	file_download_cancelled,
+	file_download_failed,
+	file_download_progress,
+	file_download_compressed,
+	file_hash_failed,
+	file_hash_matched,
+	file_hash_mismatch,
+	file_connection_failed,
+	review_found,
+	review_download_connected,
+	review_download_failed,
+	review_connection_failed,
+	review_saved,
+	review_save_failed,
+	search_index_unavailable,
+	search_index_building,
+	search_index_failed,
+	task_submitted,
+	task_started,
+	task_completed,
+	task_failed,
+	task_requeued,
+	task_request_failed,
+};
+
+constexpr size_t log_record_max_args = 4;
+constexpr size_t log_arg_max_length = 119;	// longer text arguments are cut short
+constexpr size_t log_ring_capacity = 1024;	// events waiting to be written out, the oldest are dropped beyond this
+
+// a log event's argument, kept raw until the event is written out
+struct log_arg {
+	enum class kind : unsigned char { text, integer, size };
+
+	kind type = kind::text;
+	unsigned char length = 0;
+	char text[log_arg_max_length];
+	long long integer = 0;
+};
+
+// a size in bytes, written out like "1.5MB"
+struct log_size {
+	unsigned long long bytes;
+};
+
+// a unique id, written out shortened
+struct log_id {
+	const std::string& unique_id;
+};
+
+inline void set_log_arg(log_arg& arg, const char* text, size_t length) {
+	arg.type = log_arg::kind::text;
+	arg.length = static_cast<unsigned char>((std::min)(length, log_arg_max_length));
+	memcpy(arg.text, text, arg.length);
+}
+
+inline void set_log_arg(log_arg& arg, const std::string& text) { set_log_arg(arg, text.data(), text.length()); }
+inline void set_log_arg(log_arg& arg, const char* text) { set_log_arg(arg, text, strlen(text)); }
+inline void set_log_arg(log_arg& arg, const log_id& id) { set_log_arg(arg, id.unique_id.data(), (std::min)(id.unique_id.length(), size_t(8))); }
+inline void set_log_arg(log_arg& arg, const log_size& size) { arg.type = log_arg::kind::size; arg.integer = static_cast<long long>(size.bytes); }
+
+template <typename integer_type, typename = std::enable_if_t<std::is_integral_v<integer_type>>>
+inline void set_log_arg(log_arg& arg, integer_type value) { arg.type = log_arg::kind::integer; arg.integer = static_cast<long long>(value); }
+
+// a log event as it waits in the ring
+struct log_record {
+	long long time = 0;	// milliseconds since the epoch
+	log_event event = log_event::upgrading_table;
+	unsigned char arg_count = 0;
+	std::array<log_arg, log_record_max_args> args;
+};
+
+// make the text of a log event, without its time and level
+std::string format_log_record(const log_record& record);
+
+// the level of a log event
+collab::log_level log_event_level(log_event event);
+
+// logs events without holding up the threads that raise them
+// an event is copied into a preallocated ring as an id and raw arguments; a background thread
+// makes the text and passes it to the log function, and writes the raw record to the log file
+class async_logger {
+public:
+	async_logger();
+	~async_logger();
+
+	void set_log(std::function<void(const std::string& event)> log);
+	void set_level(collab::log_level level);
+	bool set_file(const std::string& full_path, unsigned long long max_size, int max_files, std::string& error);
+	unsigned long long dropped();
+
+	template <typename... arguments>
+	void operator()(log_event event, const arguments&... args) {
+		static_assert(sizeof...(args) <= log_record_max_args, "Too many log event arguments");
+
+		if (log_event_level(event) < _level.load(std::memory_order_relaxed))
+			return;
+
+		const long long time = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto& record = next_record();
+			record.time = time;
+			record.event = event;
+			record.arg_count = static_cast<unsigned char>(sizeof...(args));
+
+			size_t i = 0;
+			(set_log_arg(record.args[i++], args), ...);
+		}
+
+		_cv.notify_one();
+	}
+
+private:
+	// the slot for a new record, making room by dropping the oldest one if the ring is full
+	// to be called with _mutex held
+	log_record& next_record();
+
+	void writer_func();
+	void write_out(const log_record& record);
+	void rotate_file();
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::vector<log_record> _ring;
+	size_t _first = 0;	// the oldest record in the ring
+	size_t _count = 0;
+	bool _stop = false;
+	unsigned long long _dropped = 0;
+
+	std::atomic<collab::log_level> _level{ collab::log_level::debug };
+
+	// the log function and the log file are only used by the writer thread, and by the setters
+	std::mutex _output_mutex;
+	std::function<void(const std::string& event)> _log;
+	std::ofstream _file;
+	std::string _file_path;
+	unsigned long long _file_max_size = 0;
+	unsigned long long _file_size = 0;
+	int _file_max_count = 0;
+
+	std::thread _writer;
+};
+
+// sent on the file channel by the nodes in a session that have tasks or task workers, so that idle
+// workers know where to find work, and submitters know which of their tasks are still being run
+struct task_summary_structure {
+	std::string source_node_unique_id;
+	std::string session_id;
+	std::vector<std::string> ips;
+	unsigned short transfer_port = FILE_TRANSFER_PORT;	// the first of the source node's tcp ports
+	int queued = 0;			// the tasks waiting on the node for a worker
+	int idle_workers = 0;	// the node's task workers with nothing to do
+	std::vector<std::string> running;	// the tasks the node's workers are running
+};
+
+bool serialize_task_summary_structure(const task_summary_structure& cls,
+	std::string& serialized, std::string& error);
+bool deserialize_task_summary_structure(const std::string& serialized,
+	task_summary_structure& cls, std::string& error);
+
+// a task handed to a worker, with the details of its inputs so that the worker can fetch them
+struct task_assignment_structure {
+	collab::task task;
+	std::vector<collab::file> inputs;
+};
+
+bool serialize_task_assignment_structure(const task_assignment_structure& cls,
+	std::string& serialized, std::string& error);
+bool deserialize_task_assignment_structure(const std::string& serialized,
+	task_assignment_structure& cls, std::string& error);
+
+// requests made to the file source of the node a task was submitted from
+// a steal request lists the programs the worker's node allows, and is answered with a serialized
+// task_assignment_structure for a task that runs one of them, or nothing if there is no such task
+std::string make_task_steal_request(const std::string& session_unique_id, const std::string& worker_unique_id,
+	const std::vector<std::string>& programs);
+std::string make_task_done_request(const std::string& worker_unique_id, const collab::task_status& outcome);
+
+// hand back a task the worker took but can't run, it goes back in the queue
+std::string make_task_release_request(const std::string& worker_unique_id, const std::string& task_unique_id);
+bool is_task_request(const std::string& request);
+
+// a peer's task summary, as last received
+struct task_peer {
+	std::string session_id;
+	std::vector<std::string> ips;
+	unsigned short transfer_port = FILE_TRANSFER_PORT;
+	int queued = 0;
+	int idle_workers = 0;
+	std::set<std::string> running;
+	std::chrono::steady_clock::time_point last_seen;
+};
+
+// the tasks submitted from this node
+// this node's workers take queued tasks from the front of the queue, peers take them from the back
+// (work stealing), so a node works through its own tasks in order while idle peers take the ones
+// that would otherwise wait the longest
+class task_board {
+public:
+	void submit(const collab::task& task, const std::vector<collab::file>& inputs);
+
+	// whether the worker's node can run the task, tasks it can't run are left in the queue for others
+	using task_filter = std::function<bool(const collab::task& task)>;
+
+	// take the oldest queued task that can be run, for one of this node's workers
+	bool take_oldest(const std::string& worker_unique_id, const task_filter& can_run,
+		task_assignment_structure& assignment);
+
+	// take the newest queued task in the session that can be run, for a peer's worker
+	// the worker's address is recorded, only reports from it are accepted for the task
+	bool take_newest(const std::string& session_unique_id, const std::string& worker_unique_id,
+		const std::string& worker_address, const task_filter& can_run, task_assignment_structure& assignment);
+
+	// record the outcome of a task, as reported by the worker that ran it
+	// the worker address is empty for this node's workers, false if the report isn't from the task's worker
+	bool finish(const std::string& worker_unique_id, const std::string& worker_address,
+		const collab::task_status& outcome);
+
+	// put a task the worker took, but couldn't run, back in the queue
+	bool release(const std::string& worker_unique_id, const std::string& worker_address,
+		const std::string& task_unique_id);
+
+	// put tasks whose workers are lost back in the queue, lost is asked about every running task
+	void requeue(const std::function<bool(const std::string& worker_unique_id, const std::string& task_unique_id,
+		const std::chrono::steady_clock::time_point& taken)>& lost);
+
+	int queued(const std::string& session_unique_id);
+	void statuses(const std::string& session_unique_id, std::vector<collab::task_status>& tasks);
+
+	// answer a task request that came in over tcp from the source address
+	std::string answer(const std::string& request, const std::string& source_address);
+
+private:
+	struct entry {
+		collab::task_status status;
+		std::vector<collab::file> inputs;
+		std::string worker_address;	// where the worker took the task from, empty for this node's workers
+		std::chrono::steady_clock::time_point taken;
+	};
+
+	void take(entry& task, const std::string& worker_unique_id, const std::string& worker_address,
+		task_assignment_structure& assignment);
+
+	std::mutex _mutex;
+	std::map<std::string, entry> _tasks;
+	std::deque<std::string> _queue;		// the queued tasks, oldest first
+	std::vector<std::string> _submitted;	// all the tasks, in the order they were submitted
+};
+
+bool serialize_capacity_structure(const collab::node_capacity& cls,
+	std::string& serialized, std::string& error);
+bool deserialize_capacity_structure(const std::string& serialized,
+	collab::node_capacity& cls, std::string& error);
+
+// round the figures off, so that small changes don't count as changes to the advertised state
+collab::node_capacity quantize_capacity(const collab::node_capacity& capacity);
+
+// how well a node can serve data, roughly the link speed left after the cpu load
+double capacity_score(const collab::node_capacity& capacity);
+
+// samples this node's capacity, reusing the last sample if it is recent enough
+class capacity_sampler {
+public:
+	collab::node_capacity sample(const std::string& unique_id, const std::string& folder);
+
+private:
+	std::mutex _mutex;
+	collab::node_capacity _last;
+	std::chrono::steady_clock::time_point _sampled;
+	bool _has_sample = false;
+
+	// the system times at the last sample, the load is worked out from the difference
+	unsigned long long _idle_time = 0;
+	unsigned long long _busy_time = 0;
+};
+
+// a peer's capacity, as last advertised
+struct peer_capacity {
+	collab::node_capacity capacity;
+	std::chrono::steady_clock::time_point last_seen;
+};
+
+constexpr size_t trace_span_capacity = 8192;	// the oldest spans are dropped beyond this
+
+// the wall clock in microseconds since the epoch, spans recorded on different nodes are compared by it
+long long trace_clock_now();
+
+// keeps the most recent trace spans recorded by this node
+class tracer {
+public:
+	tracer(const std::string& node_id) :
+		_node_id(node_id) {}
+
+	void record(const std::string& item_id, const char* name, long long start_us, long long duration_us,
+		const std::string& detail = std::string());
+
+	// record a point in time
+	void mark(const std::string& item_id, const char* name, const std::string& detail = std::string()) {
+		record(item_id, name, trace_clock_now(), 0, detail);
+	}
+
+	void snapshot(std::vector<collab::trace_span>& spans);
+
+private:
+	const std::string& _node_id;
+	std::mutex _mutex;
+	std::deque<collab::trace_span> _spans;
+};
+
+// records a span from its construction to its destruction
+class scoped_trace {
+public:
+	scoped_trace(tracer& tracer, const std::string& item_id, const char* name) :
+		_tracer(tracer),
+		_item_id(item_id),
+		_name(name),
+		_start_us(trace_clock_now()),
+		_start(std::chrono::steady_clock::now()) {}
+	~scoped_trace() {
+		_tracer.record(_item_id, _name, _start_us, std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - _start).count());
+	}
+
+private:
+	tracer& _tracer;
+	const std::string& _item_id;
+	const char* _name;
+	const long long _start_us;
+	const std::chrono::steady_clock::time_point _start;
+
+	scoped_trace(const scoped_trace&) = delete;
+	scoped_trace& operator=(const scoped_trace&) = delete;
+};
+
+// decides when a broadcast sender should broadcast
+// the interval between broadcasts doubles each time the state being broadcast is found unchanged,
+// up to broadcast_cycle_max, and drops back to broadcast_cycle_min as soon as the state changes or
+// the cadence is kicked; intervals are jittered so that nodes don't end up broadcasting in lockstep
+class broadcast_cadence {
+public:
+	broadcast_cadence(stop_signal& stop);
+	~broadcast_cadence() = default;
+
+	// check whether the given state (the serialized broadcast) should be broadcast now
+	// if it returns true the caller is expected to broadcast, and the next broadcast is scheduled
+	bool due(const std::string& state);
+
+	// the time left until the next scheduled broadcast
+	std::chrono::milliseconds time_to_next();
+
+	// broadcast at the earliest opportunity, e.g. after a local change or when a peer is found to be behind
+	void kick();
+
+	// broadcast within broadcast_cycle_min, e.g. when a peer's summary differs from ours
+	// unlike a kick this doesn't broadcast straight away, so two nodes that keep differing don't
+	// end up answering each other's broadcasts back and forth
+	void hurry();
+
+	// a change has just been announced separately, so the next state is taken as already broadcast
+	// and the regular broadcast only follows after the short interval, to repair any losses
+	void announced();
+
+private:
+	stop_signal& _stop;
+	std::mutex _mutex;
+	size_t _digest = 0;
+	bool _kicked = false;
+	bool _announced = false;
+	std::chrono::milliseconds _interval{ broadcast_cycle_min };
+	std::chrono::steady_clock::time_point _next_broadcast;
+};
+
+// a look into a peer's file or review tree, waiting in the download queue
+struct merkle_descent {
+	payload_type channel = payload_type::file_summary;	// file_summary or review_summary
+	merkle_summary_structure summary;
+};
+
+// a file waiting in the download queue
+struct file_download {
+	collab::file file;
+	std::string address;	// the ip address of the source to download from
+	unsigned short port = FILE_TRANSFER_PORT;	// the port of the source's file transfer server
+	std::string source_unique_id;	// the unique id of the source, if known
+	long long ticket = 0;	// the transfer scheduler ticket
+	long long queued_us = 0;	// when the download was queued, see trace_clock_now
+};
+
+struct review_fetch {
+	review_header_structure header;
+	std::vector<std::string> ips;	// the ip addresses of the source
+	unsigned short transfer_port = FILE_TRANSFER_PORT;	// the first of the source's tcp ports
+};
+
+// runs background work on a fixed set of threads, one per core
+// every thread has a queue of its own for each priority. Work posted from one of the threads goes on
+// that thread's queue, other work is spread across the queues. A thread takes the newest work from its
+// own queue and, once that is empty, steals the oldest work of the same priority from the other threads,
+// before moving on to the next priority. Idle threads sleep until work is posted.
+// it runs the cpu work that comes in bursts: the import and export read-ahead and hashing, the *_async
+// calls and collab::run_async. Work that spends its time blocked on sockets or on a remote source (the
+// broadcast threads, file downloads, review fetches and merkle descents) stays on threads of its own, so
+// that it can't take the pool's threads away from the cpu work
+class executor {
+public:
+	executor();
+	~executor();
+
+	void post(collab::work_priority priority, std::function<void()> work);
+
+	template<class F>
+	auto submit(collab::work_priority priority, F work) -> std::future<decltype(work())> {
+		using result = decltype(work());
+		auto p_task = std::make_shared<std::packaged_task<result()>>(std::move(work));
+		auto future = p_task->get_future();
+		post(priority, [p_task]() { (*p_task)(); });
+		return future;
+	}
+
+	// wait for high priority work, running other high priority work in the meantime so that waiting
+	// on one of the executor's own threads can't hold up the work being waited on
+	template<class T>
+	T wait(std::future<T>& future) {
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			std::function<void()> work;
+
+			// nothing urgent is queued, so the work being waited on is already running
+			if (!take(collab::work_priority::high, work)) {
+				future.wait();
+				break;
+			}
+
+			work();
+		}
+
+		return future.get();
+	}
+
+	// run the work that is still queued and stop the threads, work posted afterwards is run by the caller
+	void stop();
+
+	size_t thread_count();
+
+private:
+	static constexpr size_t priority_count = 3;
+
+	struct worker_queues {
+		std::mutex mutex;
+		std::array<std::deque<std::function<void()>>, priority_count> queues;	// indexed by priority
+	};
+
+	// take the most urgent work, down to the given priority
+	bool take(collab::work_priority lowest, std::function<void()>& work);
+	void worker_func(size_t index);
+
+	std::vector<std::unique_ptr<worker_queues>> _queues;
+	std::vector<std::thread> _threads;
+	std::atomic<size_t> _next_queue{ 0 };
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	long long _pending = 0;		// the work posted and not yet taken
+	bool _stopping = false;
+};
+
 class collab::impl {
 	liblec::leccore::database::connection* _p_con;
 	collab& _collab;
@@ -156,17 +1253,87 @@ class collab::impl {
 	std::future<void> _file_broadcast_receiver;
 	std::future<void> _review_broadcast_sender;
 	std::future<void> _review_broadcast_receiver;
-	bool _stop_session_broadcast = false;
+	std::vector<std::future<void>> _file_download_workers;
 	std::string _cert_folder, _files_folder;
-	std::function<void(const std::string& event)> _log;
 
 public:
+	// logs events in the background, e.g. _log(log_event::file_saved, file.name, file.extension)
+	async_logger _log;
+
 	std::string _unique_id;
 
+	// the first of the udp ports and of the tcp ports used by this node, see collab::set_ports
+	unsigned short _broadcast_port = SESSION_BROADCAST_PORT;
+	unsigned short _transfer_port = FILE_TRANSFER_PORT;
+
 	std::string _current_session_unique_id;
 
-	// concurrency control related to the session broadcast thread
-	liblec::mutex _session_broadcast_mutex;
+	// signals the broadcast threads to stop, and wakes them up while they are taking a breath
+	stop_signal _stop;
+
+	// broadcast cadences, kicked whenever the respective local state changes
+	broadcast_cadence _session_cadence{ _stop };
+	broadcast_cadence _message_cadence{ _stop };
+	broadcast_cadence _user_cadence{ _stop };
+	broadcast_cadence _file_cadence{ _stop };
+	broadcast_cadence _review_cadence{ _stop };
+	broadcast_cadence _task_cadence{ _stop };
+	broadcast_cadence _capacity_cadence{ _stop };
+
+	// kick all broadcast cadences, e.g. when a peer (re)appears
+	void kick_broadcasts();
+
+	// the transport used by the broadcast senders, receivers listen on both
+	std::atomic<collab::transport> _transport{ collab::transport::broadcast };
+
+	// when a peer on another machine was last heard on a multicast group, in steady clock milliseconds
+	std::atomic<long long> _group_peer_heard{ 0 };
+
+	// whether a peer has been heard on a multicast group within multicast_peer_timeout
+	bool group_peers_heard();
+
+	// send a payload over the selected transport, to the group of the given session if multicast is selected
+	// the payload is sent with a header that identifies its type and session
+	// with multicast selected the payload is broadcast too, until peers are heard on a group, since a
+	// multicast send succeeds even where multicast isn't routed; it's also broadcast if the send fails
+	bool send_datagram(datagram_sender& sender, payload_type type, const std::string& payload,
+		const std::string& session_unique_id, std::string& error);
+
+	// counters, gauges and latency histograms, see collab::get_metrics
+	metrics_registry _metrics;
+
+	// the metrics of each datagram channel, see channel_metrics_for
+	channel_metrics _session_channel_metrics{ _metrics, "sessions" };
+	channel_metrics _message_channel_metrics{ _metrics, "messages" };
+	channel_metrics _user_channel_metrics{ _metrics, "users" };
+	channel_metrics _file_channel_metrics{ _metrics, "files" };
+	channel_metrics _review_channel_metrics{ _metrics, "reviews" };
+
+	// the metrics of the channel a payload type is sent on, see channel_name
+	channel_metrics& channel_metrics_for(payload_type type);
+
+	database_metrics _database_metrics{ _metrics };
+
+	// spans recorded as messages, files and reviews go through this node, see collab::get_trace
+	tracer _trace{ _unique_id };
+
+	// add the datagrams just taken from the receiver to the channel's metrics, along with any
+	// datagrams the receiver had to drop
+	void count_received_datagrams(payload_type channel, datagram_receiver& receiver,
+		const std::vector<std::string>& datagrams);
+
+	// count a datagram received on the channel that couldn't be deserialized
+	void count_deserialize_failure(payload_type channel);
+
+	// locally written messages waiting to be announced by the message broadcast sender
+	std::mutex _message_announcement_mutex;
+	std::vector<message> _message_announcements;
+
+	// incremented whenever a message is added to the local database
+	std::atomic<unsigned long long> _messages_revision{ 0 };
+
+	// timestamps messages written locally
+	hybrid_logical_clock _hlc;
 
 	// concurrency control related to the local database
 	liblec::mutex _database_mutex;
@@ -182,6 +1349,64 @@ public:
 	liblec::mutex _review_source_mutex;
 	bool _review_source_running = false;
 
+	// the reviews to fetch, taken one at a time by the review fetch worker so that a source is never
+	// asked for more than one review at once; the set of pending fetches covers both queued fetches and
+	// the fetch in progress, so that a review announced again meanwhile isn't fetched twice
+	std::mutex _review_fetch_mutex;
+	std::condition_variable _review_fetch_cv;
+	std::deque<review_fetch> _review_fetch_queue;
+	std::set<std::string> _pending_review_fetches;	// review unique ids
+	bool _stop_review_fetches = false;
+	std::future<void> _review_fetch_worker;
+
+	// the background work, see collab::run_async
+	executor _executor;
+
+	// schedules file and review downloads
+	transfer_scheduler _transfer_scheduler;
+
+	// concurrency control related to the download queue
+	// the set of pending downloads covers both queued downloads and downloads in progress
+	std::mutex _download_mutex;
+	std::condition_variable _download_cv;
+	std::vector<file_download> _download_queue;
+	std::set<std::string> _pending_downloads;	// file hashes
+
+	// looks into peers' trees, taken by the download workers ahead of downloads so that
+	// the receivers don't hold up listening on the round trips; one per peer and channel
+	std::vector<merkle_descent> _descent_queue;
+
+	// queue a look into the tree of the summary's source, replacing any older look into the same tree
+	void queue_merkle_descent(payload_type channel, const merkle_summary_structure& summary);
+
+	// the file and review trees of sessions, see merkle_cache
+	merkle_cache<collab::file> _file_trees;
+	merkle_cache<collab::review> _review_trees;
+	bool _stop_downloads = false;
+	int _download_worker_count = default_download_worker_count;
+
+	// tasks submitted from this node, see collab::submit_task
+	task_board _task_board;
+
+	// the latest task summaries of peers, keyed by their unique id
+	std::mutex _task_peer_mutex;
+	std::map<std::string, task_peer> _task_peers;
+
+	// the tasks this node's workers are running, for this node or for peers
+	std::mutex _running_tasks_mutex;
+	std::set<std::string> _running_tasks;
+	std::atomic<int> _idle_task_workers{ 0 };
+
+	// this node's capacity, and the latest capacity of peers keyed by their unique id
+	capacity_sampler _capacity_sampler;
+	std::mutex _capacity_mutex;
+	std::map<std::string, peer_capacity> _peer_capacities;
+
+	// see collab::set_task_workers
+	int _task_worker_count = 0;
+	std::vector<std::string> _task_programs;
+	std::vector<std::future<void>> _task_workers;
+
 	impl(collab& collab);
 	~impl();
 
@@ -192,6 +1417,23 @@ public:
 
 	std::optional<std::reference_wrapper<liblec::leccore::database::connection>> get_connection();
 
+	// create the message, file and review tables, migrating tables made by older versions
+	bool upgrade_database(std::string& error);
+
+	// whether the full-text search index is available, see create_search_index
+	bool _search_index_available = false;
+
+	// create the full-text search index and fill it with the existing messages and reviews, unless it exists already
+	// to be called with the database mutex locked
+	bool create_search_index(liblec::leccore::database::connection& con, std::string& error);
+
+	// add a message or review to the full-text search index, does nothing if the index isn't available
+	// to be called with the database mutex locked, after the item has been stored; failures are only
+	// logged since the item itself is already safely in the database
+	void add_to_search_index(liblec::leccore::database::connection& con, collab::search_hit::item_type type,
+		const std::string& unique_id, const std::string& session_unique_id, long long time,
+		const std::string& text);
+
 	static void session_broadcast_sender_func(impl* p_impl);
 	static void session_broadcast_receiver_func(impl* p_impl);
 
@@ -207,6 +1449,66 @@ public:
 	static void review_broadcast_sender_func(impl* p_impl);
 	static void review_broadcast_receiver_func(impl* p_impl);
 
+	static void file_download_worker_func(impl* p_impl);
+	static bool download_file(impl* p_impl, const file_download& download);
+
+	// queue a file for download, returns false if the file is already queued or being downloaded
+	// if the file is already queued, the download moves to this source if it has a lot more capacity
+	bool queue_file_download(const file& file, const std::vector<std::string>& ips, unsigned short transfer_port,
+		const std::string& source_unique_id = std::string());
+
+	// add the files in the list that are missing in the current session, downloading them if necessary
+	static void receive_file_list(impl* p_impl, const file_broadcast_structure& cls,
+		const std::string& current_session_unique_id);
+
+	// download the reviews in the list that are missing in the current session
+	static void receive_review_list(impl* p_impl, const review_broadcast_structure& cls,
+		const std::string& current_session_unique_id);
+
+	// fetch the queued reviews, blocking network work is kept off the executor
+	static void review_fetch_worker_func(impl* p_impl);
+
+	// download a review's text from its source and add the review to the local database
+	static void fetch_review(impl* p_impl, const review_header_structure& header,
+		const std::vector<std::string>& ips, unsigned short transfer_port);
+
+	// connect to the source of the summary and look into the nodes of its tree that differ from the local tree
+	// the serialized items of the differing leaves are returned, for the channel to deserialize
+	static bool descend_merkle_tree(impl* p_impl, const merkle_summary_structure& summary,
+		unsigned short port, int magic_number, const merkle_tree& local,
+		std::vector<std::string>& leaves, std::string& error);
+
+	// run a queued look into a peer's tree, and receive the items that differ
+	static void run_merkle_descent(impl* p_impl, const merkle_descent& descent);
+
+	static void task_worker_func(impl* p_impl);
+
+	// take a queued task from the peer in the current session with the most of them
+	static bool steal_task(impl* p_impl, task_assignment_structure& assignment, task_peer& submitter);
+
+	// fetch a task's inputs, run it and share its result
+	// p_submitter is the peer the task came from, nullptr if it was submitted from this node
+	// the outcome is left queued if this node can't run the task, for it to be handed back
+	static collab::task_status run_task(impl* p_impl, const task_assignment_structure& assignment,
+		const task_peer* p_submitter);
+
+	// make a task request to a peer's file source
+	static bool send_task_request(impl* p_impl, const task_peer& peer, const std::string& request,
+		std::string& reply, std::string& error);
+
+	// the serialized task summary to broadcast in the session, empty if this node has nothing to say
+	std::string make_task_summary(const std::string& session_unique_id);
+	void receive_task_summary(const task_summary_structure& summary);
+
+	// put tasks whose workers have gone away back in the queue
+	void requeue_lost_tasks();
+
+	void receive_capacity(const collab::node_capacity& capacity);
+	bool get_peer_capacity(const std::string& unique_id, collab::node_capacity& capacity);
+
+	// whether this node is too loaded to take on work for peers
+	bool busy();
+
 	bool file_source_running();
 	bool review_source_running();
 };
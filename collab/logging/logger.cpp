@@ -0,0 +1,434 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../collab.h"
+#include "../impl.h"
+
+// STL
+#include <filesystem>
+#include <iomanip>
+#include <ctime>
+
+namespace {
+	struct log_event_format {
+		log_event event;
+		collab::log_level level;
+		const char* text;	// {0} to {3} are replaced with the arguments
+	};
+
+	using level = collab::log_level;
+
+	// in the same order as log_event
+	const log_event_format log_event_formats[] = {
+		{ log_event::upgrading_table, level::info, "Upgrading {0} table" },
+		{ log_event::receiver_start_failed, level::error, "Error: {0} receiver failed to start: {1}" },
+		{ log_event::receiver_join_failed, level::error, "Error: {0} receiver failed to join multicast group: {1}" },
+		{ log_event::source_started, level::info, "{0} source started" },
+		{ log_event::source_stopped, level::error, "Error: {0} source stopped" },
+		{ log_event::source_start_failed, level::error, "Error: {0} source failed to start" },
+		{ log_event::sink_unavailable, level::error, "Error: sink file not available. No {0} will be received." },
+		{ log_event::tree_lookup_failed, level::warning, "Error looking into {0} list of {1}: {2}" },
+		{ log_event::user_found, level::info, "New user found (UDP): {0} '{1}' (unique id: {2})" },
+		{ log_event::user_edited, level::info, "Editing user: '{0}' successful" },
+		{ log_event::user_edit_failed, level::error, "Error editing user: '{0}': {1}" },
+		{ log_event::user_saved, level::info, "Saving user: '{0}' successful" },
+		{ log_event::user_save_failed, level::error, "Error saving user: '{0}': {1}" },
+		{ log_event::session_received, level::info, "Session received (UDP): '{0}' (source node: {1})" },
+		{ log_event::temporary_session_saved, level::debug, "Temporary session entry successful for '{0}'" },
+		{ log_event::temporary_session_failed, level::error, "Creating temporary session entry for '{0}' failed: {1}" },
+		{ log_event::session_save_failed, level::error, "Creating session '{0}' failed: {1}" },
+		{ log_event::message_received, level::info, "Message received (UDP): {0} (source node: {1})" },
+		{ log_event::message_saved, level::debug, "Message '{0}' saved successfully" },
+		{ log_event::message_save_failed, level::error, "Creating message '{0}' failed: {1}" },
+		{ log_event::file_found, level::info, "New file found (UDP): '{0}{1}' (source node: {2})" },
+		{ log_event::file_already_downloaded, level::info, "File '{0}{1}' already downloaded as '{2}' in another session" },
+		{ log_event::file_saved, level::info, "File '{0}{1}' entry saved successfully" },
+		{ log_event::file_save_failed, level::error, "Entry failed for '{0}{1}': {2}" },
+		{ log_event::file_download_connected, level::debug, "Connected via TCP to {0} to download '{1}{2}' ({3})" },
+		{ log_event::file_download_cancelled, level::warning, "Download of '{0}{1}' cancelled" },
+		{ log_event::file_download_failed, level::error, "Error downloading '{0}{1}': {2}" },
+		{ log_event::file_download_progress, level::debug, "File '{0}{1}' download: {2}%" },
+		{ log_event::file_download_compressed, level::debug, "File '{0}{1}' transferred as {2} using {3} compression" },
+		{ log_event::file_hash_failed, level::error, "Error hashing '{0}{1}'" },
+		{ log_event::file_hash_matched, level::debug, "Hash match for file '{0}{1}'" },
+		{ log_event::file_hash_mismatch, level::error, "Hash mis-match for file '{0}{1}': obtained {2} instead of {3}" },
+		{ log_event::file_connection_failed, level::error, "TCP connection for downloading '{0}{1}' from {2} failed: {3}" },
+		{ log_event::review_found, level::info, "New review found (UDP): '{0}' (source node: {1})" },
+		{ log_event::review_download_connected, level::debug, "Connected via TCP to {0} to download review '{1}'" },
+		{ log_event::review_download_failed, level::error, "Error downloading review '{0}': {1}" },
+		{ log_event::review_connection_failed, level::error, "TCP connection for downloading review '{0}' from {1} failed: {2}" },
+		{ log_event::review_saved, level::debug, "Review '{0}' saved successfully" },
+		{ log_event::review_save_failed, level::error, "Entry failed for review '{0}': {1}" },
+		{ log_event::search_index_unavailable, level::warning, "Full-text search index not available: {0}" },
+		{ log_event::search_index_building, level::info, "Building full-text search index" },
+		{ log_event::search_index_failed, level::error, "Error: indexing {0} {1} failed: {2}" },
+		{ log_event::task_submitted, level::info, "Task '{0}' submitted" },
+		{ log_event::task_started, level::info, "Running task '{0}' for {1}" },
+		{ log_event::task_completed, level::info, "Task '{0}' completed" },
+		{ log_event::task_failed, level::error, "Task '{0}' failed: {1}" },
+		{ log_event::task_requeued, level::warning, "Task {0} requeued, worker {1} lost" },
+		{ log_event::task_request_failed, level::error, "Error: task request to {0} failed: {1}" },
+	};
+
+	constexpr size_t log_event_count = sizeof(log_event_formats) / sizeof(log_event_formats[0]);
+	static_assert(log_event_count == static_cast<size_t>(log_event::task_request_failed) + 1,
+		"Every log event needs a format");
+
+	// the binary log file starts with the magic and the format version, followed by the records
+	const std::string log_file_magic = "CLOG";
+	constexpr unsigned char log_file_version = 1;
+
+	// each record is: time (8 bytes), event (2), argument count (1), then for each argument its
+	// kind (1) and either the text length (1) and the text, or an integer (8)
+	void append_log_record(std::string& buffer, const log_record& record) {
+		auto append = [&buffer](const void* data, size_t length) {
+			buffer.append(static_cast<const char*>(data), length);
+		};
+
+		const auto event = static_cast<unsigned short>(record.event);
+		append(&record.time, sizeof(record.time));
+		append(&event, sizeof(event));
+		append(&record.arg_count, sizeof(record.arg_count));
+
+		for (size_t i = 0; i < record.arg_count; i++) {
+			const auto& arg = record.args[i];
+			append(&arg.type, sizeof(arg.type));
+
+			if (arg.type == log_arg::kind::text) {
+				append(&arg.length, sizeof(arg.length));
+				append(arg.text, arg.length);
+			}
+			else
+				append(&arg.integer, sizeof(arg.integer));
+		}
+	}
+
+	bool read_log_record(std::istream& stream, log_record& record) {
+		auto read = [&stream](void* data, size_t length) {
+			return static_cast<bool>(stream.read(static_cast<char*>(data), length));
+		};
+
+		unsigned short event = 0;
+		if (!read(&record.time, sizeof(record.time)) ||
+			!read(&event, sizeof(event)) ||
+			!read(&record.arg_count, sizeof(record.arg_count)) ||
+			event >= log_event_count || record.arg_count > log_record_max_args)
+			return false;
+
+		record.event = static_cast<log_event>(event);
+
+		for (size_t i = 0; i < record.arg_count; i++) {
+			auto& arg = record.args[i];
+
+			if (!read(&arg.type, sizeof(arg.type)))
+				return false;
+
+			if (arg.type == log_arg::kind::text) {
+				if (!read(&arg.length, sizeof(arg.length)) || arg.length > log_arg_max_length ||
+					!read(arg.text, arg.length))
+					return false;
+			}
+			else
+				if (!read(&arg.integer, sizeof(arg.integer)))
+					return false;
+		}
+
+		return true;
+	}
+
+	std::string log_level_name(collab::log_level log_level) {
+		switch (log_level) {
+		case level::debug: return "debug";
+		case level::info: return "info";
+		case level::warning: return "warning";
+		case level::error: return "error";
+		default: return "unknown";
+		}
+	}
+}
+
+collab::log_level log_event_level(log_event event) {
+	const auto index = static_cast<size_t>(event);
+	return index < log_event_count ? log_event_formats[index].level : collab::log_level::error;
+}
+
+std::string format_log_record(const log_record& record) {
+	const auto index = static_cast<size_t>(record.event);
+	if (index >= log_event_count)
+		return "Unknown event " + std::to_string(index);
+
+	const std::string format = log_event_formats[index].text;
+
+	std::string text;
+	text.reserve(format.length() + record.arg_count * 16);
+
+	for (size_t i = 0; i < format.length(); i++) {
+		// a placeholder is a digit in braces
+		if (format[i] == '{' && i + 2 < format.length() && format[i + 2] == '}' &&
+			format[i + 1] >= '0' && format[i + 1] <= '9') {
+			const size_t arg_index = format[i + 1] - '0';
+			i += 2;
+
+			if (arg_index >= record.arg_count)
+				continue;
+
+			const auto& arg = record.args[arg_index];
+
+			switch (arg.type) {
+			case log_arg::kind::text: text.append(arg.text, arg.length); break;
+			case log_arg::kind::integer: text += std::to_string(arg.integer); break;
+			case log_arg::kind::size: text += liblec::leccore::format_size(static_cast<unsigned long long>(arg.integer)); break;
+			default: break;
+			}
+		}
+		else
+			text += format[i];
+	}
+
+	return text;
+}
+
+async_logger::async_logger() :
+	_ring(log_ring_capacity),
+	_writer(&async_logger::writer_func, this) {}
+
+async_logger::~async_logger() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+
+	_cv.notify_one();
+	_writer.join();
+}
+
+void async_logger::set_log(std::function<void(const std::string& event)> log) {
+	std::lock_guard<std::mutex> lock(_output_mutex);
+	_log = log;
+}
+
+void async_logger::set_level(collab::log_level level) {
+	_level = level;
+}
+
+bool async_logger::set_file(const std::string& full_path, unsigned long long max_size, int max_files,
+	std::string& error) {
+	std::lock_guard<std::mutex> lock(_output_mutex);
+
+	if (_file.is_open())
+		_file.close();
+
+	_file_path = full_path;
+	_file_max_size = max_size;
+	_file_max_count = (std::max)(max_files, 0);
+	_file_size = 0;
+
+	if (full_path.empty())
+		return true;
+
+	try {
+		_file.open(full_path, std::ios::out | std::ios::app | std::ios::binary);
+
+		if (!_file) {
+			error = "Cannot open '" + full_path + "' for writing";
+			_file_path.clear();
+			return false;
+		}
+
+		_file_size = std::filesystem::file_size(full_path);
+
+		if (_file_size == 0) {
+			_file.write(log_file_magic.data(), log_file_magic.length());
+			_file.put(static_cast<char>(log_file_version));
+			_file_size = log_file_magic.length() + 1;
+		}
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		_file.close();
+		_file_path.clear();
+		return false;
+	}
+
+	return true;
+}
+
+unsigned long long async_logger::dropped() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _dropped;
+}
+
+log_record& async_logger::next_record() {
+	if (_count == _ring.size()) {
+		// full ... drop the oldest record
+		_first = (_first + 1) % _ring.size();
+		_count--;
+		_dropped++;
+	}
+
+	return _ring[(_first + _count++) % _ring.size()];
+}
+
+void async_logger::writer_func() {
+	// records are copied out of the ring in batches so the ring isn't locked while they're written out
+	std::vector<log_record> batch;
+	batch.reserve(_ring.size());
+
+	while (true) {
+		bool stop = false;
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv.wait(lock, [this]() { return _stop || _count > 0; });
+
+			for (; _count > 0; _count--) {
+				batch.push_back(_ring[_first]);
+				_first = (_first + 1) % _ring.size();
+			}
+
+			stop = _stop;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_output_mutex);
+
+			// events still waiting when the logger is being destroyed only go to the log file,
+			// the owner of the log function may already be gone
+			if (stop)
+				_log = nullptr;
+
+			for (const auto& record : batch)
+				write_out(record);
+
+			if (_file.is_open())
+				_file.flush();
+		}
+
+		batch.clear();
+
+		if (stop)
+			break;
+	}
+}
+
+void async_logger::write_out(const log_record& record) {
+	if (_log)
+		_log(format_log_record(record));
+
+	if (!_file.is_open())
+		return;
+
+	std::string buffer;
+	append_log_record(buffer, record);
+
+	if (_file_max_size > 0 && _file_size + buffer.length() > _file_max_size)
+		rotate_file();
+
+	if (!_file.is_open())
+		return;
+
+	_file.write(buffer.data(), buffer.length());
+	_file_size += buffer.length();
+}
+
+void async_logger::rotate_file() {
+	_file.close();
+
+	try {
+		// shift the rotated files up by one, dropping the last one
+		if (_file_max_count > 0) {
+			std::filesystem::remove(_file_path + "." + std::to_string(_file_max_count));
+
+			for (int i = _file_max_count - 1; i > 0; i--) {
+				const std::string from = _file_path + "." + std::to_string(i);
+				if (std::filesystem::exists(from))
+					std::filesystem::rename(from, _file_path + "." + std::to_string(i + 1));
+			}
+
+			std::filesystem::rename(_file_path, _file_path + ".1");
+		}
+		else
+			std::filesystem::remove(_file_path);
+
+		_file.open(_file_path, std::ios::out | std::ios::trunc | std::ios::binary);
+		_file.write(log_file_magic.data(), log_file_magic.length());
+		_file.put(static_cast<char>(log_file_version));
+		_file_size = log_file_magic.length() + 1;
+	}
+	catch (const std::exception&) {
+		// leave the log file closed rather than keep trying on every event
+		_file.close();
+	}
+}
+
+void collab::set_log_level(log_level level) {
+	_d._log.set_level(level);
+}
+
+bool collab::set_log_file(const std::string& full_path, unsigned long long max_size, int max_files,
+	std::string& error) {
+	return _d._log.set_file(full_path, max_size, max_files, error);
+}
+
+unsigned long long collab::dropped_log_events() {
+	return _d._log.dropped();
+}
+
+bool collab::read_log_file(const std::string& full_path, std::vector<std::string>& events,
+	std::string& error) {
+	events.clear();
+
+	std::ifstream file(full_path, std::ios::in | std::ios::binary);
+
+	if (!file) {
+		error = "Cannot open '" + full_path + "'";
+		return false;
+	}
+
+	std::string magic(log_file_magic.length(), '\0');
+	char version = 0;
+
+	if (!file.read(&magic[0], magic.length()) || magic != log_file_magic || !file.get(version) ||
+		static_cast<unsigned char>(version) > log_file_version) {
+		error = "'" + full_path + "' is not a collab log file";
+		return false;
+	}
+
+	log_record record;
+	while (read_log_record(file, record)) {
+		// format the time
+		const std::time_t seconds = static_cast<std::time_t>(record.time / 1000);
+		std::tm time = {};
+		localtime_s(&time, &seconds);
+
+		std::stringstream ss;
+		ss << std::put_time(&time, "%Y-%m-%d %H:%M:%S") << "." << std::setw(3) << std::setfill('0') << record.time % 1000
+			<< " [" << log_level_name(log_event_level(record.event)) << "] " << format_log_record(record);
+
+		events.push_back(ss.str());
+	}
+
+	// a record cut short at the end, e.g. by a crash, is left out
+	return true;
+}
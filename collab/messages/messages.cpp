@@ -24,6 +24,13 @@
 
 #include "../impl.h"
 
+// STL
+#include <algorithm>
+#include <cstdio>
+
+// boost
+#include <boost\serialization\version.hpp>
+
 // serialize template to make collab::message serializable
 template<class Archive>
 void serialize(Archive& ar, collab::message& cls, const unsigned int version) {
@@ -32,6 +39,66 @@ void serialize(Archive& ar, collab::message& cls, const unsigned int version) {
 	ar& cls.session_id;
 	ar& cls.sender_unique_id;
 	ar& cls.text;
+
+	// version 1 adds the hybrid logical clock timestamp
+	if (version > 0)
+		ar& cls.hlc;
+}
+
+BOOST_CLASS_VERSION(collab::message, 1)
+
+// selects messages with the interned ids resolved, to be followed by a WHERE clause on m
+// times are read back as real numbers because leccore's integer getter is only 32 bits wide
+const char message_query[] =
+	"SELECT m.UniqueID AS UniqueID, CAST(m.Time AS REAL) AS Time, s.Value AS SessionID, "
+	"u.Value AS SenderUniqueID, m.Message AS Message, m.HLC AS HLC "
+	"FROM SessionMessages m "
+	"JOIN Identifiers s ON s.ID = m.SessionKey "
+	"JOIN Identifiers u ON u.ID = m.SenderKey ";
+
+unsigned long long hybrid_logical_clock::physical_now() {
+	return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+unsigned long long hybrid_logical_clock::now() {
+	const unsigned long long physical = physical_now() << 16;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// follow the physical clock, unless it's behind the last timestamp, in which case count on from there
+	_last = physical > _last ? physical : _last + 1;
+	return _last;
+}
+
+void hybrid_logical_clock::update(unsigned long long timestamp) {
+	// don't let a peer with a clock that's way off drag this clock along with it
+	if ((timestamp >> 16) > physical_now() + hlc_max_drift)
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (timestamp > _last)
+		_last = timestamp;
+}
+
+unsigned long long hybrid_logical_clock::from_time(long long time) {
+	return (static_cast<unsigned long long>(time) * 1000) << 16;
+}
+
+std::string hlc_to_string(unsigned long long hlc) {
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", hlc);
+	return buffer;
+}
+
+unsigned long long hlc_from_string(const std::string& hlc) {
+	try {
+		return std::stoull(hlc, nullptr, 16);
+	}
+	catch (const std::exception&) {
+		return 0;
+	}
 }
 
 // serialize template to make message_broadcast_structure serializable
@@ -80,18 +147,17 @@ bool deserialize_message_broadcast_structure(const std::string& serialized,
 }
 
 void collab::impl::message_broadcast_sender_func(impl* p_impl) {
-	// create a broadcast sender object
-	liblec::lecnet::udp::broadcast::sender sender(MESSAGE_BROADCAST_PORT);
+	// create a datagram sender object
+	datagram_sender sender(node_port(p_impl->_broadcast_port, MESSAGE_BROADCAST_PORT));
 
-	// loop until _stop_session_broadcast is false
+	// loop until a stop is requested
 	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
-		}
+		// wake ups from here on cut the next breath short
+		const auto wake_count = p_impl->_stop.wake_count();
 
 		std::string current_session_unique_id;
 
@@ -100,6 +166,37 @@ void collab::impl::message_broadcast_sender_func(impl* p_impl) {
 			current_session_unique_id = p_impl->_current_session_unique_id;
 		}
 
+		// announce locally written messages straight away, the regular broadcast below repairs any losses
+		std::vector<message> announcements;
+
+		{
+			std::lock_guard<std::mutex> lock(p_impl->_message_announcement_mutex);
+			announcements.swap(p_impl->_message_announcements);
+		}
+
+		for (size_t i = 0; i < announcements.size(); i += message_broadcast_limit) {
+			// make a message broadcast object with just the new messages
+			message_broadcast_structure cls;
+			cls.source_node_unique_id = p_impl->_collab.unique_id();
+			cls.message_list.assign(announcements.begin() + i,
+				announcements.begin() + (std::min)(i + message_broadcast_limit, announcements.size()));
+
+			std::string serialized_announcement, error;
+			if (serialize_message_broadcast_structure(cls, serialized_announcement, error)) {
+				if (p_impl->send_datagram(sender, payload_type::message_list, serialized_announcement, current_session_unique_id, error)) {
+					// broadcast successful
+					for (const auto& it : cls.message_list)
+						p_impl->_trace.mark(it.unique_id, "message.announce");
+				}
+			}
+		}
+
+		if (!announcements.empty())
+			p_impl->_message_cadence.announced();
+
+		// the broadcast, left empty if there is nothing to broadcast
+		std::string serialized_message_list;
+
 		if (!current_session_unique_id.empty()) {
 			std::string error;
 			std::vector<message> local_message_list;
@@ -108,41 +205,46 @@ void collab::impl::message_broadcast_sender_func(impl* p_impl) {
 			if (p_impl->_collab.get_latest_messages(current_session_unique_id, local_message_list, message_broadcast_limit, error)) {
 
 				// make a message broadcast object
-				std::string serialized_message_list;
 				message_broadcast_structure cls;
 				cls.source_node_unique_id = p_impl->_collab.unique_id();
 				cls.message_list = local_message_list;
 
 				// serialize the message broadcast object
-				if (serialize_message_broadcast_structure(cls, serialized_message_list, error)) {
+				if (!serialize_message_broadcast_structure(cls, serialized_message_list, error))
+					serialized_message_list.clear();
+			}
+		}
 
-					// broadcast the serialized object
-					unsigned long actual_count = 0;
-					if (sender.send(serialized_message_list, 1, 0, actual_count, error)) {
-						// broadcast successful
-					}
-				}
+		// broadcast the serialized object if it's due
+		if (p_impl->_message_cadence.due(serialized_message_list) && !serialized_message_list.empty()) {
+			std::string error;
+			if (p_impl->send_datagram(sender, payload_type::message_list, serialized_message_list, current_session_unique_id, error)) {
+				// broadcast successful
 			}
 		}
 
-		// take a breath
-		std::this_thread::sleep_for(std::chrono::milliseconds{ message_broadcast_cycle });
+		// take a breath until the next broadcast is due, a change wakes us up sooner
+		p_impl->_stop.sleep_for(p_impl->_message_cadence.time_to_next(), wake_count);
 	}
 }
 
 void collab::impl::message_broadcast_receiver_func(impl* p_impl) {
-	// create broadcast receiver object
-	liblec::lecnet::udp::broadcast::receiver receiver(MESSAGE_BROADCAST_PORT, "0.0.0.0");
+	// create datagram receiver object
+	datagram_receiver receiver(node_port(p_impl->_broadcast_port, MESSAGE_BROADCAST_PORT), p_impl->_stop);
+
+	{
+		std::string error;
+		if (!receiver.start(error)) {
+			p_impl->_log(log_event::receiver_start_failed, "message", error);
+			return;
+		}
+	}
 
-	// loop until _stop_session_broadcast is false
+	// loop until a stop is requested
 	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
-
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
-		}
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
 		std::string current_session_unique_id;
 
@@ -151,18 +253,28 @@ void collab::impl::message_broadcast_receiver_func(impl* p_impl) {
 			current_session_unique_id = p_impl->_current_session_unique_id;
 		}
 
+		{
+			// listen on the session's multicast group, broadcasts are received regardless
+			std::string error;
+			if (!receiver.set_group(session_multicast_group(current_session_unique_id), error))
+				p_impl->_log(log_event::receiver_join_failed, "message", error);
+		}
+
 		if (!current_session_unique_id.empty()) {
 			std::string error;
 
-			// run the receiver
-			if (receiver.run(message_receiver_cycle, error)) {
-				// loop while running
-				while (receiver.running())
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			// wait for datagrams, a stop request or session change cuts the wait short
+			std::vector<std::string> datagrams;
+			if (receiver.wait(datagrams, std::chrono::milliseconds{ message_receiver_cycle })) {
+				p_impl->count_received_datagrams(payload_type::message_list, receiver, datagrams);
+
+				// process every datagram received
+				for (auto& serialized_message_list : datagrams) {
+					// discard datagrams for other channels and sessions before going to the trouble of decoding them
+					// a datagram that passes comes from a peer in our session, even if the peer has no messages in it yet
+					if (!strip_datagram_header(serialized_message_list, payload_type::message_list, current_session_unique_id))
+						continue;
 
-				// no longer running ... check if a datagram was received
-				std::string serialized_message_list;
-				if (receiver.get(serialized_message_list, error)) {
 					// datagram received ... deserialize
 
 					message_broadcast_structure cls;
@@ -180,6 +292,42 @@ void collab::impl::message_broadcast_receiver_func(impl* p_impl) {
 							// database may be empty or table may not exist, so ignore
 						}
 
+						// check if the peer is behind, i.e. it doesn't have our latest messages
+						bool peer_has_messages = false;
+						long long peer_oldest_time = 0;	// the time of the oldest message in the peer's broadcast
+
+						for (const auto& it : cls.message_list) {
+							if (it.session_id == current_session_unique_id) {
+								peer_oldest_time = peer_has_messages ? (std::min)(peer_oldest_time, it.time) : it.time;
+								peer_has_messages = true;
+							}
+						}
+
+						bool peer_behind = false;
+
+						const size_t latest = local_message_list.size() > message_broadcast_limit ?
+							local_message_list.size() - message_broadcast_limit : 0;
+
+						for (size_t i = latest; i < local_message_list.size() && !peer_behind; i++) {
+							if (local_message_list[i].time < peer_oldest_time)
+								continue;	// older than anything the peer broadcast, can't tell
+
+							bool found = false;
+
+							for (const auto& it : cls.message_list) {
+								if (it.unique_id == local_message_list[i].unique_id) {
+									found = true;
+									break;
+								}
+							}
+
+							peer_behind = !found;
+						}
+
+						// let the peer catch up without waiting for our next scheduled broadcast
+						if (peer_behind)
+							p_impl->_message_cadence.kick();
+
 						// check if any message is missing in the local database
 						for (const auto& it : cls.message_list) {
 							if (it.session_id != current_session_unique_id)
@@ -195,32 +343,42 @@ void collab::impl::message_broadcast_receiver_func(impl* p_impl) {
 							}
 
 							if (!found) {
-								p_impl->_log("Message received (UDP): " + shorten_unique_id(it.unique_id) + " (source node: " + shorten_unique_id(cls.source_node_unique_id) + ")");
+								p_impl->_log(log_event::message_received, log_id{ it.unique_id }, log_id{ cls.source_node_unique_id });
+
+								// from the message being written on the node it came from to it arriving here, the physical
+								// part of its hybrid logical clock timestamp is the writing node's clock in milliseconds
+								if (it.hlc > 0) {
+									const long long written_us = static_cast<long long>(it.hlc >> 16) * 1000;
+									p_impl->_trace.record(it.unique_id, "message.propagation", written_us,
+										trace_clock_now() - written_us, "from " + shorten_unique_id(cls.source_node_unique_id));
+								}
 
 								// add this message to the local database
 								if (p_impl->_collab.create_message(it, error)) {
 									// message added successfully to the local database
-									p_impl->_log("Message '" + shorten_unique_id(it.unique_id) + "' saved successfully");
+									p_impl->_log(log_event::message_saved, log_id{ it.unique_id });
 								}
 								else
-									p_impl->_log("Creating message '" + shorten_unique_id(it.unique_id) + "' failed: " + error);
+									p_impl->_log(log_event::message_save_failed, log_id{ it.unique_id }, error);
 							}
 						}
 					}
+					else
+						p_impl->count_deserialize_failure(payload_type::message_list);
 				}
 			}
-
-			receiver.stop();
 		}
 		else {
 			// take a breath
-			std::this_thread::sleep_for(std::chrono::milliseconds{ message_receiver_cycle });
+			p_impl->_stop.sleep_for(std::chrono::milliseconds{ message_receiver_cycle });
 		}
 	}
 }
 
-bool collab::create_message(const message& message, std::string& error) {
+bool collab::create_message(const message& message_in, std::string& error) {
+	scoped_trace trace(_d._trace, message_in.unique_id, "message.store");
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.create_message);
 
 	// get optional object
 	auto con_opt = _d.get_connection();
@@ -233,28 +391,59 @@ bool collab::create_message(const message& message, std::string& error) {
 	// get database connection object reference
 	auto& con = con_opt.value().get();
 
-	// create table if it doesn't exist
-	if (!con.execute("CREATE TABLE IF NOT EXISTS SessionMessages "
-		"(UniqueID TEXT NOT NULL, "
-		"Time REAL NOT NULL, "
-		"SessionID TEXT NOT NULL, "
-		"SenderUniqueID TEXT NOT NULL, "
-		"Message TEXT NOT NULL, PRIMARY KEY(UniqueID));",
-		{}, error))
+	message message = message_in;
+
+	if (message.hlc == 0) {
+		if (message.sender_unique_id == _d._unique_id)
+			message.hlc = _d._hlc.now();
+		else
+			// the message is from a node that predates hybrid logical clocks
+			message.hlc = hybrid_logical_clock::from_time(message.time);
+	}
+	else
+		_d._hlc.update(message.hlc);
+
+	if (!intern_identifier(con, message.session_id, error) ||
+		!intern_identifier(con, message.sender_unique_id, error))
 		return false;
 
 	// insert data into table
-	if (!con.execute("INSERT INTO SessionMessages VALUES(?, ?, ?, ?, ?);",
-		{ message.unique_id, static_cast<double>(message.time), message.session_id, message.sender_unique_id, message.text },
+	if (!con.execute("INSERT INTO SessionMessages (UniqueID, Time, SessionKey, SenderKey, Message, HLC) "
+		"VALUES(?, ?, (SELECT ID FROM Identifiers WHERE Value = ?), (SELECT ID FROM Identifiers WHERE Value = ?), ?, ?);",
+		{ message.unique_id, static_cast<double>(message.time), message.session_id, message.sender_unique_id, message.text,
+		hlc_to_string(message.hlc) },
 		error))
 		return false;
 
+	_d.add_to_search_index(con, search_hit::item_type::message, message.unique_id, message.session_id, message.time, message.text);
+
+	_d._messages_revision++;
+
+	if (message.sender_unique_id == _d._unique_id) {
+		// the message was written locally, have the message broadcast sender announce it straight away
+		{
+			std::lock_guard<std::mutex> lock(_d._message_announcement_mutex);
+			_d._message_announcements.push_back(message);
+		}
+
+		_d._stop.wake();
+	}
+	else {
+		// pass the message on straight away
+		_d._message_cadence.kick();
+	}
+
 	return true;
 }
 
+unsigned long long collab::messages_revision() {
+	return _d._messages_revision;
+}
+
 bool collab::get_messages(const std::string& session_unique_id,
 	std::vector<message>& messages, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_messages);
 
 	messages.clear();
 
@@ -277,9 +466,8 @@ bool collab::get_messages(const std::string& session_unique_id,
 	liblec::leccore::database::table results;
 
 	if (!con.execute_query(
-		"SELECT UniqueID, Time, SessionID, SenderUniqueID, Message "
-		"FROM SessionMessages "
-		"WHERE SessionID = ? ORDER BY Time ASC;",
+		std::string(message_query) +
+		"WHERE m.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) ORDER BY m.HLC ASC, u.Value ASC, m.UniqueID ASC;",
 		{ session_unique_id }, results, error))
 		return false;
 
@@ -302,6 +490,9 @@ bool collab::get_messages(const std::string& session_unique_id,
 			if (row.at("Message").has_value())
 				msg.text = liblec::leccore::database::get::text(row.at("Message"));
 
+			if (row.at("HLC").has_value())
+				msg.hlc = hlc_from_string(liblec::leccore::database::get::text(row.at("HLC")));
+
 			messages.push_back(msg);
 		}
 		catch (const std::exception& e) {
@@ -316,6 +507,7 @@ bool collab::get_messages(const std::string& session_unique_id,
 bool collab::get_latest_messages(const std::string& session_unique_id, std::vector<message>& messages,
 	int number, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_latest_messages);
 
 	messages.clear();
 
@@ -339,19 +531,17 @@ bool collab::get_latest_messages(const std::string& session_unique_id, std::vect
 
 	if (number > 0) {
 		if (!con.execute_query(
-			"SELECT UniqueID, Time, SessionID, SenderUniqueID, Message "
-			"FROM SessionMessages "
-			"WHERE SessionID = ? "
-			"ORDER BY Time DESC "
+			std::string(message_query) +
+			"WHERE m.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) "
+			"ORDER BY m.HLC DESC, u.Value DESC, m.UniqueID DESC "
 			"LIMIT ?;",
 			{ session_unique_id, number }, results, error))
 			return false;
 	}
 	else {
 		if (!con.execute_query(
-			"SELECT UniqueID, Time, SessionID, SenderUniqueID, Message "
-			"FROM SessionMessages "
-			"WHERE SessionID = ? ORDER BY Time DESC;",
+			std::string(message_query) +
+			"WHERE m.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) ORDER BY m.HLC DESC, u.Value DESC, m.UniqueID DESC;",
 			{ session_unique_id }, results, error))
 			return false;
 	}
@@ -375,6 +565,73 @@ bool collab::get_latest_messages(const std::string& session_unique_id, std::vect
 			if (row.at("Message").has_value())
 				msg.text = liblec::leccore::database::get::text(row.at("Message"));
 
+			if (row.at("HLC").has_value())
+				msg.hlc = hlc_from_string(liblec::leccore::database::get::text(row.at("HLC")));
+
+			messages.push_back(msg);
+		}
+		catch (const std::exception& e) {
+			error = e.what();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool collab::get_messages_after(const std::string& session_unique_id,
+	unsigned long long hlc, std::vector<message>& messages, std::string& error) {
+	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_messages_after);
+
+	messages.clear();
+
+	if (session_unique_id.empty()) {
+		error = "Session unique id not supplied";
+		return false;
+	}
+
+	// get optional object
+	auto con_opt = _d.get_connection();
+
+	if (!con_opt.has_value()) {
+		error = "No database connection";
+		return false;
+	}
+
+	// get database connection object reference
+	auto& con = con_opt.value().get();
+
+	liblec::leccore::database::table results;
+
+	if (!con.execute_query(
+		std::string(message_query) +
+		"WHERE m.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) AND m.HLC > ? ORDER BY m.HLC ASC, u.Value ASC, m.UniqueID ASC;",
+		{ session_unique_id, hlc_to_string(hlc) }, results, error))
+		return false;
+
+	for (auto& row : results.data) {
+		collab::message msg;
+
+		try {
+			if (row.at("UniqueID").has_value())
+				msg.unique_id = liblec::leccore::database::get::text(row.at("UniqueID"));
+
+			if (row.at("Time").has_value())
+				msg.time = static_cast<long long>(liblec::leccore::database::get::real(row.at("Time")));
+
+			if (row.at("SessionID").has_value())
+				msg.session_id = liblec::leccore::database::get::text(row.at("SessionID"));
+
+			if (row.at("SenderUniqueID").has_value())
+				msg.sender_unique_id = liblec::leccore::database::get::text(row.at("SenderUniqueID"));
+
+			if (row.at("Message").has_value())
+				msg.text = liblec::leccore::database::get::text(row.at("Message"));
+
+			if (row.at("HLC").has_value())
+				msg.hlc = hlc_from_string(liblec::leccore::database::get::text(row.at("HLC")));
+
 			messages.push_back(msg);
 		}
 		catch (const std::exception& e) {
@@ -407,7 +664,8 @@ bool collab::user_has_messages_in_session(const std::string& user_unique_id, con
 	if (!con.execute_query(
 		"SELECT Time "
 		"FROM SessionMessages "
-		"WHERE SenderUniqueID = ? AND SessionID = ?;",
+		"WHERE SenderKey = (SELECT ID FROM Identifiers WHERE Value = ?) "
+		"AND SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?);",
 		{ user_unique_id, session_unique_id }, results, error))
 		return false;
 
@@ -0,0 +1,314 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../collab.h"
+#include "../impl.h"
+
+// STL
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+std::string channel_name(payload_type type) {
+	switch (type) {
+	case payload_type::session_list: return "sessions";
+	case payload_type::message_list: return "messages";
+	case payload_type::user:
+	case payload_type::capacity: return "users";	// capacity records share the user channel
+	case payload_type::file_list:
+	case payload_type::file_summary:
+	case payload_type::task_summary: return "files";	// task summaries share the file channel
+	case payload_type::review_list:
+	case payload_type::review_summary: return "reviews";
+	default: return "unknown";
+	}
+}
+
+void metric_histogram::record(const std::chrono::steady_clock::duration& duration) {
+	const auto microseconds = static_cast<unsigned long long>((std::max)(0LL, static_cast<long long>(
+		std::chrono::duration_cast<std::chrono::microseconds>(duration).count())));
+
+	// the bucket is the number of bits needed to hold the duration
+	int bucket = 0;
+	for (auto value = microseconds; value > 0 && bucket < metric_histogram_buckets - 1; value >>= 1)
+		bucket++;
+
+	_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	_count.fetch_add(1, std::memory_order_relaxed);
+	_total.fetch_add(microseconds, std::memory_order_relaxed);
+
+	auto max = _max.load(std::memory_order_relaxed);
+	while (microseconds > max && !_max.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+		;
+}
+
+void metric_histogram::snapshot(collab::metrics::histogram& histogram) const {
+	histogram = {};
+	histogram.total_ms = _total.load(std::memory_order_relaxed) / 1000.0;
+	histogram.max_ms = _max.load(std::memory_order_relaxed) / 1000.0;
+
+	for (int i = 0; i < metric_histogram_buckets; i++) {
+		const auto count = _buckets[i].load(std::memory_order_relaxed);
+		histogram.count += count;
+
+		// the last bucket has no upper bound of its own, so the longest duration stands in for it
+		const double upper_bound_ms = i < metric_histogram_buckets - 1 ?
+			static_cast<double>(1ULL << i) / 1000.0 : (std::max)(histogram.max_ms, static_cast<double>(1ULL << (i - 1)) / 1000.0);
+
+		histogram.buckets.push_back({ upper_bound_ms, count });
+	}
+
+	// the count is taken from the buckets so the percentiles agree with them
+	auto percentile = [&](double fraction) {
+		const auto rank = static_cast<unsigned long long>(std::ceil(fraction * histogram.count));
+		unsigned long long cumulative = 0;
+
+		for (const auto& [upper_bound_ms, count] : histogram.buckets) {
+			cumulative += count;
+			if (cumulative >= rank && count > 0)
+				return (std::min)(upper_bound_ms, histogram.max_ms);
+		}
+
+		return histogram.max_ms;
+	};
+
+	if (histogram.count > 0) {
+		histogram.p50_ms = percentile(0.50);
+		histogram.p90_ms = percentile(0.90);
+		histogram.p99_ms = percentile(0.99);
+	}
+}
+
+metrics_registry::metrics_registry() :
+	_serial([]() {
+		static std::atomic<unsigned long long> next_serial{ 1 };
+		return next_serial++;
+	}()) {}
+
+template <typename metric>
+metric& find_or_make(std::shared_mutex& mutex, std::map<std::string, std::unique_ptr<metric>>& metrics,
+	const std::string& name) {
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto it = metrics.find(name);
+		if (it != metrics.end())
+			return *it->second;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	auto& p_metric = metrics[name];
+
+	if (!p_metric)
+		p_metric = std::make_unique<metric>();
+
+	return *p_metric;
+}
+
+metric_counter& metrics_registry::counter(const std::string& name) {
+	return find_or_make(_mutex, _counters, name);
+}
+
+metric_gauge& metrics_registry::gauge(const std::string& name) {
+	return find_or_make(_mutex, _gauges, name);
+}
+
+metric_histogram& metrics_registry::histogram(const std::string& name) {
+	return find_or_make(_mutex, _histograms, name);
+}
+
+void metrics_registry::snapshot(collab::metrics& snapshot) {
+	snapshot = {};
+
+	std::shared_lock<std::shared_mutex> lock(_mutex);
+
+	for (const auto& [name, p_counter] : _counters)
+		snapshot.counters[name] = p_counter->value();
+
+	for (const auto& [name, p_gauge] : _gauges)
+		snapshot.gauges[name] = p_gauge->value();
+
+	for (const auto& [name, p_histogram] : _histograms)
+		p_histogram->snapshot(snapshot.histograms[name]);
+}
+
+channel_metrics::channel_metrics(metrics_registry& metrics, const std::string& channel) :
+	datagrams_sent(metrics.counter("datagrams.sent." + channel)),
+	datagram_bytes_sent(metrics.counter("datagram_bytes.sent." + channel)),
+	datagrams_received(metrics.counter("datagrams.received." + channel)),
+	datagram_bytes_received(metrics.counter("datagram_bytes.received." + channel)),
+	datagrams_dropped(metrics.counter("datagrams.dropped." + channel)),
+	deserialize_failures(metrics.counter("deserialize_failures." + channel)),
+	datagram_batch(metrics.gauge("datagram_batch." + channel)) {}
+
+channel_metrics& collab::impl::channel_metrics_for(payload_type type) {
+	switch (type) {
+	case payload_type::session_list: return _session_channel_metrics;
+	case payload_type::message_list: return _message_channel_metrics;
+	case payload_type::file_list:
+	case payload_type::file_summary:
+	case payload_type::task_summary: return _file_channel_metrics;
+	case payload_type::review_list:
+	case payload_type::review_summary: return _review_channel_metrics;
+	case payload_type::user:
+	case payload_type::capacity:
+	default: return _user_channel_metrics;
+	}
+}
+
+database_metrics::database_metrics(metrics_registry& metrics) :
+	create_session(metrics.histogram("db.create_session")),
+	get_sessions(metrics.histogram("db.get_sessions")),
+	get_user(metrics.histogram("db.get_user")),
+	create_message(metrics.histogram("db.create_message")),
+	get_messages(metrics.histogram("db.get_messages")),
+	get_latest_messages(metrics.histogram("db.get_latest_messages")),
+	get_messages_after(metrics.histogram("db.get_messages_after")),
+	create_file(metrics.histogram("db.create_file")),
+	get_files(metrics.histogram("db.get_files")),
+	get_file(metrics.histogram("db.get_file")),
+	create_review(metrics.histogram("db.create_review")),
+	get_reviews(metrics.histogram("db.get_reviews")),
+	get_review(metrics.histogram("db.get_review")),
+	search(metrics.histogram("db.search")) {}
+
+void count_transfer(metrics_registry& metrics, const std::string& direction, const std::string& peer,
+	unsigned long long bytes) {
+	struct peer_counters {
+		unsigned long long registry_serial = 0;
+		std::string direction;
+		std::string peer;
+		metric_counter* p_total = nullptr;
+		metric_counter* p_peer = nullptr;
+	};
+
+	thread_local peer_counters last;
+
+	if (last.registry_serial != metrics.serial() || last.peer != peer || last.direction != direction) {
+		last.registry_serial = metrics.serial();
+		last.direction = direction;
+		last.peer = peer;
+		last.p_total = &metrics.counter("transfer_bytes." + direction);
+		last.p_peer = &metrics.counter("transfer_bytes." + direction + "." + peer);
+	}
+
+	last.p_total->add(bytes);
+	last.p_peer->add(bytes);
+}
+
+void collab::get_metrics(metrics& snapshot) {
+	_d._metrics.snapshot(snapshot);
+}
+
+// metric names are made by collab, but peer addresses end up in them, so escape them anyway
+std::string json_string(const std::string& value) {
+	std::string escaped = "\"";
+
+	for (const char c : value) {
+		switch (c) {
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				std::stringstream ss;
+				ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+				escaped += ss.str();
+			}
+			else
+				escaped += c;
+			break;
+		}
+	}
+
+	return escaped + "\"";
+}
+
+bool collab::save_metrics(const std::string& full_path, std::string& error) {
+	metrics snapshot;
+	get_metrics(snapshot);
+
+	std::stringstream ss;
+	ss << std::setprecision(6) << std::fixed;
+
+	ss << "{\n  \"counters\": {";
+	for (auto it = snapshot.counters.begin(); it != snapshot.counters.end(); it++)
+		ss << (it == snapshot.counters.begin() ? "\n" : ",\n") << "    " << json_string(it->first) << ": " << it->second;
+	ss << "\n  },\n";
+
+	ss << "  \"gauges\": {";
+	for (auto it = snapshot.gauges.begin(); it != snapshot.gauges.end(); it++)
+		ss << (it == snapshot.gauges.begin() ? "\n" : ",\n") << "    " << json_string(it->first) << ": " << it->second;
+	ss << "\n  },\n";
+
+	ss << "  \"histograms\": {";
+	for (auto it = snapshot.histograms.begin(); it != snapshot.histograms.end(); it++) {
+		const auto& histogram = it->second;
+
+		ss << (it == snapshot.histograms.begin() ? "\n" : ",\n") << "    " << json_string(it->first) << ": {\n"
+			<< "      \"count\": " << histogram.count << ",\n"
+			<< "      \"total_ms\": " << histogram.total_ms << ",\n"
+			<< "      \"max_ms\": " << histogram.max_ms << ",\n"
+			<< "      \"p50_ms\": " << histogram.p50_ms << ",\n"
+			<< "      \"p90_ms\": " << histogram.p90_ms << ",\n"
+			<< "      \"p99_ms\": " << histogram.p99_ms << ",\n"
+			<< "      \"buckets\": [";
+
+		// leave out empty buckets, most of them are
+		bool first = true;
+		for (const auto& [upper_bound_ms, count] : histogram.buckets) {
+			if (count == 0)
+				continue;
+
+			ss << (first ? "" : ", ") << "{ \"le_ms\": " << upper_bound_ms << ", \"count\": " << count << " }";
+			first = false;
+		}
+
+		ss << "]\n    }";
+	}
+	ss << "\n  }\n}\n";
+
+	try {
+		std::ofstream file(full_path, std::ios::out | std::ios::trunc);
+
+		if (!file) {
+			error = "Cannot open '" + full_path + "' for writing";
+			return false;
+		}
+
+		file << ss.str();
+		file.close();
+
+		if (!file) {
+			error = "Error writing to '" + full_path + "'";
+			return false;
+		}
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,94 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../collab.h"
+#include "../impl.h"
+
+namespace {
+	const char datagram_magic[] = { 'C', 'L', 'B' };
+}
+
+unsigned long long fnv1a_hash(const std::string& data) {
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (const unsigned char c : data) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+unsigned long long session_hash(const std::string& session_unique_id) {
+	if (session_unique_id.empty())
+		return 0;
+
+	return fnv1a_hash(session_unique_id);
+}
+
+std::string add_datagram_header(payload_type type, const std::string& session_unique_id, const std::string& payload) {
+	std::string datagram;
+	datagram.reserve(datagram_header_size + payload.size());
+
+	datagram.append(datagram_magic, sizeof(datagram_magic));
+	datagram.push_back(static_cast<char>(datagram_header_version));
+	datagram.push_back(static_cast<char>(type));
+
+	const unsigned long long hash = session_hash(session_unique_id);
+
+	for (int i = 0; i < 8; i++)
+		datagram.push_back(static_cast<char>((hash >> (8 * i)) & 0xff));
+
+	datagram.append(payload);
+	return datagram;
+}
+
+bool peek_datagram_type(const std::string& datagram, payload_type& type) {
+	if (datagram.size() < datagram_header_size ||
+		datagram.compare(0, sizeof(datagram_magic), datagram_magic, sizeof(datagram_magic)) != 0 ||
+		static_cast<unsigned char>(datagram[3]) != datagram_header_version)
+		return false;
+
+	type = static_cast<payload_type>(datagram[4]);
+	return true;
+}
+
+bool strip_datagram_header(std::string& datagram, payload_type type, const std::string& session_unique_id) {
+	payload_type datagram_type;
+	if (!peek_datagram_type(datagram, datagram_type) || datagram_type != type)
+		return false;	// no header, a different version or a different channel
+
+	unsigned long long hash = 0;
+
+	for (int i = 0; i < 8; i++)
+		hash |= static_cast<unsigned long long>(static_cast<unsigned char>(datagram[5 + i])) << (8 * i);
+
+	// datagrams that aren't tied to a session pass, as do all datagrams if we're not in a session
+	if (hash != 0 && !session_unique_id.empty() && hash != session_hash(session_unique_id))
+		return false;
+
+	datagram.erase(0, datagram_header_size);
+	return true;
+}
@@ -0,0 +1,352 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+// winsock has to come before anything that pulls in Windows.h
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <MSWSock.h>
+
+#include "../collab.h"
+#include "../impl.h"
+
+// lecnet
+#include <liblec/lecnet/tcp.h>
+
+// STL
+#include <deque>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+class datagram_receiver::datagram_receiver_impl {
+public:
+	const unsigned short _port;
+	stop_signal& _stop;
+	int _listener_id = -1;
+
+	bool _wsa_started = false;
+	SOCKET _socket = INVALID_SOCKET;
+	std::future<void> _thread;
+
+	std::string _group;		// the multicast group joined, if any
+
+	// tells us which address each datagram was sent to, null if it isn't available
+	LPFN_WSARECVMSG _recvmsg = nullptr;
+
+	// this machine's addresses, to tell our own looped back multicast datagrams from a peer's
+	std::vector<u_long> _host_addresses;
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::deque<std::string> _queue;
+	unsigned long long _dropped = 0;
+	bool _heard_on_group = false;
+	bool _interrupted = false;
+
+	datagram_receiver_impl(unsigned short port, stop_signal& stop) :
+		_port(port),
+		_stop(stop) {}
+
+	void interrupt() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_interrupted = true;
+		}
+
+		_cv.notify_all();
+	}
+
+	// receive a datagram, noting whether it was sent to a multicast group
+	int receive(std::string& buffer, sockaddr_in& sender_address, bool& multicast) {
+		multicast = false;
+
+		if (!_recvmsg) {
+			int sender_address_size = sizeof(sender_address);
+
+			return recvfrom(_socket, &buffer[0], static_cast<int>(buffer.size()), 0,
+				reinterpret_cast<sockaddr*>(&sender_address), &sender_address_size);
+		}
+
+		WSABUF data = {};
+		data.len = static_cast<ULONG>(buffer.size());
+		data.buf = &buffer[0];
+
+		char control[WSA_CMSG_SPACE(sizeof(IN_PKTINFO))] = {};
+
+		WSAMSG message = {};
+		message.name = reinterpret_cast<sockaddr*>(&sender_address);
+		message.namelen = sizeof(sender_address);
+		message.lpBuffers = &data;
+		message.dwBufferCount = 1;
+		message.Control.len = sizeof(control);
+		message.Control.buf = control;
+
+		DWORD received = 0;
+		if (_recvmsg(_socket, &message, &received, nullptr, nullptr) == SOCKET_ERROR)
+			return SOCKET_ERROR;
+
+		for (WSACMSGHDR* p_header = WSA_CMSG_FIRSTHDR(&message); p_header; p_header = WSA_CMSG_NXTHDR(&message, p_header)) {
+			if (p_header->cmsg_level == IPPROTO_IP && p_header->cmsg_type == IP_PKTINFO) {
+				const auto* p_info = reinterpret_cast<const IN_PKTINFO*>(WSA_CMSG_DATA(p_header));
+				multicast = IN_MULTICAST(ntohl(p_info->ipi_addr.s_addr));
+			}
+		}
+
+		return static_cast<int>(received);
+	}
+
+	bool from_this_machine(const sockaddr_in& sender_address) {
+		for (const auto& address : _host_addresses)
+			if (address == sender_address.sin_addr.s_addr)
+				return true;
+
+		return false;
+	}
+
+	// runs on the receiving thread, blocks on the socket until closed by stop()
+	static void receive_func(datagram_receiver_impl* p_impl) {
+		std::string buffer(max_datagram_size, '\0');
+
+		while (true) {
+			sockaddr_in sender_address = {};
+			bool multicast = false;
+
+			const int received = p_impl->receive(buffer, sender_address, multicast);
+
+			if (received == SOCKET_ERROR) {
+				const int error_code = WSAGetLastError();
+
+				// a previous send to an unreachable port, or a truncated datagram ... carry on
+				if (error_code == WSAECONNRESET || error_code == WSAEMSGSIZE)
+					continue;
+
+				break;	// the socket has been closed
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(p_impl->_mutex);
+				p_impl->_queue.emplace_back(buffer.data(), received);
+
+				if (multicast && !p_impl->from_this_machine(sender_address))
+					p_impl->_heard_on_group = true;
+
+				// drop the oldest datagrams if processing can't keep up ... broadcasts are repeated anyway
+				while (p_impl->_queue.size() > max_queued_datagrams) {
+					p_impl->_queue.pop_front();
+					p_impl->_dropped++;
+				}
+			}
+
+			p_impl->_cv.notify_all();
+		}
+	}
+};
+
+datagram_receiver::datagram_receiver(unsigned short port, stop_signal& stop) :
+	_d(*new datagram_receiver_impl(port, stop)) {
+	// stop requests and wake ups cut waits short
+	_d._listener_id = _d._stop.add_listener([this]() { _d.interrupt(); });
+}
+
+datagram_receiver::~datagram_receiver() {
+	_d._stop.remove_listener(_d._listener_id);
+	stop();
+	delete& _d;
+}
+
+bool datagram_receiver::start(std::string& error) {
+	if (_d._socket != INVALID_SOCKET)
+		return true;
+
+	if (!_d._wsa_started) {
+		WSADATA wsa_data;
+		const int result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+
+		if (result != 0) {
+			error = winsock_error_string(result);
+			return false;
+		}
+
+		_d._wsa_started = true;
+	}
+
+	_d._socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (_d._socket == INVALID_SOCKET) {
+		error = winsock_error_string(WSAGetLastError());
+		return false;
+	}
+
+	// allow other receivers on this machine to bind to the same port, broadcasts are delivered to each of them
+	BOOL reuse_address = TRUE;
+	setsockopt(_d._socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse_address), sizeof(reuse_address));
+
+	BOOL broadcast = TRUE;
+	setsockopt(_d._socket, SOL_SOCKET, SO_BROADCAST, reinterpret_cast<const char*>(&broadcast), sizeof(broadcast));
+
+	// a larger receive buffer absorbs bursts while the queue is being drained
+	int receive_buffer = datagram_receive_buffer;
+	setsockopt(_d._socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&receive_buffer), sizeof(receive_buffer));
+
+	// ask for the address each datagram was sent to, so that we can tell when multicast reaches us
+	DWORD packet_info = TRUE;
+	if (setsockopt(_d._socket, IPPROTO_IP, IP_PKTINFO, reinterpret_cast<const char*>(&packet_info), sizeof(packet_info)) != SOCKET_ERROR) {
+		GUID recvmsg_id = WSAID_WSARECVMSG;
+		DWORD bytes = 0;
+
+		if (WSAIoctl(_d._socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &recvmsg_id, sizeof(recvmsg_id),
+			&_d._recvmsg, sizeof(_d._recvmsg), &bytes, nullptr, nullptr) == SOCKET_ERROR)
+			_d._recvmsg = nullptr;
+	}
+
+	{
+		std::vector<std::string> host_ips;
+		liblec::lecnet::tcp::get_host_ips(host_ips);
+
+		_d._host_addresses.clear();
+
+		for (const auto& ip : host_ips) {
+			in_addr host_address = {};
+			if (inet_pton(AF_INET, ip.c_str(), &host_address) == 1)
+				_d._host_addresses.push_back(host_address.s_addr);
+		}
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(_d._port);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(_d._socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+		error = winsock_error_string(WSAGetLastError());
+		closesocket(_d._socket);
+		_d._socket = INVALID_SOCKET;
+		return false;
+	}
+
+	try {
+		_d._thread = std::async(std::launch::async, datagram_receiver_impl::receive_func, &_d);
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		closesocket(_d._socket);
+		_d._socket = INVALID_SOCKET;
+		return false;
+	}
+
+	return true;
+}
+
+bool datagram_receiver::set_group(const std::string& group, std::string& error) {
+	if (group == _d._group)
+		return true;
+
+	if (_d._socket == INVALID_SOCKET) {
+		error = "Receiver not started";
+		return false;
+	}
+
+	ip_mreq membership = {};
+	membership.imr_interface.s_addr = htonl(INADDR_ANY);
+
+	if (!_d._group.empty()) {
+		if (inet_pton(AF_INET, _d._group.c_str(), &membership.imr_multiaddr) == 1)
+			setsockopt(_d._socket, IPPROTO_IP, IP_DROP_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership));
+
+		_d._group.clear();
+	}
+
+	if (group.empty())
+		return true;
+
+	// remember the group even if joining fails, so a failed join isn't retried (and reported) until the group changes
+	_d._group = group;
+
+	if (inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1) {
+		error = "Invalid multicast group: " + group;
+		return false;
+	}
+
+	if (setsockopt(_d._socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership)) == SOCKET_ERROR) {
+		error = winsock_error_string(WSAGetLastError());
+		return false;
+	}
+
+	return true;
+}
+
+void datagram_receiver::stop() {
+	if (_d._socket != INVALID_SOCKET) {
+		// closing the socket unblocks the receiving thread
+		closesocket(_d._socket);
+
+		if (_d._thread.valid())
+			_d._thread.wait();
+
+		_d._socket = INVALID_SOCKET;
+		_d._group.clear();	// memberships go with the socket
+	}
+
+	if (_d._wsa_started) {
+		WSACleanup();
+		_d._wsa_started = false;
+	}
+
+	_d.interrupt();
+}
+
+bool datagram_receiver::wait(std::vector<std::string>& datagrams, const std::chrono::milliseconds& timeout) {
+	datagrams.clear();
+
+	std::unique_lock<std::mutex> lock(_d._mutex);
+
+	_d._cv.wait_for(lock, timeout, [this]() { return !_d._queue.empty() || _d._interrupted; });
+	_d._interrupted = false;
+
+	if (_d._queue.empty())
+		return false;
+
+	// take everything that has been queued
+	datagrams.reserve(_d._queue.size());
+
+	for (auto& datagram : _d._queue)
+		datagrams.push_back(std::move(datagram));
+
+	_d._queue.clear();
+	return true;
+}
+
+bool datagram_receiver::take_heard_on_group() {
+	std::lock_guard<std::mutex> lock(_d._mutex);
+	const bool heard = _d._heard_on_group;
+	_d._heard_on_group = false;
+	return heard;
+}
+
+unsigned long long datagram_receiver::take_dropped() {
+	std::lock_guard<std::mutex> lock(_d._mutex);
+	const auto dropped = _d._dropped;
+	_d._dropped = 0;
+	return dropped;
+}
@@ -0,0 +1,128 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+// winsock has to come before anything that pulls in Windows.h
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#include "../collab.h"
+#include "../impl.h"
+
+#pragma comment(lib, "Ws2_32.lib")
+
+class datagram_sender::datagram_sender_impl {
+public:
+	const unsigned short _port;
+
+	bool _wsa_started = false;
+	SOCKET _socket = INVALID_SOCKET;
+
+	// serializes sends, and the lazy creation of the socket
+	std::mutex _mutex;
+
+	datagram_sender_impl(unsigned short port) :
+		_port(port) {}
+
+	bool create_socket(std::string& error) {
+		if (_socket != INVALID_SOCKET)
+			return true;
+
+		if (!_wsa_started) {
+			WSADATA wsa_data;
+			const int result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+
+			if (result != 0) {
+				error = winsock_error_string(result);
+				return false;
+			}
+
+			_wsa_started = true;
+		}
+
+		_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+		if (_socket == INVALID_SOCKET) {
+			error = winsock_error_string(WSAGetLastError());
+			return false;
+		}
+
+		BOOL broadcast = TRUE;
+		setsockopt(_socket, SOL_SOCKET, SO_BROADCAST, reinterpret_cast<const char*>(&broadcast), sizeof(broadcast));
+
+		// let multicast datagrams cross a few routers, the default of 1 keeps them on the local subnet
+		DWORD ttl = multicast_ttl;
+		setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+
+		// deliver multicast datagrams to receivers on this machine too, like broadcasts
+		DWORD loop = TRUE;
+		setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loop), sizeof(loop));
+
+		return true;
+	}
+};
+
+datagram_sender::datagram_sender(unsigned short port) :
+	_d(*new datagram_sender_impl(port)) {}
+
+datagram_sender::~datagram_sender() {
+	if (_d._socket != INVALID_SOCKET)
+		closesocket(_d._socket);
+
+	if (_d._wsa_started)
+		WSACleanup();
+
+	delete& _d;
+}
+
+bool datagram_sender::send(const std::string& datagram, const std::string& address, std::string& error) {
+	if (datagram.size() > max_datagram_size) {
+		error = "Datagram too large";
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(_d._mutex);
+
+	if (!_d.create_socket(error))
+		return false;
+
+	sockaddr_in destination = {};
+	destination.sin_family = AF_INET;
+	destination.sin_port = htons(_d._port);
+
+	if (inet_pton(AF_INET, address.c_str(), &destination.sin_addr) != 1) {
+		error = "Invalid address: " + address;
+		return false;
+	}
+
+	const int sent = sendto(_d._socket, datagram.data(), static_cast<int>(datagram.size()), 0,
+		reinterpret_cast<const sockaddr*>(&destination), sizeof(destination));
+
+	if (sent == SOCKET_ERROR) {
+		error = winsock_error_string(WSAGetLastError());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,145 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+// winsock has to come before anything that pulls in Windows.h
+#include <WinSock2.h>
+
+#include "../collab.h"
+#include "../impl.h"
+
+std::string winsock_error_string(int error_code) {
+	char* p_buffer = nullptr;
+
+	FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+		NULL, error_code, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&p_buffer, 0, NULL);
+
+	std::string error = p_buffer ? p_buffer : "Winsock error " + std::to_string(error_code);
+
+	if (p_buffer)
+		LocalFree(p_buffer);
+
+	// remove trailing new line characters
+	while (!error.empty() && (error.back() == '\n' || error.back() == '\r'))
+		error.pop_back();
+
+	return error;
+}
+
+std::string session_multicast_group(const std::string& session_unique_id) {
+	if (session_unique_id.empty())
+		return discovery_multicast_group;
+
+	const unsigned long long index = session_hash(session_unique_id) % (60 * 256);	// 239.255.68.0 - 239.255.127.255
+
+	return "239.255." + std::to_string(68 + index / 256) + "." + std::to_string(index % 256);
+}
+
+bool collab::impl::send_datagram(datagram_sender& sender, payload_type type, const std::string& payload,
+	const std::string& session_unique_id, std::string& error) {
+	const std::string datagram = add_datagram_header(type, session_unique_id, payload);
+
+	bool sent = false;
+
+	if (_transport == collab::transport::multicast)
+		sent = sender.send(datagram, session_multicast_group(session_unique_id), error);
+
+	// multicast may not be available on this network, and sending to a group that nobody gets
+	// doesn't fail ... broadcast too until peers are heard on a group
+	if (!sent || !group_peers_heard())
+		sent = sender.send(datagram, broadcast_address, error) || sent;
+
+	if (sent) {
+		auto& metrics = channel_metrics_for(type);
+		metrics.datagrams_sent.add();
+		metrics.datagram_bytes_sent.add(datagram.length());
+	}
+
+	return sent;
+}
+
+bool collab::impl::group_peers_heard() {
+	const long long heard = _group_peer_heard;
+
+	if (heard == 0)
+		return false;
+
+	const long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	return now - heard < multicast_peer_timeout;
+}
+
+void collab::impl::count_received_datagrams(payload_type channel, datagram_receiver& receiver,
+	const std::vector<std::string>& datagrams) {
+	// multicast reaches us from our peers, so ours is taken to reach them
+	if (receiver.take_heard_on_group())
+		_group_peer_heard = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	auto& metrics = channel_metrics_for(channel);
+
+	unsigned long long bytes = 0;
+	for (const auto& datagram : datagrams)
+		bytes += datagram.length();
+
+	metrics.datagrams_received.add(datagrams.size());
+	metrics.datagram_bytes_received.add(bytes);
+	metrics.datagram_batch.set(static_cast<long long>(datagrams.size()));
+
+	const auto dropped = receiver.take_dropped();
+	if (dropped > 0)
+		metrics.datagrams_dropped.add(dropped);
+}
+
+void collab::impl::count_deserialize_failure(payload_type channel) {
+	channel_metrics_for(channel).deserialize_failures.add();
+}
+
+collab::traffic collab::get_traffic() {
+	traffic totals;
+
+	for (const auto type : { payload_type::session_list, payload_type::message_list, payload_type::user,
+		payload_type::file_list, payload_type::review_list }) {
+		const auto& metrics = _d.channel_metrics_for(type);
+		totals.datagrams_sent += metrics.datagrams_sent.value();
+		totals.datagram_bytes_sent += metrics.datagram_bytes_sent.value();
+		totals.datagrams_received += metrics.datagrams_received.value();
+		totals.datagram_bytes_received += metrics.datagram_bytes_received.value();
+	}
+
+	totals.transfer_bytes_received = _d._metrics.counter("transfer_bytes.received").value();
+	return totals;
+}
+
+void collab::set_transport(transport transport) {
+	_d._transport = transport;
+
+	// let peers hear from us over the new transport straight away
+	_d.kick_broadcasts();
+}
+
+collab::transport collab::get_transport() {
+	return _d._transport;
+}
@@ -27,6 +27,9 @@
 // lecnet
 #include <liblec/lecnet/tcp.h>
 
+// boost
+#include <boost\serialization\version.hpp>
+
 // serialize template to make collab::review serializable
 template<class Archive>
 void serialize(Archive& ar, collab::review& cls, const unsigned int version) {
@@ -54,8 +57,14 @@ void serialize(Archive& ar, review_broadcast_structure& cls, const unsigned int
 	ar& cls.source_node_unique_id;
 	ar& cls.ips;
 	ar& cls.review_list;
+
+	// version 1 adds the source node's transfer port
+	if (version > 0)
+		ar& cls.transfer_port;
 }
 
+BOOST_CLASS_VERSION(review_broadcast_structure, 1)
+
 bool serialize_review_broadcast_structure(const review_broadcast_structure& cls,
 	std::string& serialized, std::string& error) {
 	error.clear();
@@ -94,24 +103,49 @@ bool deserialize_review_broadcast_structure(const std::string& serialized,
 	}
 }
 
+// selects reviews with the interned ids resolved, to be followed by a WHERE clause on r
+// times are read back as real numbers because leccore's integer getter is only 32 bits wide
+const char review_query[] =
+	"SELECT r.UniqueID AS UniqueID, CAST(r.Time AS REAL) AS Time, s.Value AS SessionID, "
+	"r.FileHash AS FileHash, u.Value AS SenderUniqueID, r.Text AS Text "
+	"FROM FileReviews r "
+	"JOIN Identifiers s ON s.ID = r.SessionKey "
+	"JOIN Identifiers u ON u.ID = r.SenderKey ";
+
+std::shared_ptr<const review_tree> get_review_tree(collab& collab, merkle_cache<collab::review>& trees,
+	const std::string& session_unique_id) {
+	return trees.get(session_unique_id, [&](std::vector<collab::review>& reviews) {
+		std::string error;
+		return collab.get_reviews(session_unique_id, reviews, error);
+		}, [](const collab::review& review) { return review.unique_id; });
+}
+
 class review_source : public liblec::lecnet::tcp::server_async_ssl {
 	collab& _collab;
+	metrics_registry& _metrics;
+	merkle_cache<collab::review>& _trees;
 
 public:
-	review_source(collab& collab) :
-		_collab(collab) {}
+	review_source(collab& collab, metrics_registry& metrics, merkle_cache<collab::review>& trees) :
+		_collab(collab), _metrics(metrics), _trees(trees) {}
 
 private:
 	// overrides
 	void log(const std::string& time_stamp, const std::string& event) override {}
 	std::string on_receive(const client_address& address, const std::string& data_received) override {
-		return on_receive(data_received);
+		std::string reply = on_receive(data_received);
+		count_transfer(_metrics, "sent", address.address, reply.length());
+		return reply;
 	}
 
 	// overload
 	// datareceived is simply the review unique id
 	// data returned is simply the review text
 	std::string on_receive(const std::string& review_unique_id) {
+		std::string session_unique_id, prefix;
+		if (parse_merkle_request(review_unique_id, session_unique_id, prefix))
+			return on_merkle_request(session_unique_id, prefix);
+
 		collab::review review;
 
 		std::string error;
@@ -120,19 +154,55 @@ private:
 		else
 			return review.text;
 	}
+
+	// list the headers of the session's reviews beneath the requested node of the review tree
+	std::string on_merkle_request(const std::string& session_unique_id, const std::string& prefix) {
+		const auto p_tree = get_review_tree(_collab, _trees, session_unique_id);
+
+		if (!p_tree)
+			return std::string();
+
+		return answer_merkle_request(p_tree->tree, prefix, [&](const std::set<std::string>& keys) {
+			review_broadcast_structure cls;
+			cls.source_node_unique_id = _collab.unique_id();
+
+			for (const auto& key : keys) {
+				auto it = p_tree->items.find(key);
+				if (it == p_tree->items.end())
+					continue;
+
+				const auto& review = it->second;
+
+				review_header_structure header;
+				header.unique_id = review.unique_id;
+				header.session_id = review.session_id;
+				header.time = review.time;
+				header.file_hash = review.file_hash;
+				header.sender_unique_id = review.sender_unique_id;
+
+				cls.review_list.push_back(header);
+			}
+
+			std::string serialized, error;
+			if (!serialize_review_broadcast_structure(cls, serialized, error))
+				serialized.clear();
+
+			return serialized;
+		});
+	}
 };
 
 void collab::impl::review_broadcast_sender_func(impl* p_impl) {
 	// create a review source object
 	liblec::lecnet::tcp::server::server_params params;
-	params.port = REVIEW_TRANSFER_PORT;
+	params.port = node_port(p_impl->_transfer_port, REVIEW_TRANSFER_PORT);
 	params.magic_number = review_transfer_magic_number;
-	params.max_clients = 1;
+	params.max_clients = max_review_source_clients;
 	params.server_cert = p_impl->cert_folder() + "\\collab.source";
 	params.server_cert_key = p_impl->cert_folder() + "\\collab.source";
 	params.server_cert_key_password = "com.github.alecmus.collab.source";
 
-	review_source source(p_impl->_collab);
+	review_source source(p_impl->_collab, p_impl->_metrics, p_impl->_review_trees);
 
 	// start the source
 	if (!source.start(params)) {
@@ -143,25 +213,27 @@ void collab::impl::review_broadcast_sender_func(impl* p_impl) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 
 	if (source.running()) {
-		p_impl->_log("Review source started");
+		p_impl->_log(log_event::source_started, "Review");
 
 		{
 			liblec::auto_mutex lock(p_impl->_review_source_mutex);
 			p_impl->_review_source_running = true;
 		}
 
-		// create a broadcast sender object
-		liblec::lecnet::udp::broadcast::sender sender(REVIEW_BROADCAST_PORT);
+		// create a datagram sender object
+		datagram_sender sender(node_port(p_impl->_broadcast_port, REVIEW_BROADCAST_PORT));
 
-		// loop until _stop_session_broadcast is false
+		// loop until a stop is requested
 		while (source.running()) {
-			{
-				liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+			// check if a stop has been requested
+			if (p_impl->_stop.stop_requested())
+				break;
 
-				// check flag
-				if (p_impl->_stop_session_broadcast)
-					break;
-			}
+			// wake ups from here on cut the next breath short
+			const auto wake_count = p_impl->_stop.wake_count();
+
+			// the broadcast, left empty if there is nothing to broadcast
+			std::string serialized_review_list;
 
 			std::string current_session_unique_id;
 
@@ -172,63 +244,48 @@ void collab::impl::review_broadcast_sender_func(impl* p_impl) {
 
 			if (!current_session_unique_id.empty()) {
 				std::string error;
-				std::vector<review> local_review_list;
 
-				// get review list from local database
-				if (p_impl->_collab.get_reviews(current_session_unique_id, local_review_list, error)) {
+				// get the review tree, the database is only read if the reviews have changed
+				const auto p_tree = get_review_tree(p_impl->_collab, p_impl->_review_trees, current_session_unique_id);
 
-					// make a revies broadcast object
-					std::string serialized_review_list;
-					review_broadcast_structure cls;
+				if (p_tree) {
+					// summarize the review list, peers that find that the summary differs look into it over tcp
+					merkle_summary_structure cls = make_merkle_summary(p_tree->tree);
 
 					// capture source node unique id
 					cls.source_node_unique_id = p_impl->_collab.unique_id();
 
-					// capture host ip addresses
+					// capture host ip addresses and the port peers can reach the review source on
 					liblec::lecnet::tcp::get_host_ips(cls.ips);
+					cls.transfer_port = p_impl->_transfer_port;
 
-					// capture local review header (excludes review text)
-					cls.review_list.reserve(local_review_list.size());
+					cls.session_id = current_session_unique_id;
 
-					for (const auto& review : local_review_list) {
-						review_header_structure header;
-						header.unique_id = review.unique_id;
-						header.session_id = review.session_id;
-						header.time = review.time;
-						header.file_hash = review.file_hash;
-						header.sender_unique_id = review.sender_unique_id;
-
-						cls.review_list.push_back(header);
-					}
-
-					// serialize the review broadcast object
-					if (serialize_review_broadcast_structure(cls, serialized_review_list, error)) {
+					// serialize the review summary object
+					if (!serialize_merkle_summary_structure(cls, serialized_review_list, error))
+						serialized_review_list.clear();
+				}
+			}
 
-						// broadcast the serialized object
-						unsigned long actual_count = 0;
-						if (sender.send(serialized_review_list, 1, 0, actual_count, error)) {
-							// broadcast successful
-						}
-					}
+			// broadcast the serialized object if it's due
+			if (p_impl->_review_cadence.due(serialized_review_list) && !serialized_review_list.empty()) {
+				std::string error;
+				if (p_impl->send_datagram(sender, payload_type::review_summary, serialized_review_list, current_session_unique_id, error)) {
+					// broadcast successful
 				}
 			}
 
-			// take a breath
-			std::this_thread::sleep_for(std::chrono::milliseconds{ review_broadcast_cycle });
+			// take a breath until the next broadcast is due, a change wakes us up sooner
+			p_impl->_stop.sleep_for(p_impl->_review_cadence.time_to_next(), wake_count);
 		}
 
-		bool stopped_by_request = false;
-
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
-			stopped_by_request = p_impl->_stop_session_broadcast == true;
-		}
+		const bool stopped_by_request = p_impl->_stop.stop_requested();
 
 		if (!stopped_by_request)
-			p_impl->_log("Error: review source stopped");
+			p_impl->_log(log_event::source_stopped, "review");
 	}
 	else {
-		p_impl->_log("Error: review source failed to start");
+		p_impl->_log(log_event::source_start_failed, "review");
 
 		liblec::auto_mutex lock(p_impl->_review_source_mutex);
 		p_impl->_review_source_running = false;
@@ -250,18 +307,22 @@ void collab::impl::review_broadcast_sender_func(impl* p_impl) {
 }
 
 void collab::impl::review_broadcast_receiver_func(impl* p_impl) {
-	// create broadcast receiver object
-	liblec::lecnet::udp::broadcast::receiver receiver(REVIEW_BROADCAST_PORT, "0.0.0.0");
-
-	// loop until _stop_session_broadcast is false
-	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+	// create datagram receiver object
+	datagram_receiver receiver(node_port(p_impl->_broadcast_port, REVIEW_BROADCAST_PORT), p_impl->_stop);
 
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
+	{
+		std::string error;
+		if (!receiver.start(error)) {
+			p_impl->_log(log_event::receiver_start_failed, "review", error);
+			return;
 		}
+	}
+
+	// loop until a stop is requested
+	while (true) {
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
 		std::string current_session_unique_id;
 
@@ -270,133 +331,242 @@ void collab::impl::review_broadcast_receiver_func(impl* p_impl) {
 			current_session_unique_id = p_impl->_current_session_unique_id;
 		}
 
+		{
+			// listen on the session's multicast group, broadcasts are received regardless
+			std::string error;
+			if (!receiver.set_group(session_multicast_group(current_session_unique_id), error))
+				p_impl->_log(log_event::receiver_join_failed, "review", error);
+		}
+
 		if (!current_session_unique_id.empty()) {
 			std::string error;
 
 			// check if collab.sink file exists
 			if (!file_available(p_impl->cert_folder() + "\\collab.sink")) {
-				p_impl->_log("Error: sink file not available. No reviews will be received.");
+				p_impl->_log(log_event::sink_unavailable, "reviews");
 				break;
 			}
 
-			// run the receiver
-			if (receiver.run(review_receiver_cycle, error)) {
-				// loop while running
-				while (receiver.running())
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			// wait for datagrams, a stop request or session change cuts the wait short
+			std::vector<std::string> datagrams;
+			if (receiver.wait(datagrams, std::chrono::milliseconds{ review_receiver_cycle })) {
+				p_impl->count_received_datagrams(payload_type::review_list, receiver, datagrams);
 
-				// no longer running ... check if a datagram was received
-				std::string serialized_review_list;
-				if (receiver.get(serialized_review_list, error)) {
-					// datagram received ... deserialize
+				// the local review tree, only looked up if a summary comes in
+				std::shared_ptr<const review_tree> p_local_tree;
 
-					review_broadcast_structure cls;
-					if (deserialize_review_broadcast_structure(serialized_review_list, cls, error)) {
-						// deserialized successfully
-
-						// check if data is coming from a different node
-						if (cls.source_node_unique_id == p_impl->_collab.unique_id())
-							continue;	// ignore this data
-
-						// check if any review is missing in the local database
-						for (const auto& it : cls.review_list) {
-							if (it.session_id != current_session_unique_id)
-								continue;	// ignore this data, it's for another session
-
-							// check if review exists in the session (local database)
-							if (!p_impl->_collab.review_exists(it.unique_id)) {
-								p_impl->_log("New review found (UDP): '" + shorten_unique_id(it.unique_id) + "' (source node: " + shorten_unique_id(cls.source_node_unique_id) + ")");
-
-								bool downloaded = false;	// flag to determine if review text has been downloaded
-								std::string text;
-
-								// get sink IP list
-								std::vector<std::string> ips_client;
-								liblec::lecnet::tcp::get_host_ips(ips_client);
-
-								// select the ip to connect to
-								const std::string selected_ip = select_ip(cls.ips, ips_client);
-
-								// configure tcp/ip sink parameters
-								liblec::lecnet::tcp::client::client_params params;
-								params.address = selected_ip;
-								params.port = REVIEW_TRANSFER_PORT;
-								params.magic_number = review_transfer_magic_number;
-								params.use_ssl = true;
-								params.ca_cert_path = p_impl->cert_folder() + "\\collab.sink";
-
-								// create tcp/ip sink object
-								liblec::lecnet::tcp::client sink;
-
-								if (sink.connect(params, error)) {
-									while (sink.connecting())
-										std::this_thread::sleep_for(std::chrono::milliseconds(1));
-
-									if (sink.connected(error)) {
-										// review unique_id
-
-										p_impl->_log("Connected via TCP to " + selected_ip + " to download review '" + shorten_unique_id(it.unique_id));
-
-										if (sink.send_data(it.unique_id, text, 10, nullptr, error)) {
-											downloaded = true;
-										}
-										else {
-											p_impl->_log("Error downloading review'" + shorten_unique_id(it.unique_id) + "': " + error);
-											break;
-										}
-
-										// disconnect tcp sink
-										sink.disconnect();
-									}
-									else
-										p_impl->_log("TCP connection for downloading review '" + shorten_unique_id(it.unique_id) + "' from " + selected_ip + " failed: " + error);
-								}
-								else
-									p_impl->_log("TCP connection for downloading review '" + shorten_unique_id(it.unique_id) + "' from " + selected_ip + " failed: " + error);
-
-								if (downloaded) {
-									// add this review to the local database (full review including text)
-									collab::review review;
-
-									// clone details from review broadcast structure
-									review.unique_id = it.unique_id;
-									review.time = it.time;
-									review.session_id = it.session_id;
-									review.file_hash = it.file_hash;
-									review.sender_unique_id = it.sender_unique_id;
-
-									// add the text downloaded via TCP to make a complete review structure
-									review.text = text;
-
-									if (p_impl->_collab.create_review(review, error)) {
-										// review added successfully to the local database
-										p_impl->_log("Review '" + shorten_unique_id(it.unique_id) + "' saved successfully");
-									}
-									else
-										p_impl->_log("Entry failed for review '" + shorten_unique_id(it.unique_id) + "': " + error);
-								}
-							}
-						}
+				// process every datagram received
+				for (auto& serialized_review_list : datagrams) {
+					// discard datagrams for other channels and sessions before going to the trouble of decoding them
+					if (!strip_datagram_header(serialized_review_list, payload_type::review_summary, current_session_unique_id))
+						continue;
+
+					// datagram received ... deserialize
+					merkle_summary_structure summary;
+					if (!deserialize_merkle_summary_structure(serialized_review_list, summary, error)) {
+						p_impl->count_deserialize_failure(payload_type::review_summary);
+						continue;
 					}
+
+					// check if data is coming from a different node
+					if (summary.source_node_unique_id == p_impl->_collab.unique_id() ||
+						summary.session_id != current_session_unique_id)
+						continue;	// ignore this data
+
+					if (!p_local_tree)
+						p_local_tree = get_review_tree(p_impl->_collab, p_impl->_review_trees, current_session_unique_id);
+
+					if (p_local_tree && summary.root == p_local_tree->tree.hash(""))
+						continue;	// same reviews
+
+					// the peer may be missing some of our reviews too, let it see our summary soon
+					p_impl->_review_cadence.hurry();
+
+					// look into the parts of the source's review tree that differ on a download worker,
+					// the round trips would otherwise keep this thread from listening
+					p_impl->queue_merkle_descent(payload_type::review_summary, summary);
 				}
 			}
-
-			receiver.stop();
 		}
 		else {
 			// take a breath
-			std::this_thread::sleep_for(std::chrono::milliseconds{ review_receiver_cycle });
+			p_impl->_stop.sleep_for(std::chrono::milliseconds{ review_receiver_cycle });
 		}
 	}
 }
 
+void collab::impl::receive_review_list(impl* p_impl, const review_broadcast_structure& cls,
+	const std::string& current_session_unique_id) {
+	// check if any review is missing in the local database
+	for (const auto& it : cls.review_list) {
+		if (it.session_id != current_session_unique_id)
+			continue;	// ignore this data, it's for another session
+
+		// check if review exists in the session (local database)
+		if (!p_impl->_collab.review_exists(it.unique_id)) {
+			{
+				std::lock_guard<std::mutex> lock(p_impl->_review_fetch_mutex);
+
+				if (!p_impl->_pending_review_fetches.insert(it.unique_id).second)
+					continue;	// already being fetched
+
+				// fetch the review on the review fetch worker so that this thread can get back to listening
+				review_fetch fetch;
+				fetch.header = it;
+				fetch.ips = cls.ips;
+				fetch.transfer_port = cls.transfer_port;
+				p_impl->_review_fetch_queue.push_back(fetch);
+			}
+
+			p_impl->_review_fetch_cv.notify_one();
+
+			p_impl->_log(log_event::review_found, log_id{ it.unique_id }, log_id{ cls.source_node_unique_id });
+			p_impl->_trace.mark(it.unique_id, "review.found", "from " + shorten_unique_id(cls.source_node_unique_id));
+		}
+	}
+}
+
+void collab::impl::review_fetch_worker_func(impl* p_impl) {
+	while (true) {
+		review_fetch fetch;
+
+		{
+			std::unique_lock<std::mutex> lock(p_impl->_review_fetch_mutex);
+
+			// wait for a review to fetch
+			p_impl->_review_fetch_cv.wait(lock, [p_impl]() {
+				return p_impl->_stop_review_fetches || !p_impl->_review_fetch_queue.empty();
+				});
+
+			if (p_impl->_stop_review_fetches)
+				break;
+
+			fetch = p_impl->_review_fetch_queue.front();
+			p_impl->_review_fetch_queue.pop_front();
+		}
+
+		fetch_review(p_impl, fetch.header, fetch.ips, fetch.transfer_port);
+
+		std::lock_guard<std::mutex> lock(p_impl->_review_fetch_mutex);
+		p_impl->_pending_review_fetches.erase(fetch.header.unique_id);
+	}
+}
+
+void collab::impl::fetch_review(impl* p_impl, const review_header_structure& header,
+	const std::vector<std::string>& ips, unsigned short transfer_port) {
+	std::string error;
+
+	bool downloaded = false;	// flag to determine if review text has been downloaded
+	std::string text;
+
+	const auto download_start = std::chrono::steady_clock::now();
+	const auto download_start_us = trace_clock_now();
+
+	// get sink IP list
+	std::vector<std::string> ips_client;
+	liblec::lecnet::tcp::get_host_ips(ips_client);
+
+	// select the ip to connect to
+	const std::string selected_ip = select_ip(ips, ips_client);
+
+	// configure tcp/ip sink parameters
+	liblec::lecnet::tcp::client::client_params params;
+	params.address = selected_ip;
+	params.port = node_port(transfer_port, REVIEW_TRANSFER_PORT);
+	params.magic_number = review_transfer_magic_number;
+	params.use_ssl = true;
+	params.ca_cert_path = p_impl->cert_folder() + "\\collab.sink";
+
+	// create tcp/ip sink object
+	liblec::lecnet::tcp::client sink;
+
+	if (sink.connect(params, error)) {
+		while (sink.connecting())
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		if (sink.connected(error)) {
+			// review unique_id
+
+			p_impl->_log(log_event::review_download_connected, selected_ip, log_id{ header.unique_id });
+
+			// reviews are interactive content, they go ahead of any file downloads
+			const long long ticket = p_impl->_transfer_scheduler.enqueue(header.unique_id,
+				"Review " + shorten_unique_id(header.unique_id), selected_ip, transfer_priority::interactive, 0);
+
+			bool sent = false;
+
+			if (p_impl->_transfer_scheduler.acquire(ticket)) {
+				sent = sink.send_data(header.unique_id, text, 10, nullptr, error);
+
+				if (sent) {
+					p_impl->_transfer_scheduler.consume(ticket, text.length());
+					count_transfer(p_impl->_metrics, "received", selected_ip, text.length());
+				}
+			}
+			else
+				error = "Download cancelled";
+
+			p_impl->_transfer_scheduler.complete(ticket);
+
+			if (sent) {
+				downloaded = true;
+			}
+			else {
+				p_impl->_log(log_event::review_download_failed, log_id{ header.unique_id }, error);
+				return;
+			}
+
+			// disconnect tcp sink
+			sink.disconnect();
+		}
+		else
+			p_impl->_log(log_event::review_connection_failed, log_id{ header.unique_id }, selected_ip, error);
+	}
+	else
+		p_impl->_log(log_event::review_connection_failed, log_id{ header.unique_id }, selected_ip, error);
+
+	const auto download_time = std::chrono::steady_clock::now() - download_start;
+	p_impl->_trace.record(header.unique_id, "review.download", download_start_us,
+		std::chrono::duration_cast<std::chrono::microseconds>(download_time).count(),
+		(downloaded ? "from " : "failed, from ") + selected_ip);
+
+	if (downloaded)
+		p_impl->_metrics.histogram("download.review").record(download_time);
+	else
+		p_impl->_metrics.counter("download_failures.review").add();
+
+	if (downloaded) {
+		// add this review to the local database (full review including text)
+		collab::review review;
+
+		// clone details from review broadcast structure
+		review.unique_id = header.unique_id;
+		review.time = header.time;
+		review.session_id = header.session_id;
+		review.file_hash = header.file_hash;
+		review.sender_unique_id = header.sender_unique_id;
+
+		// add the text downloaded via TCP to make a complete review structure
+		review.text = text;
+
+		if (p_impl->_collab.create_review(review, error)) {
+			// review added successfully to the local database
+			p_impl->_log(log_event::review_saved, log_id{ header.unique_id });
+		}
+		else
+			p_impl->_log(log_event::review_save_failed, log_id{ header.unique_id }, error);
+	}
+}
+
 bool collab::impl::review_source_running() {
 	liblec::auto_mutex lock(_review_source_mutex);
 	return _review_source_running;
 }
 
 bool collab::create_review(const review& review, std::string& error) {
+	scoped_trace trace(_d._trace, review.unique_id, "review.store");
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.create_review);
 
 	// get optional object
 	auto con_opt = _d.get_connection();
@@ -409,29 +579,32 @@ bool collab::create_review(const review& review, std::string& error) {
 	// get database connection object reference
 	auto& con = con_opt.value().get();
 
-	// create table if it doesn't exist
-	if (!con.execute("CREATE TABLE IF NOT EXISTS FileReviews "
-		"(UniqueID TEXT NOT NULL, "
-		"Time REAL NOT NULL, "
-		"SessionID TEXT NOT NULL, "
-		"FileHash TEXT NOT NULL, "
-		"SenderUniqueID TEXT NOT NULL, "
-		"Text TEXT NOT NULL, PRIMARY KEY(UniqueID));",
-		{}, error))
+	if (!intern_identifier(con, review.session_id, error) ||
+		!intern_identifier(con, review.sender_unique_id, error))
 		return false;
 
 	// insert data into table
-	if (!con.execute("INSERT INTO FileReviews VALUES(?, ?, ?, ?, ?, ?);",
+	if (!con.execute("INSERT INTO FileReviews (UniqueID, Time, SessionKey, FileHash, SenderKey, Text) "
+		"VALUES(?, ?, (SELECT ID FROM Identifiers WHERE Value = ?), ?, (SELECT ID FROM Identifiers WHERE Value = ?), ?);",
 		{ review.unique_id, static_cast<double>(review.time), review.session_id, review.file_hash, review.sender_unique_id,
 		review.text }, error))
 		return false;
 
+	_d.add_to_search_index(con, search_hit::item_type::review, review.unique_id, review.session_id, review.time, review.text);
+
+	// the session's review tree has changed
+	_d._review_trees.invalidate(review.session_id);
+
+	// broadcast the change straight away
+	_d._review_cadence.kick();
+
 	return true;
 }
 
 bool collab::get_reviews(const std::string& session_unique_id,
 	std::vector<review>& reviews, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_reviews);
 
 	reviews.clear();
 
@@ -454,9 +627,8 @@ bool collab::get_reviews(const std::string& session_unique_id,
 	liblec::leccore::database::table results;
 
 	if (!con.execute_query(
-		"SELECT UniqueID, Time, SessionID, FileHash, SenderUniqueID, Text "
-		"FROM FileReviews "
-		"WHERE SessionID = ? ORDER BY Time DESC;",
+		std::string(review_query) +
+		"WHERE r.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) ORDER BY r.Time DESC;",
 		{ session_unique_id }, results, error))
 		return false;
 
@@ -495,6 +667,7 @@ bool collab::get_reviews(const std::string& session_unique_id,
 
 bool collab::get_reviews(const std::string& session_unique_id, const std::string& file_hash, std::vector<review>& reviews, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_reviews);
 
 	reviews.clear();
 
@@ -517,10 +690,9 @@ bool collab::get_reviews(const std::string& session_unique_id, const std::string
 	liblec::leccore::database::table results;
 
 	if (!con.execute_query(
-		"SELECT UniqueID, Time, SessionID, FileHash, SenderUniqueID, Text "
-		"FROM FileReviews "
-		"WHERE SessionID = ? AND FileHash = ? "
-		"ORDER BY Time DESC;",
+		std::string(review_query) +
+		"WHERE r.SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) AND r.FileHash = ? "
+		"ORDER BY r.Time DESC;",
 		{ session_unique_id, file_hash }, results, error))
 		return false;
 
@@ -559,6 +731,7 @@ bool collab::get_reviews(const std::string& session_unique_id, const std::string
 
 bool collab::get_review(const std::string& unique_id, review& review, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_review);
 
 	review = {};
 
@@ -581,9 +754,8 @@ bool collab::get_review(const std::string& unique_id, review& review, std::strin
 	liblec::leccore::database::table results;
 
 	if (!con.execute_query(
-		"SELECT UniqueID, Time, SessionID, FileHash, SenderUniqueID, Text "
-		"FROM FileReviews "
-		"WHERE UniqueID = ?;",
+		std::string(review_query) +
+		"WHERE r.UniqueID = ?;",
 		{ unique_id }, results, error))
 		return false;
 
@@ -0,0 +1,358 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../collab.h"
+#include "../impl.h"
+
+// STL
+#include <algorithm>
+#include <cctype>
+
+namespace {
+	std::string item_type_name(collab::search_hit::item_type type) {
+		return type == collab::search_hit::item_type::review ? "review" : "message";
+	}
+
+	collab::search_hit::item_type parse_item_type(const std::string& name) {
+		return name == "review" ? collab::search_hit::item_type::review : collab::search_hit::item_type::message;
+	}
+
+	std::vector<std::string> split_words(const std::string& query) {
+		std::vector<std::string> words;
+		std::istringstream ss(query);
+
+		std::string word;
+		while (ss >> word)
+			words.push_back(word);
+
+		return words;
+	}
+
+	// make an fts5 query out of the words: each word is quoted so that it's taken literally,
+	// and made a prefix so that it also matches longer words
+	std::string make_match_query(const std::vector<std::string>& words) {
+		std::string match;
+
+		for (const auto& word : words) {
+			if (!match.empty())
+				match += " ";
+
+			match += "\"";
+
+			for (const auto& c : word) {
+				if (c == '"')
+					match += "\"\"";
+				else
+					match += c;
+			}
+
+			match += "\"*";
+		}
+
+		return match;
+	}
+
+	// make a LIKE pattern that matches the word anywhere, escaping the characters LIKE treats specially
+	std::string make_like_pattern(const std::string& word) {
+		std::string pattern = "%";
+
+		for (const auto& c : word) {
+			if (c == '%' || c == '_' || c == '\\')
+				pattern += '\\';
+
+			pattern += c;
+		}
+
+		return pattern + "%";
+	}
+
+	// the index marks matches with these, they're swapped for tags once the text has been escaped
+	const char match_start_marker = '\x02';
+	const char match_end_marker = '\x03';
+
+	// escape the text so that it's shown as is, rather than taken for markup
+	std::string escape_markup(const std::string& text) {
+		std::string escaped;
+		escaped.reserve(text.length());
+
+		for (const auto& c : text) {
+			switch (c) {
+			case '&': escaped += "&amp;"; break;
+			case '<': escaped += "&lt;"; break;
+			case '>': escaped += "&gt;"; break;
+			case '"': escaped += "&quot;"; break;
+			default: escaped += c; break;
+			}
+		}
+
+		return escaped;
+	}
+
+	// escape an extract from the index and put the matches in bold
+	std::string markup_snippet(const std::string& text) {
+		std::string snippet = escape_markup(text);
+		std::string marked;
+		marked.reserve(snippet.length());
+
+		for (const auto& c : snippet) {
+			if (c == match_start_marker)
+				marked += "<strong>";
+			else
+				if (c == match_end_marker)
+					marked += "</strong>";
+				else
+					marked += c;
+		}
+
+		return marked;
+	}
+
+	// cut an extract out of the text around the first occurrence of the word, with the word in bold
+	// the text is escaped, so the only markup in the extract is the bold
+	std::string make_snippet(const std::string& text, const std::string& word) {
+		auto it = std::search(text.begin(), text.end(), word.begin(), word.end(), [](char a, char b) {
+			return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+			});
+
+		const size_t position = it == text.end() ? 0 : static_cast<size_t>(it - text.begin());
+		const size_t length = it == text.end() ? 0 : word.length();
+
+		size_t start = position > search_snippet_length / 3 ? position - search_snippet_length / 3 : 0;
+		size_t end = (std::min)(text.length(), start + search_snippet_length);
+
+		// don't cut utf-8 characters in half
+		while (start > 0 && (static_cast<unsigned char>(text[start]) & 0xC0) == 0x80)
+			start--;
+
+		while (end < text.length() && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80)
+			end++;
+
+		std::string snippet = start > 0 ? "..." : "";
+		snippet += escape_markup(text.substr(start, position - start));
+
+		if (length > 0)
+			snippet += "<strong>" + escape_markup(text.substr(position, length)) + "</strong>";
+
+		if (position + length < end)
+			snippet += escape_markup(text.substr(position + length, end - position - length));
+
+		if (end < text.length())
+			snippet += "...";
+
+		return snippet;
+	}
+}
+
+bool collab::impl::create_search_index(liblec::leccore::database::connection& con, std::string& error) {
+	liblec::leccore::database::table results;
+
+	if (!con.execute_query("SELECT name FROM sqlite_master WHERE type = 'table' AND name = 'SearchIndex';",
+		{}, results, error))
+		return false;
+
+	if (!results.data.empty()) {
+		_search_index_available = true;
+		return true;
+	}
+
+	// the session key, time and so on are only carried along, just the text is indexed
+	if (!con.execute("CREATE VIRTUAL TABLE SearchIndex USING fts5"
+		"(Text, "
+		"Kind UNINDEXED, "
+		"ItemID UNINDEXED, "
+		"SessionKey UNINDEXED, "
+		"Time UNINDEXED, "
+		"tokenize = 'unicode61 remove_diacritics 2');",
+		{}, error)) {
+		// this build of sqlcipher doesn't have fts5, searches will have to scan the text
+		_log(log_event::search_index_unavailable, error);
+		error.clear();
+
+		_search_index_available = false;
+		return true;
+	}
+
+	_log(log_event::search_index_building);
+
+	// index the existing messages and reviews
+	if (!con.execute("BEGIN TRANSACTION;", {}, error))
+		return false;
+
+	if (!con.execute("INSERT INTO SearchIndex (Text, Kind, ItemID, SessionKey, Time) "
+		"SELECT Message, 'message', UniqueID, SessionKey, Time FROM SessionMessages;", {}, error) ||
+		!con.execute("INSERT INTO SearchIndex (Text, Kind, ItemID, SessionKey, Time) "
+		"SELECT Text, 'review', UniqueID, SessionKey, Time FROM FileReviews;", {}, error)) {
+		std::string rollback_error;
+		if (!con.execute("ROLLBACK;", {}, rollback_error)) {}
+
+		return false;
+	}
+
+	if (!con.execute("COMMIT;", {}, error))
+		return false;
+
+	_search_index_available = true;
+	return true;
+}
+
+void collab::impl::add_to_search_index(liblec::leccore::database::connection& con, collab::search_hit::item_type type,
+	const std::string& unique_id, const std::string& session_unique_id, long long time,
+	const std::string& text) {
+	if (!_search_index_available)
+		return;
+
+	std::string error;
+	if (!con.execute("INSERT INTO SearchIndex (Text, Kind, ItemID, SessionKey, Time) "
+		"VALUES(?, ?, ?, (SELECT ID FROM Identifiers WHERE Value = ?), ?);",
+		{ text, item_type_name(type), unique_id, session_unique_id, static_cast<double>(time) }, error))
+		_log(log_event::search_index_failed, item_type_name(type), log_id{ unique_id }, error);
+}
+
+bool collab::search(const std::string& session_unique_id,
+	const std::string& query,
+	int limit, int cursor,
+	std::vector<search_hit>& hits,
+	int& next_cursor,
+	std::string& error) {
+	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.search);
+
+	hits.clear();
+	next_cursor = -1;
+
+	if (session_unique_id.empty()) {
+		error = "Session unique id not supplied";
+		return false;
+	}
+
+	const auto words = split_words(query);
+
+	if (words.empty()) {
+		error = "Search query not supplied";
+		return false;
+	}
+
+	limit = (std::max)(limit, 1);
+	cursor = (std::max)(cursor, 0);
+
+	// get optional object
+	auto con_opt = _d.get_connection();
+
+	if (!con_opt.has_value()) {
+		error = "No database connection";
+		return false;
+	}
+
+	// get database connection object reference
+	auto& con = con_opt.value().get();
+
+	liblec::leccore::database::table results;
+
+	// one more hit than asked for is fetched, to tell whether there is another page
+	if (_d._search_index_available) {
+		if (!con.execute_query(
+			"SELECT Kind, ItemID, CAST(Time AS REAL) AS Time, "
+			"snippet(SearchIndex, 0, char(2), char(3), '...', " + std::to_string(search_snippet_tokens) + ") AS Snippet "
+			"FROM SearchIndex "
+			"WHERE SearchIndex MATCH ? AND SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) "
+			"ORDER BY rank "
+			"LIMIT ? OFFSET ?;",
+			{ make_match_query(words), session_unique_id, limit + 1, cursor }, results, error))
+			return false;
+	}
+	else {
+		// scan the text for every word, the conditions are repeated for messages and reviews
+		std::string message_conditions, review_conditions;
+		std::vector<std::any> values;
+
+		values.push_back(session_unique_id);
+
+		for (const auto& word : words) {
+			message_conditions += "AND Message LIKE ? ESCAPE '\\' ";
+			values.push_back(make_like_pattern(word));
+		}
+
+		values.push_back(session_unique_id);
+
+		for (const auto& word : words) {
+			review_conditions += "AND Text LIKE ? ESCAPE '\\' ";
+			values.push_back(make_like_pattern(word));
+		}
+
+		values.push_back(limit + 1);
+		values.push_back(cursor);
+
+		if (!con.execute_query(
+			"SELECT 'message' AS Kind, UniqueID AS ItemID, CAST(Time AS REAL) AS Time, Message AS Snippet "
+			"FROM SessionMessages "
+			"WHERE SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) " + message_conditions +
+			"UNION ALL "
+			"SELECT 'review' AS Kind, UniqueID AS ItemID, CAST(Time AS REAL) AS Time, Text AS Snippet "
+			"FROM FileReviews "
+			"WHERE SessionKey = (SELECT ID FROM Identifiers WHERE Value = ?) " + review_conditions +
+			"ORDER BY Time DESC "
+			"LIMIT ? OFFSET ?;",
+			values, results, error))
+			return false;
+	}
+
+	for (auto& row : results.data) {
+		if (static_cast<int>(hits.size()) == limit) {
+			// there is at least one more hit
+			next_cursor = cursor + limit;
+			break;
+		}
+
+		search_hit hit;
+
+		try {
+			if (row.at("Kind").has_value())
+				hit.type = parse_item_type(liblec::leccore::database::get::text(row.at("Kind")));
+
+			if (row.at("ItemID").has_value())
+				hit.unique_id = liblec::leccore::database::get::text(row.at("ItemID"));
+
+			if (row.at("Time").has_value())
+				hit.time = static_cast<long long>(liblec::leccore::database::get::real(row.at("Time")));
+
+			if (row.at("Snippet").has_value())
+				hit.snippet = liblec::leccore::database::get::text(row.at("Snippet"));
+
+			// when scanning, the whole text comes back ... cut it down
+			if (_d._search_index_available)
+				hit.snippet = markup_snippet(hit.snippet);
+			else
+				hit.snippet = make_snippet(hit.snippet, words.front());
+
+			hits.push_back(hit);
+		}
+		catch (const std::exception& e) {
+			error = e.what();
+			return false;
+		}
+	}
+
+	return true;
+}
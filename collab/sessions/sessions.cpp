@@ -79,18 +79,20 @@ bool deserialize_session_broadcast_structure(const std::string& serialized,
 }
 
 void collab::impl::session_broadcast_sender_func(impl* p_impl) {
-	// create a broadcast sender object
-	liblec::lecnet::udp::broadcast::sender sender(SESSION_BROADCAST_PORT);
+	// create a datagram sender object
+	datagram_sender sender(node_port(p_impl->_broadcast_port, SESSION_BROADCAST_PORT));
 
-	// loop until _stop_session_broadcast is false
+	// loop until a stop is requested
 	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
-		}
+		// wake ups from here on cut the next breath short
+		const auto wake_count = p_impl->_stop.wake_count();
+
+		// the broadcast, left empty if there is nothing to broadcast
+		std::string serialized_session_list;
 
 		std::string error;
 		std::vector<session> local_session_list;
@@ -99,52 +101,62 @@ void collab::impl::session_broadcast_sender_func(impl* p_impl) {
 		if (p_impl->_collab.get_local_sessions(local_session_list, error)) {
 
 			// make a session broadcast object
-			std::string serialized_session_list;
 			session_broadcast_structure cls;
 			cls.source_node_unique_id = p_impl->_collab.unique_id();
 			cls.session_list = local_session_list;
 
 			// serialize the session broadcast object
-			if (serialize_session_broadcast_structure(cls, serialized_session_list, error)) {
+			if (!serialize_session_broadcast_structure(cls, serialized_session_list, error))
+				serialized_session_list.clear();
+		}
 
-				// broadcast the serialized object
-				unsigned long actual_count = 0;
-				if (sender.send(serialized_session_list, 1, 0, actual_count, error)) {
-					// broadcast successful
-				}
+		// broadcast the serialized object if it's due
+		if (p_impl->_session_cadence.due(serialized_session_list) && !serialized_session_list.empty()) {
+			if (p_impl->send_datagram(sender, payload_type::session_list, serialized_session_list, "", error)) {
+				// broadcast successful
 			}
 		}
 
-		// take a breath
-		std::this_thread::sleep_for(std::chrono::milliseconds{ session_broadcast_cycle });
+		// take a breath until the next broadcast is due, a change wakes us up sooner
+		p_impl->_stop.sleep_for(p_impl->_session_cadence.time_to_next(), wake_count);
 	}
 }
 
 void collab::impl::session_broadcast_receiver_func(impl* p_impl) {
-	// create broadcast receiver object
-	liblec::lecnet::udp::broadcast::receiver receiver(SESSION_BROADCAST_PORT, "0.0.0.0");
+	// create datagram receiver object
+	datagram_receiver receiver(node_port(p_impl->_broadcast_port, SESSION_BROADCAST_PORT), p_impl->_stop);
 
-	// loop until _stop_session_broadcast is false
-	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
-
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
+	{
+		std::string error;
+		if (!receiver.start(error)) {
+			p_impl->_log(log_event::receiver_start_failed, "session", error);
+			return;
 		}
 
+		// sessions are announced on the discovery group when multicast is selected
+		if (!receiver.set_group(discovery_multicast_group, error))
+			p_impl->_log(log_event::receiver_join_failed, "session", error);
+	}
+
+	// loop until a stop is requested
+	while (true) {
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
+
 		std::string error;
 
-		// run the receiver
-		if (receiver.run(session_receiver_cycle, error)) {
-			// loop while running
-			while (receiver.running())
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		// wait for datagrams, a stop request or session change cuts the wait short
+		std::vector<std::string> datagrams;
+		if (receiver.wait(datagrams, std::chrono::milliseconds{ session_receiver_cycle })) {
+			p_impl->count_received_datagrams(payload_type::session_list, receiver, datagrams);
+
+			// process every datagram received
+			for (auto& serialized_session_list : datagrams) {
+				// discard datagrams for other channels and sessions before going to the trouble of decoding them
+				if (!strip_datagram_header(serialized_session_list, payload_type::session_list, ""))
+					continue;
 
-			// no longer running ... check if a datagram was received
-			std::string serialized_session_list;
-			if (receiver.get(serialized_session_list, error)) {
 				// datagram received ... deserialize
 
 				session_broadcast_structure cls;
@@ -162,6 +174,23 @@ void collab::impl::session_broadcast_receiver_func(impl* p_impl) {
 						// database may be empty or table may not exist, so ignore
 					}
 
+					// let the peer catch up without waiting for our next scheduled broadcast if it's missing any of our sessions
+					for (const auto& m_it : local_session_list) {
+						bool found = false;
+
+						for (const auto& it : cls.session_list) {
+							if (it.unique_id == m_it.unique_id) {
+								found = true;
+								break;
+							}
+						}
+
+						if (!found) {
+							p_impl->_session_cadence.hurry();
+							break;
+						}
+					}
+
 					// check if any session is missing in the local database
 					for (const auto& it : cls.session_list) {
 						bool found = false;
@@ -174,30 +203,31 @@ void collab::impl::session_broadcast_receiver_func(impl* p_impl) {
 						}
 
 						if (!found) {
-							p_impl->_log("Session received (UDP): '" + it.name + "' (source node: " + shorten_unique_id(cls.source_node_unique_id) + ")");
+							p_impl->_log(log_event::session_received, it.name, log_id{ cls.source_node_unique_id });
 
 							// add this session to the local database
 							if (p_impl->_collab.create_session(it, error)) {
 								// session added successfully to the local database, add it to the temporary session list
 								if (p_impl->_collab.create_temporary_session_entry(it.unique_id, error))
-									p_impl->_log("Temporary session entry successful for '" + it.name + "'");
+									p_impl->_log(log_event::temporary_session_saved, it.name);
 								else
-									p_impl->_log("Creating temporary session entry for '" + it.name + "' failed: " + error);
+									p_impl->_log(log_event::temporary_session_failed, it.name, error);
 							}
 							else
-								p_impl->_log("Creating session '" + it.name + "' failed: " + error);
+								p_impl->_log(log_event::session_save_failed, it.name, error);
 						}
 					}
 				}
+				else
+					p_impl->count_deserialize_failure(payload_type::session_list);
 			}
 		}
-
-		receiver.stop();
 	}
 }
 
 bool collab::create_session(const session& session, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.create_session);
 
 	// get optional object
 	auto con_opt = _d.get_connection();
@@ -222,6 +252,9 @@ bool collab::create_session(const session& session, std::string& error) {
 		error))
 		return false;
 
+	// broadcast the change straight away
+	_d._session_cadence.kick();
+
 	return true;
 }
 
@@ -274,6 +307,9 @@ bool collab::remove_session(const std::string& unique_id, std::string& error) {
 	if (!con.execute("DELETE FROM Sessions WHERE UniqueID = ?;", { unique_id }, error))
 		return false;
 
+	// broadcast the change straight away
+	_d._session_cadence.kick();
+
 	return true;
 }
 
@@ -329,6 +365,7 @@ bool collab::get_session(const std::string& unique_id, session& session_info, st
 
 bool collab::get_sessions(std::vector<session>& sessions, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_sessions);
 
 	sessions.clear();
 
@@ -420,6 +457,9 @@ bool collab::create_temporary_session_entry(const std::string& unique_id, std::s
 		error))
 		return false;
 
+	// broadcast the change straight away
+	_d._session_cadence.kick();
+
 	return true;
 }
 
@@ -472,10 +512,19 @@ bool collab::remove_temporary_session_entry(const std::string& unique_id, std::s
 	if (!con.execute("DELETE FROM TemporarySessions WHERE UniqueID = ?;", { unique_id }, error))
 		return false;
 
+	// broadcast the change straight away
+	_d._session_cadence.kick();
+
 	return true;
 }
 
 void collab::set_current_session_unique_id(const std::string& session_unique_id) {
-	liblec::auto_mutex lock(_d._message_broadcast_mutex);
-	_d._current_session_unique_id = session_unique_id;
+	{
+		liblec::auto_mutex lock(_d._message_broadcast_mutex);
+		_d._current_session_unique_id = session_unique_id;
+	}
+
+	// broadcast the new session's state straight away, backed off cadences would otherwise
+	// keep the session's peers waiting for up to broadcast_cycle_max
+	_d.kick_broadcasts();
 }
@@ -0,0 +1,467 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../collab.h"
+#include "../impl.h"
+
+// lecnet
+#include <liblec/lecnet/tcp.h>
+
+// STL
+#include <cstdio>
+#include <iterator>
+
+// boost
+#include <boost\serialization\version.hpp>
+
+namespace {
+	const char merkle_request_prefix[] = "?tree#";
+	const char hex_digits[] = "0123456789abcdef";
+
+	std::string hex_digest(const std::string& key) {
+		char buffer[17];
+		snprintf(buffer, sizeof(buffer), "%016llx", fnv1a_hash(key));
+		return buffer;
+	}
+
+	// fnv-1a hash of the digests one after the other, 0 if there are none
+	template<class iterator>
+	unsigned long long hash_digests(iterator first, iterator last) {
+		if (first == last)
+			return 0;
+
+		unsigned long long hash = 14695981039346656037ULL;
+
+		for (; first != last; first++) {
+			for (const unsigned char c : first->first) {
+				hash ^= c;
+				hash *= 1099511628211ULL;
+			}
+		}
+
+		return hash;
+	}
+}
+
+// serialize template to make merkle_summary_structure serializable
+template<class Archive>
+void serialize(Archive& ar, merkle_summary_structure& cls, const unsigned int version) {
+	ar& cls.source_node_unique_id;
+	ar& cls.ips;
+	ar& cls.session_id;
+	ar& cls.root;
+	ar& cls.buckets;
+
+	// version 1 adds the source node's transfer port
+	if (version > 0)
+		ar& cls.transfer_port;
+}
+
+BOOST_CLASS_VERSION(merkle_summary_structure, 1)
+
+// serialize template to make merkle_node_structure serializable
+template<class Archive>
+void serialize(Archive& ar, merkle_node_structure& cls, const unsigned int version) {
+	ar& cls.children;
+	ar& cls.items;
+}
+
+bool serialize_merkle_summary_structure(const merkle_summary_structure& cls,
+	std::string& serialized, std::string& error) {
+	error.clear();
+
+	std::stringstream ss;
+
+	try {
+		boost::archive::text_oarchive oa(ss);
+		oa& cls;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	// encode to base64
+	serialized = liblec::leccore::base64::encode(ss.str());
+	return true;
+}
+
+bool deserialize_merkle_summary_structure(const std::string& serialized,
+	merkle_summary_structure& cls, std::string& error) {
+	std::stringstream ss;
+
+	// decode from base64
+	ss << liblec::leccore::base64::decode(serialized);
+
+	try {
+		boost::archive::text_iarchive ia(ss);
+		ia& cls;
+		return true;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+}
+
+bool serialize_merkle_node_structure(const merkle_node_structure& cls,
+	std::string& serialized, std::string& error) {
+	error.clear();
+
+	std::stringstream ss;
+
+	try {
+		boost::archive::text_oarchive oa(ss);
+		oa& cls;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	// no need to encode to base64, this goes over tcp
+	serialized = ss.str();
+	return true;
+}
+
+bool deserialize_merkle_node_structure(const std::string& serialized,
+	merkle_node_structure& cls, std::string& error) {
+	if (serialized.empty()) {
+		error = "Source doesn't support merkle trees";
+		return false;
+	}
+
+	std::stringstream ss(serialized);
+
+	try {
+		boost::archive::text_iarchive ia(ss);
+		ia& cls;
+		return true;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+}
+
+merkle_tree::merkle_tree(const std::vector<std::string>& keys) {
+	for (const auto& key : keys)
+		_keys.emplace(hex_digest(key), key);
+
+	build("", _keys.begin(), _keys.end());
+}
+
+void merkle_tree::build(const std::string& prefix, key_map::const_iterator first, key_map::const_iterator last) {
+	node cls;
+	cls.count = static_cast<size_t>(std::distance(first, last));
+
+	if (cls.count == 0)
+		return;
+
+	// a node's hash covers the digests of everything beneath it, in order
+	cls.hash = hash_digests(first, last);
+	_nodes[prefix] = cls;
+
+	// leaves are listed rather than descended into, their children are only hashed if asked for
+	if (cls.count <= merkle_leaf_size || prefix.length() >= 16)
+		return;
+
+	// the keys are in order, so each child's keys follow each other
+	const size_t depth = prefix.length();
+
+	while (first != last) {
+		const char digit = first->first[depth];
+
+		auto child_last = first;
+		while (child_last != last && child_last->first[depth] == digit)
+			child_last++;
+
+		build(prefix + digit, first, child_last);
+		first = child_last;
+	}
+}
+
+std::pair<merkle_tree::key_map::const_iterator, merkle_tree::key_map::const_iterator>
+merkle_tree::range(const std::string& prefix) const {
+	auto first = _keys.lower_bound(prefix);
+	auto last = first;
+
+	while (last != _keys.end() && last->first.compare(0, prefix.length(), prefix) == 0)
+		last++;
+
+	return { first, last };
+}
+
+unsigned long long merkle_tree::hash(const std::string& prefix) const {
+	auto it = _nodes.find(prefix);
+	if (it != _nodes.end())
+		return it->second.hash;
+
+	// beneath a leaf, or empty
+	const auto keys = range(prefix);
+	return hash_digests(keys.first, keys.second);
+}
+
+std::vector<unsigned long long> merkle_tree::children(const std::string& prefix) const {
+	std::vector<unsigned long long> hashes;
+	hashes.reserve(merkle_fanout);
+
+	for (int i = 0; i < merkle_fanout; i++)
+		hashes.push_back(hash(prefix + hex_digits[i]));
+
+	return hashes;
+}
+
+std::set<std::string> merkle_tree::keys(const std::string& prefix) const {
+	std::set<std::string> keys;
+
+	const auto range = this->range(prefix);
+
+	for (auto it = range.first; it != range.second; it++)
+		keys.insert(it->second);
+
+	return keys;
+}
+
+size_t merkle_tree::count(const std::string& prefix) const {
+	auto it = _nodes.find(prefix);
+	if (it != _nodes.end())
+		return it->second.count;
+
+	const auto range = this->range(prefix);
+	return static_cast<size_t>(std::distance(range.first, range.second));
+}
+
+merkle_summary_structure make_merkle_summary(const merkle_tree& tree) {
+	merkle_summary_structure cls;
+	cls.buckets = tree.children("");
+
+	// the root covers everything, so it's the same as hashing the whole tree
+	cls.root = tree.hash("");
+	return cls;
+}
+
+std::string make_merkle_request(const std::string& session_unique_id, const std::string& prefix) {
+	return merkle_request_prefix + session_unique_id + "#" + prefix;
+}
+
+bool parse_merkle_request(const std::string& request, std::string& session_unique_id, std::string& prefix) {
+	const size_t prefix_length = sizeof(merkle_request_prefix) - 1;
+
+	if (request.compare(0, prefix_length, merkle_request_prefix) != 0)
+		return false;
+
+	const auto idx = request.find('#', prefix_length);
+
+	if (idx == std::string::npos)
+		return false;
+
+	session_unique_id = request.substr(prefix_length, idx - prefix_length);
+	prefix = request.substr(idx + 1);
+	return true;
+}
+
+std::string answer_merkle_request(const merkle_tree& tree, const std::string& prefix,
+	std::function<std::string(const std::set<std::string>& keys)> serialize_items) {
+	merkle_node_structure cls;
+
+	// list the node if it's small enough, or if it can't be split any further
+	if (tree.count(prefix) <= merkle_leaf_size || prefix.length() >= 16)
+		cls.items = serialize_items(tree.keys(prefix));
+	else
+		cls.children = tree.children(prefix);
+
+	std::string serialized, error;
+	if (!serialize_merkle_node_structure(cls, serialized, error))
+		return std::string();
+
+	return serialized;
+}
+
+bool collab::impl::descend_merkle_tree(impl* p_impl, const merkle_summary_structure& summary,
+	unsigned short port, int magic_number, const merkle_tree& local,
+	std::vector<std::string>& leaves, std::string& error) {
+	leaves.clear();
+
+	// the nodes that differ, and haven't been looked into yet
+	std::vector<std::string> pending;
+
+	auto add_differing_children = [&](const std::string& prefix, const std::vector<unsigned long long>& remote) {
+		const auto local_children = local.children(prefix);
+
+		for (int i = 0; i < merkle_fanout; i++) {
+			// there is nothing to get from a node that's empty at the source
+			if (remote[i] != 0 && remote[i] != local_children[i])
+				pending.push_back(prefix + hex_digits[i]);
+		}
+	};
+
+	if (summary.buckets.size() == merkle_fanout)
+		add_differing_children("", summary.buckets);
+	else
+		pending.push_back("");	// start from the root
+
+	if (pending.empty())
+		return true;
+
+	// get sink IP list
+	std::vector<std::string> ips_client;
+	liblec::lecnet::tcp::get_host_ips(ips_client);
+
+	// configure tcp/ip sink parameters
+	liblec::lecnet::tcp::client::client_params params;
+	params.address = select_ip(summary.ips, ips_client);
+	params.port = port;
+	params.magic_number = magic_number;
+	params.use_ssl = true;
+	params.ca_cert_path = p_impl->cert_folder() + "\\collab.sink";
+
+	// create tcp/ip sink object
+	liblec::lecnet::tcp::client sink;
+
+	if (!sink.connect(params, error))
+		return false;
+
+	while (sink.connecting())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	if (!sink.connected(error))
+		return false;
+
+	bool success = true;
+
+	for (int requests = 0; !pending.empty() && requests < max_merkle_requests; requests++) {
+		if (p_impl->_stop.stop_requested()) {
+			error = "Stop requested";
+			success = false;
+			break;
+		}
+
+		const std::string prefix = pending.back();
+		pending.pop_back();
+
+		std::string reply;
+		if (!sink.send_data(make_merkle_request(summary.session_id, prefix), reply, 10, nullptr, error)) {
+			success = false;
+			break;
+		}
+
+		count_transfer(p_impl->_metrics, "received", params.address, reply.length());
+
+		merkle_node_structure node;
+		if (!deserialize_merkle_node_structure(reply, node, error)) {
+			success = false;
+			break;
+		}
+
+		if (node.children.empty())
+			leaves.push_back(node.items);
+		else if (node.children.size() == merkle_fanout)
+			add_differing_children(prefix, node.children);
+		else {
+			error = "Invalid node";
+			success = false;
+			break;
+		}
+	}
+
+	// disconnect tcp sink
+	sink.disconnect();
+
+	return success;
+}
+
+void collab::impl::run_merkle_descent(impl* p_impl, const merkle_descent& descent) {
+	std::string current_session_unique_id;
+
+	{
+		liblec::auto_mutex lock(p_impl->_message_broadcast_mutex);
+		current_session_unique_id = p_impl->_current_session_unique_id;
+	}
+
+	const auto& summary = descent.summary;
+
+	if (summary.session_id != current_session_unique_id)
+		return;	// we've left the session since
+
+	const bool files = descent.channel == payload_type::file_summary;
+
+	// the local tree, which may have caught up with the source while the descent was queued
+	const merkle_tree* p_local = nullptr;
+	std::shared_ptr<const file_tree> p_file_tree;
+	std::shared_ptr<const review_tree> p_review_tree;
+
+	if (files) {
+		p_file_tree = get_file_tree(p_impl->_collab, p_impl->_file_trees, current_session_unique_id);
+		if (p_file_tree)
+			p_local = &p_file_tree->tree;
+	}
+	else {
+		p_review_tree = get_review_tree(p_impl->_collab, p_impl->_review_trees, current_session_unique_id);
+		if (p_review_tree)
+			p_local = &p_review_tree->tree;
+	}
+
+	const merkle_tree empty;
+
+	if (!p_local)
+		p_local = &empty;
+	else
+		if (summary.root == p_local->hash(""))
+			return;	// nothing differs anymore
+
+	// look into the parts of the source's tree that differ
+	std::vector<std::string> leaves;
+	std::string error;
+
+	if (files) {
+		if (!descend_merkle_tree(p_impl, summary, node_port(summary.transfer_port, FILE_TRANSFER_PORT), file_transfer_magic_number,
+			*p_local, leaves, error))
+			p_impl->_log(log_event::tree_lookup_failed, "file", log_id{ summary.source_node_unique_id }, error);
+
+		for (const auto& leaf : leaves) {
+			file_broadcast_structure cls;
+			if (deserialize_file_broadcast_structure(leaf, cls, error)) {
+				cls.ips = summary.ips;
+				cls.transfer_port = summary.transfer_port;
+				receive_file_list(p_impl, cls, current_session_unique_id);
+			}
+		}
+	}
+	else {
+		if (!descend_merkle_tree(p_impl, summary, node_port(summary.transfer_port, REVIEW_TRANSFER_PORT), review_transfer_magic_number,
+			*p_local, leaves, error))
+			p_impl->_log(log_event::tree_lookup_failed, "review", log_id{ summary.source_node_unique_id }, error);
+
+		for (const auto& leaf : leaves) {
+			review_broadcast_structure cls;
+			if (deserialize_review_broadcast_structure(leaf, cls, error)) {
+				cls.ips = summary.ips;
+				cls.transfer_port = summary.transfer_port;
+				receive_review_list(p_impl, cls, current_session_unique_id);
+			}
+		}
+	}
+}
@@ -0,0 +1,1024 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../impl.h"
+
+// Windows
+#include <Windows.h>
+
+// lecnet
+#include <liblec/lecnet/tcp.h>
+
+// STL
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+
+// serialize template to make collab::task serializable
+template<class Archive>
+void serialize(Archive& ar, collab::task& cls, const unsigned int version) {
+	ar& cls.unique_id;
+	ar& cls.time;
+	ar& cls.session_id;
+	ar& cls.submitter_unique_id;
+	ar& cls.name;
+	ar& cls.command;
+	ar& cls.inputs;
+	ar& cls.output_extension;
+}
+
+// serialize template to make task_summary_structure serializable
+template<class Archive>
+void serialize(Archive& ar, task_summary_structure& cls, const unsigned int version) {
+	ar& cls.source_node_unique_id;
+	ar& cls.session_id;
+	ar& cls.ips;
+	ar& cls.transfer_port;
+	ar& cls.queued;
+	ar& cls.idle_workers;
+	ar& cls.running;
+}
+
+// serialize template to make task_assignment_structure serializable
+template<class Archive>
+void serialize(Archive& ar, task_assignment_structure& cls, const unsigned int version) {
+	ar& cls.task;
+	ar& cls.inputs;
+}
+
+bool serialize_task_summary_structure(const task_summary_structure& cls,
+	std::string& serialized, std::string& error) {
+	error.clear();
+
+	std::stringstream ss;
+
+	try {
+		boost::archive::text_oarchive oa(ss);
+		oa& cls;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	// encode to base64
+	serialized = liblec::leccore::base64::encode(ss.str());
+	return true;
+}
+
+bool deserialize_task_summary_structure(const std::string& serialized,
+	task_summary_structure& cls, std::string& error) {
+	std::stringstream ss;
+
+	// decode from base64
+	ss << liblec::leccore::base64::decode(serialized);
+
+	try {
+		boost::archive::text_iarchive ia(ss);
+		ia& cls;
+		return true;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+}
+
+bool serialize_task_assignment_structure(const task_assignment_structure& cls,
+	std::string& serialized, std::string& error) {
+	error.clear();
+
+	std::stringstream ss;
+
+	try {
+		boost::archive::text_oarchive oa(ss);
+		oa& cls;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	// encode to base64
+	serialized = liblec::leccore::base64::encode(ss.str());
+	return true;
+}
+
+bool deserialize_task_assignment_structure(const std::string& serialized,
+	task_assignment_structure& cls, std::string& error) {
+	std::stringstream ss;
+
+	// decode from base64
+	ss << liblec::leccore::base64::decode(serialized);
+
+	try {
+		boost::archive::text_iarchive ia(ss);
+		ia& cls;
+		return true;
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+}
+
+// task requests are in the form "?task#steal#session#worker#program|program...",
+// "?task#done#task#worker#state#exit_code#result_hash#error" and "?task#release#task#worker"
+// the programs and the error go last as they may contain '#', programs are separated by '|' as paths can't have it
+const std::string task_request_prefix = "?task#";
+const char task_program_separator = '|';
+
+static std::string command_program(const std::string& command);
+static bool program_allowed(const std::string& program, const std::vector<std::string>& programs);
+
+// task ids and extensions come from peers and end up in paths, so only the expected forms are accepted
+// a task id is a uuid, "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx"
+static bool valid_task_unique_id(const std::string& unique_id) {
+	if (unique_id.length() != 36)
+		return false;
+
+	for (size_t i = 0; i < unique_id.length(); i++) {
+		if (i == 8 || i == 13 || i == 18 || i == 23) {
+			if (unique_id[i] != '-')
+				return false;
+		}
+		else
+			if (!std::isxdigit(static_cast<unsigned char>(unique_id[i])))
+				return false;
+	}
+
+	return true;
+}
+
+// an extension is a dot followed by 1 to 16 letters and digits, files may also have none
+static bool valid_extension(const std::string& extension) {
+	if (extension.empty())
+		return true;
+
+	if (extension.length() < 2 || extension.length() > 17 || extension[0] != '.')
+		return false;
+
+	return std::all_of(extension.begin() + 1, extension.end(), [](char c) {
+		return std::isalnum(static_cast<unsigned char>(c)) != 0;
+		});
+}
+
+// whether the path is a folder directly beneath the parent, once both are resolved
+static bool folder_beneath(const std::string& path, const std::string& parent) {
+	std::error_code ec;
+	const auto canonical_path = std::filesystem::weakly_canonical(path, ec);
+
+	if (ec)
+		return false;
+
+	const auto canonical_parent = std::filesystem::weakly_canonical(parent, ec);
+
+	if (ec)
+		return false;
+
+	return canonical_path.parent_path() == canonical_parent && canonical_path.filename() != ".." &&
+		!canonical_path.filename().empty();
+}
+
+// quote a path for a command line, so that spaces in it don't split it
+static std::string quote_path(const std::string& path) {
+	return "\"" + path + "\"";
+}
+
+std::string make_task_steal_request(const std::string& session_unique_id, const std::string& worker_unique_id,
+	const std::vector<std::string>& programs) {
+	std::string request = task_request_prefix + "steal#" + session_unique_id + "#" + worker_unique_id + "#";
+
+	for (size_t i = 0; i < programs.size(); i++)
+		request += (i > 0 ? std::string(1, task_program_separator) : std::string()) + programs[i];
+
+	return request;
+}
+
+std::string make_task_done_request(const std::string& worker_unique_id, const collab::task_status& outcome) {
+	return task_request_prefix + "done#" + outcome.task.unique_id + "#" + worker_unique_id + "#" +
+		std::to_string(static_cast<int>(outcome.state)) + "#" + std::to_string(outcome.exit_code) + "#" +
+		outcome.result_hash + "#" + outcome.error;
+}
+
+std::string make_task_release_request(const std::string& worker_unique_id, const std::string& task_unique_id) {
+	return task_request_prefix + "release#" + task_unique_id + "#" + worker_unique_id;
+}
+
+bool is_task_request(const std::string& request) {
+	return request.compare(0, task_request_prefix.length(), task_request_prefix) == 0;
+}
+
+// split a request into at most max_fields fields, the last field takes the rest of the request
+static std::vector<std::string> split_task_request(const std::string& request, size_t max_fields) {
+	std::vector<std::string> fields;
+	size_t start = 0;
+
+	while (fields.size() + 1 < max_fields) {
+		const auto idx = request.find('#', start);
+
+		if (idx == std::string::npos)
+			break;
+
+		fields.push_back(request.substr(start, idx - start));
+		start = idx + 1;
+	}
+
+	fields.push_back(request.substr(start));
+	return fields;
+}
+
+void task_board::submit(const collab::task& task, const std::vector<collab::file>& inputs) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	entry& task_entry = _tasks[task.unique_id];
+	task_entry.status.task = task;
+	task_entry.status.state = collab::task_state::queued;
+	task_entry.inputs = inputs;
+
+	_queue.push_back(task.unique_id);
+	_submitted.push_back(task.unique_id);
+}
+
+void task_board::take(entry& task, const std::string& worker_unique_id, const std::string& worker_address,
+	task_assignment_structure& assignment) {
+	task.status.state = collab::task_state::running;
+	task.status.worker_unique_id = worker_unique_id;
+	task.worker_address = worker_address;
+	task.taken = std::chrono::steady_clock::now();
+
+	assignment.task = task.status.task;
+	assignment.inputs = task.inputs;
+}
+
+bool task_board::take_oldest(const std::string& worker_unique_id, const task_filter& can_run,
+	task_assignment_structure& assignment) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (auto it = _queue.begin(); it != _queue.end(); it++) {
+		auto task_it = _tasks.find(*it);
+
+		if (task_it == _tasks.end() || !can_run(task_it->second.status.task))
+			continue;
+
+		_queue.erase(it);
+		take(task_it->second, worker_unique_id, std::string(), assignment);
+		return true;
+	}
+
+	return false;
+}
+
+bool task_board::take_newest(const std::string& session_unique_id, const std::string& worker_unique_id,
+	const std::string& worker_address, const task_filter& can_run, task_assignment_structure& assignment) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (auto it = _queue.rbegin(); it != _queue.rend(); it++) {
+		auto task_it = _tasks.find(*it);
+
+		if (task_it == _tasks.end() || task_it->second.status.task.session_id != session_unique_id ||
+			!can_run(task_it->second.status.task))
+			continue;
+
+		_queue.erase(std::next(it).base());
+		take(task_it->second, worker_unique_id, worker_address, assignment);
+		return true;
+	}
+
+	return false;
+}
+
+bool task_board::finish(const std::string& worker_unique_id, const std::string& worker_address,
+	const collab::task_status& outcome) {
+	if (outcome.state != collab::task_state::completed && outcome.state != collab::task_state::failed)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _tasks.find(outcome.task.unique_id);
+
+	if (it == _tasks.end())
+		return false;
+
+	auto& status = it->second.status;
+
+	// only the worker that took the task, from where it took it, can report on it
+	if (it->second.worker_address != worker_address ||
+		(status.state == collab::task_state::running && status.worker_unique_id != worker_unique_id))
+		return false;
+
+	if (status.state == collab::task_state::completed)
+		return false;	// the first result stands
+
+	if (status.state == collab::task_state::queued) {
+		// the task had been put back in the queue, but its worker came through after all
+		auto queued = std::find(_queue.begin(), _queue.end(), outcome.task.unique_id);
+
+		if (queued != _queue.end())
+			_queue.erase(queued);
+	}
+
+	status.state = outcome.state;
+	status.worker_unique_id = worker_unique_id;
+	status.result_hash = outcome.result_hash;
+	status.exit_code = outcome.exit_code;
+	status.error = outcome.error;
+	return true;
+}
+
+bool task_board::release(const std::string& worker_unique_id, const std::string& worker_address,
+	const std::string& task_unique_id) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _tasks.find(task_unique_id);
+
+	if (it == _tasks.end() || it->second.status.state != collab::task_state::running ||
+		it->second.status.worker_unique_id != worker_unique_id || it->second.worker_address != worker_address)
+		return false;
+
+	it->second.status.state = collab::task_state::queued;
+	it->second.status.worker_unique_id.clear();
+	_queue.push_front(task_unique_id);
+	return true;
+}
+
+void task_board::requeue(const std::function<bool(const std::string& worker_unique_id, const std::string& task_unique_id,
+	const std::chrono::steady_clock::time_point& taken)>& lost) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (auto& [task_unique_id, task] : _tasks) {
+		if (task.status.state != collab::task_state::running ||
+			!lost(task.status.worker_unique_id, task_unique_id, task.taken))
+			continue;
+
+		task.status.state = collab::task_state::queued;
+		task.status.worker_unique_id.clear();
+
+		// it has waited long enough, put it at the front
+		_queue.push_front(task_unique_id);
+	}
+}
+
+int task_board::queued(const std::string& session_unique_id) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	int count = 0;
+
+	for (const auto& task_unique_id : _queue) {
+		auto it = _tasks.find(task_unique_id);
+
+		if (it != _tasks.end() && it->second.status.task.session_id == session_unique_id)
+			count++;
+	}
+
+	return count;
+}
+
+void task_board::statuses(const std::string& session_unique_id, std::vector<collab::task_status>& tasks) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	tasks.clear();
+
+	for (const auto& task_unique_id : _submitted) {
+		auto it = _tasks.find(task_unique_id);
+
+		if (it != _tasks.end() && it->second.status.task.session_id == session_unique_id)
+			tasks.push_back(it->second.status);
+	}
+}
+
+std::string task_board::answer(const std::string& request, const std::string& source_address) {
+	const std::string body = request.substr(task_request_prefix.length());
+	const std::string kind = body.substr(0, body.find('#'));
+
+	if (kind == "steal") {
+		const auto fields = split_task_request(body, 4);
+
+		if (fields.size() != 4)
+			return std::string();
+
+		// only hand out tasks that run a program the worker's node allows
+		std::vector<std::string> programs;
+
+		for (size_t start = 0; start < fields[3].length();) {
+			auto end = fields[3].find(task_program_separator, start);
+
+			if (end == std::string::npos)
+				end = fields[3].length();
+
+			programs.push_back(fields[3].substr(start, end - start));
+			start = end + 1;
+		}
+
+		task_assignment_structure assignment;
+		if (!take_newest(fields[1], fields[2], source_address, [&](const collab::task& task) {
+			return program_allowed(command_program(task.command), programs);
+			}, assignment))
+			return std::string();
+
+		std::string serialized, error;
+		if (!serialize_task_assignment_structure(assignment, serialized, error))
+			return std::string();
+
+		return serialized;
+	}
+
+	if (kind == "release") {
+		const auto fields = split_task_request(body, 3);
+
+		if (fields.size() != 3)
+			return std::string();
+
+		return release(fields[2], source_address, fields[1]) ? "ok" : std::string();
+	}
+
+	const auto fields = split_task_request(body, 7);
+
+	if (fields.size() == 7 && fields[0] == "done") {
+		collab::task_status outcome;
+		outcome.task.unique_id = fields[1];
+		outcome.state = static_cast<collab::task_state>(atoi(fields[3].c_str()));
+		outcome.exit_code = atoi(fields[4].c_str());
+		outcome.result_hash = fields[5];
+		outcome.error = fields[6];
+
+		return finish(fields[2], source_address, outcome) ? "ok" : std::string();
+	}
+
+	return std::string();
+}
+
+// the program a command line starts with
+static std::string command_program(const std::string& command) {
+	const auto start = command.find_first_not_of(" \t");
+
+	if (start == std::string::npos)
+		return std::string();
+
+	if (command[start] == '"') {
+		const auto end = command.find('"', start + 1);
+		return command.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+	}
+
+	const auto end = command.find_first_of(" \t", start);
+	return command.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+// only programs listed exactly (case aside) are allowed, so 'tool.exe' doesn't let in 'C:\elsewhere\tool.exe'
+static bool program_allowed(const std::string& program, const std::vector<std::string>& programs) {
+	if (program.empty())
+		return false;
+
+	for (const auto& allowed : programs) {
+		if (allowed.length() == program.length() &&
+			std::equal(allowed.begin(), allowed.end(), program.begin(), [](char a, char b) {
+				return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+				}))
+			return true;
+	}
+
+	return false;
+}
+
+static void replace_all(std::string& text, const std::string& placeholder, const std::string& value) {
+	for (auto idx = text.find(placeholder); idx != std::string::npos; idx = text.find(placeholder, idx + value.length()))
+		text.replace(idx, placeholder.length(), value);
+}
+
+// run a command in the given folder and wait for it to exit, a stop request ends it
+static bool run_command(const std::string& command, const std::string& folder, stop_signal& stop,
+	int& exit_code, std::string& error) {
+	exit_code = 0;
+
+	STARTUPINFOA startup_info = {};
+	startup_info.cb = sizeof(startup_info);
+
+	PROCESS_INFORMATION process_info = {};
+
+	// CreateProcessA may modify the command line, so it needs a buffer of its own
+	std::vector<char> command_line(command.begin(), command.end());
+	command_line.push_back('\0');
+
+	if (!CreateProcessA(NULL, command_line.data(), NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, folder.c_str(),
+		&startup_info, &process_info)) {
+		error = "Running the command failed with error " + std::to_string(GetLastError());
+		return false;
+	}
+
+	CloseHandle(process_info.hThread);
+
+	bool stopped = false;
+
+	while (WaitForSingleObject(process_info.hProcess, 500) == WAIT_TIMEOUT) {
+		if (stop.stop_requested()) {
+			TerminateProcess(process_info.hProcess, 1);
+			WaitForSingleObject(process_info.hProcess, 5000);
+			stopped = true;
+			break;
+		}
+	}
+
+	DWORD code = 0;
+	GetExitCodeProcess(process_info.hProcess, &code);
+	CloseHandle(process_info.hProcess);
+
+	exit_code = static_cast<int>(code);
+
+	if (stopped) {
+		error = "Stop requested";
+		return false;
+	}
+
+	if (exit_code != 0) {
+		error = "The command exited with code " + std::to_string(exit_code);
+		return false;
+	}
+
+	return true;
+}
+
+bool collab::impl::send_task_request(impl* p_impl, const task_peer& peer, const std::string& request,
+	std::string& reply, std::string& error) {
+	reply.clear();
+
+	// get sink IP list
+	std::vector<std::string> ips_client;
+	liblec::lecnet::tcp::get_host_ips(ips_client);
+
+	// configure tcp/ip sink parameters
+	liblec::lecnet::tcp::client::client_params params;
+	params.address = select_ip(peer.ips, ips_client);
+	params.port = node_port(peer.transfer_port, FILE_TRANSFER_PORT);
+	params.magic_number = file_transfer_magic_number;
+	params.use_ssl = true;
+	params.ca_cert_path = p_impl->cert_folder() + "\\collab.sink";
+
+	// create tcp/ip sink object
+	liblec::lecnet::tcp::client sink;
+
+	if (!sink.connect(params, error))
+		return false;
+
+	while (sink.connecting())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	if (!sink.connected(error))
+		return false;
+
+	const bool success = sink.send_data(request, reply, 10, nullptr, error);
+
+	if (success)
+		count_transfer(p_impl->_metrics, "received", params.address, reply.length());
+
+	// disconnect tcp sink
+	sink.disconnect();
+
+	return success;
+}
+
+bool collab::impl::steal_task(impl* p_impl, task_assignment_structure& assignment, task_peer& submitter) {
+	std::string current_session_unique_id;
+
+	{
+		liblec::auto_mutex lock(p_impl->_message_broadcast_mutex);
+		current_session_unique_id = p_impl->_current_session_unique_id;
+	}
+
+	if (current_session_unique_id.empty())
+		return false;
+
+	// pick the peer in the session with the most queued tasks
+	std::string submitter_unique_id;
+
+	{
+		std::lock_guard<std::mutex> lock(p_impl->_task_peer_mutex);
+		const auto now = std::chrono::steady_clock::now();
+		int most_queued = 0;
+
+		for (const auto& [peer_unique_id, peer] : p_impl->_task_peers) {
+			if (peer.session_id != current_session_unique_id || peer.queued <= most_queued ||
+				now - peer.last_seen > std::chrono::milliseconds{ task_peer_timeout })
+				continue;
+
+			most_queued = peer.queued;
+			submitter_unique_id = peer_unique_id;
+			submitter = peer;
+		}
+	}
+
+	if (submitter_unique_id.empty())
+		return false;
+
+	std::string reply, error;
+	const bool success = send_task_request(p_impl, submitter,
+		make_task_steal_request(current_session_unique_id, p_impl->_collab.unique_id(), p_impl->_task_programs), reply, error);
+
+	if (!success)
+		p_impl->_log(log_event::task_request_failed, log_id{ submitter_unique_id }, error);
+
+	if (!success || reply.empty()) {
+		// leave the peer alone until its next summary says it has tasks
+		std::lock_guard<std::mutex> lock(p_impl->_task_peer_mutex);
+		auto it = p_impl->_task_peers.find(submitter_unique_id);
+
+		if (it != p_impl->_task_peers.end())
+			it->second.queued = 0;
+
+		return false;
+	}
+
+	// a task that fails to come through is put back in the queue by the submitter, as our summaries don't list it
+	return deserialize_task_assignment_structure(reply, assignment, error);
+}
+
+collab::task_status collab::impl::run_task(impl* p_impl, const task_assignment_structure& assignment,
+	const task_peer* p_submitter) {
+	const auto& task = assignment.task;
+	scoped_trace trace(p_impl->_trace, task.unique_id, "task.run");
+
+	task_status outcome;
+	outcome.task = task;
+	outcome.state = task_state::failed;
+	outcome.worker_unique_id = p_impl->_collab.unique_id();
+
+	const std::string program = command_program(task.command);
+
+	if (!program_allowed(program, p_impl->_task_programs)) {
+		// tasks are only taken if they can be run here, so this is a safety net ... hand the task back
+		outcome.state = task_state::queued;
+		outcome.error = "Program '" + program + "' is not allowed on this node";
+		return outcome;
+	}
+
+	// the id and extensions end up in paths, and the work folder is removed once the task ends
+	bool valid = valid_task_unique_id(task.unique_id) && valid_extension(task.output_extension);
+
+	for (const auto& input : assignment.inputs)
+		valid = valid && valid_extension(input.extension);
+
+	if (!valid) {
+		outcome.error = "The task's id or extensions are not valid";
+		return outcome;
+	}
+
+	const std::string files_folder = p_impl->_collab.files_folder();
+
+	// fetch the inputs this node doesn't have yet from the submitter, like any other shared file
+	for (const auto& input : assignment.inputs) {
+		if (file_available(files_folder + "\\" + input.hash))
+			continue;
+
+		if (!p_submitter) {
+			outcome.error = "Input '" + input.name + input.extension + "' not found";
+			return outcome;
+		}
+
+		p_impl->queue_file_download(input, p_submitter->ips, p_submitter->transfer_port);
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ task_input_timeout };
+
+	for (const auto& input : assignment.inputs) {
+		while (!file_available(files_folder + "\\" + input.hash)) {
+			if (std::chrono::steady_clock::now() > deadline) {
+				outcome.error = "Timed out waiting for input '" + input.name + input.extension + "'";
+				return outcome;
+			}
+
+			if (!p_impl->_stop.sleep_for(std::chrono::milliseconds{ 500 })) {
+				outcome.error = "Stop requested";
+				return outcome;
+			}
+		}
+	}
+
+	// the command runs in a work folder of its own, removed whichever way the task ends
+	const std::string tasks_folder = files_folder + "\\tasks";
+	const std::string work_folder = tasks_folder + "\\" + task.unique_id;
+
+	struct folder_remover {
+		std::string path, parent;
+		~folder_remover() {
+			if (!folder_beneath(path, parent))
+				return;
+
+			std::error_code ec;
+			std::filesystem::remove_all(path, ec);
+		}
+	};
+
+	if (!folder_beneath(work_folder, tasks_folder)) {
+		outcome.error = "The task's work folder is outside the tasks folder";
+		return outcome;
+	}
+
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(work_folder, ec);
+
+		if (ec) {
+			outcome.error = ec.message();
+			return outcome;
+		}
+	}
+
+	folder_remover remover{ work_folder, tasks_folder };
+
+	// copy the inputs into the work folder and put their paths in the command
+	std::string command = task.command;
+
+	for (size_t i = 0; i < assignment.inputs.size(); i++) {
+		const auto& input = assignment.inputs[i];
+		const std::string input_path = work_folder + "\\input" + std::to_string(i) + input.extension;
+
+		if (!p_impl->_collab.export_file(input.hash, input_path, outcome.error))
+			return outcome;
+
+		replace_all(command, "{input" + std::to_string(i) + "}", quote_path(input_path));
+	}
+
+	const std::string output_path = work_folder + "\\output" + task.output_extension;
+	replace_all(command, "{output}", quote_path(output_path));
+
+	if (!run_command(command, work_folder, p_impl->_stop, outcome.exit_code, outcome.error))
+		return outcome;
+
+	if (!file_available(output_path)) {
+		outcome.error = "The command didn't write its output";
+		return outcome;
+	}
+
+	// share the result in the session
+	std::string hash;
+	if (!p_impl->_collab.import_file(output_path, hash, outcome.error))
+		return outcome;
+
+	if (!p_impl->_collab.file_exists(hash, task.session_id)) {
+		file result;
+		result.hash = hash;
+		result.time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		result.session_id = task.session_id;
+		result.sender_unique_id = p_impl->_collab.unique_id();
+		result.name = task.name;
+		result.extension = task.output_extension;
+		result.description = "Result of task " + shorten_unique_id(task.unique_id);
+
+		std::error_code ec;
+		result.size = static_cast<long long>(std::filesystem::file_size(files_folder + "\\" + hash, ec));
+
+		if (!p_impl->_collab.create_file(result, outcome.error))
+			return outcome;
+	}
+
+	outcome.state = task_state::completed;
+	outcome.result_hash = hash;
+	outcome.error.clear();
+	return outcome;
+}
+
+void collab::impl::task_worker_func(impl* p_impl) {
+	while (!p_impl->_stop.stop_requested()) {
+		// this node's own tasks first, then those of the busiest peer
+		task_assignment_structure assignment;
+		task_peer submitter;
+
+		const bool own_task = p_impl->_task_board.take_oldest(p_impl->_collab.unique_id(), [p_impl](const task& task) {
+			return program_allowed(command_program(task.command), p_impl->_task_programs);
+			}, assignment);
+
+		// a node that is short of cpu or disk leaves peers' tasks to others
+		if (!own_task && (p_impl->busy() || !steal_task(p_impl, assignment, submitter))) {
+			// take a breath, a new task or summary wakes us up sooner
+			p_impl->_stop.sleep_for(std::chrono::milliseconds{ task_worker_cycle });
+			continue;
+		}
+
+		const std::string task_unique_id = assignment.task.unique_id;
+
+		{
+			std::lock_guard<std::mutex> lock(p_impl->_running_tasks_mutex);
+			p_impl->_running_tasks.insert(task_unique_id);
+		}
+
+		p_impl->_idle_task_workers--;
+		p_impl->_task_cadence.kick();
+
+		p_impl->_log(log_event::task_started, assignment.task.name, log_id{ assignment.task.submitter_unique_id });
+
+		const task_status outcome = run_task(p_impl, assignment, own_task ? nullptr : &submitter);
+
+		if (p_impl->_stop.stop_requested())
+			break;	// the submitter puts the task back in the queue once this node is gone
+
+		if (outcome.state == task_state::completed) {
+			p_impl->_log(log_event::task_completed, assignment.task.name);
+			p_impl->_metrics.counter("tasks.completed").add();
+		}
+		else
+			if (outcome.state == task_state::failed) {
+				p_impl->_log(log_event::task_failed, assignment.task.name, outcome.error);
+				p_impl->_metrics.counter("tasks.failed").add();
+			}
+
+		// a task this node can't run goes back in the queue for another node, it hasn't failed
+		const bool release = outcome.state == task_state::queued;
+
+		// report the outcome before the task leaves our summaries, else the submitter would put it back in the queue
+		if (own_task) {
+			if (release)
+				p_impl->_task_board.release(p_impl->_collab.unique_id(), std::string(), task_unique_id);
+			else
+				p_impl->_task_board.finish(p_impl->_collab.unique_id(), std::string(), outcome);
+		}
+		else {
+			const std::string request = release ?
+				make_task_release_request(p_impl->_collab.unique_id(), task_unique_id) :
+				make_task_done_request(p_impl->_collab.unique_id(), outcome);
+
+			for (int attempt = 0; attempt < task_report_attempts; attempt++) {
+				std::string reply, error;
+				if (send_task_request(p_impl, submitter, request, reply, error))
+					break;
+
+				p_impl->_log(log_event::task_request_failed, log_id{ assignment.task.submitter_unique_id }, error);
+
+				if (!p_impl->_stop.sleep_for(std::chrono::milliseconds{ 1000 }))
+					break;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(p_impl->_running_tasks_mutex);
+			p_impl->_running_tasks.erase(task_unique_id);
+		}
+
+		p_impl->_idle_task_workers++;
+		p_impl->_task_cadence.kick();
+	}
+}
+
+std::string collab::impl::make_task_summary(const std::string& session_unique_id) {
+	task_summary_structure cls;
+	cls.queued = _task_board.queued(session_unique_id);
+	cls.idle_workers = _idle_task_workers;
+
+	{
+		std::lock_guard<std::mutex> lock(_running_tasks_mutex);
+		cls.running.assign(_running_tasks.begin(), _running_tasks.end());
+	}
+
+	// nodes without tasks or task workers keep quiet
+	if (cls.queued == 0 && cls.idle_workers == 0 && cls.running.empty())
+		return std::string();
+
+	cls.source_node_unique_id = _collab.unique_id();
+	cls.session_id = session_unique_id;
+
+	// capture host ip addresses and the port peers can reach the file source on
+	liblec::lecnet::tcp::get_host_ips(cls.ips);
+	cls.transfer_port = _transfer_port;
+
+	std::string serialized, error;
+	if (!serialize_task_summary_structure(cls, serialized, error))
+		serialized.clear();
+
+	return serialized;
+}
+
+void collab::impl::receive_task_summary(const task_summary_structure& summary) {
+	if (summary.source_node_unique_id == _collab.unique_id())
+		return;	// ignore this data
+
+	{
+		std::lock_guard<std::mutex> lock(_task_peer_mutex);
+
+		auto& peer = _task_peers[summary.source_node_unique_id];
+		peer.session_id = summary.session_id;
+		peer.ips = summary.ips;
+		peer.transfer_port = summary.transfer_port;
+		peer.queued = summary.queued;
+		peer.idle_workers = summary.idle_workers;
+		peer.running = std::set<std::string>(summary.running.begin(), summary.running.end());
+		peer.last_seen = std::chrono::steady_clock::now();
+	}
+
+	// idle workers may have something to take now
+	if (summary.queued > 0 && _idle_task_workers > 0)
+		_stop.wake();
+}
+
+void collab::impl::requeue_lost_tasks() {
+	const auto now = std::chrono::steady_clock::now();
+	const std::string unique_id = _collab.unique_id();
+
+	std::lock_guard<std::mutex> lock(_task_peer_mutex);
+
+	_task_board.requeue([&](const std::string& worker_unique_id, const std::string& task_unique_id,
+		const std::chrono::steady_clock::time_point& taken) {
+			if (worker_unique_id == unique_id)
+				return false;	// our own workers report back for sure
+
+			bool lost = false;
+			auto it = _task_peers.find(worker_unique_id);
+
+			if (it == _task_peers.end())
+				lost = now - taken > std::chrono::milliseconds{ task_peer_timeout };
+			else if (now - it->second.last_seen > std::chrono::milliseconds{ task_peer_timeout })
+				lost = true;	// the worker has gone away
+			else if (it->second.last_seen > taken + std::chrono::milliseconds{ task_summary_grace } &&
+				it->second.running.count(task_unique_id) == 0)
+				lost = true;	// the worker has dropped the task
+
+			if (lost)
+				_log(log_event::task_requeued, log_id{ task_unique_id }, log_id{ worker_unique_id });
+
+			return lost;
+		});
+
+	// forget peers that have gone away
+	for (auto it = _task_peers.begin(); it != _task_peers.end();) {
+		if (now - it->second.last_seen > std::chrono::milliseconds{ task_peer_timeout })
+			it = _task_peers.erase(it);
+		else
+			it++;
+	}
+}
+
+bool collab::submit_task(const task& task, std::string& unique_id, std::string& error) {
+	unique_id.clear();
+	error.clear();
+
+	if (task.session_id.empty() || task.command.empty()) {
+		error = "Session unique id or command not supplied";
+		return false;
+	}
+
+	collab::task cls = task;
+
+	if (cls.unique_id.empty())
+		cls.unique_id = liblec::leccore::hash_string::uuid();
+
+	// workers only take tasks with these in the expected form
+	if (!valid_task_unique_id(cls.unique_id) || !valid_extension(cls.output_extension)) {
+		error = "The task's unique id must be a uuid and its output extension a '.' followed by up to 16 letters and digits";
+		return false;
+	}
+
+	if (cls.time == 0)
+		cls.time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+	if (cls.submitter_unique_id.empty())
+		cls.submitter_unique_id = _d._unique_id;
+
+	// the inputs have to be shared in the session, workers fetch them like any other file
+	std::vector<file> inputs;
+	inputs.reserve(cls.inputs.size());
+
+	for (const auto& hash : cls.inputs) {
+		file input;
+		if (!get_file(hash, cls.session_id, input, error))
+			return false;
+
+		if (input.hash.empty()) {
+			error = "Input " + shorten_unique_id(hash) + " not found in the session";
+			return false;
+		}
+
+		inputs.push_back(input);
+	}
+
+	_d._task_board.submit(cls, inputs);
+	_d._log(log_event::task_submitted, cls.name);
+	_d._trace.mark(cls.unique_id, "task.submitted", cls.name);
+
+	// let peers know, and wake up our own workers
+	_d._task_cadence.kick();
+
+	unique_id = cls.unique_id;
+	return true;
+}
+
+void collab::get_tasks(const std::string& session_unique_id, std::vector<task_status>& tasks) {
+	_d._task_board.statuses(session_unique_id, tasks);
+}
@@ -0,0 +1,160 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../collab.h"
+#include "../impl.h"
+
+// STL
+#include <fstream>
+
+long long trace_clock_now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void tracer::record(const std::string& item_id, const char* name, long long start_us, long long duration_us,
+	const std::string& detail) {
+	collab::trace_span span;
+	span.item_id = item_id;
+	span.name = name;
+	span.node_id = _node_id;
+	span.start_us = start_us;
+	span.duration_us = (std::max)(duration_us, 0LL);
+	span.detail = detail;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_spans.size() == trace_span_capacity)
+		_spans.pop_front();
+
+	_spans.push_back(std::move(span));
+}
+
+void tracer::snapshot(std::vector<collab::trace_span>& spans) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	spans.assign(_spans.begin(), _spans.end());
+}
+
+void collab::add_trace_event(const std::string& item_id, const std::string& name) {
+	_d._trace.mark(item_id, name.c_str());
+}
+
+void collab::get_trace(std::vector<trace_span>& spans) {
+	_d._trace.snapshot(spans);
+}
+
+bool collab::save_trace(const std::string& full_path, std::string& error) {
+	std::vector<trace_span> spans;
+	get_trace(spans);
+	return save_trace(full_path, spans, error);
+}
+
+bool collab::save_trace(const std::string& full_path, const std::vector<trace_span>& spans,
+	std::string& error) {
+	// each node is a process, and each item type a thread within it
+	std::map<std::string, int> node_pids;
+	const std::vector<std::string> item_types = { "message", "file", "review" };
+
+	auto item_tid = [&item_types](const std::string& name) {
+		const std::string type = name.substr(0, name.find('.'));
+
+		for (size_t i = 0; i < item_types.size(); i++) {
+			if (item_types[i] == type)
+				return static_cast<int>(i) + 1;
+		}
+
+		return 0;
+	};
+
+	std::stringstream ss;
+	ss << "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [";
+
+	bool first = true;
+	auto begin_event = [&]() -> std::stringstream& {
+		ss << (first ? "\n    " : ",\n    ");
+		first = false;
+		return ss;
+	};
+
+	for (const auto& span : spans) {
+		if (node_pids.count(span.node_id))
+			continue;
+
+		const int pid = static_cast<int>(node_pids.size()) + 1;
+		node_pids[span.node_id] = pid;
+
+		begin_event() << "{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid <<
+			", \"args\": { \"name\": " << json_string("node " + shorten_unique_id(span.node_id)) << " } }";
+
+		for (size_t i = 0; i < item_types.size(); i++)
+			begin_event() << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid <<
+				", \"tid\": " << i + 1 << ", \"args\": { \"name\": " << json_string(item_types[i] + "s") << " } }";
+	}
+
+	for (const auto& span : spans) {
+		auto& event = begin_event();
+		event << "{ \"name\": " << json_string(span.name) <<
+			", \"cat\": " << json_string(span.name.substr(0, span.name.find('.'))) <<
+			", \"pid\": " << node_pids[span.node_id] <<
+			", \"tid\": " << item_tid(span.name) <<
+			", \"ts\": " << span.start_us;
+
+		if (span.duration_us > 0)
+			event << ", \"ph\": \"X\", \"dur\": " << span.duration_us;
+		else
+			event << ", \"ph\": \"i\", \"s\": \"t\"";
+
+		event << ", \"args\": { \"id\": " << json_string(span.item_id);
+
+		if (!span.detail.empty())
+			event << ", \"detail\": " << json_string(span.detail);
+
+		event << " } }";
+	}
+
+	ss << "\n  ]\n}\n";
+
+	try {
+		std::ofstream file(full_path, std::ios::out | std::ios::trunc);
+
+		if (!file) {
+			error = "Cannot open '" + full_path + "' for writing";
+			return false;
+		}
+
+		file << ss.str();
+		file.close();
+
+		if (!file) {
+			error = "Error writing to '" + full_path + "'";
+			return false;
+		}
+	}
+	catch (const std::exception& e) {
+		error = e.what();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,209 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+#include "../collab.h"
+#include "../impl.h"
+
+// STL
+#include <algorithm>
+
+long long transfer_scheduler::enqueue(const std::string& id, const std::string& name,
+	const std::string& peer, collab::transfer_priority priority, long long size) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	entry e;
+	e.transfer.id = id;
+	e.transfer.name = name;
+	e.transfer.peer = peer;
+	e.transfer.priority = priority;
+	e.transfer.size = size;
+
+	const long long ticket = _next_ticket++;
+	_transfers[ticket] = e;
+	return ticket;
+}
+
+double transfer_scheduler::refill(token_bucket& bucket, long long limit,
+	const std::chrono::steady_clock::time_point& now) {
+	if (limit <= 0) {
+		// unlimited
+		bucket.tokens = 0.0;
+		bucket.last_refill = now;
+		return 0.0;
+	}
+
+	if (bucket.last_refill == std::chrono::steady_clock::time_point())
+		bucket.last_refill = now;
+
+	const double elapsed = std::chrono::duration<double>(now - bucket.last_refill).count();
+	bucket.last_refill = now;
+
+	// allow a burst of up to one second's worth of data
+	bucket.tokens = (std::min)(static_cast<double>(limit), bucket.tokens + elapsed * static_cast<double>(limit));
+
+	return bucket.tokens >= 0.0 ? 0.0 : -bucket.tokens / static_cast<double>(limit);
+}
+
+bool transfer_scheduler::acquire(long long ticket) {
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	auto it = _transfers.find(ticket);
+
+	if (it == _transfers.end())
+		return false;
+
+	auto& e = it->second;
+	e.waiting = true;
+
+	while (!_stopped) {
+		// check if a transfer of a higher priority class is waiting
+		bool preempted = false;
+
+		for (const auto& [t, other] : _transfers) {
+			if (other.waiting && other.transfer.priority < e.transfer.priority) {
+				preempted = true;
+				break;
+			}
+		}
+
+		if (preempted) {
+			// wait for it to get its turn
+			_cv.wait(lock);
+			continue;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		const double delay = (std::max)(refill(_global_bucket, _global_limit, now),
+			refill(_peer_buckets[e.transfer.peer], _peer_limit, now));
+
+		if (delay <= 0.0) {
+			e.waiting = false;
+			e.transfer.active = true;
+
+			// transfers of a lower priority class may be waiting on this one
+			_cv.notify_all();
+			return true;
+		}
+
+		// wait for the buckets to be out of debt
+		_cv.wait_for(lock, std::chrono::duration<double>(delay));
+	}
+
+	e.waiting = false;
+	_cv.notify_all();
+	return false;
+}
+
+void transfer_scheduler::consume(long long ticket, long long bytes) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _transfers.find(ticket);
+
+	if (it == _transfers.end())
+		return;
+
+	it->second.transfer.transferred += bytes;
+
+	// charge the buckets, possibly into debt, which delays the next chunk
+	if (_global_limit > 0)
+		_global_bucket.tokens -= static_cast<double>(bytes);
+
+	if (_peer_limit > 0)
+		_peer_buckets[it->second.transfer.peer].tokens -= static_cast<double>(bytes);
+}
+
+void transfer_scheduler::complete(long long ticket) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _transfers.find(ticket);
+
+	if (it == _transfers.end())
+		return;
+
+	const std::string peer = it->second.transfer.peer;
+	_transfers.erase(it);
+
+	// drop the peer's bucket if no other transfer is using it
+	bool peer_in_use = false;
+
+	for (const auto& [t, e] : _transfers) {
+		if (e.transfer.peer == peer) {
+			peer_in_use = true;
+			break;
+		}
+	}
+
+	if (!peer_in_use)
+		_peer_buckets.erase(peer);
+
+	_cv.notify_all();
+}
+
+void transfer_scheduler::set_limits(long long global_limit, long long peer_limit) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_global_limit = (std::max)(global_limit, 0LL);
+	_peer_limit = (std::max)(peer_limit, 0LL);
+
+	// start afresh
+	_global_bucket = {};
+	_peer_buckets.clear();
+
+	_cv.notify_all();
+}
+
+void transfer_scheduler::get_transfers(std::vector<collab::transfer>& transfers) {
+	transfers.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		transfers.reserve(_transfers.size());
+
+		for (const auto& [t, e] : _transfers)
+			transfers.push_back(e.transfer);	// in ticket order
+	}
+
+	// active transfers first, then by priority class, preserving the queue order within each class
+	std::stable_sort(transfers.begin(), transfers.end(),
+		[](const collab::transfer& a, const collab::transfer& b) {
+			if (a.active != b.active)
+				return a.active;
+
+			return a.priority < b.priority;
+		});
+}
+
+void transfer_scheduler::stop() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stopped = true;
+	_cv.notify_all();
+}
+
+void collab::get_transfers(std::vector<transfer>& transfers) {
+	_d._transfer_scheduler.get_transfers(transfers);
+}
+
+void collab::set_transfer_rate_limits(long long global_limit, long long peer_limit) {
+	_d._transfer_scheduler.set_limits(global_limit, peer_limit);
+}
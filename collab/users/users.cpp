@@ -25,6 +25,9 @@
 #include "../impl.h"
 
 #include <set>
+#include <map>
+#include <chrono>
+#include <algorithm>
 
 // serialize template to make collab::user serializable
 template<class Archive>
@@ -72,18 +75,20 @@ bool deserialize_user_structure(const std::string& serialized, collab::user& cls
 }
 
 void collab::impl::user_broadcast_sender_func(impl* p_impl) {
-	// create a broadcast sender object
-	liblec::lecnet::udp::broadcast::sender sender(USER_BROADCAST_PORT);
+	// create a datagram sender object
+	datagram_sender sender(node_port(p_impl->_broadcast_port, USER_BROADCAST_PORT));
 
-	// loop until _stop_session_broadcast is false
+	// loop until a stop is requested
 	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
-		}
+		// wake ups from here on cut the next breath short
+		const auto wake_count = p_impl->_stop.wake_count();
+
+		// the broadcast, left empty if there is nothing to broadcast
+		std::string serialized_user;
 
 		std::string error;
 		collab::user user;
@@ -92,38 +97,61 @@ void collab::impl::user_broadcast_sender_func(impl* p_impl) {
 		if (p_impl->_collab.user_exists(p_impl->_collab.unique_id()) && p_impl->_collab.get_user(p_impl->_collab.unique_id(), user, error)) {
 
 			// serialize the user object
-			std::string serialized_user;
-			if (serialize_user_structure(user, serialized_user, error)) {
+			if (!serialize_user_structure(user, serialized_user, error))
+				serialized_user.clear();
+		}
 
-				// broadcast the serialized object
-				unsigned long actual_count = 0;
-				if (sender.send(serialized_user, 1, 0, actual_count, error)) {
-					// broadcast successful
-				}
+		// broadcast the serialized object if it's due
+		if (p_impl->_user_cadence.due(serialized_user) && !serialized_user.empty()) {
+			if (p_impl->send_datagram(sender, payload_type::user, serialized_user, "", error)) {
+				// broadcast successful
 			}
 		}
 
-		// take a breath
-		std::this_thread::sleep_for(std::chrono::milliseconds{ user_broadcast_cycle });
+		// advertise this node's capacity on the user channel, rounded off so that it only counts as a change when it matters
+		std::string serialized_capacity;
+		if (!serialize_capacity_structure(quantize_capacity(p_impl->_capacity_sampler.sample(p_impl->_collab.unique_id(),
+			p_impl->_collab.files_folder())), serialized_capacity, error))
+			serialized_capacity.clear();
+
+		if (p_impl->_capacity_cadence.due(serialized_capacity) && !serialized_capacity.empty()) {
+			if (p_impl->send_datagram(sender, payload_type::capacity, serialized_capacity, "", error)) {
+				// broadcast successful
+			}
+		}
+
+		// take a breath until the next broadcast is due, a change wakes us up sooner
+		p_impl->_stop.sleep_for((std::min)(p_impl->_user_cadence.time_to_next(), p_impl->_capacity_cadence.time_to_next()), wake_count);
 	}
 }
 
 void collab::impl::user_broadcast_receiver_func(impl* p_impl) {
-	// create broadcast receiver object
-	liblec::lecnet::udp::broadcast::receiver receiver(USER_BROADCAST_PORT, "0.0.0.0");
+	// create datagram receiver object
+	datagram_receiver receiver(node_port(p_impl->_broadcast_port, USER_BROADCAST_PORT), p_impl->_stop);
+
+	{
+		std::string error;
+		if (!receiver.start(error)) {
+			p_impl->_log(log_event::receiver_start_failed, "user", error);
+			return;
+		}
+
+		// users aren't tied to a session, they are announced on the discovery group when multicast is selected
+		if (!receiver.set_group(discovery_multicast_group, error))
+			p_impl->_log(log_event::receiver_join_failed, "user", error);
+	}
 
 	// for tracking users that have already been received so that a user is not attended to more than once per session
 	std::set<std::string> received_users;
 
-	// loop until _stop_session_broadcast is false
-	while (true) {
-		{
-			liblec::auto_mutex lock(p_impl->_session_broadcast_mutex);
+	// for telling when a peer appears, or reappears after having gone quiet
+	std::map<std::string, std::chrono::steady_clock::time_point> peers_last_seen;	// K = unique id
 
-			// check flag
-			if (p_impl->_stop_session_broadcast)
-				break;
-		}
+	// loop until a stop is requested
+	while (true) {
+		// check if a stop has been requested
+		if (p_impl->_stop.stop_requested())
+			break;
 
 		std::string current_session_unique_id;
 
@@ -135,21 +163,49 @@ void collab::impl::user_broadcast_receiver_func(impl* p_impl) {
 		if (!current_session_unique_id.empty()) {
 			std::string error;
 
-			// run the receiver
-			if (receiver.run(user_receiver_cycle, error)) {
-				// loop while running
-				while (receiver.running())
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			// wait for datagrams, a stop request or session change cuts the wait short
+			std::vector<std::string> datagrams;
+			if (receiver.wait(datagrams, std::chrono::milliseconds{ user_receiver_cycle })) {
+				p_impl->count_received_datagrams(payload_type::user, receiver, datagrams);
+
+				// process every datagram received
+				for (auto& serialized_user : datagrams) {
+					payload_type type;
+
+					// discard datagrams for other channels and sessions before going to the trouble of decoding them
+					if (!peek_datagram_type(serialized_user, type) ||
+						(type != payload_type::user && type != payload_type::capacity) ||
+						!strip_datagram_header(serialized_user, type, current_session_unique_id))
+						continue;
+
+					if (type == payload_type::capacity) {
+						collab::node_capacity capacity;
+						if (deserialize_capacity_structure(serialized_user, capacity, error))
+							p_impl->receive_capacity(capacity);
+						else
+							p_impl->count_deserialize_failure(payload_type::capacity);
+
+						continue;
+					}
 
-				// no longer running ... check if a datagram was received
-				std::string serialized_user;
-				if (receiver.get(serialized_user, error)) {
 					// datagram received ... deserialize
 
 					collab::user cls;
 					if (deserialize_user_structure(serialized_user, cls, error)) {
 						// deserialized successfully
 
+						if (cls.unique_id != p_impl->_collab.unique_id()) {
+							const auto now = std::chrono::steady_clock::now();
+							auto it = peers_last_seen.find(cls.unique_id);
+
+							// a peer that hasn't been heard from in a while may have missed our broadcasts, which are
+							// now far apart if nothing has changed, so broadcast everything straight away
+							if (it == peers_last_seen.end() || now - it->second > std::chrono::milliseconds{ 2 * broadcast_cycle_max })
+								p_impl->kick_broadcasts();
+
+							peers_last_seen[cls.unique_id] = now;
+						}
+
 						if (cls.unique_id == p_impl->_collab.unique_id() ||		// check if data is coming from a different node
 							received_users.count(cls.unique_id)) {				// don't attend to same user more than once per session
 							// ignore this data
@@ -163,40 +219,40 @@ void collab::impl::user_broadcast_receiver_func(impl* p_impl) {
 								// add to received user list
 								received_users.insert(cls.unique_id);
 
-								p_impl->_log("New user found (UDP): " + cls.display_name + " '" + cls.username + "' (unique id: " + shorten_unique_id(cls.unique_id) + ")");
+								p_impl->_log(log_event::user_found, cls.display_name, cls.username, log_id{ cls.unique_id });
 
 								if (p_impl->_collab.user_exists(cls.unique_id)) {
 									// edit user
 									if (p_impl->_collab.edit_user(cls.unique_id, cls, error)) {
 										// user edited successfully
-										p_impl->_log("Editing user: '" + shorten_unique_id(cls.unique_id) + "' successful");
+										p_impl->_log(log_event::user_edited, log_id{ cls.unique_id });
 									}
 									else
-										p_impl->_log("Error editing user: '" + shorten_unique_id(cls.unique_id) + "': " + error);
+										p_impl->_log(log_event::user_edit_failed, log_id{ cls.unique_id }, error);
 								}
 								else {
 									// save user to local database
 									if (p_impl->_collab.save_user(cls, error)) {
 										// user added successfully to the local database
-										p_impl->_log("Saving user: '" + shorten_unique_id(cls.unique_id) + "' successful");
+										p_impl->_log(log_event::user_saved, log_id{ cls.unique_id });
 									}
 									else
-										p_impl->_log("Error saving user: '" + shorten_unique_id(cls.unique_id) + "': " + error);
+										p_impl->_log(log_event::user_save_failed, log_id{ cls.unique_id }, error);
 								}
 							}
 						}
 					}
+					else
+						p_impl->count_deserialize_failure(payload_type::user);
 				}
 			}
-
-			receiver.stop();
 		}
 		else {
 			// clear received user list so it's refreshed per session
 			received_users.clear();
 
 			// take a breath
-			std::this_thread::sleep_for(std::chrono::milliseconds{ user_receiver_cycle });
+			p_impl->_stop.sleep_for(std::chrono::milliseconds{ user_receiver_cycle });
 		}
 	}
 }
@@ -228,6 +284,9 @@ bool collab::save_user(const collab::user& user,
 		error))
 		return false;
 
+	// broadcast the change straight away
+	_d._user_cadence.kick();
+
 	return true;
 }
 
@@ -259,6 +318,7 @@ bool collab::user_exists(const std::string& unique_id) {
 
 bool collab::get_user(const std::string& unique_id, collab::user& user, std::string& error) {
 	liblec::auto_mutex lock(_d._database_mutex);
+	scoped_timer timer(_d._database_metrics.get_user);
 
 	user.unique_id.clear();
 	user.username.clear();
@@ -376,5 +436,8 @@ bool collab::edit_user(const std::string& unique_id, const collab::user& user, s
 		error))
 		return false;
 
+	// broadcast the change straight away
+	_d._user_cadence.kick();
+
 	return true;
 }
@@ -50,6 +50,10 @@
 
 // STL
 #include <functional>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <set>
 
 using namespace liblec;
 using snap_type = lecui::rect::snap_type;
@@ -125,12 +129,37 @@ class main_form : public lecui::form {
 	leccore::download_update _download_update;
 	std::string _update_directory;
 	bool _setting_autostart = false;
+	bool _setting_multicast = false;
 	std::string _folder, _node_folder, _cert_folder, _files_folder, _files_staging_folder;
 	std::vector<collab::session> _previous_sessions;
 	std::vector<collab::message> _previous_messages;
+	unsigned long long _previous_messages_revision = 0;
+	std::string _previous_messages_session_unique_id;
 	std::vector<collab::file> _previous_files;
 	std::vector<collab::review> _previous_reviews;
 
+	// reads in the background, picked up by the timers that started them once they are in
+	std::future<collab::async_result<std::vector<collab::session>>> _sessions_read;
+	std::future<collab::async_result<std::vector<collab::message>>> _messages_read;
+	std::future<collab::async_result<std::vector<collab::file>>> _files_read;
+	std::string _files_read_session_unique_id;
+	std::future<collab::async_result<std::vector<collab::review>>> _reviews_read;
+	std::string _reviews_read_key;	// the session and file the reviews are being read for
+	static constexpr int read_poll_interval = 50;	// in milliseconds, how often a timer checks on its read
+	unsigned long long _background_calls = 0;	// for naming the timers of on_background_call_done
+
+	// the users' display names and images, resolved in the background so that drawing a list doesn't
+	// read the database; the lists are drawn again when a user's details come in
+	struct user_info {
+		std::string display_name;		// empty if the user isn't known yet
+		std::string user_image_file;	// empty if the user has no image
+		std::chrono::steady_clock::time_point resolved;
+	};
+
+	std::map<std::string, user_info> _user_info;	// K = user unique id
+	std::set<std::string> _users_to_resolve, _users_resolving;
+	static constexpr int user_info_refresh = 30;	// in seconds, how long before a user's details are read again
+
 	const bool _cleanup_mode;
 	const bool _update_mode;
 	const bool _recent_update_mode;
@@ -148,15 +177,16 @@ class main_form : public lecui::form {
 	std::string _message_sent_just_now;
 	std::string _current_session_file_hash;
 
-	// concurrency control related to the log
-	liblec::mutex _log_mutex;
-
 	struct event_info {
 		std::string time;
 		std::string event;
 	};
 
-	std::vector<event_info> _log_queue;
+	// events from the collab threads to the log table, the oldest events are dropped when the table falls behind
+	static constexpr size_t log_queue_capacity = 1024;
+	liblec::mpsc_queue<event_info> _log_queue{ log_queue_capacity };
+	unsigned long long _log_dropped_reported = 0;
+	static constexpr size_t max_log_rows = 1000;	// older events are removed from the log table
 	std::map<std::string, collab::file> _session_files;
 
 	bool on_initialize(std::string& error);
@@ -183,6 +213,7 @@ class main_form : public lecui::form {
 
 	void on_darktheme(bool on);
 	void on_autostart(bool on);
+	void on_multicast(bool on);
 	void on_autocheck_updates(bool on);
 	void on_autodownload_updates(bool on);
 	void on_select_location();
@@ -198,11 +229,37 @@ class main_form : public lecui::form {
 	void update_session_chat_messages();
 	void update_session_chat_files();
 	void update_file_reviews();
+	void update_transfers();
 	int map_extension_to_resource(const std::string& extension);
 
 	void log(const std::string& event);
 	void update_log();
 
+	// check on a background call on a timer, and give its result to on_done on this thread once it is in
+	template <typename T, typename F>
+	void on_background_call_done(std::future<T> call, F on_done) {
+		auto p_call = std::make_shared<std::future<T>>(std::move(call));
+		const std::string alias = "background_call_" + std::to_string(_background_calls++);
+
+		_timer_man.add(alias, read_poll_interval, [this, p_call, alias, on_done]() {
+			if (p_call->wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return;	// still running, the timer keeps looping
+
+			// stopping the timer may release this lambda, so hold on to what is needed after
+			auto p_done_call = p_call;
+			auto done = on_done;
+			_timer_man.stop(alias);
+
+			T result = p_done_call->get();
+			done(result);
+			});
+	}
+
+	// the user's details as last resolved, the shortened unique id until they are in
+	user_info get_user_info(const std::string& unique_id);
+	std::string get_display_name(const std::string& unique_id);
+	void resolve_users();
+
 public:
 	main_form(const std::string& caption, bool restarted);
 	~main_form();
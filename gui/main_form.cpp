@@ -427,10 +427,24 @@ void main_form::update_session_list() {
 	// stop the timer
 	_timer_man.stop("update_session_list");
 
-	std::vector<collab::session> sessions;
+	if (!_sessions_read.valid() ||
+		_sessions_read.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		// read the sessions in the background, and check on the read until it is in
+		if (!_sessions_read.valid())
+			_sessions_read = _collab.get_sessions_async();
+
+		_timer_man.add("update_session_list", read_poll_interval, [&]() {
+			update_session_list();
+			});
+
+		return;
+	}
+
+	auto read = _sessions_read.get();
+	std::vector<collab::session>& sessions = read.value;
 
 	std::string error;
-	if (_collab.get_sessions(sessions, error)) {
+	if (read.success) {
 		// check if anything has changed
 		if (sessions != _previous_sessions) {
 			_previous_sessions = sessions;
@@ -466,9 +480,98 @@ void main_form::update_session_list() {
 		});
 }
 
-void main_form::log(const std::string& event) {
-	liblec::auto_mutex lock(_log_mutex);
+main_form::user_info main_form::get_user_info(const std::string& unique_id) {
+	auto it = _user_info.find(unique_id);
+
+	if ((it == _user_info.end() ||
+		std::chrono::steady_clock::now() - it->second.resolved > std::chrono::seconds(user_info_refresh)) &&
+		_users_resolving.count(unique_id) == 0) {
+		// read the user's details in the background, the lists are drawn again once they are in
+		_users_to_resolve.insert(unique_id);
+		resolve_users();
+	}
+
+	if (it == _user_info.end() || it->second.display_name.empty()) {
+		// use the shortened version of the user's unique id
+		user_info info;
+		info.display_name = shorten_unique_id(unique_id);
+		return info;
+	}
+
+	return it->second;
+}
 
+std::string main_form::get_display_name(const std::string& unique_id) {
+	return get_user_info(unique_id).display_name;
+}
+
+void main_form::resolve_users() {
+	if (!_users_resolving.empty() || _users_to_resolve.empty())
+		return;	// the users asked for meanwhile are resolved once the current read is in
+
+	_users_resolving.swap(_users_to_resolve);
+
+	auto p_resolved = std::make_shared<std::map<std::string, user_info>>();
+
+	on_background_call_done(_collab.run_async([this, unique_ids = _users_resolving,
+		staging_folder = _files_staging_folder, p_resolved]() {
+		for (const auto& unique_id : unique_ids) {
+			std::string error;
+			collab::user user;
+
+			if (!_collab.get_user(unique_id, user, error) || user.display_name.empty())
+				continue;	// not known yet
+
+			user_info info;
+			info.display_name = user.display_name;
+
+			if (!user.user_image.empty()) {
+				info.user_image_file = staging_folder + "\\" + user.unique_id + ".jpg";
+
+				// save to file
+				if (!leccore::file::write(info.user_image_file, user.user_image, error))
+					info.user_image_file.clear();
+			}
+
+			(*p_resolved)[unique_id] = info;
+		}
+
+		return true;
+		}), [this, p_resolved](bool&) {
+			const auto now = std::chrono::steady_clock::now();
+			bool changed = false;
+
+			for (const auto& unique_id : _users_resolving) {
+				user_info info;
+
+				if (p_resolved->count(unique_id))
+					info = p_resolved->at(unique_id);
+
+				auto& previous = _user_info[unique_id];
+
+				if (info.display_name != previous.display_name || info.user_image_file != previous.user_image_file)
+					changed = true;
+
+				info.resolved = now;
+				previous = info;
+			}
+
+			_users_resolving.clear();
+
+			if (changed) {
+				// draw the lists again with the new details
+				_previous_messages.clear();
+				_previous_messages_session_unique_id.clear();
+				_previous_files.clear();
+				_previous_reviews.clear();
+			}
+
+			// resolve the users asked for meanwhile
+			resolve_users();
+		});
+}
+
+void main_form::log(const std::string& event) {
 	liblec::log(event);
 
 	// get the current time
@@ -481,7 +584,7 @@ void main_form::log(const std::string& event) {
 	ss << std::put_time(&time, "%B %d, %H:%M:%S");
 
 	// add to log queue
-	_log_queue.push_back({ ss.str(), event });
+	_log_queue.push({ ss.str(), event });
 }
 
 void main_form::update_log() {
@@ -489,25 +592,43 @@ void main_form::update_log() {
 	_timer_man.stop("update_log");
 
 	try {
-		bool do_update = !_log_queue.empty();
+		auto& log_table = get_table_view("log/log_table");
+		bool do_update = false;
 
-		if (do_update) {
-			auto& log_table = get_table_view("log/log_table");
+		// note any events that were dropped because the log table fell behind
+		const auto dropped = _log_queue.dropped();
 
-			liblec::auto_mutex lock(_log_mutex);
+		if (dropped > _log_dropped_reported) {
+			liblec::lecui::table_row row;
+			row.insert(std::make_pair("Time", std::string()));
+			row.insert(std::make_pair("Event", std::to_string(dropped - _log_dropped_reported) +
+				" log event(s) dropped, " + std::to_string(dropped) + " in total"));
 
-			// retrieve log events in the queue and insert them into the log table
-			for (const auto& info : _log_queue) {
-				liblec::lecui::table_row row;
-				row.insert(std::make_pair("Time", info.time));
-				row.insert(std::make_pair("Event", info.event));
+			log_table
+				.data().push_back(row);
 
-				log_table
-					.data().push_back(row);
-			}
+			_log_dropped_reported = dropped;
+			do_update = true;
+		}
 
-			// clear the log queue
-			_log_queue.clear();
+		// retrieve log events in the queue and insert them into the log table
+		event_info info;
+		while (_log_queue.pop(info)) {
+			liblec::lecui::table_row row;
+			row.insert(std::make_pair("Time", info.time));
+			row.insert(std::make_pair("Event", info.event));
+
+			log_table
+				.data().push_back(row);
+
+			do_update = true;
+		}
+
+		if (do_update) {
+			// keep only the most recent events in the log table
+			auto& rows = log_table.data();
+			if (rows.size() > max_log_rows)
+				rows.erase(rows.begin(), rows.begin() + (rows.size() - max_log_rows));
 
 			update();
 		}
@@ -316,6 +316,14 @@ bool main_form::on_initialize(std::string& error) {
 		if (!reg.do_delete("Software\\Microsoft\\Windows\\CurrentVersion\\Run", "collab", error)) {}
 	}
 
+	if (!_settings.read_value("", "multicast", value, error))
+		return false;
+	else
+		// default to no
+		_setting_multicast = value == "yes";
+
+	_collab.set_transport(_setting_multicast ? collab::transport::multicast : collab::transport::broadcast);
+
 	if (!_settings.read_value("", "folder", value, error))
 		return false;
 	else {
@@ -51,18 +51,32 @@ lecui::containers::pane& main_form::add_chat_pane(lecui::containers::pane& colla
 		}
 		catch (const std::exception&) {}
 
-		std::string error;
-		if (_collab.create_message(msg, error)) {
+		try {
+			// clear the text field now, the message is saved in the background
+			_message_sent_just_now = msg.unique_id;
+			auto& message = get_text_field("home/collaboration_pane/chat_pane/message");
+			message.text().clear();
+			update();
+		}
+		catch (const std::exception&) {}
+
+		on_background_call_done(_collab.create_message_async(msg), [this, text = msg.text](collab::async_status& status) {
+			if (status.success)
+				return;
+
+			// give the text back so that it isn't lost
 			try {
-				_message_sent_just_now = msg.unique_id;
 				auto& message = get_text_field("home/collaboration_pane/chat_pane/message");
-				message.text().clear();
-				update();
+
+				if (message.text().empty()) {
+					message.text(text);
+					update();
+				}
 			}
 			catch (const std::exception&) {}
-		}
-		else
-			lecui::form::message(error);
+
+			lecui::form::message(status.error);
+			});
 	};
 
 	// add chat pane (dynamic)
@@ -32,22 +32,53 @@
 #include <sstream>
 #include <sstream>
 #include <iomanip>
+#include <set>
 
 void main_form::update_session_chat_messages() {
 	if (_current_session_unique_id.empty()) {
 		_previous_messages.clear();
+		_previous_messages_session_unique_id.clear();
 		return;	// exit immediately, user isn't currently part of any session
 	}
 
+	if (!_messages_read.valid()) {
+		// check if any message has been added since the last update ... much cheaper than reading the database
+		const auto messages_revision = _collab.messages_revision();
+
+		if (messages_revision == _previous_messages_revision &&
+			_current_session_unique_id == _previous_messages_session_unique_id)
+			return;	// nothing new, the timer keeps looping
+
+		_previous_messages_revision = messages_revision;
+		_previous_messages_session_unique_id = _current_session_unique_id;
+
+		// read the messages in the background, a later tick picks them up
+		_messages_read = _collab.get_messages_async(_current_session_unique_id);
+		return;
+	}
+
+	if (_messages_read.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;	// still reading, the timer keeps looping
+
+	auto read = _messages_read.get();
+
+	if (_previous_messages_session_unique_id != _current_session_unique_id)
+		return;	// the session changed while reading, the next tick reads again
+
 	// stop the timer
 	_timer_man.stop("update_session_chat_messages");
 
-	std::vector<collab::message> messages;
+	std::vector<collab::message>& messages = read.value;
 
 	std::string error;
-	if (_collab.get_messages(_current_session_unique_id, messages, error)) {
+	if (read.success) {
 		// check if anything has changed
 		if (messages != _previous_messages) {
+			// messages that are about to be shown for the first time, for tracing
+			std::set<std::string> previous_unique_ids;
+			for (const auto& msg : _previous_messages)
+				previous_unique_ids.insert(msg.unique_id);
+
 			_previous_messages = messages;
 			log("Session " + shorten_unique_id(_current_session_unique_id) + ": messages changed");
 
@@ -60,9 +91,6 @@ void main_form::update_session_chat_messages() {
 
 				std::string previous_sender_unique_id;
 
-				// K = unique_id, T = display name
-				std::map<std::string, std::string> display_names;
-
 				bool latest_message_arrived = false;
 
 				struct day_struct {
@@ -104,34 +132,8 @@ void main_form::update_session_chat_messages() {
 					if (continuation && !day_change)
 						bottom_margin -= (.85f * _margin);
 
-					std::string display_name;
-
-					// try to get this user's display name
-					try {
-						if (display_names.count(msg.sender_unique_id) == 0) {
-							// fetch from local database
-							std::string _display_name;
-							if (_collab.get_user_display_name(msg.sender_unique_id, _display_name, error) && !_display_name.empty()) {
-								// capture
-								display_name = _display_name;
-
-								// cache
-								display_names[msg.sender_unique_id] = display_name;
-							}
-							else {
-								// use shortened version of user's unique id
-								display_name = shorten_unique_id(msg.sender_unique_id);
-							}
-						}
-						else {
-							// use the cached display name
-							display_name = display_names.at(msg.sender_unique_id);
-						}
-					}
-					catch (const std::exception&) {
-						// use shortened version of user's unique id
-						display_name = shorten_unique_id(msg.sender_unique_id);
-					}
+					// the user's display name, resolved in the background
+					const std::string display_name = get_display_name(msg.sender_unique_id);
 
 					float font_size = _ui_font_size;
 
@@ -228,6 +230,9 @@ void main_form::update_session_chat_messages() {
 					}
 
 					previous_sender_unique_id = msg.sender_unique_id;
+
+					if (previous_unique_ids.count(msg.unique_id) == 0)
+						_collab.add_trace_event(msg.unique_id, "message.render");
 				}
 
 				if (latest_message_arrived) {
@@ -244,8 +249,8 @@ void main_form::update_session_chat_messages() {
 		}
 	}
 
-	// resume the timer (1200ms looping ...)
-	_timer_man.add("update_session_chat_messages", 1200, [&]() {
+	// resume the timer (100ms looping ... cheap because of the revision check)
+	_timer_man.add("update_session_chat_messages", 100, [&]() {
 		update_session_chat_messages();
 		});
 }
@@ -29,6 +29,7 @@
 #include <liblec/lecui/widgets/label.h>
 #include <liblec/lecui/widgets/text_field.h>
 #include <liblec/lecui/widgets/button.h>
+#include <liblec/lecui/widgets/table_view.h>
 #include <liblec/lecui/utilities/filesystem.h>
 
 // leccore
@@ -36,7 +37,7 @@
 
 // STL
 #include <filesystem>
-#include <thread>
+#include <future>
 
 lecui::containers::pane& main_form::add_files_pane(lecui::containers::pane& collaboration_pane, const lecui::rect& ref_rect) {
 	// lambda functions
@@ -49,9 +50,18 @@ lecui::containers::pane& main_form::add_files_pane(lecui::containers::pane& coll
 				lecui::appearance _apprnc{ *this };
 				lecui::dimensions _dim{ *this };
 
+				lecui::timer_manager _timer_man{ *this };
+
 				main_form& _main_form;
 				const std::string& _full_path;
 
+				// the file being added, and the background calls adding it, one after the other
+				collab::file _file;
+				std::future<collab::async_result<std::string>> _import;
+				std::future<collab::async_result<bool>> _exists;
+				std::future<collab::async_status> _save;
+				unsigned long long _ticks = 0;
+
 				void on_add() {
 					try {
 						auto& file_name = get_text_field("home/file_name");
@@ -106,17 +116,6 @@ lecui::containers::pane& main_form::add_files_pane(lecui::containers::pane& coll
 						// capture file description
 						file.description = file_description.text();
 
-						// capture file hash
-						leccore::hash_file hash_file;
-						hash_file.start(_full_path, { leccore::hash_file::algorithm::sha256 });
-
-						std::string file_size_string;
-
-						try {
-							file_size_string = leccore::format_size(std::filesystem::file_size(_full_path));
-						}
-						catch (const std::exception&) {}
-
 						// prevent quitting
 						prevent_quit();
 
@@ -126,90 +125,126 @@ lecui::containers::pane& main_form::add_files_pane(lecui::containers::pane& coll
 						if (!_widget_man.disable("home/file_description", error)) {}
 						if (!_widget_man.disable("home/add", error)) {}
 
-						// set status text to hashing
-						status.text("Hashing file, please wait . .");
+						// set status text to adding
+						status.text("Adding file, please wait . .");
 
 						update();
 
-						unsigned long long count = 0;
+						// import the file into the files folder in the background, hashing it in the same pass
+						// the timer takes it from there once the import is in
+						_file = file;
+						_import = _main_form._collab.import_file_async(_full_path);
 
-						while (hash_file.hashing()) {
-							if (count % 40 == 0) {
-								// little bit of lazy animation using dots
-								if (status.text().length() >= 65)
-									status.text("Hashing file, please wait . .");
-								else
-									status.text() += " .";
+						_timer_man.add("add_file", main_form::read_poll_interval, [this]() {
+							on_add_progress();
+							});
+					}
+					catch (const std::exception& e) {
+						allow_quit();
+						message(e.what());
+					}
+				}
 
-								update();
-							}
+				// check on the background calls, starting the next one as each comes in
+				void on_add_progress() {
+					try {
+						auto& status = get_label("home/status");
+
+						// little bit of lazy animation using dots
+						if (_ticks++ % 2 == 0) {
+							if (status.text().length() >= 65)
+								status.text("Adding file, please wait . .");
+							else
+								status.text() += " .";
+
+							update();
+						}
+
+						if (_import.valid()) {
+							if (_import.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+								return;	// still importing, the timer keeps looping
 
-							count++;
+							const auto imported = _import.get();
 
-							if (!keep_alive()) {
-								allow_quit();
+							if (!imported.success) {
+								on_add_done("Error adding file: " + imported.error);
 								return;
 							}
 
-							std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+							// check if file already exists in this session
+							_file.hash = imported.value;
+							_exists = _main_form._collab.file_exists_async(_file.hash, _file.session_id);
+							return;
 						}
 
-						// enable controls
-						if (!_widget_man.enable("home/file_name", error)) {}
-						if (!_widget_man.enable("home/file_description", error)) {}
-						if (!_widget_man.enable("home/add", error)) {}
+						if (_exists.valid()) {
+							if (_exists.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+								return;
 
-						// clear status text
-						status.text().clear();
+							if (_exists.get().value) {
+								// the files pane has the session's files, no need to read the database for the name
+								auto it = _main_form._session_files.find(_file.hash);
 
-						allow_quit();
+								if (it != _main_form._session_files.end())
+									on_add_done("This file already exists in this session under the following name:\n"
+										"<strong>" + it->second.name + "</strong>"
+										"<span style = 'font-size: 8.0pt;'>" + it->second.extension + "</span>");
+								else
+									on_add_done("This file already exists in this session");
 
-						update();
+								return;
+							}
 
-						leccore::hash_file::hash_results results;
-						if (!hash_file.result(results, error)) {
-							message("Error hashing file: " + error);
+							// save the file to the database
+							_save = _main_form._collab.create_file_async(_file);
 							return;
 						}
 
-						file.hash = results.at(leccore::hash_file::algorithm::sha256);
-
-						// check if file already exists in this session
-						if (_main_form._collab.file_exists(file.hash, _main_form._current_session_unique_id)) {
-							collab::file existing_file;
+						if (_save.valid()) {
+							if (_save.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+								return;
 
-							if (_main_form._collab.get_file(file.hash, _main_form._current_session_unique_id, existing_file, error))
-								message("This file already exists in this session under the following name:\n"
-									"<strong>" + existing_file.name + "</strong>"
-									"<span style = 'font-size: 8.0pt;'>" + existing_file.extension + "</span>");
-							else
-								message("This file already exists in this session");
-							
-							return;
-						}
+							const auto saved = _save.get();
 
-						// check if file already exists in another session
-						if (!_main_form._collab.file_exists(file.hash)) {
-							// copy the file to the collab folder
-							if (!leccore::file::copy(_full_path, _main_form._files_folder + "\\" + file.hash, error)) {
-								message("Error copying file: " + error);
+							if (!saved.success) {
+								on_add_done("Error saving to database: " + saved.error);
 								return;
 							}
-						}
 
-						// save the file to the database
-						if (!_main_form._collab.create_file(file, error)) {
-							message("Error saving to database: " + error);
-							return;
-						}
+							on_add_done(std::string());
 
-						// file saved successfully ... close this form
-						close();
+							// file saved successfully ... close this form
+							close();
+						}
 					}
 					catch (const std::exception& e) {
-						allow_quit();
-						message(e.what());
+						on_add_done(e.what());
+					}
+				}
+
+				// stop checking on the background calls and give the controls back, showing the error if there is one
+				void on_add_done(const std::string& error_message) {
+					_timer_man.stop("add_file");
+
+					// enable controls
+					std::string error;
+					if (!_widget_man.enable("home/file_name", error)) {}
+					if (!_widget_man.enable("home/file_description", error)) {}
+					if (!_widget_man.enable("home/add", error)) {}
+
+					// clear status text
+					try {
+						auto& status = get_label("home/status");
+						status.text().clear();
 					}
+					catch (const std::exception&) {}
+
+					allow_quit();
+
+					update();
+
+					if (!error_message.empty())
+						message(error_message);
 				}
 
 			public:
@@ -383,14 +418,18 @@ lecui::containers::pane& main_form::add_files_pane(lecui::containers::pane& coll
 	content_pane
 		.color_fill().alpha(0);
 
+	// the add and transfers buttons share the space below the content pane
+	const auto buttons_rect = lecui::rect()
+		.width(content_pane.rect().width() - 2.f * 10.f)
+		.height(25.f)
+		.snap_to(content_pane.rect(), snap_type::bottom, 0.f);
+
 	// add button
 	auto& add_file = lecui::widgets::button::add(files_pane, "add_file");
 	add_file
 		.text("Add file")
-		.rect(lecui::rect(add_file.rect())
-			.width(content_pane.rect().width() - 2.f * 10.f)
-			.height(25.f)
-			.snap_to(content_pane.rect(), snap_type::bottom, 0.f))
+		.rect(lecui::rect(buttons_rect)
+			.width((buttons_rect.width() - _margin) / 2.f))
 		.on_resize(lecui::resize_params()
 			.y_rate(100.f))
 		.events().action = [this, do_add_file]() {
@@ -400,5 +439,89 @@ lecui::containers::pane& main_form::add_files_pane(lecui::containers::pane& coll
 			message("Error: file source is not running");
 	};
 
+	// add transfers button
+	auto& transfers = lecui::widgets::button::add(files_pane, "transfers");
+	transfers
+		.text("Transfers")
+		.tooltip("See the files being downloaded from the other computers in the session")
+		.rect(lecui::rect(add_file.rect())
+			.snap_to(add_file.rect(), snap_type::right, _margin))
+		.on_resize(lecui::resize_params()
+			.y_rate(100.f))
+		.events().action = [this]() {
+		try {
+			// the transfers are shown where the reviews of the selected file would be
+			_page_man.close("home/collaboration_pane/files_pane/review_info");
+			_page_man.close("home/collaboration_pane/files_pane/review_input");
+			_page_man.close("home/collaboration_pane/files_pane/transfers");
+			_current_session_file_hash.clear();
+
+			auto& files_pane = get_pane("home/collaboration_pane/files_pane");
+			auto& content_pane = get_pane("home/collaboration_pane/files_pane/content");
+
+			// create transfers pane
+			auto& transfers_pane = lecui::containers::pane::add(files_pane, "transfers", 0.f);
+			transfers_pane
+				.rect(lecui::rect(files_pane.size())
+					.top(content_pane.rect().top())
+					.left(content_pane.rect().right())
+					.right(files_pane.size().get_width()))
+				.on_resize(lecui::resize_params()
+					.width_rate(100.f)
+					.height_rate(100.f));
+
+			// make pane invisible
+			transfers_pane
+				.border(0.f);
+			transfers_pane
+				.color_fill().alpha(0);
+
+			auto ref_rect = lecui::rect(transfers_pane.size());
+			ref_rect.left() += _margin;
+			ref_rect.right() -= _margin;
+			ref_rect.top() += _margin;
+			ref_rect.bottom() -= _margin;
+
+			auto& title = lecui::widgets::label::add(transfers_pane, "title");
+			title
+				.text("<strong>TRANSFERS</strong>")
+				.rect(lecui::rect()
+					.left(_margin)
+					.width(ref_rect.width())
+					.top(_margin)
+					.height(title.rect().height()))
+				.on_resize(lecui::resize_params()
+					.width_rate(100.f));
+
+			// add transfer queue, active transfers first, then queued ones in the order they will start
+			auto& queue = lecui::widgets::table_view::add(transfers_pane, "queue");
+			queue
+				.rect(lecui::rect()
+					.left(ref_rect.left())
+					.right(ref_rect.right())
+					.top(title.rect().bottom() + _margin)
+					.bottom(ref_rect.bottom()))
+				.on_resize(lecui::resize_params()
+					.width_rate(100.f)
+					.height_rate(100.f))
+				.fixed_number_column(true)
+				.columns({
+					{ "Name", 150 },
+					{ "Peer", 100 },
+					{ "Priority", 80 },
+					{ "Progress", 130 },
+					{ "Status", 60 }
+					});
+
+			update();
+
+			// fill the queue, and keep it up to date for as long as the pane is open
+			update_transfers();
+		}
+		catch (const std::exception& e) {
+			message(e.what());
+		}
+	};
+
 	return files_pane;
 }
@@ -42,12 +42,40 @@ void main_form::update_file_reviews() {
 	// stop the timer
 	_timer_man.stop("update_file_reviews");
 
-	std::vector<collab::review> reviews;
+	const std::string reviews_key = _current_session_unique_id + "#" + _current_session_file_hash;
+
+	if (!_reviews_read.valid() ||
+		_reviews_read.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		// read the reviews in the background, and check on the read until it is in
+		if (!_reviews_read.valid()) {
+			_reviews_read = _collab.get_reviews_async(_current_session_unique_id, _current_session_file_hash);
+			_reviews_read_key = reviews_key;
+		}
+
+		_timer_man.add("update_file_reviews", read_poll_interval, [&]() {
+			update_file_reviews();
+			});
+
+		return;
+	}
+
+	auto read = _reviews_read.get();
+
+	if (_reviews_read_key != reviews_key) {
+		// the file changed while reading, read the reviews again
+		_timer_man.add("update_file_reviews", 0, [&]() {
+			update_file_reviews();
+			});
+
+		return;
+	}
+
+	std::vector<collab::review>& reviews = read.value;
 	std::string error;
 	int panes_not_rendered = 0;
 	std::vector<std::string> pane_list;
 
-	if (_collab.get_reviews(_current_session_unique_id, _current_session_file_hash, reviews, error)) {
+	if (read.success) {
 		// check if anything has changed
 		if (reviews != _previous_reviews) {
 			_previous_reviews = reviews;
@@ -60,14 +88,6 @@ void main_form::update_file_reviews() {
 
 				float bottom = 0.f;
 
-				// K = unique_id, T = display name
-				struct user_info {
-					std::string display_name;
-					std::string user_image_file;
-				};
-
-				std::map<std::string, user_info> cached_user_info;
-
 				for (const auto& review : reviews) {
 					std::tm time = { };
 					localtime_s(&time, &review.time);
@@ -76,41 +96,8 @@ void main_form::update_file_reviews() {
 					ss << std::put_time(&time, "%d %B %Y, %H:%M");
 					std::string send_date = ss.str();
 
-					user_info local_user_info;
-
-					// try to get this user's display name
-					try {
-						if (cached_user_info.count(review.sender_unique_id) == 0) {
-							// fetch from local database
-							collab::user user;
-							if (_collab.get_user(review.sender_unique_id, user, error) && !user.display_name.empty()) {
-								if (!user.user_image.empty()) {
-									local_user_info.user_image_file = _files_staging_folder + "\\" + user.unique_id + ".jpg";
-
-									// save to file
-									if (leccore::file::write(local_user_info.user_image_file, user.user_image, error)) {}
-								}
-
-								// capture
-								local_user_info.display_name = user.display_name;
-
-								// cache
-								cached_user_info[review.sender_unique_id] = local_user_info;
-							}
-							else {
-								// use the shortened version of the user's unique id
-								local_user_info.display_name = shorten_unique_id(review.sender_unique_id);
-							}
-						}
-						else {
-							// use the cached display name
-							local_user_info = cached_user_info.at(review.sender_unique_id);
-						}
-					}
-					catch (const std::exception&) {
-						// use the shortened version of the user's unique id
-						local_user_info.display_name = shorten_unique_id(review.sender_unique_id);
-					}
+					// the user's display name and image, resolved in the background
+					const user_info local_user_info = get_user_info(review.sender_unique_id);
 
 					// add review
 					auto& pane = lecui::containers::pane::add(list, review.unique_id, 0.f);
@@ -51,10 +51,36 @@ void main_form::update_session_chat_files() {
 	// stop the timer
 	_timer_man.stop("update_session_chat_files");
 
-	std::vector<collab::file> files;
+	if (!_files_read.valid() ||
+		_files_read.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		// read the files in the background, and check on the read until it is in
+		if (!_files_read.valid()) {
+			_files_read = _collab.get_files_async(_current_session_unique_id);
+			_files_read_session_unique_id = _current_session_unique_id;
+		}
+
+		_timer_man.add("update_session_chat_files", read_poll_interval, [&]() {
+			update_session_chat_files();
+			});
+
+		return;
+	}
+
+	auto read = _files_read.get();
+
+	if (_files_read_session_unique_id != _current_session_unique_id) {
+		// the session changed while reading, read the files again
+		_timer_man.add("update_session_chat_files", 0, [&]() {
+			update_session_chat_files();
+			});
+
+		return;
+	}
+
+	std::vector<collab::file>& files = read.value;
 	std::string error;
 
-	if (_collab.get_files(_current_session_unique_id, files, error)) {
+	if (read.success) {
 
 		// check if anything has changed
 		if (files != _previous_files) {
@@ -71,9 +97,6 @@ void main_form::update_session_chat_files() {
 
 				float bottom_margin = 0.f;
 
-				// K = unique_id, T = display name
-				std::map<std::string, std::string> display_names;
-
 				for (const auto& it : files) {
 					auto& file = _session_files.at(it.hash);
 
@@ -84,34 +107,8 @@ void main_form::update_session_chat_files() {
 					ss << std::put_time(&time, "%d %B %Y, %H:%M");
 					std::string send_date = ss.str();
 
-					std::string display_name;
-
-					// try to get this user's display name
-					try {
-						if (display_names.count(file.sender_unique_id) == 0) {
-							// fetch from local database
-							std::string _display_name;
-							if (_collab.get_user_display_name(file.sender_unique_id, _display_name, error) && !_display_name.empty()) {
-								// capture
-								display_name = _display_name;
-
-								// cache
-								display_names[file.sender_unique_id] = display_name;
-							}
-							else {
-								// use the shortened version of the user's unique id
-								display_name = shorten_unique_id(file.sender_unique_id);
-							}
-						}
-						else {
-							// use the cached display name
-							display_name = display_names.at(file.sender_unique_id);
-						}
-					}
-					catch (const std::exception&) {
-						// use the shortened version of the user's unique id
-						display_name = shorten_unique_id(file.sender_unique_id);
-					}
+					// the user's display name, resolved in the background
+					const std::string display_name = get_display_name(file.sender_unique_id);
 
 					const std::string file_name_text = "<strong>" + file.name + "</strong><span style = 'font-size: 8.0pt;'>" + file.extension + "</span>";
 
@@ -166,6 +163,9 @@ void main_form::update_session_chat_files() {
 							// close review info pane (it'll be recreated below)
 							_page_man.close("home/collaboration_pane/files_pane/review_info");
 
+							// close transfers pane, the reviews are shown in its place
+							_page_man.close("home/collaboration_pane/files_pane/transfers");
+
 							_previous_reviews.clear();	// to force a refresh in the case of an already selected file being selected afresh
 							_current_session_file_hash = file.hash;
 
@@ -182,25 +182,8 @@ void main_form::update_session_chat_files() {
 							ss << std::put_time(&time, "%d %B %Y, %H:%M");
 							std::string send_date = ss.str();
 
-							std::string display_name;
-
-							// try to get this user's display name
-							try {
-								// fetch from local database
-								std::string _display_name;
-								if (_collab.get_user_display_name(file.sender_unique_id, _display_name, error) && !_display_name.empty()) {
-									// capture
-									display_name = _display_name;
-								}
-								else {
-									// use shortened version of user's unique id
-									display_name = shorten_unique_id(file.sender_unique_id);
-								}
-							}
-							catch (const std::exception&) {
-								// use shortened version of user's unique id
-								display_name = shorten_unique_id(file.sender_unique_id);
-							}
+							// the user's display name, resolved in the background
+							const std::string display_name = get_display_name(file.sender_unique_id);
 
 							// create review info pane
 							auto& review_info = lecui::containers::pane::add(files_pane, "review_info", 0.f);
@@ -324,13 +307,18 @@ void main_form::update_session_chat_files() {
 							// remove destination file if it already exists
 							if (!leccore::file::remove(destination_file, error)) {}
 
-							// extract the file
-							if (!leccore::file::copy(_files_folder + "\\" + file.hash, destination_file, error))
-								message("Error extracting file: " + error);
-							else {
-								if (!leccore::shell::open(destination_file, error))
-									message("Error opening file: " + error);
-							}
+							// extract the file in the background, and open it once it is out
+							on_background_call_done(_collab.export_file_async(file.hash, destination_file),
+								[this, destination_file](collab::async_status& status) {
+									std::string error;
+
+									if (!status.success)
+										message("Error extracting file: " + status.error);
+									else {
+										if (!leccore::shell::open(destination_file, error))
+											message("Error opening file: " + error);
+									}
+								});
 						}
 
 						if (selected == "Save To ...") {
@@ -344,13 +332,18 @@ void main_form::update_session_chat_files() {
 								// remove destination file if it already exists
 								if (!leccore::file::remove(destination_file, error)) {}
 
-								// extract the file
-								if (!leccore::file::copy(_files_folder + "\\" + file.hash, destination_file, error))
-									message("Error extracting file: " + error);
-								else {
-									if (!leccore::shell::view(destination_file, error))
-										message("Error opening folder: " + error);
-								}
+								// extract the file in the background, and show it once it is out
+								on_background_call_done(_collab.export_file_async(file.hash, destination_file),
+									[this, destination_file](collab::async_status& status) {
+										std::string error;
+
+										if (!status.success)
+											message("Error extracting file: " + status.error);
+										else {
+											if (!leccore::shell::view(destination_file, error))
+												message("Error opening folder: " + error);
+										}
+									});
 							}
 						}
 
@@ -372,25 +365,8 @@ void main_form::update_session_chat_files() {
 									ss << std::put_time(&time, "%d %B %Y, %H:%M");
 									std::string send_date = ss.str();
 
-									std::string display_name;
-
-									// try to get this user's display name
-									try {
-										// fetch from local database
-										std::string _display_name;
-										if (_collab.get_user_display_name(file.sender_unique_id, _display_name, error) && !_display_name.empty()) {
-											// capture
-											display_name = _display_name;
-										}
-										else {
-											// use shortened version of user's unique id
-											display_name = shorten_unique_id(file.sender_unique_id);
-										}
-									}
-									catch (const std::exception&) {
-										// use shortened version of user's unique id
-										display_name = shorten_unique_id(file.sender_unique_id);
-									}
+									// the user's display name, resolved in the background
+									const std::string display_name = get_display_name(file.sender_unique_id);
 
 									// create review input pane
 									auto& review_input = lecui::containers::pane::add(files_pane, "review_input", 0.f);
@@ -523,12 +499,20 @@ void main_form::update_session_chat_files() {
 											// capture the review text
 											review.text = text;
 
-											if (_collab.create_review(review, error)) {
-												// review created successfully
+											// disable the button so that the review isn't added twice while it is being created
+											if (!_widget_man.disable("home/collaboration_pane/files_pane/review_input/add_review", error)) {}
+
+											// close review input pane once the review has been created in the background
+											on_background_call_done(_collab.create_review_async(review),
+												[this](collab::async_status& status) {
+													std::string error;
 
-												// close review input pane
-												_page_man.close("home/collaboration_pane/files_pane/review_input");
-											}
+													if (status.success)
+														_page_man.close("home/collaboration_pane/files_pane/review_input");
+													else {
+														if (!_widget_man.enable("home/collaboration_pane/files_pane/review_input/add_review", error)) {}
+													}
+												});
 										}
 										catch (const std::exception& e) {
 											message(e.what());
@@ -0,0 +1,88 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this softwareand associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#include "../../../../../gui.h"
+
+// lecui
+#include <liblec/lecui/widgets/table_view.h>
+
+void main_form::update_transfers() {
+	// stop the timer
+	_timer_man.stop("update_transfers");
+
+	try {
+		// throws if the transfers pane has been closed, in which case the timer isn't resumed
+		auto& queue = get_table_view("home/collaboration_pane/files_pane/transfers/queue");
+
+		// the queue is kept in memory by the transfer scheduler, no need to read it in the background
+		std::vector<collab::transfer> transfers;
+		_collab.get_transfers(transfers);
+
+		queue
+			.data().clear();
+
+		for (const auto& transfer : transfers) {
+			std::string priority;
+
+			switch (transfer.priority) {
+			case collab::transfer_priority::interactive:
+				priority = "Interactive";
+				break;
+			case collab::transfer_priority::small_file:
+				priority = "Small file";
+				break;
+			case collab::transfer_priority::bulk_file:
+			default:
+				priority = "Bulk file";
+				break;
+			}
+
+			std::string progress = leccore::format_size(transfer.transferred, 2);
+
+			if (transfer.size > 0)
+				progress += " of " + leccore::format_size(transfer.size, 2);
+
+			liblec::lecui::table_row row;
+			row.insert(std::make_pair("ID", transfer.id));
+			row.insert(std::make_pair("Name", transfer.name.empty() ? shorten_unique_id(transfer.id) : transfer.name));
+			row.insert(std::make_pair("Peer", transfer.peer));
+			row.insert(std::make_pair("Priority", priority));
+			row.insert(std::make_pair("Progress", progress));
+			row.insert(std::make_pair("Status", std::string(transfer.active ? "Active" : "Queued")));
+
+			queue
+				.data().push_back(row);
+		}
+
+		update();
+	}
+	catch (const std::exception&) {
+		return;
+	}
+
+	// resume the timer (1000ms looping ...)
+	_timer_man.add("update_transfers", 1000, [&]() {
+		update_transfers();
+		});
+}
@@ -43,6 +43,7 @@
 // STL
 #include <chrono>
 #include <filesystem>
+#include <algorithm>
 #include <thread>
 
 void main_form::add_home_page() {
@@ -151,14 +152,17 @@ void main_form::add_home_page() {
 				try {
 					const std::string unique_id = lecui::get::text(rows[0].at("UniqueID"));
 
-					collab::session session;
+					// the session list was drawn from the last read of the sessions, no need to read the database again
+					auto it = std::find_if(_previous_sessions.begin(), _previous_sessions.end(),
+						[&](const collab::session& session) { return session.unique_id == unique_id; });
 
-					std::string error;
-					if (!_collab.get_session(unique_id, session, error)) {
-						message(error);
+					if (it == _previous_sessions.end()) {
+						message("Session not found");
 						return;
 					}
 
+					const collab::session session = *it;
+
 					// to-do: implement session joining for first item in selection
 					if (join_session(session)) {
 						log("JOINED SESSION: " + shorten_unique_id(session.unique_id));
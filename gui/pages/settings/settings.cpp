@@ -104,13 +104,31 @@ void main_form::add_settings_page() {
 		.rect().snap_to(autostart_label.rect(), snap_type::bottom, 0.f);
 	autostart.events().toggle = [&](bool on) { on_autostart(on); };
 
+	// add multicast toggle button
+	auto& multicast_label = lecui::widgets::label::add(settings);
+	multicast_label
+		.text("Use multicast on the local network")
+		.on_resize(lecui::resize_params()
+			.width_rate(100.f))
+		.rect(autostart.rect())
+		.rect().snap_to(autostart.rect(), snap_type::bottom, 2.f * _margin);
+
+	auto& multicast = lecui::widgets::toggle::add(settings, "multicast");
+	multicast.text("Yes").text_off("No")
+		.tooltip("Select whether to send session traffic only to the computers in the same session instead of broadcasting it to the whole network").on(_setting_multicast)
+		.on_resize(lecui::resize_params()
+			.width_rate(100.f))
+		.rect(autostart.rect())
+		.rect().snap_to(multicast_label.rect(), snap_type::bottom, 0.f);
+	multicast.events().toggle = [&](bool on) { on_multicast(on); };
+
 	// add location of collab files
 	auto& location_caption = lecui::widgets::label::add(settings);
 	location_caption
 		.text("Location of files")
 		.on_resize(lecui::resize_params().width_rate(100.f))
-		.rect(autostart.rect())
-		.rect().snap_to(autostart.rect(), snap_type::bottom, 2.f * _margin);
+		.rect(multicast.rect())
+		.rect().snap_to(multicast.rect(), snap_type::bottom, 2.f * _margin);
 
 	auto& location = lecui::widgets::label::add(settings, "location");
 	location
@@ -227,6 +245,18 @@ void main_form::on_autostart(bool on) {
 	}
 }
 
+void main_form::on_multicast(bool on) {
+	std::string error;
+	if (!_settings.write_value("", "multicast", on ? "yes" : "no", error)) {
+		message("Error saving multicast setting: " + error);
+		// to-do: set toggle button to saved setting (or default if unreadable)
+	}
+	else
+		_setting_multicast = on;
+
+	_collab.set_transport(_setting_multicast ? collab::transport::multicast : collab::transport::broadcast);
+}
+
 void main_form::on_autocheck_updates(bool on) {
 	std::string error;
 	if (!_settings.write_value("updates", "autocheck", on ? "yes" : "no", error)) {
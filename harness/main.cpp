@@ -0,0 +1,544 @@
+/*
+** MIT License
+**
+** Copyright(c) 2021 Alec Musasa
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+**
+** The above copyright noticeand this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+
+// headless simulation harness for the collab core
+// runs several nodes in one process, each with its own unique id, database, files folder and tcp
+// ports, injects sessions, messages, files and reviews, and measures how long the nodes take to
+// converge, the bytes put on the wire and the cpu time used
+
+#include "../collab/collab.h"
+
+// leccore
+#include <liblec/leccore/hash.h>
+
+// STL
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <Windows.h>
+
+namespace {
+	struct options {
+		int nodes = 4;
+		int messages = 100;
+		int files = 10;
+		long long file_size = 1024 * 1024;
+		int reviews = 10;
+		collab::transport transport = collab::transport::broadcast;
+		int timeout = 120;	// in seconds
+
+		// away from the ports of the app, so a simulation doesn't mix with real nodes on the network
+		unsigned short broadcast_port = 40030;
+		unsigned short transfer_port = 45554;
+
+		std::string folder = "harness";
+		std::string cert_folder = ".";
+		std::string json_file;
+		std::string trace_file;
+		bool verbose = false;
+	};
+
+	struct node {
+		std::unique_ptr<collab> instance;
+		std::string folder;
+
+		std::mutex log_mutex;
+		std::ofstream log;
+
+		// the time it took the node to get every item, in milliseconds, -1 if it never did
+		long long convergence_time = -1;
+	};
+
+	void print_usage() {
+		std::cout <<
+			"usage: harness [options]\n"
+			"  --nodes <n>             number of nodes (default 4)\n"
+			"  --messages <n>          messages to post (default 100)\n"
+			"  --files <n>             files to share (default 10)\n"
+			"  --file-size <bytes>     size of each file (default 1048576)\n"
+			"  --reviews <n>           reviews to post, needs at least one file (default 10)\n"
+			"  --transport <name>      broadcast or multicast (default broadcast)\n"
+			"  --timeout <seconds>     how long to wait for convergence (default 120)\n"
+			"  --broadcast-port <port> first udp port shared by the nodes (default 40030)\n"
+			"  --transfer-port <port>  first tcp port, each node takes the next two (default 45554)\n"
+			"  --folder <path>         folder for the nodes' data, emptied first (default .\\harness)\n"
+			"  --certs <path>          folder with collab.source and collab.sink (default .)\n"
+			"  --json <path>           also write the results to this file as json\n"
+			"  --trace <path>          write the nodes' trace spans to this file as a Chrome trace\n"
+			"  --verbose               echo the nodes' logs to the console\n";
+	}
+
+	bool parse_options(int argc, char* argv[], options& opt, std::string& error) {
+		for (int i = 1; i < argc; i++) {
+			const std::string arg = argv[i];
+
+			if (arg == "--verbose") {
+				opt.verbose = true;
+				continue;
+			}
+
+			if (i + 1 >= argc) {
+				error = "Missing value for " + arg;
+				return false;
+			}
+
+			const std::string value = argv[++i];
+
+			try {
+				if (arg == "--nodes")
+					opt.nodes = std::stoi(value);
+				else if (arg == "--messages")
+					opt.messages = std::stoi(value);
+				else if (arg == "--files")
+					opt.files = std::stoi(value);
+				else if (arg == "--file-size")
+					opt.file_size = std::stoll(value);
+				else if (arg == "--reviews")
+					opt.reviews = std::stoi(value);
+				else if (arg == "--timeout")
+					opt.timeout = std::stoi(value);
+				else if (arg == "--broadcast-port")
+					opt.broadcast_port = static_cast<unsigned short>(std::stoi(value));
+				else if (arg == "--transfer-port")
+					opt.transfer_port = static_cast<unsigned short>(std::stoi(value));
+				else if (arg == "--folder")
+					opt.folder = value;
+				else if (arg == "--certs")
+					opt.cert_folder = value;
+				else if (arg == "--json")
+					opt.json_file = value;
+				else if (arg == "--trace")
+					opt.trace_file = value;
+				else if (arg == "--transport") {
+					if (value == "broadcast")
+						opt.transport = collab::transport::broadcast;
+					else if (value == "multicast")
+						opt.transport = collab::transport::multicast;
+					else {
+						error = "Unknown transport: " + value;
+						return false;
+					}
+				}
+				else {
+					error = "Unknown option: " + arg;
+					return false;
+				}
+			}
+			catch (const std::exception&) {
+				error = "Invalid value for " + arg + ": " + value;
+				return false;
+			}
+		}
+
+		if (opt.nodes < 2) {
+			error = "At least two nodes are needed";
+			return false;
+		}
+
+		if (opt.files == 0)
+			opt.reviews = 0;	// there's nothing to review
+
+		return true;
+	}
+
+	// the cpu time used by this process so far, in milliseconds
+	long long process_cpu_time() {
+		FILETIME creation_time, exit_time, kernel_time, user_time;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+			return 0;
+
+		auto to_ms = [](const FILETIME& ft) {
+			ULARGE_INTEGER value;
+			value.LowPart = ft.dwLowDateTime;
+			value.HighPart = ft.dwHighDateTime;
+			return static_cast<long long>(value.QuadPart / 10000);	// 100-nanosecond units
+		};
+
+		return to_ms(kernel_time) + to_ms(user_time);
+	}
+
+	collab::traffic total_traffic(const std::vector<std::unique_ptr<node>>& nodes) {
+		collab::traffic total;
+
+		for (const auto& n : nodes) {
+			const auto traffic = n->instance->get_traffic();
+			total.datagrams_sent += traffic.datagrams_sent;
+			total.datagram_bytes_sent += traffic.datagram_bytes_sent;
+			total.datagrams_received += traffic.datagrams_received;
+			total.datagram_bytes_received += traffic.datagram_bytes_received;
+			total.transfer_bytes_received += traffic.transfer_bytes_received;
+		}
+
+		return total;
+	}
+
+	long long now() {
+		return std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	}
+
+	bool make_file(const std::string& path, long long size, std::mt19937_64& rng, std::string& error) {
+		std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+		if (!file) {
+			error = "Creating '" + path + "' failed";
+			return false;
+		}
+
+		std::vector<unsigned long long> block(8192);
+
+		while (size > 0) {
+			for (auto& value : block)
+				value = rng();
+
+			const auto length = (std::min)(size, static_cast<long long>(block.size() * sizeof(block[0])));
+			file.write(reinterpret_cast<const char*>(block.data()), length);
+			size -= length;
+		}
+
+		if (!file) {
+			error = "Writing '" + path + "' failed";
+			return false;
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	options opt;
+	std::string error;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--help") {
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (!parse_options(argc, argv, opt, error)) {
+		std::cerr << error << "\n\n";
+		print_usage();
+		return 1;
+	}
+
+	// start from an empty folder so that every run begins with empty databases
+	try {
+		std::filesystem::remove_all(opt.folder);
+		std::filesystem::create_directories(opt.folder + "\\inject");
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Preparing '" << opt.folder << "' failed: " << e.what() << "\n";
+		return 1;
+	}
+
+	std::mutex console_mutex;
+
+	// start the nodes
+	std::vector<std::unique_ptr<node>> nodes;
+
+	for (int i = 0; i < opt.nodes; i++) {
+		auto p_node = std::make_unique<node>();
+		auto& n = *p_node;
+
+		n.folder = opt.folder + "\\node-" + std::to_string(i);
+
+		try {
+			std::filesystem::create_directories(n.folder + "\\files");
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Preparing '" << n.folder << "' failed: " << e.what() << "\n";
+			return 1;
+		}
+
+		n.log.open(n.folder + "\\log.txt", std::ios::out | std::ios::trunc);
+
+		n.instance = std::make_unique<collab>();
+		n.instance->set_unique_id(liblec::leccore::hash_string::sha256("harness#node#" + std::to_string(i)));
+		n.instance->set_ports(opt.broadcast_port, static_cast<unsigned short>(opt.transfer_port + 2 * i));
+		n.instance->set_transport(opt.transport);
+
+		const std::string prefix = "[node " + std::to_string(i) + "] ";
+
+		auto log = [&n, &console_mutex, prefix, verbose = opt.verbose](const std::string& event) {
+			{
+				std::lock_guard<std::mutex> lock(n.log_mutex);
+				n.log << event << std::endl;
+			}
+
+			if (verbose) {
+				std::lock_guard<std::mutex> lock(console_mutex);
+				std::cout << prefix << event << "\n";
+			}
+		};
+
+		if (!n.instance->initialize(n.folder + "\\collab.db", opt.cert_folder, n.folder + "\\files", log, error)) {
+			std::cerr << prefix << "Initializing failed: " << error << "\n";
+			return 1;
+		}
+
+		collab::user user;
+		user.unique_id = n.instance->unique_id();
+		user.username = "node" + std::to_string(i);
+		user.display_name = "Node " + std::to_string(i);
+
+		if (!n.instance->save_user(user, error)) {
+			std::cerr << prefix << "Saving user failed: " << error << "\n";
+			return 1;
+		}
+
+		nodes.push_back(std::move(p_node));
+	}
+
+	// every node joins the same session
+	collab::session session;
+	session.unique_id = liblec::leccore::hash_string::sha256("harness#session");
+	session.name = "Harness";
+	session.description = "Simulation harness session";
+	session.passphrase_hash = liblec::leccore::hash_string::sha256("harness");
+
+	for (auto& n : nodes) {
+		if (!n->instance->create_session(session, error)) {
+			std::cerr << "Creating session failed: " << error << "\n";
+			return 1;
+		}
+
+		n->instance->set_current_session_unique_id(session.unique_id);
+	}
+
+	// give the file and review sources a moment to start
+	for (int i = 0; i < 100; i++) {
+		bool ready = true;
+
+		for (auto& n : nodes)
+			ready = ready && n->instance->file_source_running() && n->instance->review_source_running();
+
+		if (ready)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	std::cout << opt.nodes << " nodes started, injecting " << opt.messages << " messages, " <<
+		opt.files << " files and " << opt.reviews << " reviews\n";
+
+	const auto traffic_before = total_traffic(nodes);
+	const auto cpu_before = process_cpu_time();
+	const auto start = std::chrono::steady_clock::now();
+
+	std::mt19937_64 rng(42);	// fixed seed so that runs are comparable
+
+	// spread the items across the nodes
+	for (int k = 0; k < opt.messages; k++) {
+		auto& instance = *nodes[k % nodes.size()]->instance;
+
+		collab::message msg;
+		msg.unique_id = liblec::leccore::hash_string::uuid();
+		msg.time = now();
+		msg.session_id = session.unique_id;
+		msg.sender_unique_id = instance.unique_id();
+		msg.text = "Message " + std::to_string(k) + " from " + instance.unique_id().substr(0, 8);
+
+		if (!instance.create_message(msg, error)) {
+			std::cerr << "Creating message failed: " << error << "\n";
+			return 1;
+		}
+	}
+
+	std::vector<std::string> file_hashes;
+
+	for (int k = 0; k < opt.files; k++) {
+		auto& instance = *nodes[k % nodes.size()]->instance;
+
+		const std::string path = opt.folder + "\\inject\\file-" + std::to_string(k) + ".bin";
+
+		collab::file file;
+
+		if (!make_file(path, opt.file_size, rng, error) ||
+			!instance.import_file(path, file.hash, error)) {
+			std::cerr << "Preparing file failed: " << error << "\n";
+			return 1;
+		}
+
+		file.time = now();
+		file.session_id = session.unique_id;
+		file.sender_unique_id = instance.unique_id();
+		file.name = "file-" + std::to_string(k);
+		file.extension = ".bin";
+		file.description = "Simulation harness file";
+		file.size = opt.file_size;
+
+		if (!instance.create_file(file, error)) {
+			std::cerr << "Creating file failed: " << error << "\n";
+			return 1;
+		}
+
+		file_hashes.push_back(file.hash);
+	}
+
+	for (int k = 0; k < opt.reviews; k++) {
+		// reviewed by a node other than the one that shared the file
+		auto& instance = *nodes[(k + 1) % nodes.size()]->instance;
+
+		collab::review review;
+		review.unique_id = liblec::leccore::hash_string::uuid();
+		review.time = now();
+		review.session_id = session.unique_id;
+		review.file_hash = file_hashes[k % file_hashes.size()];
+		review.sender_unique_id = instance.unique_id();
+		review.text = "Review " + std::to_string(k);
+
+		if (!instance.create_review(review, error)) {
+			std::cerr << "Creating review failed: " << error << "\n";
+			return 1;
+		}
+	}
+
+	// wait for every node to have every item
+	const auto deadline = start + std::chrono::seconds(opt.timeout);
+	int converged = 0;
+
+	while (converged < opt.nodes && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		for (auto& n : nodes) {
+			if (n->convergence_time >= 0)
+				continue;
+
+			std::vector<collab::message> messages;
+			std::vector<collab::file> files;
+			std::vector<collab::review> reviews;
+
+			if (!n->instance->get_messages(session.unique_id, messages, error) ||
+				!n->instance->get_files(session.unique_id, files, error) ||
+				!n->instance->get_reviews(session.unique_id, reviews, error))
+				continue;
+
+			if (static_cast<int>(messages.size()) < opt.messages ||
+				static_cast<int>(files.size()) < opt.files ||
+				static_cast<int>(reviews.size()) < opt.reviews)
+				continue;	// file entries are only made once the file has been downloaded and verified
+
+			n->convergence_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - start).count();
+			converged++;
+		}
+	}
+
+	const auto wall_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	const auto cpu_time = process_cpu_time() - cpu_before;
+	const auto traffic_after = total_traffic(nodes);
+
+	collab::traffic traffic;
+	traffic.datagrams_sent = traffic_after.datagrams_sent - traffic_before.datagrams_sent;
+	traffic.datagram_bytes_sent = traffic_after.datagram_bytes_sent - traffic_before.datagram_bytes_sent;
+	traffic.datagrams_received = traffic_after.datagrams_received - traffic_before.datagrams_received;
+	traffic.datagram_bytes_received = traffic_after.datagram_bytes_received - traffic_before.datagram_bytes_received;
+	traffic.transfer_bytes_received = traffic_after.transfer_bytes_received - traffic_before.transfer_bytes_received;
+
+	// report
+	long long slowest = 0;	// -1 if any node didn't converge
+
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const auto t = nodes[i]->convergence_time;
+		std::cout << "node " << i << ": " << (t < 0 ? std::string("did not converge") : std::to_string(t) + " ms") << "\n";
+
+		if (t < 0)
+			slowest = -1;
+		else if (slowest >= 0)
+			slowest = (std::max)(slowest, t);
+	}
+
+	const auto cores = (std::max)(1u, std::thread::hardware_concurrency());
+
+	std::cout << "\n" <<
+		"converged:        " << converged << " of " << opt.nodes << " nodes" <<
+		(slowest < 0 ? std::string() : " in " + std::to_string(slowest) + " ms") << "\n" <<
+		"datagrams sent:   " << traffic.datagrams_sent << " (" << traffic.datagram_bytes_sent << " bytes)\n" <<
+		"datagrams recvd:  " << traffic.datagrams_received << " (" << traffic.datagram_bytes_received << " bytes)\n" <<
+		"tcp bytes recvd:  " << traffic.transfer_bytes_received << "\n" <<
+		"cpu time:         " << cpu_time << " ms over " << wall_time << " ms (" <<
+		std::fixed << std::setprecision(1) << (wall_time > 0 ? 100.0 * cpu_time / (static_cast<double>(wall_time) * cores) : 0.0) <<
+		"% of " << cores << " cores)\n";
+
+	if (!opt.json_file.empty()) {
+		std::ofstream json(opt.json_file, std::ios::out | std::ios::trunc);
+
+		json << "{\n" <<
+			"  \"nodes\": " << opt.nodes << ",\n" <<
+			"  \"transport\": \"" << (opt.transport == collab::transport::multicast ? "multicast" : "broadcast") << "\",\n" <<
+			"  \"messages\": " << opt.messages << ",\n" <<
+			"  \"files\": " << opt.files << ",\n" <<
+			"  \"file_size\": " << opt.file_size << ",\n" <<
+			"  \"reviews\": " << opt.reviews << ",\n" <<
+			"  \"converged_nodes\": " << converged << ",\n" <<
+			"  \"convergence_ms\": " << slowest << ",\n" <<
+			"  \"node_convergence_ms\": [";
+
+		for (size_t i = 0; i < nodes.size(); i++)
+			json << (i ? ", " : "") << nodes[i]->convergence_time;
+
+		json << "],\n" <<
+			"  \"datagrams_sent\": " << traffic.datagrams_sent << ",\n" <<
+			"  \"datagram_bytes_sent\": " << traffic.datagram_bytes_sent << ",\n" <<
+			"  \"datagrams_received\": " << traffic.datagrams_received << ",\n" <<
+			"  \"datagram_bytes_received\": " << traffic.datagram_bytes_received << ",\n" <<
+			"  \"transfer_bytes_received\": " << traffic.transfer_bytes_received << ",\n" <<
+			"  \"cpu_ms\": " << cpu_time << ",\n" <<
+			"  \"wall_ms\": " << wall_time << "\n" <<
+			"}\n";
+
+		if (!json)
+			std::cerr << "Writing '" << opt.json_file << "' failed\n";
+	}
+
+	if (!opt.trace_file.empty()) {
+		// put the spans of all the nodes together, so an item can be followed from node to node
+		std::vector<collab::trace_span> spans;
+
+		for (auto& n : nodes) {
+			std::vector<collab::trace_span> node_spans;
+			n->instance->get_trace(node_spans);
+			spans.insert(spans.end(), node_spans.begin(), node_spans.end());
+		}
+
+		if (!collab::save_trace(opt.trace_file, spans, error))
+			std::cerr << "Writing '" << opt.trace_file << "' failed: " << error << "\n";
+	}
+
+	// stop the nodes
+	nodes.clear();
+
+	return converged == opt.nodes ? 0 : 2;
+}
@@ -25,6 +25,9 @@
 #include "helper_functions.h"
 #include <Windows.h>
 #include <strsafe.h>	// for StringCchPrintfA
+#include <bcrypt.h>		// for the sha256 primitives
+
+#pragma comment(lib, "bcrypt.lib")
 
 #include <mutex>
 #include <sstream>
@@ -156,6 +159,99 @@ liblec::auto_mutex::~auto_mutex() {
 	}
 }
 
+class liblec::hash_stream::hash_stream_impl {
+public:
+	hash_stream_impl() {
+		if (BCryptOpenAlgorithmProvider(&_algorithm, BCRYPT_SHA256_ALGORITHM, NULL, 0) != 0) {
+			_algorithm = NULL;
+			return;
+		}
+
+		// let CNG allocate and manage the hash object
+		if (BCryptCreateHash(_algorithm, &_hash, NULL, 0, NULL, 0, 0) != 0)
+			_hash = NULL;
+	}
+
+	~hash_stream_impl() {
+		if (_hash) {
+			BCryptDestroyHash(_hash);
+			_hash = NULL;
+		}
+
+		if (_algorithm) {
+			BCryptCloseAlgorithmProvider(_algorithm, 0);
+			_algorithm = NULL;
+		}
+	}
+
+	bool update(const void* data, size_t length) {
+		if (!_hash || _finished)
+			return false;
+
+		auto p = static_cast<const unsigned char*>(data);
+
+		// BCryptHashData takes a ULONG length so feed very large buffers in pieces
+		while (length > 0) {
+			const ULONG piece = static_cast<ULONG>(smallest(length, static_cast<size_t>(0x40000000)));
+
+			if (BCryptHashData(_hash, const_cast<PUCHAR>(p), piece, 0) != 0)
+				return false;
+
+			p += piece;
+			length -= piece;
+		}
+
+		return true;
+	}
+
+	bool finish(std::string& hash) {
+		hash.clear();
+
+		if (!_hash || _finished)
+			return false;
+
+		_finished = true;
+
+		unsigned char digest[32];
+		if (BCryptFinishHash(_hash, digest, sizeof(digest), 0) != 0)
+			return false;
+
+		static const char hex[] = "0123456789abcdef";
+		hash.reserve(2 * sizeof(digest));
+
+		for (const auto& byte : digest) {
+			hash += hex[byte >> 4];
+			hash += hex[byte & 0x0F];
+		}
+
+		return true;
+	}
+
+private:
+	BCRYPT_ALG_HANDLE _algorithm = NULL;
+	BCRYPT_HASH_HANDLE _hash = NULL;
+	bool _finished = false;
+};
+
+liblec::hash_stream::hash_stream() {
+	_d = new hash_stream_impl;
+}
+
+liblec::hash_stream::~hash_stream() {
+	if (_d) {
+		delete _d;
+		_d = nullptr;
+	}
+}
+
+bool liblec::hash_stream::update(const void* data, size_t length) {
+	return _d->update(data, length);
+}
+
+bool liblec::hash_stream::finish(std::string& hash) {
+	return _d->finish(hash);
+}
+
 void liblec::log(const std::string& string) {
 #if defined(_DEBUG)
 	std::string _string = "-->" + string + "\n";
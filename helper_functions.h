@@ -26,6 +26,8 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <memory>
 
 static inline std::string shorten_unique_id(const std::string& unique_id) {
 	std::string short_id;
@@ -140,6 +142,193 @@ namespace liblec {
 		class auto_mutex_impl;
 		auto_mutex_impl* _d;
 	};
+
+	/// <summary>
+	/// Incremental sha256 hasher. Data is fed in pieces as it becomes available, e.g.
+	/// while a file is being copied or downloaded, so no separate hashing pass is needed.
+	/// </summary>
+	/// 
+	/// <remarks>
+	/// Uses the Windows CNG primitives, which take advantage of the SHA extensions and AVX2
+	/// where the processor supports them. The resulting hash is in lowercase hex, the same
+	/// format produced by leccore::hash_file.
+	/// </remarks>
+	class hash_stream {
+	public:
+		hash_stream();
+		~hash_stream();
+
+		/// <summary>
+		/// Add data to the hash.
+		/// </summary>
+		/// 
+		/// <param name="data">
+		/// Pointer to the data.
+		/// </param>
+		/// 
+		/// <param name="length">
+		/// The length of the data, in bytes.
+		/// </param>
+		/// 
+		/// <returns>
+		/// Returns true if successful, else false.
+		/// </returns>
+		bool update(const void* data, size_t length);
+
+		/// <summary>
+		/// Complete the hash. No more data can be added afterwards.
+		/// </summary>
+		/// 
+		/// <param name="hash">
+		/// The resulting sha256 hash.
+		/// </param>
+		/// 
+		/// <returns>
+		/// Returns true if successful, else false.
+		/// </returns>
+		bool finish(std::string& hash);
+
+	private:
+		class hash_stream_impl;
+		hash_stream_impl* _d;
+
+		// Copying an object of this class is not allowed
+		hash_stream(const hash_stream&) = delete;
+		hash_stream& operator=(const hash_stream&) = delete;
+	};
+
+	/// <summary>
+	/// Bounded lock-free queue for many producer threads and one consumer thread. When the
+	/// queue is full the oldest item is dropped to make room, and the drop is counted.
+	/// </summary>
+	/// 
+	/// <remarks>
+	/// Each slot carries a sequence number that tells producers and consumers whose turn it
+	/// is, so pushing and popping only ever contend on an atomic position. A full producer
+	/// drops the oldest item by popping it itself, which is why popping is safe from any
+	/// thread even though only one thread is expected to consume.
+	/// </remarks>
+	template <typename T>
+	class mpsc_queue {
+	public:
+		/// <summary>
+		/// Make a queue.
+		/// </summary>
+		/// 
+		/// <param name="capacity">
+		/// The number of items the queue holds, rounded up to a power of two.
+		/// </param>
+		mpsc_queue(size_t capacity) {
+			size_t size = 2;
+			while (size < capacity)
+				size <<= 1;
+
+			_mask = size - 1;
+			_cells.reset(new cell[size]);
+
+			for (size_t i = 0; i < size; i++)
+				_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		/// <summary>
+		/// Add an item to the queue, dropping the oldest item if the queue is full.
+		/// </summary>
+		/// 
+		/// <param name="value">
+		/// The item.
+		/// </param>
+		void push(T value) {
+			size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+
+			while (true) {
+				cell& c = _cells[pos & _mask];
+				const size_t sequence = c.sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+
+				if (diff == 0) {
+					if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						c.value = std::move(value);
+						c.sequence.store(pos + 1, std::memory_order_release);
+						return;
+					}
+				}
+				else
+					if (diff < 0) {
+						// full, make room by dropping the oldest item
+						T oldest;
+						if (pop(oldest))
+							_dropped.fetch_add(1, std::memory_order_relaxed);
+
+						pos = _enqueue_pos.load(std::memory_order_relaxed);
+					}
+					else
+						pos = _enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		/// <summary>
+		/// Take the oldest item from the queue.
+		/// </summary>
+		/// 
+		/// <param name="value">
+		/// The item.
+		/// </param>
+		/// 
+		/// <returns>
+		/// Returns true if an item was taken, else false if the queue is empty.
+		/// </returns>
+		bool pop(T& value) {
+			size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+
+			while (true) {
+				cell& c = _cells[pos & _mask];
+				const size_t sequence = c.sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+
+				if (diff == 0) {
+					if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						value = std::move(c.value);
+						c.sequence.store(pos + _mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else
+					if (diff < 0)
+						return false;	// empty
+					else
+						pos = _dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		/// <summary>
+		/// Get the number of items dropped so far because the queue was full.
+		/// </summary>
+		/// 
+		/// <returns>
+		/// The number of dropped items.
+		/// </returns>
+		unsigned long long dropped() const {
+			return _dropped.load(std::memory_order_relaxed);
+		}
+
+	private:
+		struct cell {
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::unique_ptr<cell[]> _cells;
+		size_t _mask = 0;
+
+		// the positions are kept on separate cache lines so producers and the consumer don't share one
+		alignas(64) std::atomic<size_t> _enqueue_pos = 0;
+		alignas(64) std::atomic<size_t> _dequeue_pos = 0;
+		alignas(64) std::atomic<unsigned long long> _dropped = 0;
+
+		// Copying an object of this class is not allowed
+		mpsc_queue(const mpsc_queue&) = delete;
+		mpsc_queue& operator=(const mpsc_queue&) = delete;
+	};
 }
 
 std::string select_ip(std::vector<std::string> server_ips, std::vector<std::string> client_ips);